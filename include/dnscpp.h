@@ -31,11 +31,27 @@
 #include <dnscpp/ptr.h>
 #include <dnscpp/soa.h>
 #include <dnscpp/rrsig.h>
+#include <dnscpp/signable.h>
+#include <dnscpp/verifiers.h>
 #include <dnscpp/dnskey.h>
+#include <dnscpp/sha.h>
+#include <dnscpp/bignum.h>
+#include <dnscpp/exponent.h>
+#include <dnscpp/modulo.h>
 #include <dnscpp/printable.h>
 #include <dnscpp/hosts.h>
+#include <dnscpp/zone.h>
 #include <dnscpp/operation.h>
+#include <dnscpp/options.h>
+#include <dnscpp/dual.h>
+#include <dnscpp/exchanges.h>
+#include <dnscpp/transfer.h>
+#include <dnscpp/inbox.h>
+#include <dnscpp/contextpool.h>
+#include <dnscpp/mockserver.h>
+#include <dnscpp/allocations.h>
 #include <dnscpp/request.h>
 #include <dnscpp/question.h>
 #include <dnscpp/reverse.h>
 #include <dnscpp/tlsa.h>
+#include <dnscpp/srv.h>
@@ -66,7 +66,38 @@ public:
         return _ip;
     }
 };
-    
+
+/**
+ *  Traits for Response::extract<AAAA>(), so that the ip can be pulled
+ *  straight out of the wire data without intermediate objects
+ */
+template <> struct Typed<AAAA>
+{
+    /**
+     *  The value of an AAAA record is an ip address
+     */
+    using Value = Ip;
+
+    /**
+     *  The type constant and the minimal rdata size
+     */
+    static constexpr ns_type type = TYPE_AAAA;
+    static constexpr size_t minsize = 16;
+
+    /**
+     *  Convert the raw rdata into the value
+     *  @param  response    the full response
+     *  @param  data        the rdata of the record
+     *  @param  size        size of the rdata
+     *  @return Value
+     */
+    static Value convert(const Response &response, const unsigned char *data, size_t size)
+    {
+        // the rdata holds the address in network byte order
+        return Ip((struct in6_addr *)data);
+    }
+};
+
 /**
  *  End of namespace
  */
@@ -0,0 +1,115 @@
+/**
+ *  Allocations.h
+ *
+ *  Opt-in allocation accounting for regression tracking. When the
+ *  library is compiled with -DDNSCPP_ALLOCATIONS every heap allocation
+ *  made by the process is counted (number of allocations and bytes,
+ *  per thread, monotonic), so that the benchmark and replay programs
+ *  can report per-lookup averages and fail the build when someone
+ *  reintroduces a malloc on the datagram path. Tools like massif give
+ *  the same answer but are unusable at production rates; these are
+ *  two relaxed counter bumps per allocation.
+ *
+ *  Without the compile flag the counters exist but stay at zero, so
+ *  calling code does not have to be conditional.
+ *
+ *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Class definition
+ */
+class Allocations
+{
+private:
+    /**
+     *  The per-thread counters, bumped by the operator-new override
+     *  that is compiled when the accounting flag is set
+     *  @var uint64_t
+     */
+    static thread_local uint64_t _count;
+    static thread_local uint64_t _bytes;
+
+public:
+    /**
+     *  A copy of the counters at one point in time, two snapshots can
+     *  be subtracted to get the allocations of the work in between
+     */
+    struct Snapshot
+    {
+        /**
+         *  Number of allocations and the bytes that they requested
+         *  @var uint64_t
+         */
+        uint64_t count = 0;
+        uint64_t bytes = 0;
+
+        /**
+         *  The difference between two snapshots
+         *  @param  that    the earlier snapshot
+         *  @return Snapshot
+         */
+        Snapshot operator-(const Snapshot &that) const
+        {
+            // member-wise difference
+            Snapshot result;
+            result.count = count - that.count;
+            result.bytes = bytes - that.bytes;
+            return result;
+        }
+    };
+
+    /**
+     *  The counters of the calling thread (all zero when the library
+     *  was compiled without -DDNSCPP_ALLOCATIONS)
+     *  @return Snapshot
+     */
+    static Snapshot snapshot()
+    {
+        // copy the counters
+        Snapshot result;
+        result.count = _count;
+        result.bytes = _bytes;
+        return result;
+    }
+
+    /**
+     *  Is accounting compiled in at all? Callers can use this to
+     *  distinguish "zero allocations" from "not measured"
+     *  @return bool
+     */
+    static bool enabled();
+
+    /**
+     *  Called by the operator-new override to count one allocation,
+     *  not meant to be called from anywhere else
+     *  @param  size    the requested size
+     */
+    static void record(size_t size)
+    {
+        // bump the counters of this thread
+        _count += 1; _bytes += size;
+    }
+};
+
+/**
+ *  End of namespace
+ */
+}
@@ -12,7 +12,15 @@
  *  that just allows raw access to the underlying data of the big number.
  *  It is up to the caller to pass this on to openssl or a different
  *  library that can deal with big data.
- * 
+ *
+ *  A note on performance: the bytes exposed here are stable for the
+ *  lifetime of the key, so callers that verify many signatures should
+ *  not convert them into a fresh BIGNUM (or equivalent) per check, but
+ *  parse each key once and cache the resulting key object, keyed by the
+ *  keytag of the DNSKEY record. Combined with one reusable BN_CTX (or
+ *  equivalent scratch space) per thread, steady-state validation then
+ *  performs no bignum allocations at all.
+ *
  *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
  *  @copyright 2020 Copernica BV
  */
@@ -22,6 +30,11 @@
  */
 #pragma once
 
+/**
+ *  Dependencies
+ */
+#include <stddef.h>
+
 /**
  *  Begin of namespace
  */
@@ -32,7 +45,7 @@ namespace DNS {
  */
 class Bignum
 {
-private;
+private:
     /**
      *  Pointer to the data holding the number
      *  @var void *
@@ -49,8 +62,8 @@ protected:
     /**
      *  Protected constructor because you normally do not have to
      *  directly construct instances yourself, but use a derived class
-     *  like XXX or XXX
-     *  @param  buffer
+     *  like Exponent or Modulo
+     *  @param  data
      *  @param  size
      */
     Bignum(const void *data, size_t size) : _data(data), _size(size) {}
@@ -15,6 +15,11 @@
  */
 #pragma once
 
+/**
+ *  Dependencies
+ */
+#include <stdint.h>
+
 /**
  *  Begin of namespace
  */
@@ -50,6 +55,18 @@ private:
      */
     int _value;
 
+    /**
+     *  The max udp payload size that is advertised in the edns
+     *  pseudo-section of queries. The default of 1232 bytes fits in a
+     *  single unfragmented datagram on virtually all paths (fragmented
+     *  datagrams would make the system vulnerable for injection), while
+     *  still being big enough for most responses that do not fit in the
+     *  classic 512 bytes -- which keeps those lookups off the expensive
+     *  tcp fallback path
+     *  @var uint16_t
+     */
+    uint16_t _payload = 1232;
+
     /**
      *  Add or remove a bit
      *  @param  bit
@@ -84,7 +101,22 @@ public:
     bool authentic()        const { return AD(); }
     bool checkingdisabled() const { return CD(); }
     bool dnssec()           const { return DO(); }
-    
+
+    /**
+     *  The advertised max udp payload size
+     *  @return uint16_t
+     */
+    uint16_t payload() const { return _payload; }
+
+    /**
+     *  Update the advertised max udp payload size (clamped between the
+     *  512-byte minimum that the protocol guarantees anyway, and the
+     *  4096-byte receive slots that the sockets read datagrams into)
+     *  @param  value
+     */
+    void payload(uint16_t value) { _payload = value < 512 ? 512 : (value > 4096 ? 4096 : value); }
+
+
     /**
      *  Setters
      *  @param  value
@@ -17,6 +17,8 @@
  *  Dependencies
  */
 #include "extractor.h"
+#include "view.h"
+#include <string>
 
 /**
  *  Begin of namespace
@@ -34,19 +36,21 @@ private:
      *  @var uint8_t
      */
     uint8_t _flags = 0;
-    
+
     /**
      *  The tag name
      *  @var char[]
      */
     char _tag[16];
-    
+
     /**
-     *  The actual property value (dynamically allocated)
+     *  The null-terminated copy of the property value, only allocated
+     *  when a caller asks for property() (the view-based accessor works
+     *  straight on the response buffer and never needs this copy)
      *  @var char *
      */
-    char *_property = nullptr;
-    
+    mutable char *_property = nullptr;
+
     /**
      *  Size of the property
      *  @var size_t
@@ -77,21 +81,15 @@ public:
         
         // if tag-size valid?
         if (tagsize < 1 || tagsize > 15) throw std::runtime_error("invalid tagsize");
-        
+
         // copy the tag data + end with an empty '\0' character
         memcpy(_tag, buffer + 2, tagsize);
-        
-        // allocate enough bytes
-        _property = new char[propsize + 1];
-        
-        // copy property data
-        memcpy(_property, buffer + 2 + tagsize, propsize);
-        
+
         // remaining null character
         _tag[tagsize] = '\0';
-        _property[propsize] = '\0';
-        
-        // remember property size
+
+        // remember property size, copying the property value itself is
+        // postponed until a caller actually asks for it
         _size = propsize;
     }
     
@@ -123,15 +121,86 @@ public:
     }
     
     /**
-     *  Retrieve the property name
+     *  Retrieve the property name as a null-terminated string
+     *  This makes a private copy of the value, if you merely want to
+     *  inspect the data it is cheaper to use the value() method that
+     *  leaves the data inside the response buffer
      *  @return const char *
      */
     const char *property() const
     {
+        // if the copy was already made
+        if (_property != nullptr) return _property;
+
+        // allocate enough bytes
+        _property = new char[_size + 1];
+
+        // copy property data (the value starts behind the flags, the
+        // tag-size and the tag itself)
+        memcpy(_property, _record.data() + 2 + strlen(_tag), _size);
+
+        // remaining null character
+        _property[_size] = '\0';
+
+        // expose the copy
         return _property;
     }
+
+    /**
+     *  Get a view on the property value, pointing straight into the
+     *  response buffer without any copying. The view stays valid for as
+     *  long as the response is in scope
+     *  @return View
+     */
+    View value() const
+    {
+        // the value starts behind the flags, the tag-size and the tag
+        return View((const char *)_record.data() + 2 + strlen(_tag), _size);
+    }
 };
-    
+
+/**
+ *  Traits for Response::extract<CAA>(), so that the properties can be
+ *  pulled straight out of the wire data without intermediate objects
+ */
+template <> struct Typed<CAA>
+{
+    /**
+     *  The value of a CAA record: the flags, the tag and the property
+     */
+    struct Value
+    {
+        uint8_t flags;
+        std::string tag;
+        std::string property;
+    };
+
+    /**
+     *  The type constant and the minimal rdata size
+     */
+    static constexpr ns_type type = TYPE_CAA;
+    static constexpr size_t minsize = 3;
+
+    /**
+     *  Convert the raw rdata into the value
+     *  @param  response    the full response
+     *  @param  data        the rdata of the record
+     *  @param  size        size of the rdata
+     *  @return Value
+     */
+    static Value convert(const Response &response, const unsigned char *data, size_t size)
+    {
+        // size of the tag (the flags come first, then the tag-size)
+        size_t tagsize = data[1];
+
+        // guard against a tag that runs past the rdata
+        if (tagsize + 2 > size) tagsize = size - 2;
+
+        // the tag and the property value follow the two header bytes
+        return Value{ data[0], std::string((const char *)data + 2, tagsize), std::string((const char *)data + 2 + tagsize, size - 2 - tagsize) };
+    }
+};
+
 /**
  *  End of namespace
  */
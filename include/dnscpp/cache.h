@@ -0,0 +1,298 @@
+/**
+ *  Cache.h
+ *
+ *  Class that holds previously received responses, so that repeated
+ *  queries for the same name and type can be answered from memory
+ *  without sending out a new datagram. Entries are stored for as long
+ *  as the time-to-live of the records in the response permits. Negative
+ *  answers (nxdomain and no-data responses) are cached too, for the
+ *  period prescribed by RFC 2308 (the SOA minimum-field).
+ *
+ *  Caching is disabled by default, you can enable it by setting a
+ *  max number of cached responses via Context::cachecapacity().
+ *
+ *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include <map>
+#include <list>
+#include <memory>
+#include <vector>
+#include <string>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Forward declarations
+ */
+class Response;
+
+/**
+ *  Class definition
+ */
+class Cache
+{
+public:
+    /**
+     *  Helper class that holds one cached response
+     */
+    class Entry
+    {
+    private:
+        /**
+         *  The raw response buffer
+         *  @var std::vector<unsigned char>
+         */
+        std::vector<unsigned char> _buffer;
+
+        /**
+         *  Time at which the entry is no longer valid
+         *  @var double
+         */
+        double _expires;
+
+    public:
+        /**
+         *  Constructor
+         *  @param  response    the response to store
+         *  @param  expires     time at which the entry expires
+         */
+        Entry(const Response &response, double expires);
+
+        /**
+         *  Destructor
+         */
+        virtual ~Entry() = default;
+
+        /**
+         *  The raw buffer data
+         *  @return const unsigned char *
+         */
+        const unsigned char *data() const { return _buffer.data(); }
+
+        /**
+         *  Size of the raw buffer
+         *  @return size_t
+         */
+        size_t size() const { return _buffer.size(); }
+
+        /**
+         *  When does this entry expire?
+         *  @return double
+         */
+        double expires() const { return _expires; }
+
+        /**
+         *  Is the entry expired?
+         *  @param  now     current time
+         *  @return bool
+         */
+        bool expired(double now) const { return now >= _expires; }
+
+        /**
+         *  Is a background lookup already running to refresh this entry?
+         *  (only meaningful in serve-stale mode, to avoid that every hit
+         *  on a stale entry starts yet another refresh)
+         *  @return bool
+         */
+        bool refreshing() const { return _refreshing; }
+
+        /**
+         *  Mark that a background lookup has been started for this entry
+         *  @param  value
+         */
+        void refreshing(bool value) { _refreshing = value; }
+
+        /**
+         *  How often has this entry been served from the cache?
+         *  @return size_t
+         */
+        size_t hits() const { return _hits; }
+
+        /**
+         *  Register that the entry was served from the cache
+         */
+        void hit() { _hits += 1; }
+
+    private:
+        /**
+         *  Is a background refresh-lookup in progress?
+         *  @var bool
+         */
+        bool _refreshing = false;
+
+        /**
+         *  Number of times the entry was served from the cache (used to
+         *  decide whether the entry is hot enough for refresh-ahead)
+         *  @var size_t
+         */
+        size_t _hits = 0;
+    };
+
+    /**
+     *  Custom comparison object used by the map, the hostname part of
+     *  the key should be compared case-insensitively (public because other
+     *  hostname+type keyed maps in the library use the same ordering)
+     */
+    struct KeyCompare
+    {
+        /**
+         *  The actual comparison function
+         *  @param  key1
+         *  @param  key2
+         *  @return bool
+         */
+        bool operator()(const std::pair<std::string,uint16_t> &key1, const std::pair<std::string,uint16_t> &key2) const
+        {
+            // first compare the hostnames (without looking at case)
+            auto result = strcasecmp(key1.first.data(), key2.first.data());
+
+            // if the hostnames are different we already have our answer
+            if (result != 0) return result < 0;
+
+            // hostnames are identical, the type is decisive
+            return key1.second < key2.second;
+        }
+    };
+
+private:
+    /**
+     *  All cached entries, keyed by hostname + record-type
+     *  @var std::map
+     */
+    std::map<std::pair<std::string,uint16_t>,std::shared_ptr<Entry>,KeyCompare> _entries;
+
+    /**
+     *  Max number of entries to keep in memory (0 means that caching is disabled)
+     *  @var size_t
+     */
+    size_t _capacity = 0;
+
+    /**
+     *  Remove expired entries, and if that is not enough make some more room
+     *  @param  now     current time
+     */
+    void prune(double now);
+
+public:
+    /**
+     *  Constructor
+     */
+    Cache() = default;
+
+    /**
+     *  No copying
+     *  @param  that
+     */
+    Cache(const Cache &that) = delete;
+
+    /**
+     *  Destructor
+     */
+    virtual ~Cache() = default;
+
+    /**
+     *  The max number of cached responses
+     *  @return size_t
+     */
+    size_t capacity() const { return _capacity; }
+
+    /**
+     *  Update the max number of cached responses (set to 0 to disable caching)
+     *  @param  value       the new capacity
+     */
+    void capacity(size_t value);
+
+    /**
+     *  Number of responses that are currently cached
+     *  @return size_t
+     */
+    size_t size() const { return _entries.size(); }
+
+    /**
+     *  Look for a cached response for a certain hostname and record-type
+     *  This method returns nullptr if there is no (still valid) match, unless
+     *  the stale-parameter is set, in which case an expired entry is returned
+     *  too (the caller is then responsible for refreshing it)
+     *  @param  now         current time
+     *  @param  hostname    the hostname to look for
+     *  @param  type        the record-type
+     *  @param  stale       are expired entries acceptable too?
+     *  @return std::shared_ptr<Entry>
+     */
+    std::shared_ptr<Entry> find(double now, const char *hostname, uint16_t type, bool stale = false) const;
+
+    /**
+     *  Store a response in the cache
+     *  This method checks whether the response is cacheable at all, so it
+     *  is safe to call this for each received response
+     *  @param  now         current time
+     *  @param  response    the received response
+     */
+    void insert(double now, const Response &response);
+
+    /**
+     *  Remove all cached entries
+     */
+    void flush() { _entries.clear(); }
+
+    /**
+     *  Collect the hot entries that are about to expire, so that the core
+     *  can re-query them before the ttl runs out (refresh-ahead). Returned
+     *  entries are marked as refreshing so that they are not returned twice.
+     *  @param  now         current time
+     *  @param  window      how far ahead of the expiration we look (seconds)
+     *  @param  threshold   min number of cache-hits to consider an entry hot
+     *  @return std::list   the hostname+type combinations to re-query
+     */
+    std::list<std::pair<std::string,uint16_t>> expiring(double now, double window, size_t threshold);
+
+    /**
+     *  Write a snapshot of the cache to a file, in a flat pointer-free
+     *  format that can be mapped back with restore() after a restart,
+     *  so that processes do not have to start with a cold cache
+     *  @param  filename    file to write the snapshot to
+     *  @return bool        was the snapshot written?
+     */
+    bool persist(const char *filename) const;
+
+    /**
+     *  Load a snapshot that was earlier written with persist()
+     *  The file is mapped into memory with mmap() and entries that have
+     *  not yet expired are merged into the cache
+     *  @param  filename    file holding the snapshot
+     *  @param  now         current time
+     *  @return bool        was the snapshot loaded?
+     */
+    bool restore(const char *filename, double now);
+
+    /**
+     *  Helper method to calculate how long a response may be cached, based
+     *  on the ttls of the answer-records (or for negative answers: the SOA
+     *  minimum-field from RFC 2308). Returns 0 if the response should not
+     *  be cached at all.
+     *  @param  response    the response to inspect
+     *  @return uint32_t    lifetime in seconds
+     */
+    static uint32_t ttl(const Response &response);
+};
+
+/**
+ *  End of namespace
+ */
+}
@@ -28,6 +28,7 @@ namespace DNS {
  */
 class Response;
 class Operation;
+class Ip;
 
 /**
  *  The callback-type used for the callback-based query() methods
@@ -36,6 +37,15 @@ class Operation;
 using SuccessCallback = std::function<void(const Operation *, const Response &response)>;
 using FailureCallback = std::function<void(const Operation *, int rcode)>;
 
+/**
+ *  The callback-type for the slow-lookup log: fired for lookups that
+ *  took longer than the configured threshold, and for lookups that
+ *  timed out altogether (the nameserver is the server to which the
+ *  latest datagram was sent, or nullptr when nothing was sent yet)
+ *  @type   function
+ */
+using SlowCallback = std::function<void(const char *domain, int type, const Ip *nameserver, size_t attempts, double elapsed)>;
+
 /**
  *  Utility class to turn callbacks into a handler
  */
@@ -0,0 +1,87 @@
+/**
+ *  ConfigWatcher.h
+ *
+ *  Class that watches the /etc/hosts and /etc/resolv.conf files with
+ *  inotify and tells the core to pick up changes while it is running,
+ *  so that a changed hosts file or nameserver list does not require a
+ *  full rebuild of the DNS::Context (which would drop all in-flight
+ *  lookups and warm sockets).
+ *
+ *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include "monitor.h"
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Forward declarations
+ */
+class Core;
+
+/**
+ *  Class definition
+ */
+class ConfigWatcher : private Monitor
+{
+private:
+    /**
+     *  Pointer to the core object
+     *  @var Core
+     */
+    Core *_core;
+
+    /**
+     *  The inotify filedescriptor
+     *  @var int
+     */
+    int _fd = -1;
+
+    /**
+     *  User space identifier of this monitor
+     *  @var void *
+     */
+    void *_identifier = nullptr;
+
+    /**
+     *  Method that is called from user-space when the inotify descriptor
+     *  becomes readable (meaning: one of the watched files changed)
+     */
+    virtual void notify() override;
+
+public:
+    /**
+     *  Constructor
+     *  @param  core        the core object that should pick up the changes
+     *  @throws std::runtime_error
+     */
+    ConfigWatcher(Core *core);
+
+    /**
+     *  No copying
+     *  @param  that
+     */
+    ConfigWatcher(const ConfigWatcher &that) = delete;
+
+    /**
+     *  Destructor
+     */
+    virtual ~ConfigWatcher();
+};
+
+/**
+ *  End of namespace
+ */
+}
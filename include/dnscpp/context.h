@@ -19,6 +19,10 @@
 #include "type.h"
 #include "core.h"
 #include "callbacks.h"
+#include "dual.h"
+#include "exchanges.h"
+#include "transfer.h"
+#include "options.h"
 
 /**
  *  Begin of namespace
@@ -36,6 +40,46 @@ class Operation;
  */
 class Context : private Core
 {
+private:
+    /**
+     *  The actual implementation behind the query() overloads
+     *  @param  name        the record name to look for
+     *  @param  type        type of record (normally you ask for an 'a' record)
+     *  @param  bits        bits to include in the query
+     *  @param  options     per-lookup timing overrides (or nullptr)
+     *  @param  handler     object that will be notified when the query is ready
+     *  @param  urgent      is this a latency-critical lookup?
+     *  @return operation   object to interact with the operation while it is in progress
+     */
+    Operation *lookup(const char *domain, ns_type type, const Bits &bits, const Options *options, Handler *handler, bool urgent);
+
+    /**
+     *  Hand a lookup that can be answered without network traffic over
+     *  to the scheduler, delivering the result synchronously first when
+     *  immediate mode is enabled
+     *  @param  lookup      the local (hosts-file or cache) lookup
+     *  @param  urgent      is this a latency-critical lookup?
+     *  @return operation   object to interact with the operation
+     */
+    Operation *local(Lookup *lookup, bool urgent = false)
+    {
+        // in immediate mode the callback runs right away, before the
+        // query() call returns, a hosts or cache hit then costs nothing
+        // but the lookup itself
+        if (_synchronous) lookup->execute(Now());
+
+        // the scheduler still takes ownership: in immediate mode the
+        // already-completed lookup is simply dropped on the next tick
+        return add(lookup, urgent);
+    }
+
+    /**
+     *  Should lookups that can be answered locally (hosts file, caches)
+     *  run their callback before query() returns?
+     *  @var bool
+     */
+    bool _synchronous = false;
+
 public:
     /**
      *  Constructor
@@ -92,12 +136,335 @@ public:
      *  @param  size      the requested buffer size in bytes, or default with 0. 
      *                    only gets applied to new sockets.
      */
-    void buffersize(int32_t size) 
+    void buffersize(int32_t size)
     {
         // store the property
         _buffersize = size;
     }
-    
+
+    /**
+     *  Bind the context to a cpu (-1 to unbind): sockets that are opened
+     *  afterwards ask the kernel to steer their incoming datagrams to
+     *  that cpu (SO_INCOMING_CPU where available), so that receive
+     *  processing stays on the core, and thus the numa node, that also
+     *  runs the event loop. Must be set before lookups start (the
+     *  sockets are opened lazily)
+     *  @param  cpu       the cpu to bind to
+     */
+    void affinity(int cpu)
+    {
+        // store the property
+        _affinity = cpu;
+    }
+
+    /**
+     *  Set the busy-poll budget in microseconds (0 disables it): sockets
+     *  that are opened afterwards set SO_BUSY_POLL so that the kernel
+     *  busy-polls the device queue, and spin() uses it as the default
+     *  budget for polling the sockets directly from user space. This
+     *  trades cpu time for tens of microseconds of wakeup latency per
+     *  response, only sensible for latency-critical contexts
+     *  @param  microseconds    the budget
+     */
+    void busypoll(int32_t microseconds)
+    {
+        // store the property
+        _busypoll = microseconds;
+    }
+
+    /**
+     *  Set the max number of responses to keep in the in-memory cache,
+     *  repeated queries for a name are then answered from memory for as
+     *  long as the ttl of the records permits (0 disables caching)
+     *  @param  value     max number of cached responses
+     */
+    void cachecapacity(size_t value)
+    {
+        // pass on to the cache
+        _cache.capacity(value);
+    }
+
+    /**
+     *  The max number of responses that are kept in the in-memory cache
+     *  @return size_t
+     */
+    size_t cachecapacity() const
+    {
+        // retrieve from the cache
+        return _cache.capacity();
+    }
+
+    /**
+     *  Enable refresh-ahead prefetching: cache entries that were served at
+     *  least this many times are re-queried in the background shortly before
+     *  their ttl runs out, so that the hot set never experiences a miss.
+     *  Set to 0 (the default) to disable. Only meaningful when caching is
+     *  enabled via cachecapacity().
+     *  @param  value     min number of cache-hits to consider an entry hot
+     */
+    void prefetch(size_t value)
+    {
+        // store the property
+        _prefetch = value;
+    }
+
+    /**
+     *  Write a snapshot of the response cache to a file, typically called
+     *  at shutdown so that the process can restart with a warm cache
+     *  @param  filename    file to write the snapshot to
+     *  @return bool        was the snapshot written?
+     */
+    bool savecache(const char *filename) const
+    {
+        // pass on to the cache
+        return _cache.persist(filename);
+    }
+
+    /**
+     *  Load a cache snapshot that was written by an earlier savecache()
+     *  call, typically called right after construction (next to where the
+     *  constructor loads /etc/resolv.conf and /etc/hosts). Entries that
+     *  expired in the meantime are skipped. Caching must have been enabled
+     *  with cachecapacity() before this call.
+     *  @param  filename    file holding the snapshot
+     *  @return bool        was the snapshot loaded?
+     */
+    bool loadcache(const char *filename)
+    {
+        // pass on to the cache
+        return _cache.restore(filename, Now());
+    }
+
+    /**
+     *  Add a hostname-to-ip entry at runtime, on top of the entries that
+     *  were loaded from /etc/hosts. Updating entries this way is cheap and
+     *  non-disruptive: sockets stay warm and in-flight lookups keep running
+     *  @param  hostname    the hostname
+     *  @param  ip          the address to associate with the hostname
+     *  @return bool        was the entry added (false if it already existed)?
+     */
+    bool addhost(const char *hostname, const Ip &ip) { return _hosts.add(hostname, ip); }
+
+    /**
+     *  Remove all entries for a hostname at runtime (entries that came
+     *  from /etc/hosts can be removed too)
+     *  @param  hostname    the hostname to remove
+     *  @return bool        was anything removed?
+     */
+    bool removehost(const char *hostname) { return _hosts.remove(hostname); }
+
+    /**
+     *  Remove a single hostname-to-ip combination at runtime
+     *  @param  hostname    the hostname
+     *  @param  ip          the specific address to remove
+     *  @return bool        was the entry removed?
+     */
+    bool removehost(const char *hostname, const Ip &ip) { return _hosts.remove(hostname, ip); }
+
+    /**
+     *  Replace all entries for a hostname with a single new address, the
+     *  typical call for pushing an endpoint override
+     *  @param  hostname    the hostname
+     *  @param  ip          the new (only) address for the hostname
+     *  @return bool        was the entry installed?
+     */
+    bool sethost(const char *hostname, const Ip &ip) { return _hosts.replace(hostname, ip); }
+
+    /**
+     *  Load a compiled local policy zone (blocked domains and internal
+     *  rewrites, see the ZoneBuilder class). The file is mapped read-only
+     *  into memory, so this returns immediately no matter how many
+     *  entries it holds, and worker processes that load the same file
+     *  share the pages. Queries that the zone can answer never reach the
+     *  network; calling this again replaces the previously loaded zone
+     *  @param  filename    the compiled zone file
+     *  @return bool        was the file valid and mapped?
+     */
+    bool loadzone(const char *filename) { return _zone.load(filename); }
+
+    /**
+     *  Attach a cache segment in shared memory, so that multiple worker
+     *  processes can resolve from one pool of cached responses. Exactly one
+     *  process should be configured as the designated writer, the readers
+     *  access the segment lock-free.
+     *  @param  name      name of the shared memory segment (e.g. "/dnscpp-cache")
+     *  @param  slots     number of slots in the table (only relevant for the creator)
+     *  @param  writer    is this process the single designated writer?
+     *  @throws std::runtime_error
+     */
+    void sharedcache(const char *name, size_t slots, bool writer);
+
+    /**
+     *  Set the number of UDP sockets that each nameserver uses. Each socket
+     *  is bound to its own ephemeral port, so a small pool widens the space
+     *  of outstanding (port, query-id) pairs and spreads incoming responses
+     *  over multiple kernel receive queues. Only useful for applications
+     *  with very many lookups in flight; best called before any lookups
+     *  are started.
+     *  @param  value       the number of sockets per nameserver
+     */
+    void sockets(size_t value)
+    {
+        // store the property (we need at least one socket)
+        _sockets = value ? value : 1;
+
+        // update the already existing nameservers too
+        for (auto &nameserver : _nameservers) nameserver.sockets(_sockets);
+    }
+
+    /**
+     *  Enable or disable receive-buffer autotuning: when enabled, the
+     *  kernel drop counters of all sockets are sampled on every timer
+     *  tick, and when the kernel turns out to be dropping datagrams the
+     *  receive buffers are doubled (up to 8mb, and subject to the
+     *  rmem_max limit of the system). Context::drops() exposes the
+     *  sampled counter so applications can alert on it too.
+     *  @param  value       should the buffers adapt automatically?
+     */
+    void autotune(bool value)
+    {
+        // store the property
+        _autotune = value;
+    }
+
+    /**
+     *  Total number of datagrams that the kernel dropped because socket
+     *  receive buffers were full
+     *  @return size_t
+     */
+    size_t drops() const
+    {
+        // add up the counters of all nameservers
+        size_t result = 0;
+
+        // iterate over the nameservers
+        for (const auto &nameserver : _nameservers) result += nameserver.drops();
+
+        // expose the sum
+        return result;
+    }
+
+    /**
+     *  Set the max number of responses that a nameserver buffers before
+     *  they are processed. When more responses come in than can be
+     *  buffered, the oldest ones are shed, so that memory use stays
+     *  bounded and dispatch latency predictable under reflection traffic
+     *  or a misbehaving resolver. Best called before lookups are started.
+     *  @param  value       the number of responses to buffer at most
+     */
+    void backlog(size_t value)
+    {
+        // store the property (for nameservers constructed later)
+        _backlog = value ? value : 1;
+
+        // update the already existing nameservers too
+        for (auto &nameserver : _nameservers) nameserver.backlog(_backlog);
+    }
+
+    /**
+     *  Set a rate limit per nameserver, for upstream resolvers that enforce
+     *  a per-client queries-per-second limit and answer bursts with drops
+     *  (such a drop costs a full retransmit interval, a short wait for the
+     *  next token is much cheaper). Lookups that are held back are released
+     *  by the scheduler exactly when their token accrues.
+     *  @param  rate        max queries per second per nameserver (0.0 disables)
+     *  @param  burst       max queries that may be sent back-to-back
+     */
+    void ratelimit(double rate, double burst = 16.0)
+    {
+        // store the properties (for nameservers constructed later)
+        _rate = std::max(rate, 0.0);
+        _burst = std::max(burst, 1.0);
+
+        // update the already existing nameservers too
+        for (auto &nameserver : _nameservers) nameserver.ratelimit(_rate, _burst);
+    }
+
+    /**
+     *  Total number of responses that were shed because a backlog was full,
+     *  a growing number is a sign that the backlog (or the processing
+     *  capacity) is too small
+     *  @return size_t
+     */
+    size_t dropped() const
+    {
+        // add up the counters of all nameservers
+        size_t result = 0;
+
+        // iterate over the nameservers
+        for (const auto &nameserver : _nameservers) result += nameserver.dropped();
+
+        // expose the sum
+        return result;
+    }
+
+    /**
+     *  Bind the socket pool of every nameserver to one shared port per
+     *  nameserver with SO_REUSEPORT, so that the kernel shards incoming
+     *  responses over the receive queues of the pool instead of
+     *  serializing everything through a single descriptor. Call this
+     *  after sockets() has been used to size the pools.
+     */
+    void reuseport()
+    {
+        // shard the pool of every nameserver
+        for (auto &nameserver : _nameservers) nameserver.shard();
+    }
+
+    /**
+     *  Add a route for split-horizon setups: queries for the zone (and for
+     *  everything below it) are only sent to the given nameserver, instead
+     *  of to all configured nameservers. Call multiple times with the same
+     *  zone to assign multiple nameservers to it. The most specific zone
+     *  wins when multiple routes match a query.
+     *  @param  zone        the zone for which a specific route applies
+     *  @param  nameserver  ip of a nameserver responsible for the zone
+     */
+    void route(const char *zone, const Ip &nameserver)
+    {
+        // pass on to the core
+        Core::route(zone, nameserver);
+    }
+
+    /**
+     *  Enable or disable automatic reloading of the configuration files:
+     *  when enabled, the /etc/hosts and /etc/resolv.conf files are watched
+     *  with inotify and changes are picked up without restarting, new
+     *  hosts-entries are merged and nameservers are added/removed in place
+     *  @param  value     should the configuration files be watched?
+     *  @throws std::runtime_error
+     */
+    void autoreload(bool value);
+
+    /**
+     *  Enable or disable serve-stale mode: when enabled, an expired cache
+     *  entry is served to the caller right away, while a background lookup
+     *  is started to refresh the entry. This flattens the latency-tail for
+     *  hot domains, at the cost of occasionally serving outdated records.
+     *  Only meaningful when caching is enabled via cachecapacity().
+     *  @param  value     should stale entries be served?
+     */
+    void servestale(bool value)
+    {
+        // store the property
+        _servestale = value;
+    }
+
+    /**
+     *  Enable or disable dns-over-tls (rfc 7858): when enabled, queries
+     *  that need a connection (truncated responses, large answers) are
+     *  sent over an encrypted connection to port 853 instead of plain
+     *  dns on port 53. The TLS session is cached per nameserver, so
+     *  reconnects are resumed and complete in a single round-trip. Note
+     *  that the nameservers must of course support dns-over-tls.
+     *  @param  value       should dns-over-tls be used?
+     */
+    void secure(bool value)
+    {
+        // store the property
+        _secure = value;
+    }
+
     /**
      *  Set max time to wait for a response
      *  @param timeout      time in seconds
@@ -117,7 +484,24 @@ public:
         // store property, make sure the numbers are reasonably clamped
         _interval = std::max(interval, 0.1);
     }
-    
+
+    /**
+     *  Enable hedged requests: when a lookup has not been answered after
+     *  this delay, the same query is already sent to the next nameserver
+     *  (instead of waiting out the full retransmit interval), and whichever
+     *  response arrives first is used. A good value is the p95 of the
+     *  response times that you normally see. This burns some extra
+     *  datagrams, in exchange for a tail latency that is no longer
+     *  dictated by one slow or broken resolver. Pass 0.0 to disable.
+     *  @param  hedge       delay in seconds (0.0 to disable)
+     */
+    void hedge(double hedge)
+    {
+        // store property (0.0 disables, negative values make no sense)
+        _hedge = std::max(hedge, 0.0);
+    }
+
+
     /**
      *  Set the spread (how long to wait until we context the next server)
      *  This setting is deprecated and now unused
@@ -165,13 +549,123 @@ public:
      *  @param rotate   the new setting
      */
     void rotate(bool rotate) { _rotate = rotate; }
-    
+
+    /**
+     *  Override the search domains from /etc/resolv.conf: names with
+     *  fewer dots than the ndots setting are completed with each of
+     *  these domains, and the candidates are probed concurrently (the
+     *  first positive answer wins). Pass an empty list to disable
+     *  search-domain expansion altogether
+     *  @param  value   the search domains
+     */
+    void searchpaths(std::vector<std::string> value) { _searchpaths = std::move(value); }
+
+    /**
+     *  Override the ndots setting: names with at least this many dots
+     *  are considered fully qualified and bypass the search domains
+     *  @param  value   the new setting (capped to 15, like the conf)
+     */
+    void ndots(size_t value) { _ndots = std::min(size_t(15), value); }
+
+    /**
+     *  Enable or disable weighted nameserver selection: when enabled the
+     *  first attempt of each lookup goes to the nameserver with the best
+     *  recent latency/loss score (with a small exploration fraction so
+     *  that recovered servers get re-tried) instead of round-robin
+     *  @param  weighted    the new setting
+     */
+    void weighted(bool weighted) { _weighted = weighted; }
+
+    /**
+     *  Enable or disable dns 0x20 encoding: when enabled the case of the
+     *  query-name is randomized per query and responses must echo that
+     *  exact case before they are accepted. This adds unguessable bits on
+     *  top of the sixteen-bit query id, making off-path spoofing of udp
+     *  responses much harder (and bigger edns payload sizes safer to
+     *  use). Leave this off for upstream resolvers that lowercase names
+     *  @param  dns0x20     the new setting
+     */
+    void dns0x20(bool dns0x20) { _dns0x20 = dns0x20; }
+
+    /**
+     *  Set the port to which queries are sent. This is normally just
+     *  53, a different port is useful to point the context at an
+     *  in-process mock nameserver (see MockServer) in tests and
+     *  benchmarks. Change this before traffic flows
+     *  @param  port        the port to use
+     */
+    void dnsport(uint16_t port) { _dnsport = port; }
+
+    /**
+     *  Keep the udp sockets of a nameserver warm: after the last lookup
+     *  lost interest the sockets (and their event-loop registration)
+     *  stay open for this grace period, so that traffic that comes in
+     *  millisecond bursts separated by sub-second gaps does not pay the
+     *  socket setup for every burst, and the first query of a burst
+     *  does not race the setup. The default of 0.0 closes the sockets
+     *  as soon as nobody is listening
+     *  @param  seconds     the grace period in seconds
+     */
+    void keepwarm(double seconds) { _keepwarm = std::max(0.0, seconds); }
+
+    /**
+     *  Opt in to immediate delivery for lookups that can be answered
+     *  without network traffic (hosts file, in-memory cache, shared
+     *  cache): the result callback then runs before query() returns,
+     *  so a local hit costs nothing but the lookup itself instead of
+     *  a full event-loop round trip. This is off by default because
+     *  code written for the normal asynchronous contract may not
+     *  expect the callback to run while query() is still on the stack
+     *  @param  value       deliver local answers synchronously?
+     */
+    void synchronous(bool value) { _synchronous = value; }
+
+    /**
+     *  Install the slow-lookup log: the hook is called for every lookup
+     *  that takes longer than the threshold, and for every lookup that
+     *  times out altogether, with the domain, the record-type, the ip
+     *  of the server of the latest attempt (nullptr when nothing was
+     *  sent), the number of attempts and the elapsed time. This costs
+     *  nothing for the fast majority of lookups, the bookkeeping is
+     *  already there. The hook runs just before the lookup reports to
+     *  its own handler, so it should not destruct the context
+     *  @param  threshold   report lookups slower than this (in seconds,
+     *                      0.0 reports timed-out lookups only)
+     *  @param  callback    the hook to install
+     */
+    void slowlog(double threshold, const SlowCallback &callback)
+    {
+        // store both settings
+        _slow = std::max(0.0, threshold); _slowlog = callback;
+    }
+
+    /**
+     *  Set the number of worker threads for the crypto offload pool that
+     *  is exposed via the verifiers() method. Expensive signature checks
+     *  can be queued to this pool so that they do not stall datagram
+     *  processing on the loop thread. The pool is created lazily on the
+     *  first call to verifiers(), so the size must be set before that;
+     *  zero (the default) means that no pool is created at all
+     *  @param  count       number of worker threads
+     */
+    void workers(size_t count) { _workers = count; }
+
     /**
      *  Set the max number of calls that are made to userspace in one iteration
      *  @param  value       the new value
      */
     void maxcalls(size_t value) { _maxcalls = value; }
-    
+
+    /**
+     *  Set the max amount of time (in seconds) that one event-loop iteration
+     *  may spend on calls to userspace. When the budget runs out the remaining
+     *  work is rescheduled via an immediate timer, so that the latency of a
+     *  loop iteration stays bounded no matter how expensive the user-space
+     *  handlers are (0.0, the default, disables the time budget)
+     *  @param  value       the new value
+     */
+    void maxtime(double value) { _maxtime = value; }
+
     /**
      *  Do a dns lookup and pass the result to a user-space handler object
      *  When you supply invalid parameters (for example a syntactivally invalid
@@ -180,11 +674,48 @@ public:
      *  @param  type        type of record (normally you ask for an 'a' record)
      *  @param  bits        bits to include in the query
      *  @param  handler     object that will be notified when the query is ready
+     *  @param  urgent      latency-critical lookup? urgent lookups bypass the
+     *                      overflow queue and are scheduled ahead of the
+     *                      regular (batch) lookups that are waiting to run
      *  @return operation   object to interact with the operation while it is in progress
      */
-    Operation *query(const char *domain, ns_type type, const Bits &bits, Handler *handler);
-    Operation *query(const char *domain, ns_type type, Handler *handler) { return query(domain, type, _bits, handler); }
-    
+    Operation *query(const char *domain, ns_type type, const Bits &bits, Handler *handler, bool urgent = false) { return lookup(domain, type, bits, nullptr, handler, urgent); }
+    Operation *query(const char *domain, ns_type type, Handler *handler, bool urgent = false) { return lookup(domain, type, _bits, nullptr, handler, urgent); }
+
+    /**
+     *  Do a dns lookup with per-lookup timing overrides: the fields of
+     *  the options struct that are set override the context-wide
+     *  timeout, interval and attempts for this one lookup, so that
+     *  interactive and batch queries with very different budgets can
+     *  share one context (one set of sockets, one cache)
+     *  @param  name        the record name to look for
+     *  @param  type        type of record (normally you ask for an 'a' record)
+     *  @param  bits        bits to include in the query
+     *  @param  options     the per-lookup overrides
+     *  @param  handler     object that will be notified when the query is ready
+     *  @param  urgent      is this a latency-critical lookup?
+     *  @return operation   object to interact with the operation while it is in progress
+     */
+    Operation *query(const char *domain, ns_type type, const Bits &bits, const Options &options, Handler *handler, bool urgent = false) { return lookup(domain, type, bits, &options, handler, urgent); }
+    Operation *query(const char *domain, ns_type type, const Options &options, Handler *handler, bool urgent = false) { return lookup(domain, type, _bits, &options, handler, urgent); }
+
+    /**
+     *  Submit many lookups in one call, with one shared handler. Each
+     *  item goes through the same code path as query() (hosts file,
+     *  cache, coalescing), but the internal timer is re-armed once for
+     *  the whole batch instead of once per lookup, and the initial
+     *  datagrams leave in one burst in submission order, which makes
+     *  this considerably cheaper for batch jobs that submit thousands
+     *  of lookups in a tight loop.
+     *  @param  queries     the (domain, type) pairs to look up
+     *  @param  bits        bits to include in the queries
+     *  @param  handler     object that is notified for each result
+     *  @return operations  per-item operation handles (in input order,
+     *                      null for items with invalid parameters)
+     */
+    std::vector<Operation*> query_many(const std::vector<std::pair<const char*,ns_type>> &queries, const Bits &bits, Handler *handler);
+    std::vector<Operation*> query_many(const std::vector<std::pair<const char*,ns_type>> &queries, Handler *handler) { return query_many(queries, _bits, handler); }
+
     /**
      *  Do a reverse IP lookup, this is only meaningful for PTR lookups
      *  @param  ip          the ip address to lookup
@@ -194,7 +725,50 @@ public:
      */
     Operation *query(const Ip &ip, const Bits &bits, Handler *handler);
     Operation *query(const Ip &ip, Handler *handler) { return query(ip, _bits, handler); }
-    
+
+    /**
+     *  Combined dual-stack lookup: resolve both the A and the AAAA
+     *  records of a domain in one operation. The two questions go out
+     *  back-to-back, share one deadline, and the handler receives a
+     *  single combined callback. With early-delivery enabled the result
+     *  is already reported when the first address family answers
+     *  (happy-eyeballs style) and the other lookup is cancelled.
+     *  @param  domain      the domain to resolve
+     *  @param  bits        bits to include in the queries
+     *  @param  handler     object notified about the combined result
+     *  @param  early       report as soon as the first family answers?
+     *  @return Dual        the operation (or nullptr on failure)
+     */
+    Dual *dual(const char *domain, const Bits &bits, Dual::Handler *handler, bool early = false);
+    Dual *dual(const char *domain, Dual::Handler *handler, bool early = false) { return dual(domain, _bits, handler, early); }
+
+    /**
+     *  Resolve the mail exchanges of a domain in one operation: first
+     *  the MX records, then (the moment the MX answer arrives) the A
+     *  and AAAA records of all exchanges in one parallel batch. The
+     *  handler receives a single combined result sorted by preference.
+     *  @param  domain      the domain whose mail exchanges are resolved
+     *  @param  bits        bits to include in the queries
+     *  @param  handler     object notified about the combined result
+     *  @return Exchanges   the operation (or nullptr on failure)
+     */
+    Exchanges *exchanges(const char *domain, const Bits &bits, Exchanges::Handler *handler);
+    Exchanges *exchanges(const char *domain, Exchanges::Handler *handler) { return exchanges(domain, _bits, handler); }
+
+    /**
+     *  Transfer a full zone (axfr) from its primary nameserver. The
+     *  records are streamed to the handler as they arrive, so memory
+     *  use is constant no matter how big the zone is. Note that this
+     *  runs over a dedicated tcp connection to the given nameserver,
+     *  and bypasses the nameservers from /etc/resolv.conf (which are
+     *  normally caching resolvers that refuse zone transfers anyway).
+     *  @param  nameserver  the primary nameserver holding the zone
+     *  @param  domain      the zone to transfer
+     *  @param  handler     object notified about the records
+     *  @return Transfer    the operation (or nullptr on failure)
+     */
+    Transfer *transfer(const Ip &nameserver, const char *domain, Transfer::Handler *handler);
+
     /**
      *  Do a dns lookup and pass the result to callbacks
      *  @param  name        the record name to look for
@@ -222,8 +796,17 @@ public:
      *  Expose some getters from core
      */
     using Core::buffersize;
+    using Core::affinity;
+    using Core::busypoll;
+    using Core::spin;
+    using Core::loop;
+    using Core::verifiers;
+    using Core::stats;
+    using Core::cancel_many;
     using Core::bits;
     using Core::rotate;
+    using Core::searchpaths;
+    using Core::ndots;
     using Core::expire;
     using Core::interval;
     using Core::capacity;
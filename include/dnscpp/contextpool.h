@@ -0,0 +1,262 @@
+/**
+ *  ContextPool.h
+ *
+ *  Facade that shards lookups over multiple contexts, each running on
+ *  its own event loop (typically one per core, each with its own
+ *  sockets and receive queues). Lookups are distributed by a hash of
+ *  the domain, so that repeated lookups for the same domain land on
+ *  the same shard and profit from that shard's cache, but when a
+ *  shard is far busier than the rest the lookup is handed to the
+ *  least loaded shard instead.
+ *
+ *  The pool submits via the inboxes of the shards, so publish() may
+ *  be called from any thread; completion handlers run on the loop
+ *  thread of the shard that performed the lookup. To share responses
+ *  between the shards, point the shards at one shared cache segment
+ *  (see Context::sharedcache()).
+ *
+ *  On multi-socket (numa) machines each shard can be given a cpu: the
+ *  thread that runs the shard's loop should then call pin() as its
+ *  very first action, so that it is bound to that cpu and the memory
+ *  the shard allocates while working (lookup state, receive buffers)
+ *  is first-touched from, and thus placed on, the local numa node.
+ *  The shard's sockets additionally ask the kernel to steer their
+ *  incoming datagrams to the same cpu, so that a datagram is received,
+ *  processed and answered without crossing the interconnect.
+ *
+ *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include "context.h"
+#include "inbox.h"
+#include <atomic>
+#include <vector>
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Class definition
+ */
+class ContextPool
+{
+private:
+    /**
+     *  One shard: a context with its inbox and a counter of the lookups
+     *  that were submitted to it and have not yet completed
+     */
+    struct Shard
+    {
+        /**
+         *  The context that runs the lookups of this shard
+         *  @var Context
+         */
+        Context context;
+
+        /**
+         *  The inbox via which lookups are submitted from other threads
+         *  @var Inbox
+         */
+        Inbox inbox;
+
+        /**
+         *  Number of submitted-but-not-completed lookups
+         *  @var std::atomic
+         */
+        std::atomic<size_t> pending;
+
+        /**
+         *  The cpu on which this shard runs (-1 when not bound to one)
+         *  @var int
+         */
+        int cpu = -1;
+
+        /**
+         *  Constructor
+         *  @param  loop        the event loop of this shard
+         *  @param  defaults    load settings from /etc/resolv.conf?
+         */
+        Shard(Loop *loop, bool defaults) : context(loop, defaults), inbox(&context), pending(0) {}
+    };
+
+    /**
+     *  Wrapper that forwards all callbacks to the user space handler and
+     *  decrements the pending-counter of the shard when the lookup ends
+     */
+    class Bridge : public Handler
+    {
+    private:
+        /**
+         *  The counter to decrement when the lookup is finished
+         *  @var std::atomic
+         */
+        std::atomic<size_t> *_pending;
+
+        /**
+         *  The actual user space handler
+         *  @var Handler
+         */
+        Handler *_handler;
+
+    public:
+        /**
+         *  Constructor
+         *  @param  pending     counter of the shard
+         *  @param  handler     the user space handler
+         */
+        Bridge(std::atomic<size_t> *pending, Handler *handler) : _pending(pending), _handler(handler) {}
+
+        /**
+         *  Destructor (virtual because the callbacks self-destruct)
+         */
+        virtual ~Bridge() = default;
+
+        /**
+         *  A response was received, this ends the lookup
+         *  @param  operation   the finished operation
+         *  @param  response    the received response
+         */
+        virtual void onReceived(const Operation *operation, const Response &response) override
+        {
+            // the shard has one lookup less in flight
+            _pending->fetch_sub(1, std::memory_order_relaxed);
+
+            // pass on to user space (the handler of the operation is this
+            // bridge, so we forward explicitly) and self-destruct
+            _handler->onReceived(operation, response); delete this;
+        }
+
+        /**
+         *  The lookup timed out, this ends the lookup too
+         *  @param  operation   the finished operation
+         */
+        virtual void onTimeout(const Operation *operation) override
+        {
+            // the shard has one lookup less in flight
+            _pending->fetch_sub(1, std::memory_order_relaxed);
+
+            // pass on and self-destruct
+            _handler->onTimeout(operation); delete this;
+        }
+
+        /**
+         *  The lookup was cancelled (or could not even be started)
+         *  @param  operation   the cancelled operation
+         */
+        virtual void onCancelled(const Operation *operation) override
+        {
+            // the shard has one lookup less in flight
+            _pending->fetch_sub(1, std::memory_order_relaxed);
+
+            // pass on and self-destruct
+            _handler->onCancelled(operation); delete this;
+        }
+    };
+
+    /**
+     *  The shards (behind pointers because atomics cannot be moved)
+     *  @var std::vector
+     */
+    std::vector<std::unique_ptr<Shard>> _shards;
+
+    /**
+     *  Pick the shard for a certain domain
+     *  @param  domain      the domain that is being looked up
+     *  @return size_t      index of the shard to use
+     */
+    size_t select(const char *domain) const;
+
+public:
+    /**
+     *  Constructor, must be called before the loops start running, and
+     *  each loop should afterwards be run by its own thread
+     *  @param  loops       the event loops, one per shard
+     *  @param  defaults    load settings from /etc/resolv.conf?
+     *  @throws std::runtime_error
+     */
+    ContextPool(const std::vector<Loop*> &loops, bool defaults = true);
+
+    /**
+     *  Constructor that also assigns a cpu to each shard (for numa-aware
+     *  setups, normally one shard per core). The sockets of each shard
+     *  are then steered to its cpu, and the thread that runs a shard's
+     *  loop should call pin() as its very first action
+     *  @param  loops       the event loops, one per shard
+     *  @param  cpus        the cpu for each shard (same order as loops)
+     *  @param  defaults    load settings from /etc/resolv.conf?
+     *  @throws std::runtime_error
+     */
+    ContextPool(const std::vector<Loop*> &loops, const std::vector<int> &cpus, bool defaults = true);
+
+    /**
+     *  No copying
+     *  @param  that        other pool
+     */
+    ContextPool(const ContextPool &that) = delete;
+
+    /**
+     *  Destructor, must be called when the loops no longer run
+     */
+    virtual ~ContextPool() = default;
+
+    /**
+     *  Number of shards in the pool
+     *  @return size_t
+     */
+    size_t shards() const { return _shards.size(); }
+
+    /**
+     *  Access to the context of one shard, for shard-level configuration
+     *  (buffer sizes, shared cache, et cetera), only to be used before
+     *  the loops start running
+     *  @param  index       index of the shard
+     *  @return Context
+     */
+    Context *context(size_t index) { return &_shards[index]->context; }
+
+    /**
+     *  Bind the calling thread to the cpu of one shard. This must be
+     *  called by the thread that runs the shard's loop, before the loop
+     *  starts: all memory the shard touches while working is then
+     *  allocated on (first-touched from) the numa node of that cpu
+     *  @param  index       index of the shard
+     *  @return bool        was the thread successfully bound?
+     */
+    bool pin(size_t index);
+
+    /**
+     *  Submit a lookup, may be called from any thread, the handler runs
+     *  on the loop thread of the selected shard
+     *  @param  domain      the domain to look up
+     *  @param  type        type of records to look for
+     *  @param  bits        the bits to include in the query
+     *  @param  handler     user space handler
+     *  @return bool        was the lookup submitted?
+     */
+    bool publish(const char *domain, ns_type type, const Bits &bits, Handler *handler);
+
+    /**
+     *  Submit a lookup with default bits
+     *  @param  domain      the domain to look up
+     *  @param  type        type of records to look for
+     *  @param  handler     user space handler
+     *  @return bool        was the lookup submitted?
+     */
+    bool publish(const char *domain, ns_type type, Handler *handler);
+};
+
+/**
+ *  End of namespace
+ */
+}
@@ -21,9 +21,13 @@
 #include "nameserver.h"
 #include "resolvconf.h"
 #include "hosts.h"
+#include "zone.h"
+#include "cache.h"
 #include "bits.h"
 #include "now.h"
 #include "lookup.h"
+#include "wheel.h"
+#include "callbacks.h"
 #include <list>
 #include <deque>
 #include <memory>
@@ -37,6 +41,12 @@ namespace DNS {
  *  Forward declarations
  */
 class Loop;
+class SharedCache;
+class ConfigWatcher;
+class RemoteLookup;
+class Handler;
+class Operation;
+class Verifiers;
 
 /**
  *  Class definition
@@ -63,12 +73,40 @@ protected:
     Hosts _hosts;
 
     /**
-     *  All operations that are in progress and that are waiting for the next 
-     *  (possibly first) attempt. Note that we use multiple queues so that we do
-     *  not have to use a slow (priority) queue.
-     *  @var std::deque<std::shared_ptr<Lookup>>
+     *  The memory-mapped local policy zone (blocked domains and internal
+     *  rewrites), empty until a compiled zone file is loaded
+     *  @var Zone
      */
-    std::deque<std::shared_ptr<Lookup>> _lookups;
+    Zone _zone;
+
+    /**
+     *  Cache with previously received responses
+     *  @var Cache
+     */
+    Cache _cache;
+
+    /**
+     *  Optional cache segment in shared memory, so that multiple worker
+     *  processes can resolve from one pool of cached responses
+     *  @var std::unique_ptr<SharedCache>
+     */
+    std::unique_ptr<SharedCache> _sharedcache;
+
+    /**
+     *  Optional watcher that picks up changes to /etc/hosts and
+     *  /etc/resolv.conf while the context is running
+     *  @var std::unique_ptr<ConfigWatcher>
+     */
+    std::unique_ptr<ConfigWatcher> _watcher;
+
+    /**
+     *  All operations that are in progress and that are waiting for the next
+     *  (possibly first) attempt. The wheel buckets them by the time of that
+     *  attempt, so that picking the next due lookup is a constant-time
+     *  operation and short delays are not stuck behind longer ones.
+     *  @var Wheel
+     */
+    Wheel _lookups;
     
     /**
      *  To avoid that external DNS servers, or our own response-buffer, is flooded
@@ -85,7 +123,65 @@ protected:
      *  @var std::deque<std::shared_ptr<Lookup>>
      */
     std::deque<std::shared_ptr<Lookup>> _ready;
-    
+
+    /**
+     *  Routing table for split-horizon setups: zones (stored lowercase,
+     *  without trailing dot) that must be resolved by a specific subset of
+     *  the nameservers instead of by all of them
+     *  @var std::map
+     */
+    std::map<std::string,std::vector<Ip>> _routes;
+
+    /**
+     *  Administration of the remote lookups that are currently in flight,
+     *  keyed by hostname + record-type, so that identical queries can be
+     *  coalesced onto one lookup instead of going out on the wire twice
+     *  @var std::map
+     */
+    std::map<std::pair<std::string,uint16_t>,RemoteLookup*,Cache::KeyCompare> _inflight;
+
+    /**
+     *  One precompiled query template: the full wire form of a query for
+     *  a certain domain/type/bits combination, from which fresh queries
+     *  can be stamped out with just a copy and a new random id
+     */
+    struct Template
+    {
+        /**
+         *  The domain of the query
+         *  @var std::string
+         */
+        std::string domain;
+
+        /**
+         *  The record-type of the query
+         *  @var uint16_t
+         */
+        uint16_t type;
+
+        /**
+         *  The flags (ad/cd/do) and advertised payload size that went
+         *  into the wire form
+         *  @var int / uint16_t
+         */
+        int flags;
+        uint16_t payload;
+
+        /**
+         *  The precompiled query
+         *  @var std::unique_ptr<Query>
+         */
+        std::unique_ptr<Query> query;
+    };
+
+    /**
+     *  Small cache of precompiled query templates, most recently used in
+     *  front, so that repeated lookups for the same domain skip the name
+     *  compression and header encoding
+     *  @var std::list<Template>
+     */
+    std::list<Template> _templates;
+
     /**
      *  The next timer to run
      *  @var void *
@@ -97,7 +193,21 @@ protected:
      *  @var bool
      */
     double _immediate = false;
-    
+
+    /**
+     *  Is a batched submission in progress? While a batch is active
+     *  add() postpones the timer bookkeeping, so that submitting many
+     *  lookups re-arms the timer once instead of once per lookup
+     *  @var bool
+     */
+    bool _batching = false;
+
+    /**
+     *  Did add() skip a timer re-arm during the current batch?
+     *  @var bool
+     */
+    bool _rearm = false;
+
     /**
      *  Size of the send and receive buffer. If set to zero, default
      *  will be kept. This is limited by the system maximum (wmem_max and rmem_max)
@@ -105,6 +215,55 @@ protected:
      */
     int32_t _buffersize = 0;
 
+    /**
+     *  The cpu on which this context runs (-1 when not bound to one).
+     *  When set, the kernel is asked to steer incoming datagrams on the
+     *  sockets of this context to that cpu (SO_INCOMING_CPU), so that
+     *  receive processing stays on the core (and numa node) that also
+     *  runs the event loop
+     *  @var int
+     */
+    int _affinity = -1;
+
+    /**
+     *  Busy-poll budget in microseconds (0 disables busy-polling). When
+     *  set, the sockets ask the kernel to busy-poll the device queue for
+     *  this long before a blocking read gives up (SO_BUSY_POLL), and the
+     *  spin() method uses it as its default spin budget
+     *  @var int32_t
+     */
+    int32_t _busypoll = 0;
+
+    /**
+     *  Number of UDP sockets that each nameserver opens. More sockets
+     *  means more simultaneously outstanding (port, query-id) pairs and
+     *  more kernel receive queues for very high query rates
+     *  @var size_t
+     */
+    size_t _sockets = 1;
+
+    /**
+     *  Max number of responses that a nameserver buffers before they are
+     *  processed, when more come in the oldest ones are shed
+     *  @var size_t
+     */
+    size_t _backlog = 1024;
+
+    /**
+     *  Rate limit per nameserver in queries per second (0.0 = unlimited),
+     *  for upstream resolvers that enforce a per-client limit and answer
+     *  bursts with drops
+     *  @var double
+     */
+    double _rate = 0.0;
+
+    /**
+     *  Number of queries that may be sent back-to-back when rate limiting
+     *  is active (the size of the token bucket)
+     *  @var double
+     */
+    double _burst = 16.0;
+
     /**
      *  Max time that we wait for a response
      *  @var double
@@ -122,6 +281,16 @@ protected:
      *  @var double
      */
     double _interval = 2.0;
+
+    /**
+     *  Delay before the query is hedged to the next nameserver (0.0 means
+     *  no hedging: the next nameserver is only tried after the interval).
+     *  With hedging the same query is sent to an other nameserver after
+     *  this much shorter delay, and whichever response arrives first wins,
+     *  so one slow resolver no longer dictates the tail latency
+     *  @var double
+     */
+    double _hedge = 0.0;
     
     /**
      *  Default bits to include in queries
@@ -134,6 +303,44 @@ protected:
      *  @var bool
      */
     bool _rotate = false;
+
+    /**
+     *  The search domains that are appended to short hostnames (normally
+     *  taken from the "search" line in /etc/resolv.conf)
+     *  @var std::vector<std::string>
+     */
+    std::vector<std::string> _searchpaths;
+
+    /**
+     *  Names with at least this many dots are considered fully qualified
+     *  and bypass the search domains
+     *  @var size_t
+     */
+    size_t _ndots = 1;
+
+    /**
+     *  Should the first attempt go to the nameserver with the best recent
+     *  latency/loss score? this beats plain rotation when one server of the
+     *  set is degraded (rotation keeps feeding it first attempts)
+     *  @var bool
+     */
+    bool _weighted = false;
+
+    /**
+     *  Should the case of query-names be randomized (dns 0x20 encoding)?
+     *  responses must then echo the exact case, which adds unguessable
+     *  bits on top of the query id and makes off-path spoofing of udp
+     *  responses much harder
+     *  @var bool
+     */
+    bool _dns0x20 = false;
+
+    /**
+     *  Should expired cache entries be served while a background lookup
+     *  refreshes them (serve-stale mode)?
+     *  @var bool
+     */
+    bool _servestale = false;
     
     /**
      *  Max number of operations to run at the same time
@@ -146,7 +353,106 @@ protected:
      *  @var size_t
      */
     size_t _maxcalls = 5;
-    
+
+    /**
+     *  The max amount of time (in seconds) that one iteration may spend
+     *  on calls to userspace, measured with the coarse clock. When the
+     *  budget runs out the remaining work is rescheduled via an immediate
+     *  timer, so that a burst of responses with expensive handlers cannot
+     *  stall the event loop (0.0 disables the time budget, in which case
+     *  only the call-count budget applies)
+     *  @var double
+     */
+    double _maxtime = 0.0;
+
+    /**
+     *  Cache entries that were served at least this many times are
+     *  re-queried shortly before their ttl runs out, so that hot entries
+     *  never experience a cache-miss (0 disables refresh-ahead)
+     *  @var size_t
+     */
+    size_t _prefetch = 0;
+
+    /**
+     *  Should the receive buffers grow automatically when the kernel is
+     *  detected to be dropping datagrams?
+     *  @var bool
+     */
+    bool _autotune = false;
+
+    /**
+     *  Should queries be sent over dns-over-tls (port 853) instead of
+     *  plain dns when a connection to the nameserver is needed?
+     *  @var bool
+     */
+    bool _secure = false;
+
+    /**
+     *  Total number of kernel-side drops seen at the previous check
+     *  @var size_t
+     */
+    size_t _kerneldrops = 0;
+
+    /**
+     *  Number of worker threads for the optional crypto offload pool
+     *  (0 means that no pool is created and all checks run inline)
+     *  @var size_t
+     */
+    size_t _workers = 0;
+
+    /**
+     *  The port to which queries are sent (normally just 53, but a
+     *  different port is useful to run against an in-process mock
+     *  nameserver in tests and benchmarks)
+     *  @var uint16_t
+     */
+    uint16_t _dnsport = 53;
+
+    /**
+     *  Grace period in seconds during which the udp sockets of a
+     *  nameserver stay open (including their event-loop registration)
+     *  after the last lookup lost interest, so that bursty traffic does
+     *  not pay the socket setup over and over (0.0 means that sockets
+     *  close as soon as nobody is listening)
+     *  @var double
+     */
+    double _keepwarm = 0.0;
+
+    /**
+     *  Threshold of the slow-lookup log in seconds: lookups that take
+     *  longer than this are reported to the hook below (0.0 means that
+     *  only timed-out lookups are reported)
+     *  @var double
+     */
+    double _slow = 0.0;
+
+    /**
+     *  The hook of the slow-lookup log, when set it is called for every
+     *  lookup that exceeds the threshold and for every lookup that
+     *  times out, with the bookkeeping that the lookup already keeps
+     *  @var SlowCallback
+     */
+    SlowCallback _slowlog;
+
+    /**
+     *  The optional pool of worker threads for expensive cryptographic
+     *  checks, lazily created on first use
+     *  @var std::unique_ptr<Verifiers>
+     */
+    std::unique_ptr<Verifiers> _verifiers;
+
+    /**
+     *  Start background lookups for hot cache entries that are about to expire
+     *  @param  now     current time
+     */
+    void prefetch(double now);
+
+    /**
+     *  Check the kernel drop counters of all sockets, and grow the
+     *  receive buffers when the kernel is dropping datagrams
+     */
+    void autotune();
+
 
     /**
      *  Calculate the delay until the next job
@@ -179,8 +485,41 @@ protected:
      *  @param  lookup
      *  @return Operation
      */
-    Operation *add(Lookup *lookup);
-    
+    Operation *add(Lookup *lookup, bool urgent = false);
+
+    /**
+     *  Install the immediate timer because a new lookup is due
+     */
+    void arm();
+
+    /**
+     *  Cancel many operations in one call: all operations that carry
+     *  the given tag (see Operation::tag()), or simply all in-flight
+     *  operations when no tag is supplied. The internal structures are
+     *  cleared wholesale instead of once per lookup, so this is the
+     *  method to use for graceful shutdown with a large number of
+     *  lookups in flight. Every cancelled operation still gets its
+     *  onCancelled() callback.
+     *  @param  tag         the tag to match (nullptr to cancel everything)
+     *  @return size_t      number of operations that were cancelled
+     */
+    size_t cancel_many(const void *tag = nullptr);
+
+    /**
+     *  Start or finish a batched submission: while a batch is active
+     *  add() postpones the timer bookkeeping, finishing the batch
+     *  installs the one timer for all the lookups that were added
+     *  @param  active      is a batch in progress?
+     */
+    void batch(bool active)
+    {
+        // remember the mode
+        _batching = active;
+
+        // when the batch finishes, install the timer that add() skipped
+        if (!active && _rearm) { arm(); _rearm = false; }
+    }
+
     /**
      *  Protected constructor, only the derived class may construct it
      *  @param  loop        your event loop
@@ -221,12 +560,68 @@ public:
      *  @return int32_t
      */
     int32_t buffersize() const { return _buffersize; }
-    
+
+    /**
+     *  The cpu on which this context runs (-1 when not bound to one)
+     *  @return int
+     */
+    int affinity() const { return _affinity; }
+
+    /**
+     *  The busy-poll budget in microseconds (0 when disabled)
+     *  @return int32_t
+     */
+    int32_t busypoll() const { return _busypoll; }
+
+    /**
+     *  Spin on the sockets of all nameservers for a given budget: the
+     *  sockets are polled directly, and a response that arrives during
+     *  the spin is processed immediately instead of waiting for the
+     *  readiness callback of the event loop (which costs a wakeup). To
+     *  be called from the loop thread, typically right after submitting
+     *  a latency-critical lookup; when nothing arrives within the budget
+     *  the caller simply falls back to the event loop
+     *  @param  budget      how long to spin (in seconds)
+     *  @return bool        was a datagram received and processed?
+     */
+    bool spin(double budget);
+
+    /**
+     *  Number of UDP sockets that each nameserver opens
+     *  @return size_t
+     */
+    size_t sockets() const { return _sockets; }
+
+    /**
+     *  Max number of responses that a nameserver buffers
+     *  @return size_t
+     */
+    size_t backlog() const { return _backlog; }
+
+    /**
+     *  Rate limit per nameserver in queries per second (0.0 = unlimited)
+     *  @return double
+     */
+    double rate() const { return _rate; }
+
+    /**
+     *  Number of queries that may be sent back-to-back
+     *  @return double
+     */
+    double burst() const { return _burst; }
+
     /**
      *  The period between sending the datagram again
      *  @return double
      */
     double interval() const { return _interval; }
+
+    /**
+     *  The delay before the query is hedged to the next nameserver
+     *  (0.0 means that hedging is disabled)
+     *  @return double
+     */
+    double hedge() const { return _hedge; }
     
     /**
      *  The time to wait for a response
@@ -258,6 +653,75 @@ public:
      */
     bool rotate() const { return _rotate; }
 
+    /**
+     *  The search domains that are appended to short hostnames
+     *  @return std::vector<std::string>
+     */
+    const std::vector<std::string> &searchpaths() const { return _searchpaths; }
+
+    /**
+     *  Names with at least this many dots bypass the search domains
+     *  @return size_t
+     */
+    size_t ndots() const { return _ndots; }
+
+    /**
+     *  Should the best-scoring nameserver get the first attempt?
+     *  @return bool
+     */
+    bool weighted() const { return _weighted; }
+
+    /**
+     *  Should the case of query-names be randomized (dns 0x20 encoding)?
+     *  @return bool
+     */
+    bool dns0x20() const { return _dns0x20; }
+
+    /**
+     *  The port to which queries are sent
+     *  @return uint16_t
+     */
+    uint16_t dnsport() const { return _dnsport; }
+
+    /**
+     *  Grace period during which idle nameserver sockets stay open
+     *  @return double
+     */
+    double keepwarm() const { return _keepwarm; }
+
+    /**
+     *  Threshold of the slow-lookup log (0.0 when only timeouts are logged)
+     *  @return double
+     */
+    double slow() const { return _slow; }
+
+    /**
+     *  Report a slow or timed-out lookup to the hook (a no-op when no
+     *  hook is installed)
+     *  @param  domain      the domain that was looked up
+     *  @param  type        record-type of the lookup
+     *  @param  nameserver  server of the latest attempt (or nullptr)
+     *  @param  attempts    number of datagrams that were sent
+     *  @param  elapsed     time since the lookup started in seconds
+     */
+    void slowlog(const char *domain, int type, const Ip *nameserver, size_t attempts, double elapsed)
+    {
+        // pass on to the hook, if one is installed
+        if (_slowlog) _slowlog(domain, type, nameserver, attempts, elapsed);
+    }
+
+    /**
+     *  Are expired cache entries served while a background lookup refreshes them?
+     *  @return bool
+     */
+    bool servestale() const { return _servestale; }
+
+    /**
+     *  Should connections to nameservers use dns-over-tls?
+     *  @return bool
+     */
+    bool secure() const { return _secure; }
+
     /**
      *  Does a certain hostname exists in /etc/hosts? In that case a NXDOMAIN error should not be given
      *  @param  hostname        hostname to check
@@ -265,6 +729,103 @@ public:
      */
     bool exists(const char *hostname) const { return _hosts.lookup(hostname) != nullptr; }
 
+    /**
+     *  Expose the cache with previously received responses
+     *  @return Cache
+     */
+    Cache &cache() { return _cache; }
+
+    /**
+     *  Expose the optional shared memory cache (nullptr if not configured)
+     *  @return SharedCache
+     */
+    SharedCache *sharedcache() { return _sharedcache.get(); }
+
+    /**
+     *  Expose the pool of worker threads for expensive cryptographic
+     *  checks, lazily created on first use (nullptr when the number of
+     *  workers is configured to be zero)
+     *  @return Verifiers
+     */
+    Verifiers *verifiers();
+
+    /**
+     *  Store a response in the cache(s), so that identical queries that are
+     *  started in the near future can be answered from memory
+     *  @param  now         current time
+     *  @param  response    the received response
+     */
+    void store(double now, const Response &response);
+
+    /**
+     *  Pick up changes to the configuration files without disturbing the
+     *  operations that are currently running: new hosts-entries are merged
+     *  and nameservers are added/removed in place
+     *  @param  hosts       did /etc/hosts change?
+     *  @param  resolvconf  did /etc/resolv.conf change?
+     */
+    void reload(bool hosts, bool resolvconf);
+
+    /**
+     *  Register a remote lookup in the administration of in-flight lookups
+     *  (called by the RemoteLookup constructor)
+     *  @param  domain      the domain of the lookup
+     *  @param  type        type of records that are looked up
+     *  @param  lookup      the lookup that goes out on the wire
+     */
+    void enlist(const char *domain, uint16_t type, RemoteLookup *lookup);
+
+    /**
+     *  Remove a remote lookup from the administration of in-flight lookups
+     *  (called when the lookup completes, times out or is cancelled)
+     *  @param  domain      the domain of the lookup
+     *  @param  type        type of records that were looked up
+     *  @param  lookup      the lookup that is no longer in flight
+     */
+    void delist(const char *domain, uint16_t type, const RemoteLookup *lookup);
+
+    /**
+     *  Try to coalesce a new query onto an identical lookup that is already
+     *  in flight, this returns nullptr if there is no such lookup
+     *  @param  domain      the domain of the lookup
+     *  @param  type        type of records to look for
+     *  @param  bits        the bits to include in the request
+     *  @param  handler     user space object interested in the result
+     *  @return Operation
+     */
+    Operation *coalesce(const char *domain, uint16_t type, const Bits &bits, Handler *handler);
+
+    /**
+     *  Add a route: queries for the zone (and everything below it) are
+     *  only sent to the given nameserver, the method can be called multiple
+     *  times for the same zone to assign multiple nameservers to it
+     *  @param  zone        the zone for which a specific route applies
+     *  @param  nameserver  ip of a nameserver responsible for the zone
+     */
+    void route(const char *zone, const Ip &nameserver);
+
+    /**
+     *  Find the route that applies to a certain domain, using a longest
+     *  suffix match over the configured zones, this returns nullptr when
+     *  the domain should simply use all nameservers
+     *  @param  domain      the domain that is being looked up
+     *  @return std::vector the nameservers to use (or nullptr)
+     */
+    const std::vector<Ip> *route(const char *domain) const;
+
+    /**
+     *  Get the precompiled query for a domain/type/bits combination,
+     *  compiling and caching it on first use. The returned reference is
+     *  only valid until the next call (the caller is supposed to copy it
+     *  right away, which the template-based Operation constructor does)
+     *  @param  domain      the domain to look up
+     *  @param  type        record-type to look up
+     *  @param  bits        the bits to include in the query
+     *  @return Query       the precompiled query
+     *  @throws std::runtime_error
+     */
+    const Query &compile(const char *domain, ns_type type, const Bits &bits);
+
     /**
      *  Reschedule the timer
      *  @param  now         current time
@@ -280,6 +841,26 @@ public:
         // expose the member
         return _nameservers;
     }
+
+    /**
+     *  Snapshot the traffic statistics of all nameservers, one entry
+     *  per server with its ip and a copy of its counters
+     *  @return std::vector
+     */
+    std::vector<std::pair<Ip,Stats::Snapshot>> stats() const
+    {
+        // the snapshots to fill
+        std::vector<std::pair<Ip,Stats::Snapshot>> result;
+
+        // one entry per nameserver
+        result.reserve(_nameservers.size());
+
+        // copy the counters of each server
+        for (const auto &nameserver : _nameservers) result.emplace_back(nameserver.ip(), nameserver.stats().snapshot());
+
+        // expose the snapshots
+        return result;
+    }
 };
 
 /**
@@ -15,6 +15,11 @@
  */
 #pragma once
 
+/**
+ *  Dependencies
+ */
+#include "response.h"
+
 /**
  *  Begin of namespace
  */
@@ -54,7 +59,7 @@ public:
         _bytes(ns_name_uncompress(begin, end, data, _name, MAXDNAME))
     {
         // check for success
-        if (_bytes < 0) std::runtime_error("failed to decompress name");
+        if (_bytes < 0) throw std::runtime_error("failed to decompress name");
 
         // the ns_name_uncompress() method has special handling for the root-domain which we want to roll back
         if (_name[0] == '.') _name[0] = '\0';
@@ -63,13 +68,35 @@ public:
     /**
      *  Constructor
      *  You need to pass in the full response because the compression
-     *  algorithm could use pointers to other records inside the same message
+     *  algorithm could use pointers to other records inside the same message.
+     *  The response remembers earlier expansions, so when the same owner
+     *  name appears in many records (large rrsets) the compression
+     *  pointers are chased just once
      *  @param  response        the full response object
      *  @param  data            the data buffer
      *  @throws std::runtime_error
      */
-    Decompressed(const Response &response, const unsigned char *data) :
-        Decompressed(response.data(), response.end(), data) {}
+    Decompressed(const Response &response, const unsigned char *data)
+    {
+        // maybe this very name was already expanded for an earlier record
+        auto *cached = response.expansion(data, _bytes);
+
+        // when it was, a simple copy of the expanded name is sufficient
+        if (cached != nullptr) { strcpy(_name, cached); return; }
+
+        // chase the compression pointers
+        _bytes = ns_name_uncompress(response.data(), response.end(), data, _name, MAXDNAME);
+
+        // check for success (throwing here also makes sure that a failed
+        // expansion never ends up in the cache of the response)
+        if (_bytes < 0) throw std::runtime_error("failed to decompress name");
+
+        // the ns_name_uncompress() method has special handling for the root-domain which we want to roll back
+        if (_name[0] == '.') _name[0] = '\0';
+
+        // remember the expansion for subsequent records with the same owner
+        response.remember(data, _name, _bytes);
+    }
     
     /**
      *  Destructor
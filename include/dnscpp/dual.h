@@ -0,0 +1,254 @@
+/**
+ *  Dual.h
+ *
+ *  Combined dual-stack lookup: one operation that resolves both the A
+ *  and the AAAA records of a domain. The two questions are sent out
+ *  back-to-back and share one deadline, and userspace gets a single
+ *  combined callback instead of having to join two separate lookups.
+ *
+ *  In the optional early-delivery mode (happy-eyeballs style) the
+ *  result is already reported when the first address family answers,
+ *  and the lookup for the other family is cancelled.
+ *
+ *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include "handler.h"
+#include "operation.h"
+#include "response.h"
+#include <memory>
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Forward declarations
+ */
+class Context;
+
+/**
+ *  Class definition
+ */
+class Dual : private DNS::Handler
+{
+public:
+    /**
+     *  Interface to be implemented by the object that wants to be
+     *  notified about the combined result
+     */
+    class Handler
+    {
+    public:
+        /**
+         *  Called when the lookup is complete. Each response can be a
+         *  nullptr: when that address family failed, or (in early mode)
+         *  when the other family answered first
+         *  @param  operation   the reporting operation
+         *  @param  ipv4        the response with A records (or nullptr)
+         *  @param  ipv6        the response with AAAA records (or nullptr)
+         */
+        virtual void onResolved(const Dual *operation, const Response *ipv4, const Response *ipv6) = 0;
+
+        /**
+         *  Called when both address families failed
+         *  @param  operation   the reporting operation
+         *  @param  rcode       the rcode of the last failure
+         */
+        virtual void onFailure(const Dual *operation, int rcode) = 0;
+    };
+
+private:
+    /**
+     *  The userspace handler
+     *  @var Handler
+     */
+    Handler *_handler;
+
+    /**
+     *  The two underlying lookups (set to nullptr when one completes)
+     *  @var Operation
+     */
+    Operation *_ipv4 = nullptr;
+    Operation *_ipv6 = nullptr;
+
+    /**
+     *  The responses that came in so far
+     *  @var std::unique_ptr<Response>
+     */
+    std::unique_ptr<Response> _responses[2];
+
+    /**
+     *  Should the result be reported as soon as the first family
+     *  answers, instead of waiting for both?
+     *  @var bool
+     */
+    bool _early;
+
+    /**
+     *  The rcode of the most recent failure
+     *  @var int
+     */
+    int _rcode = 0;
+
+    /**
+     *  Is the operation complete (no more pending lookups)?
+     *  @return bool
+     */
+    bool complete() const { return _ipv4 == nullptr && _ipv6 == nullptr; }
+
+    /**
+     *  Report the result to userspace and destruct the operation
+     */
+    void report()
+    {
+        // did we collect at least one answer?
+        if (_responses[0] || _responses[1]) _handler->onResolved(this, _responses[0].get(), _responses[1].get());
+
+        // both families failed
+        else _handler->onFailure(this, _rcode);
+
+        // the operation is no longer needed
+        delete this;
+    }
+
+    /**
+     *  Mark one of the underlying lookups as finished
+     *  @param  operation   the lookup that finished
+     *  @return bool        was this indeed one of our pending lookups?
+     */
+    bool finish(const Operation *operation)
+    {
+        // forget the lookup that just completed
+        if (operation == _ipv4) { _ipv4 = nullptr; return true; }
+        if (operation == _ipv6) { _ipv6 = nullptr; return true; }
+
+        // a lookup that we already gave up on (this happens for the
+        // onCancelled() call that follows our own call to cancel())
+        return false;
+    }
+
+    /**
+     *  Called when one of the lookups succeeded
+     *  @param  operation   the lookup that finished
+     *  @param  response    the received response
+     */
+    virtual void onResolved(const Operation *operation, const Response &response) override
+    {
+        // the slot for this address family
+        size_t slot = operation == _ipv4 ? 0 : 1;
+
+        // forget the lookup (leap out for lookups we already gave up on)
+        if (!finish(operation)) return;
+
+        // remember the response for the family that answered
+        _responses[slot].reset(new Response(response));
+
+        // in early mode the first answer concludes the operation, the
+        // lookup for the other family is no longer interesting
+        if (_early && !complete())
+        {
+            // the lookup that is still pending
+            auto *other = _ipv4 ? _ipv4 : _ipv6;
+
+            // forget it first, so that the synchronous onCancelled()
+            // callback does not try to report or destruct
+            _ipv4 = _ipv6 = nullptr;
+
+            // cancel it
+            other->cancel();
+        }
+
+        // report when there is nothing left to wait for
+        if (complete()) report();
+    }
+
+    /**
+     *  Called when one of the lookups failed
+     *  @param  operation   the lookup that finished
+     *  @param  rcode       the received rcode
+     */
+    virtual void onFailure(const Operation *operation, int rcode) override
+    {
+        // forget the lookup (leap out for lookups we already gave up on)
+        if (!finish(operation)) return;
+
+        // remember the failure
+        _rcode = rcode;
+
+        // report when the other family is also done
+        if (complete()) report();
+    }
+
+    /**
+     *  Called when one of the lookups was cancelled
+     *  @param  operation   the lookup that was cancelled
+     */
+    virtual void onCancelled(const Operation *operation) override
+    {
+        // forget the lookup (leap out for lookups we already gave up on)
+        if (!finish(operation)) return;
+
+        // report when there is nothing left to wait for
+        if (complete()) report();
+    }
+
+    /**
+     *  Private destructor, the object destructs itself after the result
+     *  has been reported to userspace
+     */
+    virtual ~Dual() = default;
+
+public:
+    /**
+     *  Constructor
+     *  You normally do not construct this yourself, but use Context::dual()
+     *  @param  context     the context that performs the lookups
+     *  @param  domain      the domain to resolve
+     *  @param  bits        bits to include in the queries
+     *  @param  handler     object notified about the combined result
+     *  @param  early       report as soon as the first family answers?
+     *  @throws std::runtime_error
+     */
+    Dual(Context *context, const char *domain, const Bits &bits, Handler *handler, bool early);
+
+    /**
+     *  No copying
+     *  @param  that
+     */
+    Dual(const Dual &that) = delete;
+
+    /**
+     *  Cancel the operation, both underlying lookups are cancelled and
+     *  no further calls to the handler are made
+     */
+    void cancel()
+    {
+        // forget the pending lookups first, so that the synchronous
+        // onCancelled() callbacks are ignored and nothing is reported
+        auto *ipv4 = _ipv4; _ipv4 = nullptr;
+        auto *ipv6 = _ipv6; _ipv6 = nullptr;
+
+        // cancel what was still pending
+        if (ipv4) ipv4->cancel();
+        if (ipv6) ipv6->cancel();
+
+        // the object is no longer needed
+        delete this;
+    }
+};
+
+/**
+ *  End of namespace
+ */
+}
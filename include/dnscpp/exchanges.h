@@ -0,0 +1,409 @@
+/**
+ *  Exchanges.h
+ *
+ *  Composite operation that resolves the mail exchanges of a domain:
+ *  first the MX records, and the moment the MX answer arrives the A
+ *  and AAAA lookups for all exchanges are fanned out in one batch
+ *  (via query_many(), so the address queries leave in a single burst
+ *  and share the nameserver sockets). Userspace gets one combined
+ *  callback with the exchanges sorted by MX preference, each with the
+ *  addresses that were found, instead of having to orchestrate 2-5
+ *  dependent round trips in application callbacks.
+ *
+ *  A domain without MX records gets the implicit mx of rfc 5321: the
+ *  domain itself, with preference 0. A domain with a null mx
+ *  (rfc 7505, a single "." exchange) reports an empty list.
+ *
+ *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include "handler.h"
+#include "operation.h"
+#include "response.h"
+#include "record.h"
+#include "type.h"
+#include "mx.h"
+#include "a.h"
+#include "aaaa.h"
+#include "ip.h"
+#include "bits.h"
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Forward declarations
+ */
+class Context;
+
+/**
+ *  Class definition
+ */
+class Exchanges : private DNS::Handler
+{
+public:
+    /**
+     *  One mail exchange with the addresses that were found for it
+     */
+    struct Exchange
+    {
+        /**
+         *  The hostname of the exchange
+         *  @var std::string
+         */
+        std::string hostname;
+
+        /**
+         *  The MX preference (lower is more preferred)
+         *  @var uint16_t
+         */
+        uint16_t priority;
+
+        /**
+         *  The addresses of the exchange (A and AAAA combined, empty
+         *  when the address lookups failed)
+         *  @var std::vector<Ip>
+         */
+        std::vector<Ip> addresses;
+    };
+
+    /**
+     *  Interface to be implemented by the object that wants to be
+     *  notified about the combined result
+     */
+    class Handler
+    {
+    public:
+        /**
+         *  Called when the operation is complete. The exchanges are
+         *  sorted by preference; an empty list means the domain
+         *  published a null mx and does not accept mail
+         *  @param  operation   the reporting operation
+         *  @param  exchanges   the exchanges with their addresses
+         */
+        virtual void onResolved(const Exchanges *operation, const std::vector<Exchange> &exchanges) = 0;
+
+        /**
+         *  Called when the operation failed (the MX lookup failed, or
+         *  no exchange resolved to a single address)
+         *  @param  operation   the reporting operation
+         *  @param  rcode       the rcode of the last failure
+         */
+        virtual void onFailure(const Exchanges *operation, int rcode) = 0;
+    };
+
+private:
+    /**
+     *  The context, needed for the address fan-out of the second phase
+     *  @var Context
+     */
+    Context *_context;
+
+    /**
+     *  The userspace handler
+     *  @var Handler
+     */
+    Handler *_handler;
+
+    /**
+     *  The domain whose mail exchanges are resolved (also the implicit
+     *  mx when the domain publishes no MX records)
+     *  @var std::string
+     */
+    std::string _domain;
+
+    /**
+     *  The bits to include in all queries
+     *  @var Bits
+     */
+    Bits _bits;
+
+    /**
+     *  The MX lookup of the first phase (nullptr once it completed)
+     *  @var Operation
+     */
+    Operation *_mx = nullptr;
+
+    /**
+     *  The combined result that is being assembled
+     *  @var std::vector<Exchange>
+     */
+    std::vector<Exchange> _exchanges;
+
+    /**
+     *  The address lookups of the second phase that are still pending,
+     *  mapped to the index of the exchange they belong to
+     *  @var std::map
+     */
+    std::map<const Operation*,size_t> _pending;
+
+    /**
+     *  The rcode of the most recent failure
+     *  @var int
+     */
+    int _rcode = 0;
+
+    /**
+     *  Did at least one exchange resolve to an address?
+     *  @var bool
+     */
+    bool _found = false;
+
+    /**
+     *  Was the MX answer a null mx (the domain refuses mail)?
+     *  @var bool
+     */
+    bool _nullmx = false;
+
+    /**
+     *  Report the result to userspace and destruct the operation
+     */
+    void report()
+    {
+        // success when an address was found, or when the domain
+        // explicitly refuses mail (an empty list is the answer then)
+        if (_found || _nullmx) _handler->onResolved(this, _exchanges);
+
+        // nothing resolved
+        else _handler->onFailure(this, _rcode);
+
+        // the operation is no longer needed
+        delete this;
+    }
+
+    /**
+     *  Start the address lookups for all exchanges (the second phase),
+     *  implemented in the cpp file because it needs the context
+     */
+    void fanout();
+
+    /**
+     *  Process the answer of the MX lookup of the first phase
+     *  @param  response    the received response
+     */
+    void exchanges(const Response &response)
+    {
+        // walk over the answer section
+        for (size_t i = 0; i < response.answers(); ++i)
+        {
+            // prevent exceptions (a malformed record could fail to parse)
+            try
+            {
+                // the next answer record
+                Record record(response, ns_s_an, i);
+
+                // we are only interested in the MX records (the answer
+                // may also hold the cname chain towards them)
+                if (record.type() != TYPE_MX) continue;
+
+                // extract preference and hostname
+                MX mx(response, record);
+
+                // a null mx (single "." exchange) means the domain
+                // refuses mail, rfc 7505
+                if (strcmp(mx.hostname(), ".") == 0) { _nullmx = true; continue; }
+
+                // remember the exchange
+                _exchanges.push_back(Exchange{ mx.hostname(), mx.priority(), {} });
+            }
+            catch (...)
+            {
+                // a malformed record is skipped
+            }
+        }
+
+        // a domain without MX records gets the implicit mx: the domain
+        // itself with preference 0 (rfc 5321), unless it refuses mail
+        if (_exchanges.empty() && !_nullmx) _exchanges.push_back(Exchange{ _domain, 0, {} });
+
+        // sort by preference (stable, so equal preferences keep the
+        // order in which the nameserver supplied them)
+        std::stable_sort(_exchanges.begin(), _exchanges.end(), [](const Exchange &a, const Exchange &b) {
+            return a.priority < b.priority;
+        });
+
+        // fan out the address lookups, or report right away for a null mx
+        if (_exchanges.empty()) report();
+        else fanout();
+    }
+
+    /**
+     *  Process the answer of one of the address lookups
+     *  @param  slot        the exchange the lookup belongs to
+     *  @param  response    the received response
+     */
+    void addresses(size_t slot, const Response &response)
+    {
+        // walk over the answer section
+        for (size_t i = 0; i < response.answers(); ++i)
+        {
+            // prevent exceptions (a malformed record could fail to parse)
+            try
+            {
+                // the next answer record
+                Record record(response, ns_s_an, i);
+
+                // collect the addresses of both families
+                if (record.type() == TYPE_A) _exchanges[slot].addresses.push_back(A(response, record).ip());
+                if (record.type() == TYPE_AAAA) _exchanges[slot].addresses.push_back(AAAA(response, record).ip());
+
+                // at least one exchange has an address now
+                if (record.type() == TYPE_A || record.type() == TYPE_AAAA) _found = true;
+            }
+            catch (...)
+            {
+                // a malformed record is skipped
+            }
+        }
+    }
+
+    /**
+     *  Mark one of the pending lookups as finished
+     *  @param  operation   the lookup that finished
+     *  @param  slot        output: the exchange it belongs to
+     *  @return bool        was this indeed one of our pending lookups?
+     */
+    bool finish(const Operation *operation, size_t &slot)
+    {
+        // look it up
+        auto iter = _pending.find(operation);
+
+        // a lookup that we already gave up on (this happens for the
+        // onCancelled() call that follows our own call to cancel())
+        if (iter == _pending.end()) return false;
+
+        // the exchange it belongs to
+        slot = iter->second;
+
+        // forget the lookup
+        _pending.erase(iter);
+
+        // it was ours
+        return true;
+    }
+
+    /**
+     *  Called when one of the lookups succeeded
+     *  @param  operation   the lookup that finished
+     *  @param  response    the received response
+     */
+    virtual void onResolved(const Operation *operation, const Response &response) override
+    {
+        // the answer of the first phase starts the fan-out
+        if (operation == _mx) { _mx = nullptr; return exchanges(response); }
+
+        // one of the address lookups (leap out for lookups we already
+        // gave up on)
+        size_t slot;
+        if (!finish(operation, slot)) return;
+
+        // collect the addresses
+        addresses(slot, response);
+
+        // report when there is nothing left to wait for
+        if (_pending.empty()) report();
+    }
+
+    /**
+     *  Called when one of the lookups failed
+     *  @param  operation   the lookup that finished
+     *  @param  rcode       the received rcode
+     */
+    virtual void onFailure(const Operation *operation, int rcode) override
+    {
+        // a failing MX lookup fails the whole operation
+        if (operation == _mx) { _mx = nullptr; _rcode = rcode; return report(); }
+
+        // one of the address lookups (leap out for lookups we already
+        // gave up on)
+        size_t slot;
+        if (!finish(operation, slot)) return;
+
+        // remember the failure, the exchange simply keeps no addresses
+        _rcode = rcode;
+
+        // report when there is nothing left to wait for
+        if (_pending.empty()) report();
+    }
+
+    /**
+     *  Called when one of the lookups was cancelled
+     *  @param  operation   the lookup that was cancelled
+     */
+    virtual void onCancelled(const Operation *operation) override
+    {
+        // the MX lookup was cancelled behind our back
+        if (operation == _mx) { _mx = nullptr; return report(); }
+
+        // one of the address lookups (leap out for lookups we already
+        // gave up on)
+        size_t slot;
+        if (!finish(operation, slot)) return;
+
+        // report when there is nothing left to wait for
+        if (_pending.empty()) report();
+    }
+
+    /**
+     *  Private destructor, the object destructs itself after the result
+     *  has been reported to userspace
+     */
+    virtual ~Exchanges() = default;
+
+public:
+    /**
+     *  Constructor
+     *  You normally do not construct this yourself, but use Context::exchanges()
+     *  @param  context     the context that performs the lookups
+     *  @param  domain      the domain whose mail exchanges are resolved
+     *  @param  bits        bits to include in the queries
+     *  @param  handler     object notified about the combined result
+     *  @throws std::runtime_error
+     */
+    Exchanges(Context *context, const char *domain, const Bits &bits, Handler *handler);
+
+    /**
+     *  No copying
+     *  @param  that
+     */
+    Exchanges(const Exchanges &that) = delete;
+
+    /**
+     *  Cancel the operation, all underlying lookups are cancelled and
+     *  no further calls to the handler are made
+     */
+    void cancel()
+    {
+        // forget the pending lookups first, so that the synchronous
+        // onCancelled() callbacks are ignored and nothing is reported
+        auto *mx = _mx; _mx = nullptr;
+        auto pending = std::move(_pending); _pending.clear();
+
+        // cancel what was still pending
+        if (mx) mx->cancel();
+        for (auto &lookup : pending) const_cast<Operation*>(lookup.first)->cancel();
+
+        // the object is no longer needed
+        delete this;
+    }
+};
+
+/**
+ *  End of namespace
+ */
+}
@@ -18,6 +18,12 @@
  */
 #pragma once
 
+/**
+ *  Dependencies
+ */
+#include "bignum.h"
+#include "sha.h"
+
 /**
  *  Begin of namespace
  */
@@ -18,6 +18,8 @@
  */
 #include <map>
 #include <list>
+#include <vector>
+#include <string>
 
 /**
  *  Begin of namespace
@@ -38,37 +40,70 @@ class Hosts
 {
 private:
     /**
-     *  Custom comparison object used by the map
+     *  All the hostnames found
+     *  @var std::list
      */
-    struct HostnameCompare
-    {
-        /**
-         *  The actual comparison function
-         *  @param  hostname1
-         *  @param  hostname2
-         *  @return bool
-         */
-        bool operator()(const char *hostname1, const char *hostname2) const { return strcasecmp(hostname1, hostname2) < 0; }
-    };
+    std::list<std::string> _hostnames;
 
     /**
-     *  All the hostnames found
+     *  All the IP addresses found (a list because elements should keep
+     *  their address when entries are added and removed at runtime)
      *  @var std::list
      */
-    std::list<std::string> _hostnames;
+    std::list<Ip> _ips;
 
     /**
-     *  Map of hostnames to IP addresses
-     *  @var std::multimap
+     *  Index of hostnames to IP addresses. This is an open-addressing
+     *  (linear probing) hash table because the lookup is on the hot path
+     *  of every query: empty slots hold a nullptr hostname, a hostname
+     *  with multiple addresses occupies multiple slots
+     *  @var std::vector
      */
-    std::multimap<const char *,Ip,HostnameCompare> _host2ip;
-    
+    std::vector<std::pair<const char *,const Ip *>> _host2ip;
+
+    /**
+     *  Number of slots in use in the hash table
+     *  @var size_t
+     */
+    size_t _entries = 0;
+
     /**
      *  Map the other way around, from IP to hostname
      *  @var std::multimap
      */
     std::multimap<Ip,const char *> _ip2host;
 
+    /**
+     *  Make sure the hash table has room for a number of extra entries
+     *  @param  count       expected number of extra entries
+     */
+    void reserve(size_t count);
+
+    /**
+     *  Insert one hostname-to-ip combination into the hash table
+     *  @param  hostname    the hostname (must be in stable storage)
+     *  @param  ip          the ip (must be in stable storage)
+     */
+    void insert(const char *hostname, const Ip *ip);
+
+    /**
+     *  Check if a certain hostname-to-ip combination is already indexed,
+     *  which happens all the time when a file is reloaded
+     *  @param  hostname    the hostname
+     *  @param  ip          the ip
+     *  @return bool
+     */
+    bool contains(const char *hostname, const Ip &ip) const;
+
+    /**
+     *  Remove entries from the index (the workhorse behind the public
+     *  remove() methods): all entries for a hostname, or just a single
+     *  hostname-to-ip combination
+     *  @param  hostname    the hostname to remove
+     *  @param  ip          the specific address to remove (nullptr for all)
+     *  @return bool        was anything removed?
+     */
+    bool purge(const char *hostname, const Ip *ip);
 
     /**
      *  Parse a line from the file
@@ -110,7 +145,44 @@ public:
      *  @return bool
      */
     bool load(const char *filename = "/etc/hosts");
-    
+
+    /**
+     *  Add a single hostname-to-ip combination at runtime. Other entries
+     *  for the same hostname are kept, so a hostname can be given multiple
+     *  addresses with repeated calls. This is safe to call while lookups
+     *  are in progress: entries that are already indexed keep their address
+     *  in memory, so pending local lookups are not disturbed
+     *  @param  hostname    the hostname
+     *  @param  ip          the address to associate with the hostname
+     *  @return bool        was the entry added (false if it already existed)?
+     */
+    bool add(const char *hostname, const Ip &ip);
+
+    /**
+     *  Remove all entries for a certain hostname at runtime
+     *  @param  hostname    the hostname to remove
+     *  @return bool        was anything removed?
+     */
+    bool remove(const char *hostname);
+
+    /**
+     *  Remove a single hostname-to-ip combination at runtime
+     *  @param  hostname    the hostname
+     *  @param  ip          the specific address to remove
+     *  @return bool        was the entry removed?
+     */
+    bool remove(const char *hostname, const Ip &ip);
+
+    /**
+     *  Replace all entries for a hostname with a single new address, the
+     *  typical operation for pushing an endpoint override at runtime
+     *  @param  hostname    the hostname
+     *  @param  ip          the new (only) address for the hostname
+     *  @return bool        was the entry installed?
+     */
+    bool replace(const char *hostname, const Ip &ip);
+
+
     /**
      *  Lookup an IP address given a hostname
      *  This method returns nullptr if there is no match
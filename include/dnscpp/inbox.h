@@ -0,0 +1,178 @@
+/**
+ *  Inbox.h
+ *
+ *  A DNS::Context is single threaded: all methods must be called from
+ *  the thread that runs the event loop. Applications with multiple
+ *  producer threads can use this inbox to submit lookups from any
+ *  thread: submissions are pushed onto a lock-free multi-producer
+ *  queue, and the loop thread is woken up via an eventfd to drain the
+ *  queue and start the actual lookups.
+ *
+ *  Note that the completion callbacks still run on the loop thread
+ *  (the library is loop-agnostic and has no view of the event loops
+ *  of the producer threads), so handlers that touch producer-owned
+ *  state must marshal the result back themselves.
+ *
+ *  The inbox itself must be constructed and destructed on the loop
+ *  thread, just like the context that it feeds.
+ *
+ *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include "monitor.h"
+#include "bits.h"
+#include <atomic>
+#include <string>
+#include <arpa/nameser.h>
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Forward declarations
+ */
+class Context;
+class Handler;
+
+/**
+ *  Class definition
+ */
+class Inbox : private Monitor
+{
+private:
+    /**
+     *  One submitted lookup, the nodes form an intrusive linked list so
+     *  that pushing needs no allocation besides the node itself
+     */
+    struct Submission
+    {
+        /**
+         *  The domain to look up
+         *  @var std::string
+         */
+        std::string domain;
+
+        /**
+         *  The type of records to look for
+         *  @var ns_type
+         */
+        ns_type type;
+
+        /**
+         *  The bits to include in the query
+         *  @var Bits
+         */
+        Bits bits;
+
+        /**
+         *  The user space handler that wants the result
+         *  @var Handler
+         */
+        Handler *handler;
+
+        /**
+         *  Pointer to the next (earlier) submission in the stack
+         *  @var Submission
+         */
+        Submission *next = nullptr;
+
+        /**
+         *  Constructor
+         *  @param  domain      the domain to look up
+         *  @param  type        type of records to look for
+         *  @param  bits        the bits to include
+         *  @param  handler     user space handler
+         */
+        Submission(const char *domain, ns_type type, const Bits &bits, Handler *handler) :
+            domain(domain), type(type), bits(bits), handler(handler) {}
+    };
+
+    /**
+     *  The context that runs the lookups (on the loop thread)
+     *  @var Context
+     */
+    Context *_context;
+
+    /**
+     *  Head of the lock-free stack of pending submissions, producers push
+     *  with a compare-and-swap, the loop thread takes the whole stack at
+     *  once with an exchange
+     *  @var std::atomic
+     */
+    std::atomic<Submission*> _submissions;
+
+    /**
+     *  The eventfd with which producers wake up the loop thread
+     *  @var int
+     */
+    int _fd;
+
+    /**
+     *  Identifier of our registration in the event loop
+     *  @var void*
+     */
+    void *_identifier;
+
+    /**
+     *  Method that is called by the event loop when the eventfd becomes
+     *  readable, this runs on the loop thread and drains the queue
+     */
+    virtual void notify() override;
+
+public:
+    /**
+     *  Constructor, must be called on the loop thread
+     *  @param  context     the context that will run the lookups
+     *  @throws std::runtime_error
+     */
+    Inbox(Context *context);
+
+    /**
+     *  No copying
+     *  @param  that        other inbox
+     */
+    Inbox(const Inbox &that) = delete;
+
+    /**
+     *  Destructor, must be called on the loop thread, submissions that
+     *  were not yet drained are discarded without calling their handlers
+     */
+    virtual ~Inbox();
+
+    /**
+     *  Submit a lookup, this is the only method that may be called from
+     *  any thread. Because the lookup has not started yet, no operation
+     *  is exposed: cross-thread submissions cannot be cancelled
+     *  @param  domain      the domain to look up
+     *  @param  type        type of records to look for
+     *  @param  bits        the bits to include in the query
+     *  @param  handler     handler that is notified on the loop thread
+     *  @return bool        was the submission accepted?
+     */
+    bool publish(const char *domain, ns_type type, const Bits &bits, Handler *handler);
+
+    /**
+     *  Submit a lookup with the default bits
+     *  @param  domain      the domain to look up
+     *  @param  type        type of records to look for
+     *  @param  handler     handler that is notified on the loop thread
+     *  @return bool        was the submission accepted?
+     */
+    bool publish(const char *domain, ns_type type, Handler *handler);
+};
+
+/**
+ *  End of namespace
+ */
+}
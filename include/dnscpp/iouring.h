@@ -0,0 +1,417 @@
+/**
+ *  IoUring.h
+ *
+ *  Example eventloop implementation on top of io_uring. Unlike a classic
+ *  readiness-based loop (like the one in libev.h) the kernel is asked to
+ *  report completions: readiness of the dns sockets is polled with
+ *  multishot poll operations and timers are ordinary timeout operations,
+ *  so that an idle loop makes no system calls at all and an active loop
+ *  picks up many events per io_uring_submit_and_wait() call.
+ *
+ *  This is optional example code: it is not compiled into the library.
+ *  To use it you should include <liburing.h> before this header and link
+ *  your application with liburing (kernel 5.13 or newer is required for
+ *  the multishot poll operations).
+ *
+ *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Incude guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include "monitor.h"
+#include "timer.h"
+#include "loop.h"
+#include <poll.h>
+#include <stdlib.h>
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Class definition
+ */
+class IoUring : public Loop
+{
+private:
+    /**
+     *  Internal structure that is associated with every operation that is
+     *  handed to the kernel, the address doubles as the user-data of the
+     *  submission so that completions can be routed back
+     */
+    struct Entry
+    {
+        /**
+         *  Type of the entry (1 = filedescriptor watcher, 2 = timer)
+         *  @var int
+         */
+        int type;
+
+        /**
+         *  The monitored filedescriptor (only for watchers)
+         *  @var int
+         */
+        int fd;
+
+        /**
+         *  The monitored events (1 = readability, 2 = writability)
+         *  @var int
+         */
+        int events;
+
+        /**
+         *  The object that should be notified (a Monitor for watchers,
+         *  a Timer for timers)
+         *  @var void *
+         */
+        void *object;
+
+        /**
+         *  Is the entry still active? Cancelled entries are kept around
+         *  until the kernel has no more completions referring to them
+         *  @var bool
+         */
+        bool active;
+
+        /**
+         *  Number of operations inside the kernel that still refer to
+         *  this entry, the entry may only be freed when this drops to zero
+         *  @var int
+         */
+        int pending;
+
+        /**
+         *  The expiration-timespec (only for timers, the submission keeps
+         *  a pointer to this so it must stay alive)
+         *  @var __kernel_timespec
+         */
+        struct __kernel_timespec spec;
+    };
+
+    /**
+     *  The actual io_uring instance
+     *  @var io_uring
+     */
+    struct io_uring *_ring;
+
+    /**
+     *  Is the loop supposed to stop?
+     *  @var bool
+     */
+    bool _stop = false;
+
+    /**
+     *  Helper method to turn our event-bitmask into a poll()-mask
+     *  @param  events      the events to monitor (1 = readability, 2 = writability)
+     *  @return unsigned    mask in poll() conventions
+     */
+    static unsigned mask(int events)
+    {
+        // result variable
+        unsigned result = 0;
+
+        // check both bits
+        if (events & 1) result |= POLLIN;
+        if (events & 2) result |= POLLOUT;
+
+        // done
+        return result;
+    }
+
+    /**
+     *  Arm (or re-arm) the multishot poll operation for a watcher
+     *  @param  entry       the watcher to arm
+     */
+    void arm(Entry *entry)
+    {
+        // get room for a submission
+        auto *sqe = io_uring_get_sqe(_ring);
+
+        // when the submission queue is completely full we flush it first
+        if (sqe == nullptr) { io_uring_submit(_ring); sqe = io_uring_get_sqe(_ring); }
+
+        // prepare a multishot poll, so that one submission keeps reporting
+        // readiness over and over without being re-armed for every event
+        io_uring_prep_poll_multishot(sqe, entry->fd, mask(entry->events));
+
+        // associate the entry with the operation
+        io_uring_sqe_set_data(sqe, entry);
+
+        // one more operation refers to the entry
+        entry->pending += 1;
+    }
+
+    /**
+     *  Ask the kernel to cancel all operations that refer to an entry
+     *  @param  entry       the entry that is being cancelled
+     */
+    void cancel(Entry *entry)
+    {
+        // get room for a submission
+        auto *sqe = io_uring_get_sqe(_ring);
+
+        // when the submission queue is completely full we flush it first
+        if (sqe == nullptr) { io_uring_submit(_ring); sqe = io_uring_get_sqe(_ring); }
+
+        // prepare the cancelation
+        io_uring_prep_cancel(sqe, entry, 0);
+
+        // the completion of the cancelation itself is not interesting
+        io_uring_sqe_set_data(sqe, nullptr);
+    }
+
+    /**
+     *  Process one completion
+     *  @param  cqe         the completion queue entry
+     */
+    void process(struct io_uring_cqe *cqe)
+    {
+        // get the associated entry (cancelations have no entry)
+        auto *entry = (Entry *)io_uring_cqe_get_data(cqe);
+
+        // nothing to do for completions of cancel-operations
+        if (entry == nullptr) return;
+
+        // if the kernel will not send more completions for this operation
+        // the entry has one pending operation less
+        if (!(cqe->flags & IORING_CQE_F_MORE)) entry->pending -= 1;
+
+        // cancelled entries can be freed once the kernel is done with them
+        if (!entry->active)
+        {
+            // free the entry when nothing refers to it any more
+            if (entry->pending == 0) free(entry);
+
+            // done
+            return;
+        }
+
+        // watchers notify their monitor, timers expire
+        if (entry->type == 1)
+        {
+            // a multishot poll sometimes ends (for example when the ring
+            // was full), in that case it has to be re-armed
+            if (!(cqe->flags & IORING_CQE_F_MORE)) arm(entry);
+
+            // notify the monitor
+            ((Monitor *)entry->object)->notify();
+        }
+        else
+        {
+            // the timeout has completed, nothing refers to the entry now
+            entry->active = false;
+
+            // notify the timer
+            ((Timer *)entry->object)->expire();
+
+            // the timer-object is freed via the Loop::cancel() method that
+            // the library calls in response to the expire()
+        }
+    }
+
+public:
+    /**
+     *  Constructor
+     *  @param  ring        the (already initialized) io_uring instance to use
+     */
+    IoUring(struct io_uring *ring) : _ring(ring) {}
+
+    /**
+     *  No copying
+     *  @param  that
+     */
+    IoUring(const IoUring &that) = delete;
+
+    /**
+     *  Destructor
+     */
+    virtual ~IoUring() = default;
+
+    /**
+     *  Run one iteration of the event loop: hand all collected submissions
+     *  to the kernel with a single system call, wait for at least one
+     *  completion, and dispatch the whole batch of completions
+     *  @return bool        false when the loop was asked to stop
+     */
+    bool step()
+    {
+        // submit everything that is queued and wait for at least one completion
+        io_uring_submit_and_wait(_ring, 1);
+
+        // iterator state for the batch of completions
+        struct io_uring_cqe *cqe; unsigned head; unsigned count = 0;
+
+        // walk over all completions that are available right now
+        io_uring_for_each_cqe(_ring, head, cqe)
+        {
+            // process this completion
+            process(cqe);
+
+            // one more completion was seen
+            count += 1;
+        }
+
+        // tell the kernel that the completions were consumed
+        io_uring_cq_advance(_ring, count);
+
+        // should we continue?
+        return !_stop;
+    }
+
+    /**
+     *  Run the event loop until stop() is called
+     */
+    void run()
+    {
+        // reset the stop-flag and keep stepping
+        _stop = false; while (step());
+    }
+
+    /**
+     *  Stop the event loop (the current iteration is finished first)
+     */
+    void stop()
+    {
+        // set the flag, step() picks it up
+        _stop = true;
+    }
+
+    /**
+     *  Add a filedescriptor to the event loop
+     *  @param  int     file-descriptor to be monitored
+     *  @param  int     the events to monitor (1 = readability, 2 = writability)
+     *  @param  Monitor object that should be notified when the filedescriptor becomes active
+     *  @return void*   identifier of the watcher in the event loop
+     */
+    virtual void *add(int fd, int events, Monitor *monitor) override
+    {
+        // construct the entry
+        auto *entry = (Entry *)calloc(1, sizeof(Entry));
+
+        // fill the properties
+        entry->type = 1;
+        entry->fd = fd;
+        entry->events = events;
+        entry->object = monitor;
+        entry->active = true;
+
+        // hand the poll operation to the kernel
+        arm(entry);
+
+        // expose the entry as identifier
+        return entry;
+    }
+
+    /**
+     *  Update the events for which a filedescriptor are monitored
+     *  @param  void*   the identifier returned by the previous call to add()
+     *  @param  int     file-descriptor for which the events are changed
+     *  @param  int     the new events to monitor (1 = readabilty, 2 = writability)
+     *  @param  Monitor object that should be notified when the filedescriptor becomes active
+     *  @return void*   identified of the watcher in the event loop
+     */
+    virtual void *update(void *identifier, int fd, int events, Monitor *monitor) override
+    {
+        // the old entry is cancelled, a new one is armed, that is simpler
+        // (and not slower) than patching the poll-mask of a live operation
+        remove(identifier, fd, monitor);
+
+        // register again with the new events
+        return add(fd, events, monitor);
+    }
+
+    /**
+     *  Remove a filedescriptor from the event loop
+     *  @param  void*   the identifier returned by the previous call to add()
+     *  @param  int     the file-descriptor to be removed
+     *  @param  Monitor the object that is no longer interested
+     */
+    virtual void remove(void *identifier, int fd, Monitor *monitor) override
+    {
+        // the identifier is an entry
+        auto *entry = (Entry *)identifier;
+
+        // mark as inactive, completions that are already underway are ignored
+        entry->active = false;
+
+        // ask the kernel to abort the poll operation (the entry itself is
+        // freed when the final completion comes in)
+        cancel(entry);
+
+        // if the kernel was already done with it we can free it right away
+        if (entry->pending == 0) free(entry);
+    }
+
+    /**
+     *  Set a timer
+     *  @param  timeout number of seconds after which the timer expires
+     *  @param  Timer   the object that should be notified when the timer expired
+     *  @return void*   identifier for the timer
+     */
+    virtual void *timer(double timeout, Timer *timer) override
+    {
+        // construct the entry
+        auto *entry = (Entry *)calloc(1, sizeof(Entry));
+
+        // fill the properties
+        entry->type = 2;
+        entry->object = timer;
+        entry->active = true;
+
+        // convert the timeout into a timespec
+        entry->spec.tv_sec = (long long)timeout;
+        entry->spec.tv_nsec = (long long)((timeout - (double)entry->spec.tv_sec) * 1000000000.0);
+
+        // get room for a submission
+        auto *sqe = io_uring_get_sqe(_ring);
+
+        // when the submission queue is completely full we flush it first
+        if (sqe == nullptr) { io_uring_submit(_ring); sqe = io_uring_get_sqe(_ring); }
+
+        // prepare the timeout operation
+        io_uring_prep_timeout(sqe, &entry->spec, 0, 0);
+
+        // associate the entry with the operation
+        io_uring_sqe_set_data(sqe, entry);
+
+        // one operation refers to the entry now
+        entry->pending = 1;
+
+        // expose the entry as identifier
+        return entry;
+    }
+
+    /**
+     *  Method that is called when a timer is cancelled. This is called when
+     *  the DNS library no longer needs to be notified.
+     *  @param  void*   identifier of the timer (returned by the timer() method)
+     *  @param  Timer   the object that is unregistered
+     */
+    virtual void cancel(void *identifier, Timer *timer) override
+    {
+        // the identifier is an entry
+        auto *entry = (Entry *)identifier;
+
+        // mark as inactive
+        entry->active = false;
+
+        // ask the kernel to abort the timeout operation
+        cancel(entry);
+
+        // if the kernel was already done with it we can free it right away
+        if (entry->pending == 0) free(entry);
+    }
+};
+
+/**
+ *  End of namespace
+ */
+}
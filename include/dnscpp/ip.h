@@ -58,7 +58,15 @@ private:
         struct in_addr  ipv4;
         struct in6_addr ipv6;
     } _data;
-    
+
+    /**
+     *  Wipe the full buffer, so that the twelve bytes that are not covered
+     *  by an ipv4 address are in a known (zero) state, this gives every
+     *  address a uniform 16-byte layout so that compare() and hash() can
+     *  process the buffer as a whole without looking at the version
+     */
+    void wipe() { memset(&_data, 0, sizeof(_data)); }
+
 public:
     /**
      *  Constructor for the default 0.0.0.0 address
@@ -83,6 +91,9 @@ public:
      */
     explicit Ip(const struct in_addr *ipv4) : _version(4)
     {
+        // start with an all-zero buffer (the bytes after the address take part in compare() and hash())
+        wipe();
+
         // copy data
         memcpy(&_data.ipv4, ipv4, sizeof(struct in_addr));
     }
@@ -185,24 +196,69 @@ public:
     {
         // identical objects
         if (this == &ip) return 0;
-    
+
         // ip versions should be identical (we consider ipv4 to be smaller than ipv6)
         if (_version != ip._version) return _version - ip._version;
-        
-        // compare data
-        switch (_version) {
-        case 4: return memcmp(&_data.ipv4, &ip._data.ipv4, sizeof(struct in_addr));
-        case 6: return memcmp(&_data.ipv6, &ip._data.ipv6, sizeof(struct in6_addr));
-        default:return 0;
-        }
+
+        // the buffer has a uniform 16-byte layout (ipv4 addresses are zero-padded),
+        // so one straight-line compare covers both versions, which the compiler can
+        // turn into a couple of wide register compares without any branching
+        return memcmp(&_data, &ip._data, sizeof(_data));
     }
-    
+
+    /**
+     *  Are two addresses identical? This is cheaper than compare() == 0
+     *  because no byte-order-sensitive three-way result is needed: the
+     *  buffers are simply loaded as two 64-bit words each and xor'ed.
+     *  This runs on every response-source validation, so it should be
+     *  as close to free as possible
+     *  @param  ip
+     *  @return bool
+     */
+    bool equals(const Ip &ip) const
+    {
+        // ip versions should be identical
+        if (_version != ip._version) return false;
+
+        // load both buffers as two 64-bit words (the memcpy's keep us clear
+        // of aliasing rules and compile down to plain register loads)
+        uint64_t mine[2]; uint64_t theirs[2];
+        memcpy(mine, &_data, sizeof(mine));
+        memcpy(theirs, &ip._data, sizeof(theirs));
+
+        // branchless comparison of all 128 bits
+        return ((mine[0] ^ theirs[0]) | (mine[1] ^ theirs[1])) == 0;
+    }
+
+    /**
+     *  Hash value of the address, so that Ip can be used as key in hash
+     *  tables (a std::hash specialization is supplied below), for per-ip
+     *  state like nameserver statistics or cookie caches
+     *  @return size_t
+     */
+    size_t hash() const
+    {
+        // load the uniform 16-byte buffer as two words
+        uint64_t words[2];
+        memcpy(words, &_data, sizeof(words));
+
+        // mix the two halves and the version (multiply by the golden-ratio
+        // constant and apply a splitmix-style finalizer so that addresses
+        // from one subnet do not all land in neighboring buckets)
+        uint64_t result = (words[0] ^ _version) * UINT64_C(0x9e3779b97f4a7c15);
+        result ^= words[1] + UINT64_C(0x9e3779b97f4a7c15) + (result << 6) + (result >> 2);
+        result ^= result >> 29; result *= UINT64_C(0xbf58476d1ce4e5b9); result ^= result >> 32;
+
+        // expose the result
+        return (size_t)result;
+    }
+
     /**
      *  Compare addresses
      *  @param  ip
      */
-    bool operator==(const Ip &ip) const { return compare(ip) == 0; }
-    bool operator!=(const Ip &ip) const { return compare(ip) != 0; }
+    bool operator==(const Ip &ip) const { return equals(ip); }
+    bool operator!=(const Ip &ip) const { return !equals(ip); }
     bool operator< (const Ip &ip) const { return compare(ip) <  0; }
     bool operator> (const Ip &ip) const { return compare(ip) >  0; }
     bool operator<=(const Ip &ip) const { return compare(ip) <= 0; }
@@ -253,10 +309,13 @@ public:
     {
         // change version
         _version = 4;
-        
+
+        // reset the buffer so that the padding bytes are zero again
+        wipe();
+
         // copy data
         memcpy(&_data.ipv4, ip, sizeof(struct in_addr));
-        
+
         // allow chaining
         return *this;
     }
@@ -372,6 +431,15 @@ public:
         return result &= that;
     }
     
+    /**
+     *  Format the address into a caller-supplied buffer, without making
+     *  any allocation (a buffer of INET6_ADDRSTRLEN bytes always fits)
+     *  @param  buffer      the buffer to write to (gets null-terminated)
+     *  @param  size        size of the buffer
+     *  @return size_t      length of the formatted text (0 if the buffer is too small)
+     */
+    size_t print(char *buffer, size_t size) const;
+
     /**
      *  Write to a stream
      *  @param  stream
@@ -380,8 +448,24 @@ public:
      */
     friend std::ostream &operator<<(std::ostream &stream, const Ip &ip);
 };
-    
+
 /**
  *  End of namespace
  */
 }
+
+/**
+ *  Specialization of std::hash, so that Ip can be used as key in the
+ *  unordered containers
+ */
+namespace std {
+template <> struct hash<DNS::Ip>
+{
+    /**
+     *  Calculate the hash value
+     *  @param  ip      the address to hash
+     *  @return size_t
+     */
+    size_t operator()(const DNS::Ip &ip) const { return ip.hash(); }
+};
+}
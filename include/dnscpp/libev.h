@@ -194,6 +194,33 @@ public:
         return watcher;
     }
     
+    /**
+     *  Re-arm a timer that was set earlier, the existing watcher object is
+     *  reused so that re-arming does not allocate
+     *  @param  void*   identifier of the timer (returned by the timer() method)
+     *  @param  timeout number of seconds after which the timer expires
+     *  @param  Timer   the object that should be notified when the timer expired
+     *  @return void*   the identifier for the timer
+     */
+    virtual void *update(void *identifier, double timeout, Timer *timer) override
+    {
+        // the identifier is a watcher
+        ev_timer *watcher = (ev_timer *)identifier;
+
+        // we update the timer too (in reality the timer object never changes)
+        watcher->data = timer;
+
+        // restart the watcher with the new timeout (ev_timer_again uses the
+        // repeat value, and works both on pending and on expired timers)
+        watcher->repeat = timeout;
+
+        // re-arm
+        ev_timer_again(_loop, watcher);
+
+        // the same watcher remains in use
+        return watcher;
+    }
+
     /**
      *  Method that is called when a timer is cancelled. This is called when
      *  the DNS library no longer needs to be notified.
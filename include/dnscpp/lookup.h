@@ -44,9 +44,17 @@ protected:
      *  @param  data        optional data (only for type = ns_o_notify)
      *  @throws std::runtime_error
      */
-    Lookup(Handler *handler, int op, const char *dname, int type, const Bits &bits, const unsigned char *data = nullptr) : 
+    Lookup(Handler *handler, int op, const char *dname, int type, const Bits &bits, const unsigned char *data = nullptr) :
         Operation(handler, op, dname, type, bits, data) {}
 
+    /**
+     *  Constructor that starts from a precompiled query template
+     *  @param  handler     user space handler
+     *  @param  query       the precompiled query
+     *  @param  dns0x20     randomize the case of the query-name too?
+     */
+    Lookup(Handler *handler, const Query &query, bool dns0x20 = false) : Operation(handler, query, dns0x20) {}
+
 public:
     /**
      *  Destructor
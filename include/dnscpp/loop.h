@@ -92,7 +92,30 @@ public:
      *  @return void*   identifier for the timer
      */
     virtual void *timer(double timeout, Timer *timer) = 0;
-    
+
+    /**
+     *  Re-arm a timer that was set earlier (and that may or may not have
+     *  expired in the meantime), so that it fires again after the given
+     *  timeout. Event loop implementations are encouraged to override this
+     *  with a cheap re-arm of the existing timer object (e.g. with
+     *  ev_timer_again): the library re-arms its scheduling timer on every
+     *  submission burst, so the default fallback of cancelling and setting
+     *  a fresh timer causes needless alloc/free churn
+     *  @param  void*   identifier of the timer (returned by the timer() method)
+     *  @param  timeout number of seconds after which the timer expires
+     *  @param  Timer   the object that should be notified when the timer expired
+     *  @return void*   the (possibly new) identifier for the timer
+     */
+    virtual void *update(void *identifier, double timeout, Timer *sub)
+    {
+        // fallback for event loops from before this method existed: set up
+        // a brand new timer and cancel the old one
+        cancel(identifier, sub);
+
+        // the replacement timer
+        return timer(timeout, sub);
+    }
+
     /**
      *  Method that is called when a timer is cancelled. This is called when
      *  the DNS library no longer needs to be notified.
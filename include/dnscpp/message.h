@@ -20,6 +20,9 @@
 #include <arpa/nameser.h>
 #include <stdexcept>
 #include <string.h>
+#include <stdlib.h>
+#include <memory>
+#include <vector>
 
 /**
  *  Begin of namespace
@@ -33,16 +36,80 @@ class Message
 {
 private:
     /**
-     *  Pointer to the buffer (only if the object is copied around)
-     *  @var unsigned char *
+     *  The private copy of the wire data (only if the object is copied
+     *  around, messages that wrap a caller-owned buffer leave this
+     *  empty). The buffer is immutable and shared: copying a message
+     *  that already owns its data is just a refcount bump
+     *  @var std::shared_ptr
      */
-    unsigned char *_buffer = nullptr;
+    std::shared_ptr<unsigned char> _buffer;
 
     /**
-     *  Handle to the message
+     *  Handle to the message, the header fields are filled in eagerly,
+     *  the section offsets lazily (see parse()), which is why the
+     *  member is mutable
      *  @var ns_msg
      */
-    ns_msg _handle;
+    mutable ns_msg _handle;
+
+    /**
+     *  Has the body of the message been parsed already?
+     *  @var bool
+     */
+    mutable bool _parsed = false;
+
+    /**
+     *  Fill in the handle for a raw message: the twelve byte header is
+     *  validated and parsed right away (id, flags and the four section
+     *  counts all live there), walking the body is postponed until a
+     *  caller actually needs a record
+     *  @param  buffer      the raw data
+     *  @param  size        size of the buffer
+     *  @throws std::runtime_error
+     */
+    void initialize(const unsigned char *buffer, size_t size)
+    {
+        // messages that do not even hold a full header are never valid
+        if (size < HFIXEDSZ) throw std::runtime_error("failed to parse dns message");
+
+        // start with a clean handle
+        memset(&_handle, 0, sizeof(_handle));
+
+        // the boundaries of the message
+        _handle._msg = buffer;
+        _handle._eom = buffer + size;
+
+        // the fixed header fields
+        _handle._id = ns_get16(buffer);
+        _handle._flags = ns_get16(buffer + 2);
+
+        // the four section counts also live in the header
+        for (int section = 0; section < ns_s_max; ++section) _handle._counts[section] = ns_get16(buffer + 4 + 2 * section);
+
+        // iteration state, identical to what ns_initparse() leaves behind
+        _handle._sect = ns_s_max;
+        _handle._rrnum = -1;
+    }
+
+    /**
+     *  Parse the body of the message, this records the offsets of the
+     *  four sections in the handle so that records can be extracted;
+     *  the majority of messages never get here because the caller could
+     *  make its decision on the header alone (id, rcode, tc-bit)
+     *  @throws std::runtime_error
+     */
+    void parse() const
+    {
+        // the body is walked at most once
+        if (_parsed) return;
+
+        // the full walk over the message, this validates the body and
+        // stores the section offsets inside the handle
+        if (ns_initparse(_handle._msg, _handle._eom - _handle._msg, &_handle) != 0) throw std::runtime_error("failed to parse dns message");
+
+        // no need to do this again
+        _parsed = true;
+    }
 
 protected:
     /**
@@ -51,59 +118,97 @@ protected:
      *  @param  size        size of the buffer
      *  @throws std::runtime_error
      */
-    Message(const unsigned char *buffer, size_t size) 
+    Message(const unsigned char *buffer, size_t size)
     {
-        // try parsing the buffer
-        if (ns_initparse(buffer, size, &_handle) == 0) return;
-        
-        // on failure we report an error
-        throw std::runtime_error("failed to parse dns message");
+        // validate and parse the header, the body is parsed on demand
+        initialize(buffer, size);
     }
-    
+
+    /**
+     *  Constructor that adopts a shared buffer: the message takes shared
+     *  ownership of the wire data instead of wrapping or copying it, so
+     *  rehydrating an externally stored message is zero-copy, and later
+     *  copies of the message stay refcount bumps. Only the twelve byte
+     *  header is validated here, the body is parsed on demand
+     *  @param  buffer      shared pointer to the raw wire data
+     *  @param  size        size of the buffer
+     *  @throws std::runtime_error
+     */
+    Message(const std::shared_ptr<unsigned char> &buffer, size_t size) : _buffer(buffer)
+    {
+        // validate and parse the header, the body is parsed on demand
+        initialize(_buffer.get(), size);
+    }
+
     /**
      *  Copy constructor
-     *  It is better not to use this too often as it might not be too efficient to copy responses around
+     *  When the other message already owns its data the wire data is
+     *  shared and the copy is no more than a refcount bump, only
+     *  messages that wrap a caller-owned buffer have their data copied
      *  @param  that
      *  @throws std::runtime_error
      */
-    Message(const Message &that) : _buffer((unsigned char *)malloc(that.size()))
+    Message(const Message &that)
     {
-        // buffer should exist
-        if (_buffer == nullptr) throw std::runtime_error("failed memory allocation");
-        
-        // copy the raw data
-        memcpy(_buffer, that.data(), that.size());
-        
-        // try parsing the buffer
-        if (ns_initparse(_buffer, that.size(), &_handle) == 0) return;
-        
-        // on failure we report an error
-        throw std::runtime_error("failed to parse dns message");
+        // if the other message owns its buffer we simply share it, and
+        // the handle (which points into that same buffer) can be copied
+        // as-is, including the already-parsed section offsets
+        if (that._buffer)
+        {
+            // share the immutable data
+            _buffer = that._buffer;
+
+            // take over the parse-state
+            _handle = that._handle; _parsed = that._parsed;
+        }
+        else
+        {
+            // the other message wraps memory that we do not control (for
+            // example a stack buffer), so we need a private copy
+            _buffer = std::shared_ptr<unsigned char>((unsigned char *)malloc(that.size()), free);
+
+            // buffer should exist
+            if (_buffer == nullptr) throw std::runtime_error("failed memory allocation");
+
+            // copy the raw data
+            memcpy(_buffer.get(), that.data(), that.size());
+
+            // validate and parse the header of our own copy (the body is
+            // parsed again on demand, the offsets of the other handle are
+            // meaningless for our own buffer)
+            initialize(_buffer.get(), that.size());
+        }
     }
-    
+
+    /**
+     *  Move constructor
+     *  @param  that
+     */
+    Message(Message &&that) : _buffer(std::move(that._buffer)), _handle(that._handle), _parsed(that._parsed) {}
+
 public:
     /**
      *  Destructor
      */
-    virtual ~Message()
-    {
-        // deallocate optional buffer
-        if (_buffer) free(_buffer);
-    }
-    
+    virtual ~Message() = default;
+
     /**
      *  Get the internal handle
      *  This is normally not necessary, because you can get access to all
      *  properties via the methods, but it could be useful if you want to
      *  call libresolv functions yourself.
      *  @return ns_msg*
+     *  @throws std::runtime_error  when the message body is malformed
      */
     const ns_msg *handle() const
     {
+        // all users of the handle extract records, so the body must be known
+        parse();
+
         // expose member
         return &_handle;
     }
-    
+
     /**
      *  Access to the raw buffer data
      *  @return unsigned char *
@@ -112,7 +217,7 @@ public:
     {
         return ns_msg_base(_handle);
     }
-    
+
     /**
      *  Pointer right after the data
      *  @return unsigned char *
@@ -121,7 +226,7 @@ public:
     {
         return ns_msg_end(_handle);
     }
-    
+
     /**
      *  Size of the raw message
      *  @return size_t
@@ -130,7 +235,20 @@ public:
     {
         return ns_msg_size(_handle);
     }
-    
+
+    /**
+     *  Export the raw wire data, for example to persist a resolved
+     *  response in an external store. The returned buffer can later be
+     *  handed back to the shared-buffer constructor to rehydrate the
+     *  message without copying or re-parsing the body
+     *  @return std::vector
+     */
+    std::vector<unsigned char> dump() const
+    {
+        // one copy of the raw wire data
+        return std::vector<unsigned char>(data(), end());
+    }
+
     /**
      *  ID of the message
      *  This is used internally by the library to check if it matches with the request
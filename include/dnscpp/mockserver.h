@@ -0,0 +1,250 @@
+/**
+ *  MockServer.h
+ *
+ *  In-process mock nameserver for reproducible benchmarks and tests.
+ *  The mock binds a udp socket on the loopback interface and answers
+ *  every well-formed query it receives, with a configurable answer
+ *  latency range, loss rate and truncation rate. Point a context at
+ *  ip()/port() and the full Udp/Nameserver/RemoteLookup stack is
+ *  exercised deterministically, without a real resolver polluting the
+ *  numbers with whatever the network feels like during the run.
+ *
+ *  A queries are answered with a single A record (127.0.0.1), other
+ *  types get an empty noerror response. The question section and the
+ *  query id are echoed byte for byte, so the mock also cooperates with
+ *  dns 0x20 encoding.
+ *
+ *  The randomness (loss, truncation, latency jitter) comes from an
+ *  internal generator with a settable seed, so a run can be replayed
+ *  exactly.
+ *
+ *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include <map>
+#include <vector>
+#include <stdint.h>
+#include "monitor.h"
+#include "timer.h"
+#include "loop.h"
+#include "ip.h"
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Class definition
+ */
+class MockServer : private Monitor, private Timer
+{
+private:
+    /**
+     *  Pointer to the event loop supplied by user space
+     *  @var Loop
+     */
+    Loop *_loop;
+
+    /**
+     *  The udp socket on which queries come in
+     *  @var int
+     */
+    int _fd = -1;
+
+    /**
+     *  Identifier of the socket inside the event loop
+     *  @var void *
+     */
+    void *_identifier = nullptr;
+
+    /**
+     *  The port to which the socket is bound
+     *  @var uint16_t
+     */
+    uint16_t _port = 0;
+
+    /**
+     *  Lower and upper bound of the answer latency in seconds (both
+     *  zero means that answers are sent right away)
+     *  @var double
+     */
+    double _mindelay = 0.0, _maxdelay = 0.0;
+
+    /**
+     *  Fraction of the queries that is silently dropped
+     *  @var double
+     */
+    double _loss = 0.0;
+
+    /**
+     *  Fraction of the answers that is sent truncated (tc bit set and
+     *  the answer section left out, forcing a tcp retry)
+     *  @var double
+     */
+    double _truncation = 0.0;
+
+    /**
+     *  State of the deterministic random generator (splitmix64)
+     *  @var uint64_t
+     */
+    uint64_t _state = 0x9e3779b97f4a7c15ULL;
+
+    /**
+     *  One answer that is waiting for its scheduled send-time
+     */
+    struct Delayed
+    {
+        /**
+         *  The wire-format answer
+         *  @var std::vector
+         */
+        std::vector<unsigned char> message;
+
+        /**
+         *  Address to send it to
+         *  @var sockaddr_storage like buffer
+         */
+        char address[128];
+
+        /**
+         *  Size of that address
+         *  @var size_t
+         */
+        size_t addrsize;
+    };
+
+    /**
+     *  Answers that are waiting for their send-time, keyed by that time
+     *  (a multimap because two answers can share a send-time)
+     *  @var std::multimap
+     */
+    std::multimap<double,Delayed> _delayed;
+
+    /**
+     *  Identifier of the currently armed timer (nullptr when no answer
+     *  is waiting)
+     *  @var void *
+     */
+    void *_timer = nullptr;
+
+    /**
+     *  Draw the next deterministic random number
+     *  @return uint64_t
+     */
+    uint64_t draw();
+
+    /**
+     *  Draw a fraction between zero and one
+     *  @return double
+     */
+    double fraction();
+
+    /**
+     *  Handle one incoming query
+     *  @param  buffer      the received datagram
+     *  @param  size        size of the datagram
+     *  @param  address     where it came from
+     *  @param  addrsize    size of that address
+     */
+    void handle(const unsigned char *buffer, size_t size, const struct sockaddr *address, size_t addrsize);
+
+    /**
+     *  Send or schedule an answer
+     *  @param  message     the wire-format answer
+     *  @param  address     where to send it
+     *  @param  addrsize    size of that address
+     */
+    void answer(std::vector<unsigned char> &&message, const struct sockaddr *address, size_t addrsize);
+
+    /**
+     *  Bring the timer in sync with the earliest scheduled answer
+     *  @param  now         current time
+     */
+    void reschedule(double now);
+
+    /**
+     *  Method that is called by the event loop when the socket becomes
+     *  readable
+     */
+    virtual void notify() override;
+
+    /**
+     *  Method that is called by the event loop when the timer for the
+     *  delayed answers expires
+     */
+    virtual void expire() override;
+
+public:
+    /**
+     *  Constructor, binds the socket on the loopback interface
+     *  @param  loop        the event loop
+     *  @param  port        port to bind to (0 picks a free port)
+     *  @throws std::runtime_error
+     */
+    MockServer(Loop *loop, uint16_t port = 0);
+
+    /**
+     *  No copying
+     *  @param  that
+     */
+    MockServer(const MockServer &that) = delete;
+
+    /**
+     *  Destructor
+     */
+    virtual ~MockServer();
+
+    /**
+     *  The loopback address on which the mock listens
+     *  @return Ip
+     */
+    Ip ip() const { return Ip("127.0.0.1"); }
+
+    /**
+     *  The port on which the mock listens
+     *  @return uint16_t
+     */
+    uint16_t port() const { return _port; }
+
+    /**
+     *  Update the answer latency range, each answer gets a latency
+     *  drawn uniformly from this range
+     *  @param  mindelay    lower bound in seconds
+     *  @param  maxdelay    upper bound in seconds
+     */
+    void latency(double mindelay, double maxdelay);
+
+    /**
+     *  Update the loss rate
+     *  @param  fraction    fraction of queries to drop (0.0 .. 1.0)
+     */
+    void loss(double fraction) { _loss = fraction; }
+
+    /**
+     *  Update the truncation rate
+     *  @param  fraction    fraction of answers to truncate (0.0 .. 1.0)
+     */
+    void truncation(double fraction) { _truncation = fraction; }
+
+    /**
+     *  Reseed the deterministic random generator, two runs with the
+     *  same seed and the same traffic behave identically
+     *  @param  seed        the seed
+     */
+    void seed(uint64_t seed) { _state = seed; }
+};
+
+/**
+ *  End of namespace
+ */
+}
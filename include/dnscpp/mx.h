@@ -72,7 +72,43 @@ public:
         return _target;
     }
 };
-    
+
+/**
+ *  Traits for Response::extract<MX>(), so that the priority and the
+ *  exchange name can be pulled straight out of the wire data without
+ *  intermediate objects
+ */
+template <> struct Typed<MX>
+{
+    /**
+     *  The value of an MX record: the priority and the exchange name
+     */
+    struct Value
+    {
+        uint16_t priority;
+        Decompressed hostname;
+    };
+
+    /**
+     *  The type constant and the minimal rdata size
+     */
+    static constexpr ns_type type = TYPE_MX;
+    static constexpr size_t minsize = 2;
+
+    /**
+     *  Convert the raw rdata into the value
+     *  @param  response    the full response
+     *  @param  data        the rdata of the record
+     *  @param  size        size of the rdata
+     *  @return Value
+     */
+    static Value convert(const Response &response, const unsigned char *data, size_t size)
+    {
+        // the first two bytes hold the priority, the exchange name follows
+        return Value{ (uint16_t)ns_get16(data), Decompressed(response, data + 2) };
+    }
+};
+
 /**
  *  End of namespace
  */
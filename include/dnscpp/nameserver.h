@@ -23,10 +23,16 @@
  */
 #include "udp.h"
 #include "ip.h"
+#include "printable.h"
+#include "ring.h"
 #include "response.h"
 #include "timer.h"
 #include "watchable.h"
-#include <set>
+#include "stats.h"
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <memory>
 
 /**
  *  Begin of the namespace
@@ -37,11 +43,12 @@ namespace DNS {
  *  Forward declaration
  */
 class Core;
+class Pipeline;
 
 /**
  *  Class definition
  */
-class Nameserver : private Udp::Handler, private Watchable
+class Nameserver : private Udp::Handler, private Watchable, private Timer
 {
 public:
     /**
@@ -71,24 +78,184 @@ private:
      *  @var    Ip
      */
     Ip _ip;
-    
+
+    /**
+     *  Printable form of the IP address, rendered once at construction
+     *  time because the address never changes, so that logging code can
+     *  include the nameserver in every line without formatting cost
+     *  @var    Printable
+     */
+    Printable _printable;
+
+    /**
+     *  Pool of UDP sockets to send messages to the nameserver. Each socket
+     *  is implicitly bound to its own ephemeral port, so the pool widens
+     *  the space of outstanding (port, query-id) combinations and spreads
+     *  incoming responses over multiple receive queues
+     *  @var    std::list
+     */
+    std::list<Udp> _sockets;
+
+    /**
+     *  All the buffered responses that came in, stored in a preallocated
+     *  ring so that buffering is allocation-free
+     *  @var Ring
+     */
+    Ring _responses;
+
+    /**
+     *  Table with the handlers, directly indexed by query id, so that an
+     *  incoming response is matched with one array lookup instead of a
+     *  tree walk. The table is allocated on first use (a nameserver that
+     *  never sees traffic does not pay for it), and the rare lookups that
+     *  happen to share an id simply share a slot
+     *  @var std::vector
+     */
+    std::vector<std::vector<Handler*>> _handlers;
+
+    /**
+     *  Total number of subscribed handlers in the table (so that we do
+     *  not have to scan all slots to see if anyone is listening)
+     *  @var size_t
+     */
+    size_t _subscribers = 0;
+
+    /**
+     *  The persistent TCP connection to the nameserver, over which the
+     *  queries of all lookups that fall back to tcp are pipelined, this
+     *  is only constructed when a lookup actually needs tcp
+     *  @var std::unique_ptr<Pipeline>
+     */
+    std::unique_ptr<Pipeline> _pipeline;
+
+    /**
+     *  The timer that closes the sockets once the keep-warm grace
+     *  period has passed without new subscribers (nullptr when no
+     *  close is pending)
+     *  @var void *
+     */
+    void *_idletimer = nullptr;
+
+    /**
+     *  The dns cookie (rfc 7873) that is attached to outgoing queries:
+     *  an 8-byte random client cookie, followed by the server cookie
+     *  as soon as the nameserver has handed one out. Cookied clients
+     *  are excluded from the anti-spoofing measures (rate limits,
+     *  forced truncation) that some resolvers apply
+     *  @var unsigned char[]
+     */
+    unsigned char _cookie[40];
+
+    /**
+     *  Size of the cookie (8 as long as we only have our client cookie)
+     *  @var size_t
+     */
+    size_t _cookiesize = 8;
+
+    /**
+     *  Smoothed round-trip time of this nameserver in seconds (0.0 until
+     *  the first measurement comes in), maintained with the usual
+     *  exponentially weighted moving average from rfc 6298
+     *  @var double
+     */
+    double _srtt = 0.0;
+
+    /**
+     *  Round-trip time variance, the other half of the rto formula
+     *  @var double
+     */
+    double _rttvar = 0.0;
+
+    /**
+     *  Number of recent queries that were sent to this nameserver, the
+     *  counters are periodically halved so that they describe the recent
+     *  past instead of the full lifetime
+     *  @var size_t
+     */
+    size_t _queries = 0;
+
+    /**
+     *  Number of recent queries that actually got an answer
+     *  @var size_t
+     */
+    size_t _answers = 0;
+
+    /**
+     *  Rate limit of this nameserver in queries per second (0.0 means
+     *  unlimited), useful against upstream resolvers that enforce a
+     *  per-client limit and answer bursts with drops
+     *  @var double
+     */
+    double _rate = 0.0;
+
+    /**
+     *  Max number of tokens that can accrue, this is the burst that may
+     *  be sent after a period of silence
+     *  @var double
+     */
+    double _burst = 1.0;
+
+    /**
+     *  Number of tokens currently in the bucket
+     *  @var double
+     */
+    double _tokens = 1.0;
+
+    /**
+     *  Time of the last refill of the bucket
+     *  @var double
+     */
+    double _refill = 0.0;
+
+    /**
+     *  Traffic statistics of this nameserver (counters plus rtt
+     *  histogram), maintained with relaxed atomics so that monitoring
+     *  code can snapshot them from an other thread
+     *  @var Stats
+     */
+    Stats _stats;
+
     /**
-     *  UDP socket to send messages to the nameserver
-     *  @var    Udp
+     *  Bring the token bucket up to date
+     *  @param  now     current time
      */
-    Udp _udp;
+    void refill(double now)
+    {
+        // tokens accrue at the configured rate since the previous refill
+        if (_refill > 0.0) _tokens = std::min(_burst, _tokens + (now - _refill) * _rate);
+
+        // remember the refill-time
+        _refill = now;
+    }
 
     /**
-     *  All the buffered responses that came in 
-     *  @var std::list
+     *  Try to take one token from the bucket
+     *  @param  now     current time
+     *  @return bool    was a token available?
      */
-    std::list<Received> _responses;
+    bool consume(double now)
+    {
+        // without a rate limit there is nothing to consume
+        if (_rate <= 0.0) return true;
+
+        // bring the bucket up to date
+        refill(now);
+
+        // is a token available at all?
+        if (_tokens < 1.0) return false;
+
+        // take the token
+        _tokens -= 1.0;
+
+        // the query may be sent
+        return true;
+    }
 
     /**
-     *  Set with the handlers
-     *  @var set
+     *  Update the cached server cookie from a received response
+     *  @param  response    the response that possibly carries a cookie
      */
-    std::set<std::pair<uint16_t,Handler*>> _handlers;
+    void cookie(const Response &response);
 
     /**
      *  Method that is called when a response is received
@@ -99,6 +266,22 @@ private:
      */
     virtual void onReceived(time_t now, const struct sockaddr *address, const unsigned char *buffer, size_t size) override;
 
+    /**
+     *  Called when the last subscriber lost interest: close the sockets
+     *  right away, or schedule the delayed close of keep-warm mode
+     */
+    void idle();
+
+    /**
+     *  Cancel a pending delayed close because the sockets are in use again
+     */
+    void warm();
+
+    /**
+     *  Called by the event loop when the keep-warm grace period is over
+     */
+    virtual void expire() override;
+
 
 public:
     /**
@@ -125,6 +308,20 @@ public:
      *  @return Ip
      */
     const Ip &ip() const { return _ip; }
+
+    /**
+     *  Expose the printable form of the nameserver IP, this was rendered
+     *  once at construction time so using it costs nothing
+     *  @return Printable
+     */
+    const Printable &printable() const { return _printable; }
+
+    /**
+     *  Expose the traffic statistics of this nameserver
+     *  @return Stats
+     */
+    Stats &stats() { return _stats; }
+    const Stats &stats() const { return _stats; }
     
     /**
      *  Send a datagram to the nameserver
@@ -133,6 +330,57 @@ public:
      */
     bool datagram(const Query &query);
 
+    /**
+     *  Poll all sockets of the pool directly and process whatever came
+     *  in, without waiting for the event loop (see Context::spin())
+     *  @return bool    was a datagram received and processed?
+     */
+    bool spin()
+    {
+        // whether anything was processed
+        bool result = false;
+
+        // check all sockets of the pool
+        for (auto &socket : _sockets) if (socket.spin()) result = true;
+
+        // done
+        return result;
+    }
+
+    /**
+     *  The persistent TCP connection to this nameserver, constructed on
+     *  first use, a broken connection is transparently replaced
+     *  @return Pipeline
+     *  @throws std::runtime_error
+     */
+    Pipeline *pipeline();
+
+    /**
+     *  Bind all sockets of the pool to one shared port with SO_REUSEPORT,
+     *  so that the kernel shards incoming responses over their receive
+     *  queues instead of serializing them through one descriptor, this is
+     *  a no-op for pools of just one socket
+     */
+    void shard();
+
+    /**
+     *  Update the number of sockets in the pool, this is best called right
+     *  after construction: shrinking the pool closes sockets on which
+     *  responses could still arrive
+     *  @param  count       the number of sockets to use
+     */
+    void sockets(size_t count)
+    {
+        // we need at least one socket
+        if (count == 0) count = 1;
+
+        // grow the pool when needed (the cast is needed because the base is private)
+        while (_sockets.size() < count) _sockets.emplace_back(_core, static_cast<Udp::Handler*>(this));
+
+        // or shrink it
+        while (_sockets.size() > count) _sockets.pop_back();
+    }
+
     /**
      *  Subscribe to the socket if you want to be notified about incoming responses
      *  @param  handler     the handler that wants to receive an answer
@@ -140,8 +388,25 @@ public:
      */
     void subscribe(Handler *handler, uint16_t id)
     {
-        // emplace the handler
-        _handlers.insert(std::make_pair(id, handler));
+        // allocate the table on first use (one slot for every possible query id)
+        if (_handlers.empty()) _handlers.resize(65536);
+
+        // a pending delayed close is no longer wanted, the sockets are
+        // warm and about to be used again
+        if (_idletimer) warm();
+
+        // the slot of this query id
+        auto &subscribers = _handlers[id];
+
+        // subscribing is idempotent (a lookup that retransmits to the same
+        // server should not end up in the slot twice)
+        if (std::find(subscribers.begin(), subscribers.end(), handler) != subscribers.end()) return;
+
+        // add the handler to the slot
+        subscribers.push_back(handler);
+
+        // one extra subscriber
+        _subscribers += 1;
     }
     
     /**
@@ -151,32 +416,199 @@ public:
      */
     void unsubscribe(Handler *handler, uint16_t id)
     {
-        // find the element
-        auto iter = _handlers.find(std::make_pair(id, handler));
+        // without a table there is nothing to remove (this should not happen)
+        if (_handlers.empty()) return;
+
+        // the slot in which the handler must live
+        auto &subscribers = _handlers[id];
+
+        // find the handler
+        auto iter = std::find(subscribers.begin(), subscribers.end(), handler);
 
         // if it is not found, we leap out (this should not happen)
-        if (iter == _handlers.end()) return;
+        if (iter == subscribers.end()) return;
 
         // simply erase the element
-        _handlers.erase(iter);
+        subscribers.erase(iter);
 
-        // if nobody is listening to the socket any more, we can just as well close it
-        if (_handlers.empty()) _udp.close();
+        // one subscriber less
+        _subscribers -= 1;
+
+        // if nobody is listening any more the sockets can close, either
+        // right away or (in keep-warm mode) after the grace period
+        if (_subscribers == 0) idle();
     }
-    
+
+    /**
+     *  Drop all subscribers in one go, this is the wholesale counterpart
+     *  of unsubscribe() that the bulk-cancel path uses: clearing the
+     *  table once is much cheaper than erasing a hundred thousand
+     *  handlers one by one
+     */
+    void reset()
+    {
+        // nothing to do when nobody is subscribed
+        if (_subscribers == 0) return;
+
+        // empty all slots (the slot vectors keep their capacity, a next
+        // burst of subscriptions allocates nothing)
+        for (auto &subscribers : _handlers) subscribers.clear();
+
+        // nobody is listening any more
+        _subscribers = 0;
+
+        // the sockets can close, right away or after the grace period
+        idle();
+    }
+
+    /**
+     *  Feed a round-trip measurement into the smoothed-rtt administration,
+     *  callers should only feed unambiguous samples (a response to a query
+     *  that was sent exactly once, see karn's algorithm)
+     *  @param  rtt     measured round-trip time in seconds
+     */
+    void measure(double rtt)
+    {
+        // negative samples can occur when clocks are adjusted, skip those
+        if (rtt < 0.0) return;
+
+        // unambiguous samples also feed the rtt histogram of the stats
+        _stats.sample(rtt);
+
+        // the very first sample initializes the administration (rfc 6298 2.2)
+        if (_srtt == 0.0) { _srtt = rtt; _rttvar = rtt / 2; return; }
+
+        // update variance first (it uses the old srtt) and then the srtt itself
+        _rttvar = 0.75 * _rttvar + 0.25 * std::abs(_srtt - rtt);
+        _srtt = 0.875 * _srtt + 0.125 * rtt;
+    }
+
+    /**
+     *  The retransmission timeout derived from the measured round-trips:
+     *  waiting longer than this most likely means that the datagram or the
+     *  response was lost
+     *  @return double  timeout in seconds (0.0 when there are no measurements yet)
+     */
+    double rto() const
+    {
+        // without measurements the caller should fall back to the static interval
+        if (_srtt == 0.0) return 0.0;
+
+        // the usual formula, with a floor so that a blazing fast resolver on
+        // localhost does not trick us into hammering it with retransmissions
+        return std::max(0.05, _srtt + 4 * _rttvar);
+    }
+
+    /**
+     *  Recent latency/loss score of this nameserver, lower is better. The
+     *  score is the smoothed round-trip time plus a penalty for the
+     *  fraction of recent queries that went unanswered, so a degraded or
+     *  blackholing server quickly scores itself out of the first-attempt
+     *  position
+     *  @return double
+     */
+    double score() const
+    {
+        // start with the measured latency, servers without measurements get
+        // an optimistic default so that they are actually tried
+        double result = _srtt > 0.0 ? _srtt : 0.01;
+
+        // add the loss penalty: every lost query is worth a full second, so
+        // that even mild loss outweighs latency differences
+        if (_queries > 0) result += 1.0 * (_queries - std::min(_answers, _queries)) / _queries;
+
+        // expose the score
+        return result;
+    }
+
+    /**
+     *  Update the rate limit of this nameserver
+     *  @param  rate    max queries per second (0.0 disables the limit)
+     *  @param  burst   max queries that may be sent back-to-back
+     */
+    void ratelimit(double rate, double burst)
+    {
+        // negative rates make no sense, a burst of less than one query
+        // would block everything forever
+        _rate = std::max(rate, 0.0);
+        _burst = std::max(burst, 1.0);
+
+        // the bucket starts full, and forgets its history
+        _tokens = _burst; _refill = 0.0;
+    }
+
+    /**
+     *  Time until the rate limiter releases the next query, so that the
+     *  scheduler can release queued lookups exactly when a token accrues
+     *  @param  now     current time
+     *  @return double  delay in seconds (0.0 when a query may be sent now)
+     */
+    double available(double now)
+    {
+        // without a rate limit queries may always be sent
+        if (_rate <= 0.0) return 0.0;
+
+        // bring the bucket up to date
+        refill(now);
+
+        // the time it takes for the bucket to reach one token
+        return _tokens >= 1.0 ? 0.0 : (1.0 - _tokens) / _rate;
+    }
+
     /**
      *  Is the nameserver busy (meaning: is there a backlog of unprocessed messages?)
      *  @return bool
      */
     bool busy() const { return !_responses.empty(); }
 
+    /**
+     *  Update the max number of responses that may be buffered, buffered
+     *  messages are discarded so this is best called before traffic flows
+     *  @param  slots       the number of responses to buffer at most
+     */
+    void backlog(size_t slots) { _responses.capacity(slots); }
+
+    /**
+     *  Number of responses that were shed because the backlog was full
+     *  @return size_t
+     */
+    size_t dropped() const { return _responses.dropped(); }
+
+    /**
+     *  Number of datagrams that the kernel dropped on the sockets of this
+     *  nameserver because their receive buffers were full
+     *  @return size_t
+     */
+    size_t drops() const
+    {
+        // add up the counters of all sockets
+        size_t result = 0;
+
+        // iterate over the pool
+        for (const auto &socket : _sockets) result += socket.drops();
+
+        // expose the sum
+        return result;
+    }
+
+    /**
+     *  Update the receive buffer size of all open sockets
+     *  @param  size    the buffer size to set
+     */
+    void rcvbuf(int32_t size)
+    {
+        // update the whole pool
+        for (auto &socket : _sockets) socket.rcvbuf(size);
+    }
+
     /**
      *  Process cached responses (this is an internal method)
      *  @param  maxcalls    max number of calls to userspace
+     *  @param  deadline    stop processing when the coarse clock passes this time (0.0 = no deadline)
      *  @return size_t      number of processed answers
      *  @internal
      */
-    size_t process(size_t maxcalls);
+    size_t process(size_t maxcalls, double deadline = 0.0);
 
 };
 
@@ -1,8 +1,15 @@
 /**
  *  Now.h
- * 
+ *
  *  Utility class to get the current time
- * 
+ *
+ *  Instances are constructed all over the hot path (per readability
+ *  event, per timer evaluation), so the time is read from the coarse
+ *  kernel clock where available: that clock is updated once per tick
+ *  and reading it is just a memory load from the vdso, while its
+ *  millisecond granularity is far more precise than anything the
+ *  scheduling in this library needs.
+ *
  *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
  *  @copyright 2020 Copernica BV
  */
@@ -16,6 +23,7 @@
  *  Dependencies
  */
 #include <sys/time.h>
+#include <time.h>
 
 /**
  *  Begin of namespace
@@ -29,38 +37,54 @@ class Now
 {
 private:
     /**
-     *  THe structure that holds the current time
-     *  @var struct timeval
+     *  The current time in seconds since epoch
+     *  @var double
      */
-    struct timeval _time;
-    
+    double _time;
+
 public:
     /**
      *  Constructor
      */
     Now()
     {
-        // get the current time
-        gettimeofday(&_time, nullptr);
+#ifdef CLOCK_REALTIME_COARSE
+        // the structure that receives the time
+        struct timespec time;
+
+        // read the coarse clock (cannot fail for a valid clock-id)
+        clock_gettime(CLOCK_REALTIME_COARSE, &time);
+
+        // convert to seconds
+        _time = time.tv_sec + time.tv_nsec * 1e-9;
+#else
+        // the structure that receives the time
+        struct timeval time;
+
+        // systems without a coarse clock get the current time the old way
+        gettimeofday(&time, nullptr);
+
+        // convert to seconds
+        _time = time.tv_sec + time.tv_usec * 1e-6;
+#endif
     }
-    
+
     /**
      *  Destructor
      */
     virtual ~Now() = default;
-    
+
     /**
      *  Expose the time as double
      *  @return double
      */
     operator double () const
     {
-        return _time.tv_sec + _time.tv_usec * 1e-6;
+        return _time;
     }
 };
-    
+
 /**
  *  End of namespace
  */
 }
-
@@ -61,7 +61,39 @@ public:
         return _nameserver;
     }
 };
-    
+
+/**
+ *  Traits for Response::extract<NS>(), so that the nameserver hostname
+ *  can be pulled straight out of the wire data without intermediate
+ *  objects
+ */
+template <> struct Typed<NS>
+{
+    /**
+     *  The value of a NS record is the decompressed nameserver name
+     */
+    using Value = Decompressed;
+
+    /**
+     *  The type constant and the minimal rdata size
+     */
+    static constexpr ns_type type = TYPE_NS;
+    static constexpr size_t minsize = 0;
+
+    /**
+     *  Convert the raw rdata into the value
+     *  @param  response    the full response
+     *  @param  data        the rdata of the record
+     *  @param  size        size of the rdata
+     *  @return Value
+     */
+    static Value convert(const Response &response, const unsigned char *data, size_t size)
+    {
+        // the rdata holds a (possibly compressed) domain name
+        return Decompressed(response, data);
+    }
+};
+
 /**
  *  End of namespace
  */
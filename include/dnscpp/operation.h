@@ -48,7 +48,15 @@ protected:
      *  @var Query
      */
     const Query _query;
-        
+
+    /**
+     *  Optional user-supplied tag, so that related operations can be
+     *  cancelled together with Context::cancel_many() (nullptr for
+     *  operations that were never tagged)
+     *  @var const void *
+     */
+    const void *_tag = nullptr;
+
     /**
      *  Constructor
      *  @param  handler     user space handler
@@ -59,9 +67,20 @@ protected:
      *  @param  data        optional data (only for type = ns_o_notify)
      *  @throws std::runtime_error
      */
-    Operation(Handler *handler, int op, const char *dname, int type, const Bits &bits, const unsigned char *data = nullptr) : 
+    Operation(Handler *handler, int op, const char *dname, int type, const Bits &bits, const unsigned char *data = nullptr) :
         _handler(handler), _query(op, dname, type, bits, data) {}
 
+    /**
+     *  Constructor that starts from a precompiled query template: the
+     *  template is copied and the copy gets a fresh random id, which is
+     *  much cheaper than encoding the query from scratch
+     *  @param  handler     user space handler
+     *  @param  query       the precompiled query
+     *  @param  dns0x20     randomize the case of the query-name too?
+     */
+    Operation(Handler *handler, const Query &query, bool dns0x20 = false) :
+        _handler(handler), _query(query, true, dns0x20) {}
+
     /**
      *  Private destructor because userspace is not supposed to destruct this
      */
@@ -93,6 +112,20 @@ public:
         _handler = handler;
     }
     
+    /**
+     *  Attach a tag to the operation: an opaque value (any pointer or
+     *  sentinel of your choosing) that groups related operations, so
+     *  that a whole group can be cancelled with Context::cancel_many()
+     *  @param  value       the tag (nullptr to untag)
+     */
+    void tag(const void *value) { _tag = value; }
+
+    /**
+     *  The tag of the operation (nullptr when never tagged)
+     *  @return const void *
+     */
+    const void *tag() const { return _tag; }
+
     /**
      *  Cancel the operation
      */
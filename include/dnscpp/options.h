@@ -0,0 +1,62 @@
+/**
+ *  Options.h
+ *
+ *  Per-lookup overrides for the timing knobs that normally live on the
+ *  context. With these an interactive query can run with a one-second
+ *  budget while a batch query on the very same context gets thirty
+ *  seconds, instead of having to run multiple contexts (with duplicate
+ *  sockets and separate caches) just to vary the timing.
+ *
+ *  Fields that are left at their default keep the context-wide value.
+ *
+ *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include <stddef.h>
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Class definition
+ */
+struct Options
+{
+    /**
+     *  Time to wait for a response after the last attempt, in seconds
+     *  (negative means: use the context-wide setting)
+     *  @var double
+     */
+    double timeout = -1.0;
+
+    /**
+     *  Interval between attempts in seconds, used when the nameserver
+     *  has no round-trip measurements yet (negative means: use the
+     *  context-wide setting)
+     *  @var double
+     */
+    double interval = -1.0;
+
+    /**
+     *  Max number of attempts / datagrams to send (zero means: use the
+     *  context-wide setting)
+     *  @var size_t
+     */
+    size_t attempts = 0;
+};
+
+/**
+ *  End of namespace
+ */
+}
@@ -38,18 +38,9 @@ public:
      */
     Printable(const Ip &ip)
     {
-        // check version
-        if (ip.version() == 4)
-        {
-            // convert
-            if (inet_ntop(AF_INET, (const struct in_addr *)ip, _buffer, INET_ADDRSTRLEN) != nullptr) return;
-        }
-        else
-        {
-            // convert
-            if (inet_ntop(AF_INET6, (const struct in6_addr *)ip, _buffer, INET6_ADDRSTRLEN) != nullptr) return;
-        }
-        
+        // format into the internal buffer (which is big enough for any address)
+        if (ip.print(_buffer, sizeof(_buffer)) > 0) return;
+
         // report an error
         throw std::runtime_error(strerror(errno));
     }
@@ -61,7 +61,38 @@ public:
         return _target;
     }
 };
-    
+
+/**
+ *  Traits for Response::extract<PTR>(), so that the target hostname can
+ *  be pulled straight out of the wire data without intermediate objects
+ */
+template <> struct Typed<PTR>
+{
+    /**
+     *  The value of a PTR record is the decompressed target name
+     */
+    using Value = Decompressed;
+
+    /**
+     *  The type constant and the minimal rdata size
+     */
+    static constexpr ns_type type = TYPE_PTR;
+    static constexpr size_t minsize = 0;
+
+    /**
+     *  Convert the raw rdata into the value
+     *  @param  response    the full response
+     *  @param  data        the rdata of the record
+     *  @param  size        size of the rdata
+     *  @return Value
+     */
+    static Value convert(const Response &response, const unsigned char *data, size_t size)
+    {
+        // the rdata holds a (possibly compressed) domain name
+        return Decompressed(response, data);
+    }
+};
+
 /**
  *  End of namespace
  */
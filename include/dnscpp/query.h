@@ -47,7 +47,22 @@ private:
      *  @var size_t
      */
     size_t _size = 0;
-    
+
+    /**
+     *  Was the case of the query-name randomized (dns 0x20 encoding)?
+     *  When set, responses must echo the question with the exact same
+     *  case before they are accepted
+     *  @var bool
+     */
+    bool _dns0x20 = false;
+
+    /**
+     *  Randomize the case of the letters in the query-name (dns 0x20
+     *  encoding), which adds unguessable bits on top of the query id so
+     *  that off-path spoofing of udp responses becomes much harder
+     */
+    void randomize();
+
     /**
      *  End of the buffer
      *  This is non-const because we also use it for writing
@@ -115,10 +130,10 @@ private:
      *  solves this by allowing an extra pseudo-record to be added to each
      *  message with room for some additional flags and properties. This method
      *  adds that extra pseudo-section to the query.
-     *  @param  dnssec      should we query for dnssec-related data?
+     *  @param  bits        the bits (payload size, dnssec) to advertise
      *  @return bool
      */
-    bool edns(bool dnssec);
+    bool edns(const Bits &bits);
 
 public:
     /**
@@ -132,6 +147,18 @@ public:
      */
     Query(int op, const char *dname, int type, const Bits &bits, const unsigned char *data = nullptr);
 
+    /**
+     *  Constructor that copies a precompiled query (a template) and
+     *  optionally stamps a fresh random id into the copy. Repeated
+     *  lookups for the same domain and type can thus skip the name
+     *  compression and header encoding: the per-query cost is a plain
+     *  copy of the wire data plus a two-byte id write
+     *  @param  that        the precompiled query to copy
+     *  @param  restamp     stamp a fresh random id into the copy?
+     *  @param  dns0x20     randomize the case of the query-name too?
+     */
+    Query(const Query &that, bool restamp, bool dns0x20 = false);
+
     /**
      *  No copying (disabled because copying is expensive and we want the compiler
      *  to warn is in case we accidentally do rely on a copy-operation)
@@ -183,12 +210,24 @@ public:
     size_t questions() const;
     
     /**
-     *  Does a response match with a query, meaning: is the response 
+     *  Does a response match with a query, meaning: is the response
      *  indeed a response to this specific query?
      *  @param  response
      *  @return bool
      */
     bool matches(const Response &response) const;
+
+    /**
+     *  Copy the query into an external buffer, with a dns cookie option
+     *  (rfc 7873) appended to the edns pseudo-record. The query itself is
+     *  not modified, so the same query can be annotated with a different
+     *  cookie for each nameserver that it is sent to
+     *  @param  buffer      target buffer, should hold size() + 44 bytes
+     *  @param  cookie      the cookie (client cookie, plus server cookie when known)
+     *  @param  size        size of the cookie (between 8 and 40 bytes)
+     *  @return size_t      size of the annotated query (0 when not possible)
+     */
+    size_t cookie(unsigned char *buffer, const unsigned char *cookie, size_t size) const;
 };
     
 /**
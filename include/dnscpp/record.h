@@ -16,7 +16,10 @@
  *  Dependencies
  */
 #include "message.h"
+#include "type.h"
 #include <string.h>
+#include <stdio.h>
+#include <arpa/inet.h>
 
 /**
  *  Begin of namespace
@@ -35,6 +38,13 @@ protected:
      */
     ns_rr _record;
 
+    /**
+     *  Protected default constructor that leaves the record unfilled,
+     *  this is used by the iterator of the Response class that fills
+     *  the structure in place while it walks over the message
+     */
+    Record() = default;
+
 public:
     /**
      *  Constructor
@@ -134,6 +144,69 @@ public:
     {
         return ns_rr_rdlen(_record);
     }
+
+    /**
+     *  Format a one-line summary of the record ("name ttl class type",
+     *  for address records followed by the address itself) into a
+     *  caller-supplied buffer, without making any allocation. Useful for
+     *  (structured) logging on hot paths
+     *  @param  buffer      the buffer to write to (gets null-terminated)
+     *  @param  size        size of the buffer
+     *  @return size_t      length of the formatted text (0 if the buffer is too small)
+     */
+    size_t print(char *buffer, size_t size) const
+    {
+        // mnemonic for the record type (a small lookup for the types that
+        // appear in practice, other types are printed numerically)
+        char fallback[16]; const char *mnemonic;
+
+        // check the type
+        switch (type()) {
+        case TYPE_A:        mnemonic = "A";         break;
+        case TYPE_NS:       mnemonic = "NS";        break;
+        case TYPE_CNAME:    mnemonic = "CNAME";     break;
+        case TYPE_SOA:      mnemonic = "SOA";       break;
+        case TYPE_PTR:      mnemonic = "PTR";       break;
+        case TYPE_MX:       mnemonic = "MX";        break;
+        case TYPE_TXT:      mnemonic = "TXT";       break;
+        case TYPE_AAAA:     mnemonic = "AAAA";      break;
+        case TYPE_SRV:      mnemonic = "SRV";       break;
+        case TYPE_OPT:      mnemonic = "OPT";       break;
+        case TYPE_DNSKEY:   mnemonic = "DNSKEY";    break;
+        case TYPE_RRSIG:    mnemonic = "RRSIG";     break;
+        case TYPE_TLSA:     mnemonic = "TLSA";      break;
+        case TYPE_CAA:      mnemonic = "CAA";       break;
+        default:            snprintf(fallback, sizeof(fallback), "TYPE%u", type()); mnemonic = fallback; break;
+        }
+
+        // the summary starts with name, ttl, class and type (the class is
+        // virtually always "IN", other classes are printed numerically)
+        int result = dnsclass() == ns_c_in
+            ? snprintf(buffer, size, "%s %u IN %s", name(), ttl(), mnemonic)
+            : snprintf(buffer, size, "%s %u CLASS%u %s", name(), ttl(), dnsclass(), mnemonic);
+
+        // check for truncation
+        if (result < 0 || (size_t)result >= size) return 0;
+
+        // for other than address records the summary is now complete
+        if (type() != TYPE_A && type() != TYPE_AAAA) return result;
+
+        // the rdata must hold a full address (a malformed record is
+        // reported without the address instead of failing)
+        if (this->size() < (type() == TYPE_A ? sizeof(struct in_addr) : sizeof(struct in6_addr))) return result;
+
+        // is there room for the separator plus the address text?
+        if (size - result < INET6_ADDRSTRLEN + 1) return 0;
+
+        // append the separator
+        buffer[result++] = ' ';
+
+        // append the address straight from the rdata (writes the null-terminator too)
+        if (inet_ntop(type() == TYPE_A ? AF_INET : AF_INET6, data(), buffer + result, size - result) == nullptr) { buffer[--result] = '\0'; return result; }
+
+        // recalculate the length
+        return result + strlen(buffer + result);
+    }
 };
     
 /**
@@ -17,6 +17,7 @@
  *  Dependencies
  */
 #include <vector>
+#include <string>
 #include <resolv.h>
 
 /**
@@ -55,6 +56,29 @@ private:
      */
     bool _rotate = false;
 
+    /**
+     *  The search domains that are appended to short hostnames (from the
+     *  "search" or "domain" lines, the last of those lines wins)
+     *  @var std::vector<std::string>
+     */
+    std::vector<std::string> _searchpaths;
+
+    /**
+     *  Names with at least this many dots are considered fully qualified
+     *  and are not expanded with the search domains
+     *  @var size_t
+     */
+    size_t _ndots = 1;
+
+    /**
+     *  Open and parse the configuration file (the slow path, only taken
+     *  when the process-wide cache holds no up-to-date copy of the file)
+     *  @param  filename    the file to parse
+     *  @param  strict      run in strict mode (do not allow unsupported options)
+     *  @throws std::runtime_error
+     */
+    void load(const char *filename, bool strict);
+
     /**
      *  Helper method to parse lines
      *  @param  line        the line to parse (must already be trimmed)
@@ -105,6 +129,10 @@ private:
 public:
     /**
      *  Constructor
+     *  The parsed settings are cached process-wide per filename, keyed by
+     *  the mtime and size of the file, so that constructing many contexts
+     *  (e.g. in fork-per-job tools) costs a stat() plus a copy instead of
+     *  opening and parsing the file every time
      *  @param  filename            the file to parse
      *  @param  strict              run in strict mode (do not allow any unsupported or unrecognized data
      *  @throws std::runtime_error
@@ -147,6 +175,18 @@ public:
      *  @return size_t
      */
     size_t attempts() const { return _attempts; }
+
+    /**
+     *  The search domains that are appended to short hostnames
+     *  @return std::vector<std::string>
+     */
+    const std::vector<std::string> &searchpaths() const { return _searchpaths; }
+
+    /**
+     *  Names with at least this many dots bypass the search domains
+     *  @return size_t
+     */
+    size_t ndots() const { return _ndots; }
 };
     
 /**
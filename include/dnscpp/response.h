@@ -16,18 +16,81 @@
 /**
  *  Dependencies
  */
+#include <vector>
+#include <string>
 #include "message.h"
+#include "record.h"
 
 /**
  *  Begin of namespace
  */
 namespace DNS {
 
+/**
+ *  The Typed traits class maps a record class (A, AAAA, CNAME, etcetera)
+ *  onto its type constant and its plain value, so that values can be
+ *  pulled straight out of the wire data via Response::extract() without
+ *  constructing the intermediate Record and Extractor objects. The
+ *  specializations live in the headers of the record classes themselves
+ */
+template <typename T> struct Typed;
+
+/**
+ *  Check whether a record matches a record class: the type constant and
+ *  the minimal rdata size both come from the Typed registry, so the check
+ *  inlines to two integer compares against compile-time constants (and
+ *  using a class without a registry entry fails to compile)
+ *  @param  record      the record to check
+ *  @return bool
+ */
+template <typename T> inline bool matches(const Record &record)
+{
+    // both bounds are compile-time constants from the registry
+    return record.type() == Typed<T>::type && record.size() >= Typed<T>::minsize;
+}
+
 /**
  *  Class definition
  */
-class Response : public Message 
+class Response : public Message
 {
+private:
+    /**
+     *  Helper structure that remembers the expansion of one compressed
+     *  name inside the message
+     */
+    struct Expansion
+    {
+        /**
+         *  Offset of the compressed name inside the message
+         *  @var size_t
+         */
+        size_t offset;
+
+        /**
+         *  Number of bytes that the compressed form occupied
+         *  @var ssize_t
+         */
+        ssize_t bytes;
+
+        /**
+         *  The expanded (decompressed) name
+         *  @var std::string
+         */
+        std::string name;
+    };
+
+    /**
+     *  Names that have been decompressed before. A response that holds a
+     *  large rrset normally repeats the very same compressed owner name
+     *  for every record, so remembering earlier expansions means that the
+     *  compression pointers are chased just once per distinct name. The
+     *  cache is filled from const methods (extracting a record does not
+     *  logically modify the response), hence the mutable
+     *  @var std::vector
+     */
+    mutable std::vector<Expansion> _expansions;
+
 public:
     /**
      *  Constructor
@@ -36,7 +99,21 @@ public:
      *  @throws std::runtime_error
      */
     Response(const unsigned char *buffer, size_t size) : Message(buffer, size) {}
-    
+
+    /**
+     *  Constructor that adopts a shared buffer, the import-counterpart
+     *  of dump(): a response that was persisted in an external store can
+     *  be rehydrated without copying the wire data (the response takes
+     *  shared ownership of the buffer). Only the header is validated
+     *  here, the body is not parsed until a record is actually touched,
+     *  so replaying large volumes of stored responses costs no parsing
+     *  up-front
+     *  @param  buffer      shared pointer to the raw wire data
+     *  @param  size        size of the buffer
+     *  @throws std::runtime_error
+     */
+    Response(const std::shared_ptr<unsigned char> &buffer, size_t size) : Message(buffer, size) {}
+
     /**
      *  Copy constructor
      *  It is better not to use this too often as it might not be too efficient to copy responses around
@@ -44,7 +121,356 @@ public:
      *  @throws std::runtime_error
      */
     Response(const Response &that) : Message(that) {}
+
+    /**
+     *  Look up an earlier expansion of a compressed name
+     *  This is used by the Decompressed class, normal user space code has
+     *  no reason to call this
+     *  @param  data        position of the compressed name inside the message
+     *  @param  bytes       output-parameter for the compressed size
+     *  @return const char* the expanded name (nullptr if not seen before)
+     */
+    const char *expansion(const unsigned char *data, ssize_t &bytes) const
+    {
+        // the offset of the name inside the message
+        size_t offset = data - this->data();
+
+        // check all names that were expanded before (a message holds just
+        // a handful of distinct names, so a linear scan is appropriate)
+        for (const auto &expansion : _expansions)
+        {
+            // skip entries for other offsets
+            if (expansion.offset != offset) continue;
+
+            // expose the compressed size and the cached name
+            bytes = expansion.bytes;
+            return expansion.name.data();
+        }
+
+        // this name has not been expanded before
+        return nullptr;
+    }
+
+    /**
+     *  Remember the expansion of a compressed name, so that subsequent
+     *  records with the same owner do not have to chase the compression
+     *  pointers all over again
+     *  @param  data        position of the compressed name inside the message
+     *  @param  name        the expanded name
+     *  @param  bytes       the compressed size
+     */
+    void remember(const unsigned char *data, const char *name, ssize_t bytes) const
+    {
+        // messages hold at most a couple of hundred records, cap the cache
+        // anyway so that a hostile message cannot make it grow endlessly
+        if (_expansions.size() >= 64) return;
+
+        // store the expansion
+        _expansions.push_back(Expansion{ size_t(data - this->data()), bytes, name });
+    }
+
+    /**
+     *  Extract the typed value of a record, going straight from the wire
+     *  data to the value (an Ip for A and AAAA records, a Decompressed
+     *  name for CNAME, NS and PTR records, etcetera) without constructing
+     *  the intermediate Record and Extractor objects. The template
+     *  parameter is the record class, dispatch happens at compile time
+     *  via the Typed traits class, for example:
+     *
+     *      DNS::Ip ip = response.extract<DNS::A>(0);
+     *
+     *  @param  index       the record-number inside the section
+     *  @param  section     the section to extract the record from
+     *  @return Value       the extracted value
+     *  @throws std::runtime_error
+     */
+    template <typename T>
+    typename Typed<T>::Value extract(int index, ns_sect section = ns_s_an) const;
+
+    /**
+     *  Extract an entire rrset in one call into caller-supplied storage,
+     *  for example all A records with their ttls. The section is walked
+     *  exactly once, records of other types are skipped, and no
+     *  per-record temporaries are constructed. The method stops when the
+     *  supplied array is full and returns the number of values stored,
+     *  for example:
+     *
+     *      DNS::Ip ips[16]; uint32_t ttls[16];
+     *      size_t count = response.rrset<DNS::A>(ips, 16, ttls);
+     *
+     *  @param  values      caller-supplied array for the values
+     *  @param  capacity    size of that array (and of the ttl array)
+     *  @param  ttls        optional caller-supplied array for the ttls
+     *  @param  section     the section to extract the rrset from
+     *  @return size_t      number of values that were stored
+     *  @throws std::runtime_error
+     */
+    template <typename T>
+    size_t rrset(typename Typed<T>::Value *values, size_t capacity, uint32_t *ttls = nullptr, ns_sect section = ns_s_an) const;
+
+    /**
+     *  Forward iterator over the records in one section. The iterator
+     *  keeps its own position inside the wire data, so that walking over
+     *  a section touches every byte exactly once (enumerating records by
+     *  index restarts at the section boundary for every record, which is
+     *  quadratic for big rrsets). The iterator derives from Record and
+     *  fills the underlying structure in place, dereferencing it exposes
+     *  the normal Record interface without any copying
+     */
+    class Iterator : public Record
+    {
+    private:
+        /**
+         *  Begin and end of the full message (names may be compressed
+         *  and point back to earlier parts of the message)
+         *  @var const unsigned char *
+         */
+        const unsigned char *_begin = nullptr;
+        const unsigned char *_end = nullptr;
+
+        /**
+         *  Current position inside the wire data (start of the record
+         *  that has not been parsed yet)
+         *  @var const unsigned char *
+         */
+        const unsigned char *_pos = nullptr;
+
+        /**
+         *  Number of records that still have to be parsed
+         *  @var uint16_t
+         */
+        uint16_t _remaining = 0;
+
+        /**
+         *  Does the iterator currently hold a valid record?
+         *  @var bool
+         */
+        bool _valid = false;
+
+        /**
+         *  Parse the record at the current position and move the
+         *  position past it
+         *  @throws std::runtime_error
+         */
+        void next()
+        {
+            // when all records have been seen this becomes the end-iterator
+            if (_remaining == 0 || _pos == nullptr) { _valid = false; return; }
+
+            // expand the owner name, this also tells us how many bytes the
+            // (possibly compressed) name occupied inside the message
+            int consumed = ns_name_uncompress(_begin, _end, _pos, _record.name, sizeof(_record.name));
+
+            // check for success
+            if (consumed < 0) throw std::runtime_error("failed to parse record");
+
+            // the fixed fields come right after the name
+            const unsigned char *data = _pos + consumed;
+
+            // type, class, ttl and rdata-size together occupy ten bytes
+            if (_end - data < 10) throw std::runtime_error("failed to parse record");
+
+            // extract the fixed fields
+            _record.type = ns_get16(data);
+            _record.rr_class = ns_get16(data + 2);
+            _record.ttl = ns_get32(data + 4);
+            _record.rdlength = ns_get16(data + 8);
+
+            // the rdata comes right after the fixed fields
+            data += 10;
+
+            // the rdata must fit inside the message
+            if (_end - data < _record.rdlength) throw std::runtime_error("failed to parse record");
+
+            // store the rdata and move past the record
+            _record.rdata = data;
+            _pos = data + _record.rdlength;
+
+            // one record less to go
+            _remaining -= 1;
+
+            // the iterator now holds a valid record
+            _valid = true;
+        }
+
+    public:
+        /**
+         *  Constructor for the begin-iterator
+         *  @param  response    the response to iterate over
+         *  @param  section     the section to iterate over
+         *  @throws std::runtime_error
+         */
+        Iterator(const Response *response, ns_sect section)
+        {
+            // the message boundaries (handle() parses the body, which
+            // records the offsets of the sections)
+            auto *handle = response->handle();
+
+            // the boundaries of the full message
+            _begin = response->data();
+            _end = response->end();
+
+            // start of the section and the number of records in it
+            _pos = handle->_sections[section];
+            _remaining = handle->_counts[section];
+
+            // parse the first record
+            next();
+        }
+
+        /**
+         *  Constructor for the end-iterator
+         */
+        Iterator() = default;
+
+        /**
+         *  Move on to the next record
+         *  @return Iterator
+         *  @throws std::runtime_error
+         */
+        Iterator &operator++()
+        {
+            // parse the next record
+            next();
+
+            // allow chaining
+            return *this;
+        }
+
+        /**
+         *  Dereference, this exposes the record that was last parsed
+         *  @return Record
+         */
+        const Record &operator*() const { return *this; }
+        const Record *operator->() const { return this; }
+
+        /**
+         *  Comparison, this only distinguishes valid iterators from the
+         *  end-iterator, which is all that a forward scan needs
+         *  @param  that        the other iterator
+         *  @return bool
+         */
+        bool operator==(const Iterator &that) const { return _valid == that._valid; }
+        bool operator!=(const Iterator &that) const { return _valid != that._valid; }
+    };
+
+    /**
+     *  Helper class that makes one section iterable, so that range-based
+     *  loops over the authority and additional sections are possible too
+     */
+    class Section
+    {
+    private:
+        /**
+         *  The response to iterate over
+         *  @var Response
+         */
+        const Response *_response;
+
+        /**
+         *  The section to iterate over
+         *  @var ns_sect
+         */
+        ns_sect _section;
+
+    public:
+        /**
+         *  Constructor
+         *  @param  response    the response to iterate over
+         *  @param  section     the section to iterate over
+         */
+        Section(const Response *response, ns_sect section) : _response(response), _section(section) {}
+
+        /**
+         *  The begin- and end-iterators of the section
+         *  @return Iterator
+         */
+        Iterator begin() const { return Iterator(_response, _section); }
+        Iterator end() const { return Iterator(); }
+    };
+
+    /**
+     *  Expose one section as an iterable range with begin()/end(), so
+     *  that a range-based loop can walk over the records, for example
+     *  for the answer section:
+     *
+     *      for (const auto &record : response.section(ns_s_an)) { ... }
+     *
+     *  Note that the method is not called begin()/end() on the response
+     *  itself, because end() is already the method that exposes the end
+     *  of the raw wire data
+     *  @param  section     the section to iterate over
+     *  @return Section
+     */
+    Section section(ns_sect section) const { return Section(this, section); }
 };
+
+/**
+ *  Implementation of the extract() method, defined outside the class so
+ *  that the class definition stays readable
+ *  @param  index       the record-number inside the section
+ *  @param  section     the section to extract the record from
+ *  @return Value       the extracted value
+ *  @throws std::runtime_error
+ */
+template <typename T>
+typename Typed<T>::Value Response::extract(int index, ns_sect section) const
+{
+    // structure into which the record is parsed (this only locates the
+    // record inside the message, nothing is copied or allocated)
+    ns_rr record;
+
+    // locate the record (libresolv oddly enough wants a non-const handle)
+    if (ns_parserr((ns_msg *)handle(), section, index, &record) != 0) throw std::runtime_error("failed to parse record");
+
+    // the record must be of the expected type
+    if (ns_rr_type(record) != Typed<T>::type) throw std::runtime_error("type mismatch / wrong record type");
+
+    // check size of the record
+    if (ns_rr_rdlen(record) < Typed<T>::minsize) throw std::runtime_error("record too small");
+
+    // the traits class converts the raw rdata into the value
+    return Typed<T>::convert(*this, ns_rr_rdata(record), ns_rr_rdlen(record));
+}
+
+/**
+ *  Implementation of the rrset() method: one pass over the section with
+ *  the single-pass iterator, converting all matching records in place
+ *  @param  values      caller-supplied array for the values
+ *  @param  capacity    size of that array (and of the ttl array)
+ *  @param  ttls        optional caller-supplied array for the ttls
+ *  @param  section     the section to extract the rrset from
+ *  @return size_t      number of values that were stored
+ *  @throws std::runtime_error
+ */
+template <typename T>
+size_t Response::rrset(typename Typed<T>::Value *values, size_t capacity, uint32_t *ttls, ns_sect section) const
+{
+    // number of values stored so far
+    size_t result = 0;
+
+    // walk over the section in a single pass
+    for (Iterator iter(this, section); result < capacity && iter != Iterator(); ++iter)
+    {
+        // skip records of a different type
+        if (iter->type() != Typed<T>::type) continue;
+
+        // skip records with impossibly small rdata
+        if (iter->size() < Typed<T>::minsize) continue;
+
+        // convert the rdata straight into the caller-supplied slot
+        values[result] = Typed<T>::convert(*this, iter->data(), iter->size());
+
+        // expose the ttl too when the caller asked for them
+        if (ttls != nullptr) ttls[result] = iter->ttl();
+
+        // on to the next slot
+        result += 1;
+    }
+
+    // number of values that were stored
+    return result;
+}
     
 /**
  *  End of namespace
@@ -35,6 +35,37 @@ private:
      */
     char _buffer[128];
 
+    /**
+     *  Expose the four characters that a byte contributes to an ".ip6.arpa"
+     *  name (low nibble first, because the name holds the address in reverse
+     *  order, and each nibble is followed by a dot). The chunks come from a
+     *  table that is computed once, so that building the 32 nibbles of an
+     *  ipv6 reverse name costs sixteen four-byte copies instead of a trip
+     *  through the printf machinery
+     *  @param  byte        the byte to format
+     *  @return const char* the four-character chunk (not null-terminated)
+     */
+    static const char *chunk(unsigned char byte)
+    {
+        // the precomputed table with a chunk for each of the 256 byte values
+        static const struct Table {
+            char data[256][4];
+            Table() {
+                // the hexadecimal digits
+                const char digits[] = "0123456789abcdef";
+
+                // fill the chunk for each byte value
+                for (size_t i = 0; i < 256; ++i)
+                {
+                    data[i][0] = digits[i & 0xf]; data[i][1] = '.';
+                    data[i][2] = digits[i >> 4];  data[i][3] = '.';
+                }
+            }
+        } table;
+
+        // expose the entry
+        return table.data[byte];
+    }
 
     /**
      *  Scan the buffer as ipv4 address
@@ -112,17 +143,15 @@ public:
             // pointer to the bytes
             auto *bytes = (unsigned char *)&addr.s6_addr;
 
-            // write the parts in reverse order
-            sprintf(_buffer, "%x.%x.%x.%x.%x.%x.%x.%x.%x.%x.%x.%x.%x.%x.%x.%x.%x.%x.%x.%x.%x.%x.%x.%x.%x.%x.%x.%x.%x.%x.%x.%x.ip6.arpa",
-                bytes[15]&0xf, bytes[15] >> 4, bytes[14]&0xf, bytes[14] >> 4,
-                bytes[13]&0xf, bytes[13] >> 4, bytes[12]&0xf, bytes[12] >> 4,
-                bytes[11]&0xf, bytes[11] >> 4, bytes[10]&0xf, bytes[10] >> 4,
-                bytes[9]&0xf,  bytes[9]  >> 4, bytes[8]&0xf,  bytes[8]  >> 4,
-                bytes[7]&0xf,  bytes[7]  >> 4, bytes[6]&0xf,  bytes[6]  >> 4,
-                bytes[5]&0xf,  bytes[5]  >> 4, bytes[4]&0xf,  bytes[4]  >> 4,
-                bytes[3]&0xf,  bytes[3]  >> 4, bytes[2]&0xf,  bytes[2]  >> 4,
-                bytes[1]&0xf,  bytes[1]  >> 4, bytes[0]&0xf,  bytes[0]  >> 4
-            );
+            // pointer that walks over the output buffer
+            char *out = _buffer;
+
+            // write the parts in reverse order, each byte contributes its
+            // precomputed "l.h." chunk (low nibble first)
+            for (size_t i = 16; i-- > 0; out += 4) memcpy(out, chunk(bytes[i]), 4);
+
+            // append the suffix (including the terminating null-byte)
+            memcpy(out, "ip6.arpa", 9);
         }
     }
     
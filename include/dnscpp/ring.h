@@ -0,0 +1,208 @@
+/**
+ *  Ring.h
+ *
+ *  Because the speed at which UDP packets come in can be higher than
+ *  the speed at which they can be processed by user-space, the DNS-CPP
+ *  library first reads out the socket, buffers the responses, and
+ *  postpones parsing those responses until the event loop is idle.
+ *
+ *  This class implements the buffer for those received, unparsed
+ *  messages: a ring of fixed-size slots that is allocated once, so
+ *  that buffering a message is a single copy without any allocation,
+ *  and messages that are waiting to be processed sit next to each
+ *  other in memory instead of being scattered over the heap.
+ *
+ *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include <vector>
+#include <string.h>
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Class definition
+ */
+class Ring
+{
+public:
+    /**
+     *  Size of one slot, and thus the biggest datagram that can be
+     *  buffered (comfortably more than the 1200 bytes that we advertise
+     *  in the edns section of a query)
+     */
+    constexpr static size_t slotsize = 4096;
+
+private:
+    /**
+     *  Number of slots in the ring
+     *  @var size_t
+     */
+    size_t _slots;
+
+    /**
+     *  The actual storage for the slots, allocated lazily (an idle
+     *  nameserver then costs no memory) but at most once
+     *  @var std::vector
+     */
+    std::vector<unsigned char> _data;
+
+    /**
+     *  The sizes of the buffered messages
+     *  @var std::vector
+     */
+    std::vector<size_t> _sizes;
+
+    /**
+     *  Index of the oldest buffered message
+     *  @var size_t
+     */
+    size_t _head = 0;
+
+    /**
+     *  Number of buffered messages
+     *  @var size_t
+     */
+    size_t _count = 0;
+
+    /**
+     *  Number of messages that were shed because the ring was full (or
+     *  because a message was too big for a slot)
+     *  @var size_t
+     */
+    size_t _dropped = 0;
+
+public:
+    /**
+     *  Constructor
+     *  @param  slots       number of messages that can be buffered
+     */
+    Ring(size_t slots = 1024) : _slots(slots) {}
+
+    /**
+     *  No copying
+     *  @param  that
+     */
+    Ring(const Ring &that) = delete;
+
+    /**
+     *  Destructor
+     */
+    virtual ~Ring() = default;
+
+    /**
+     *  Is the ring empty?
+     *  @return bool
+     */
+    bool empty() const { return _count == 0; }
+
+    /**
+     *  Number of buffered messages
+     *  @return size_t
+     */
+    size_t size() const { return _count; }
+
+    /**
+     *  Number of messages that the ring can hold
+     *  @return size_t
+     */
+    size_t capacity() const { return _slots; }
+
+    /**
+     *  Update the number of messages that the ring can hold. Messages
+     *  that are currently buffered are discarded, so this is best called
+     *  before traffic starts flowing
+     *  @param  slots       number of messages that can be buffered
+     */
+    void capacity(size_t slots)
+    {
+        // we need room for at least one message
+        _slots = slots ? slots : 1;
+
+        // drop the old storage, it is reallocated with the new size on
+        // the first push
+        _data.clear(); _sizes.clear(); _head = 0; _count = 0;
+    }
+
+    /**
+     *  Number of messages that were shed because the ring was full
+     *  @return size_t
+     */
+    size_t dropped() const { return _dropped; }
+
+    /**
+     *  Add a message to the ring. When the ring is full the oldest
+     *  buffered message is shed to make room: under attack conditions
+     *  the most recent responses are the ones still worth processing
+     *  @param  buffer      the message
+     *  @param  size        size of the message
+     *  @return bool        false when the message was too big for a slot
+     */
+    bool push(const unsigned char *buffer, size_t size)
+    {
+        // messages that do not fit in a slot are refused
+        if (size > slotsize) { _dropped += 1; return false; }
+
+        // when the ring is full the oldest message makes way
+        if (_count >= _slots) { pop(); _dropped += 1; }
+
+        // allocate the storage the first time it is needed
+        if (_data.empty()) { _data.resize(_slots * slotsize); _sizes.resize(_slots); }
+
+        // the slot right behind the last buffered message
+        size_t slot = (_head + _count) % _slots;
+
+        // copy the message into the slot
+        memcpy(&_data[slot * slotsize], buffer, size);
+
+        // remember the size
+        _sizes[slot] = size;
+
+        // one more message
+        _count += 1;
+
+        // done
+        return true;
+    }
+
+    /**
+     *  The oldest buffered message (only valid when the ring is not empty)
+     *  @return const unsigned char *
+     */
+    const unsigned char *front() const { return &_data[_head * slotsize]; }
+
+    /**
+     *  Size of the oldest buffered message
+     *  @return size_t
+     */
+    size_t frontsize() const { return _sizes[_head]; }
+
+    /**
+     *  Remove the oldest message from the ring
+     */
+    void pop()
+    {
+        // nothing to do when there is nothing buffered
+        if (_count == 0) return;
+
+        // move the head and drop the count
+        _head = (_head + 1) % _slots; _count -= 1;
+    }
+};
+
+/**
+ *  End of namespace
+ */
+}
@@ -16,6 +16,13 @@
  */
 #pragma once
 
+/**
+ *  Dependencies
+ */
+#include <stdexcept>
+#include "dnskey.h"
+#include "algorithm.h"
+
 /**
  *  Begin of namespace
  */
@@ -55,10 +62,11 @@ public:
     {
         // check the protocol
         switch (key.algorithm()) {
-        case Algorith::RSA_SHA1:    break;
-        case Algorith::RSA_SHA256:  break;
-        case Algorith::RSA_SHA512:  break;
-        default:                    throw std::runtime_error("Invalid algorithm for RSA-SHA");
+        case Algorithm::RSASHA1:        break;
+        case Algorithm::RSASHA1_NSEC3:  break;
+        case Algorithm::RSASHA256:      break;
+        case Algorithm::RSASHA512:      break;
+        default:                        throw std::runtime_error("Invalid algorithm for RSA-SHA");
         }
 
         // we need at least one byte for the size
@@ -129,5 +137,5 @@ public:
 /**
  *  End of namespace
  */
-}}
+}
 
@@ -0,0 +1,203 @@
+/**
+ *  SharedCache.h
+ *
+ *  Cache backend that lives in a posix shared memory segment, so that
+ *  multiple worker processes (each with their own DNS::Context) can
+ *  resolve from one pool of cached responses instead of each hammering
+ *  the nameservers with the same queries.
+ *
+ *  The segment holds a fixed-size direct-mapped table. Every slot is
+ *  protected by a sequence-counter (seqlock): the single designated
+ *  writer bumps the counter to an odd value while it updates the slot,
+ *  readers simply retry if they see an odd or changed counter. Readers
+ *  therefore never block and need no locks at all.
+ *
+ *  Responses that do not fit in a slot (bigger than the classic 512
+ *  byte udp payload) are simply not shared, the per-process cache
+ *  still holds them.
+ *
+ *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include <vector>
+#include <string>
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Forward declarations
+ */
+class Response;
+
+/**
+ *  Class definition
+ */
+class SharedCache
+{
+private:
+    /**
+     *  Layout of a single slot in the shared segment
+     */
+    struct Slot
+    {
+        /**
+         *  Sequence counter, odd while the writer is busy with the slot
+         *  @var uint32_t
+         */
+        volatile uint32_t sequence;
+
+        /**
+         *  Time at which the stored response is no longer valid
+         *  @var double
+         */
+        double expires;
+
+        /**
+         *  The record-type of the stored question
+         *  @var uint16_t
+         */
+        uint16_t type;
+
+        /**
+         *  Size of the stored hostname
+         *  @var uint16_t
+         */
+        uint16_t namesize;
+
+        /**
+         *  Size of the stored response
+         *  @var uint16_t
+         */
+        uint16_t size;
+
+        /**
+         *  The hostname of the stored question (not null-terminated)
+         *  @var char[]
+         */
+        char name[256];
+
+        /**
+         *  The raw response buffer
+         *  @var unsigned char[]
+         */
+        unsigned char buffer[512];
+    };
+
+    /**
+     *  Layout of the header in front of the slots
+     */
+    struct Header
+    {
+        /**
+         *  Magic value to recognize (and version) the segment layout
+         *  @var uint32_t
+         */
+        uint32_t magic;
+
+        /**
+         *  Number of slots in the table
+         *  @var uint32_t
+         */
+        uint32_t slots;
+    };
+
+    /**
+     *  The magic value that we expect in the header
+     *  @var uint32_t
+     */
+    static const uint32_t MAGIC = 0x444e5331;       // "DNS1"
+
+    /**
+     *  Pointer to the mapped segment
+     *  @var Header
+     */
+    Header *_header = nullptr;
+
+    /**
+     *  Total size of the mapping in bytes
+     *  @var size_t
+     */
+    size_t _size = 0;
+
+    /**
+     *  Is this instance the designated writer?
+     *  @var bool
+     */
+    bool _writer;
+
+    /**
+     *  Get access to the slot that may hold a certain question
+     *  @param  hostname    the hostname
+     *  @param  type        the record-type
+     *  @return Slot
+     */
+    Slot *slot(const char *hostname, uint16_t type) const;
+
+public:
+    /**
+     *  Constructor, creates or attaches to a named shared memory segment
+     *  @param  name        name of the segment (e.g. "/dnscpp-cache")
+     *  @param  slots       number of slots in the table (only relevant for the creator)
+     *  @param  writer      is this instance the single designated writer?
+     *  @throws std::runtime_error
+     */
+    SharedCache(const char *name, size_t slots, bool writer);
+
+    /**
+     *  No copying
+     *  @param  that
+     */
+    SharedCache(const SharedCache &that) = delete;
+
+    /**
+     *  Destructor
+     */
+    virtual ~SharedCache();
+
+    /**
+     *  Is this instance the designated writer?
+     *  @return bool
+     */
+    bool writer() const { return _writer; }
+
+    /**
+     *  Look for a cached response for a certain hostname and record-type
+     *  On success the raw response is copied into the supplied buffer
+     *  @param  now         current time
+     *  @param  hostname    the hostname to look for
+     *  @param  type        the record-type
+     *  @param  buffer      buffer in which the response is stored
+     *  @param  expires     on success the expire-time of the entry is stored here
+     *  @return bool        was a still-valid response found?
+     */
+    bool find(double now, const char *hostname, uint16_t type, std::vector<unsigned char> &buffer, double &expires) const;
+
+    /**
+     *  Store a response in the shared segment
+     *  Only the designated writer actually writes, for other instances
+     *  this is a no-op so it is safe to always call this
+     *  @param  now         current time
+     *  @param  expires     time at which the response expires
+     *  @param  response    the received response
+     */
+    void insert(double now, double expires, const Response &response);
+};
+
+/**
+ *  End of namespace
+ */
+}
@@ -0,0 +1,149 @@
+/**
+ *  Signable.h
+ *
+ *  Helper class that reconstructs the "signed data" of an RRSIG record
+ *  as described in RFC 4034 section 3.1.8.1: the rdata of the signature
+ *  (up to and including the signer name) followed by the covered rrset
+ *  in canonical form (lowercased owner names, original ttl, records
+ *  sorted in canonical order).
+ *
+ *  DNS-CPP deliberately does not depend on a crypto library, so the
+ *  actual signature check is left to user space: this class prepares the
+ *  exact byte sequence over which the signature was calculated, which
+ *  can be passed to openssl or any other library together with the key
+ *  from the DNSKEY record. The static verify() method does this for all
+ *  signatures in a response in one pass, canonicalizing each distinct
+ *  rrset only once.
+ *
+ *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include <vector>
+#include <deque>
+#include <functional>
+#include "response.h"
+#include "record.h"
+#include "rrsig.h"
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Class definition
+ */
+class Signable
+{
+private:
+    /**
+     *  The assembled signed data
+     *  @var std::vector
+     */
+    std::vector<unsigned char> _data;
+
+    /**
+     *  Append the rdata-prefix of the signature (everything up to and
+     *  including the signer name, which is written in lowercase)
+     *  @param  signature   the signature
+     */
+    void prefix(const RRSIG &signature);
+
+    /**
+     *  Helper method that writes a domain name in canonical wire form
+     *  (lowercase), optionally reduced to its rightmost labels with a
+     *  wildcard in front (RFC 4035 section 5.3.2)
+     *  @param  out         buffer to append to
+     *  @param  name        the name to encode
+     *  @param  labels      number of labels according to the signature
+     */
+    static void encode(std::vector<unsigned char> &out, const char *name, size_t labels);
+
+    /**
+     *  Build the canonical form of the rrset that a signature covers
+     *  @param  signature   the signature
+     *  @param  records     all records of the section (already collected)
+     *  @return std::vector the canonicalized rrset
+     */
+    static std::vector<unsigned char> rrset(const RRSIG &signature, const std::deque<Record> &records);
+
+    /**
+     *  Private constructor that combines a signature-prefix with an
+     *  already canonicalized rrset (used by the batch verify() method to
+     *  share the rrset between signatures that cover the same records)
+     *  @param  signature   the signature
+     *  @param  records     the canonicalized rrset
+     */
+    Signable(const RRSIG &signature, const std::vector<unsigned char> &records);
+
+public:
+    /**
+     *  Constructor, builds the signed data for one signature
+     *  @param  response    the response that holds signature and records
+     *  @param  signature   the signature to reconstruct the data for
+     *  @throws std::runtime_error
+     */
+    Signable(const Response &response, const RRSIG &signature);
+
+    /**
+     *  Destructor
+     */
+    virtual ~Signable() = default;
+
+    /**
+     *  The byte sequence over which the signature was calculated
+     *  @return const unsigned char *
+     */
+    const unsigned char *data() const { return _data.data(); }
+
+    /**
+     *  Size of that byte sequence
+     *  @return size_t
+     */
+    size_t size() const { return _data.size(); }
+
+    /**
+     *  The type of the callback that performs the actual cryptographic
+     *  check (library-independent: it gets the signature record plus the
+     *  signed data and should return true when the signature is valid)
+     *  Implementations are advised to use one-shot digest/verify calls
+     *  (like openssl's EVP_DigestVerify()) rather than hand-rolled sha
+     *  code: those runtime-dispatch to the sha-ni / armv8 crypto
+     *  instructions of the cpu, which matters because digesting the
+     *  canonicalized rrsets is pure throughput work
+     *  @type   function
+     */
+    using Verifier = std::function<bool(const RRSIG &signature, const unsigned char *data, size_t size)>;
+
+    /**
+     *  Verify all signatures in the answer section of a response in one
+     *  pass: the records are collected once, each distinct rrset is
+     *  canonicalized once and shared between the signatures that cover
+     *  it, and the verifier is called for every signature
+     *  Verification outcomes are deterministic for a given signed-data
+     *  byte sequence (which embeds the keytag), so they are cached in a
+     *  bounded per-thread lru keyed by a seeded digest of that data:
+     *  repeat lookups of the same signed rrset within the ttl skip the
+     *  expensive cryptographic check entirely. Pass cache=false to force
+     *  the callback to run for every signature
+     *  @param  response    the response to verify
+     *  @param  verifier    callback that performs the cryptographic check
+     *  @param  cache       may cached outcomes be used?
+     *  @return size_t      number of signatures that the verifier approved
+     */
+    static size_t verify(const Response &response, const Verifier &verifier, bool cache = true);
+};
+
+/**
+ *  End of namespace
+ */
+}
@@ -0,0 +1,189 @@
+/**
+ *  SRV.h
+ *
+ *  If you have a Record object that holds an SRV record (rfc 2782,
+ *  service discovery), you can use this extra class to extract the
+ *  priority, weight, port and target hostname from it.
+ *
+ *  Because every consumer of SRV records needs the same ordering (by
+ *  priority, and weight-proportional within equal priorities), the
+ *  class can also order a whole rrset in one pass at extraction time,
+ *  so that callers do not each re-implement the rfc 2782 selection
+ *  algorithm over the raw records.
+ *
+ *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include "extractor.h"
+#include "decompressed.h"
+#include "type.h"
+#include <string>
+#include <vector>
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Forward declarations
+ */
+class Response;
+
+/**
+ *  Class definition
+ */
+class SRV : public Extractor
+{
+private:
+    /**
+     *  The target server name
+     *  @var char[]
+     */
+    Decompressed _target;
+
+public:
+    /**
+     *  One target of an ordered SRV set, in the order in which the
+     *  targets should be tried
+     */
+    struct Target
+    {
+        /**
+         *  The hostname of the target
+         *  @var std::string
+         */
+        std::string hostname;
+
+        /**
+         *  The priority (lower is more preferred)
+         *  @var uint16_t
+         */
+        uint16_t priority;
+
+        /**
+         *  The weight that was used for the ordering
+         *  @var uint16_t
+         */
+        uint16_t weight;
+
+        /**
+         *  The port on which the service runs
+         *  @var uint16_t
+         */
+        uint16_t port;
+    };
+
+    /**
+     *  The constructor
+     *  @param  response
+     *  @param  record
+     *  @throws std::runtime_error
+     */
+    SRV(const Response &response, const Record &record) :
+        Extractor(record, TYPE_SRV, 6),
+        _target(response, record.data() + 6) {} // priority, weight and port precede the target
+
+    /**
+     *  Destructor
+     */
+    virtual ~SRV() = default;
+
+    /**
+     *  The priority (lower is more preferred)
+     *  @return uint16_t
+     */
+    uint16_t priority() const
+    {
+        // extract the value
+        return ns_get16(_record.data());
+    }
+
+    /**
+     *  The weight for the selection within one priority
+     *  @return uint16_t
+     */
+    uint16_t weight() const
+    {
+        // extract the value
+        return ns_get16(_record.data() + 2);
+    }
+
+    /**
+     *  The port on which the service runs
+     *  @return uint16_t
+     */
+    uint16_t port() const
+    {
+        // extract the value
+        return ns_get16(_record.data() + 4);
+    }
+
+    /**
+     *  The target hostname
+     *  @return const char *
+     */
+    const char *hostname() const
+    {
+        // return the hostname
+        return _target;
+    }
+
+    /**
+     *  Extract and order the whole SRV rrset of a response in one
+     *  pass: grouped by priority, and within one priority ordered by
+     *  the weighted random selection of rfc 2782, so that over many
+     *  lookups the load spreads proportionally to the weights. The
+     *  result is the order in which the targets should be contacted.
+     *  A target of "." (service decidedly not available) is skipped.
+     *  @param  response    the response holding the SRV records
+     *  @param  section     the section to extract from
+     *  @return std::vector the ordered targets
+     */
+    static std::vector<Target> order(const Response &response, ns_sect section = ns_s_an);
+};
+
+/**
+ *  Traits for Response::extract<SRV>(), so that the target can be pulled
+ *  straight out of the wire data without intermediate objects
+ */
+template <> struct Typed<SRV>
+{
+    /**
+     *  The value of an SRV record reuses the Target structure
+     */
+    using Value = SRV::Target;
+
+    /**
+     *  The type constant and the minimal rdata size
+     */
+    static constexpr ns_type type = TYPE_SRV;
+    static constexpr size_t minsize = 6;
+
+    /**
+     *  Convert the raw rdata into the value
+     *  @param  response    the full response
+     *  @param  data        the rdata of the record
+     *  @param  size        size of the rdata
+     *  @return Value
+     */
+    static Value convert(const Response &response, const unsigned char *data, size_t size)
+    {
+        // the three fixed fields come first, the target name follows
+        return Value{ std::string(Decompressed(response, data + 6)), (uint16_t)ns_get16(data), (uint16_t)ns_get16(data + 2), (uint16_t)ns_get16(data + 4) };
+    }
+};
+
+/**
+ *  End of namespace
+ */
+}
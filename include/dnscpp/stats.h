@@ -0,0 +1,233 @@
+/**
+ *  Stats.h
+ *
+ *  Per-nameserver traffic statistics: counters for the datagrams that
+ *  were sent and received, retransmissions, attempt-timeouts and
+ *  truncated responses, plus a round-trip-time histogram with fixed
+ *  log-scale buckets. Operators can snapshot these numbers to drive
+ *  the tuning of settings like capacity(), buffersize() and attempts()
+ *  from real data instead of guesswork.
+ *
+ *  The counters are maintained with relaxed atomics so that the hot
+ *  path pays no more than a plain increment, while a monitoring thread
+ *  can take a snapshot without locking. The individual numbers in a
+ *  snapshot are each consistent, but are not taken at one atomic
+ *  instant, which is fine for monitoring purposes.
+ *
+ *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include <atomic>
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Class definition
+ */
+class Stats
+{
+public:
+    /**
+     *  Number of buckets in the round-trip-time histogram: bucket i
+     *  counts the samples faster than 100 microseconds times 2^(i+1),
+     *  the last bucket counts everything slower
+     *  @var size_t
+     */
+    static constexpr size_t buckets = 16;
+
+    /**
+     *  A plain copy of the counters, this is what monitoring code gets
+     */
+    struct Snapshot
+    {
+        /**
+         *  Number of datagrams that were sent to the nameserver
+         *  @var uint64_t
+         */
+        uint64_t sent;
+
+        /**
+         *  Number of responses that were received from the nameserver
+         *  @var uint64_t
+         */
+        uint64_t received;
+
+        /**
+         *  Number of sent datagrams that were retransmissions of an
+         *  earlier attempt of the same lookup
+         *  @var uint64_t
+         */
+        uint64_t retransmitted;
+
+        /**
+         *  Number of attempts that got no answer in time (the answer
+         *  may still have arrived later, it just came too late)
+         *  @var uint64_t
+         */
+        uint64_t timeouts;
+
+        /**
+         *  Number of responses that came back truncated, forcing the
+         *  lookup to fall back to tcp
+         *  @var uint64_t
+         */
+        uint64_t truncated;
+
+        /**
+         *  The round-trip-time histogram, filled with the unambiguous
+         *  samples (responses to queries that were sent exactly once)
+         *  @var uint64_t[]
+         */
+        uint64_t rtt[buckets];
+    };
+
+private:
+    /**
+     *  Number of datagrams that were sent to the nameserver
+     *  @var std::atomic
+     */
+    std::atomic<uint64_t> _sent;
+
+    /**
+     *  Number of responses that were received from the nameserver
+     *  @var std::atomic
+     */
+    std::atomic<uint64_t> _received;
+
+    /**
+     *  Number of retransmitted datagrams
+     *  @var std::atomic
+     */
+    std::atomic<uint64_t> _retransmitted;
+
+    /**
+     *  Number of attempts that got no answer in time
+     *  @var std::atomic
+     */
+    std::atomic<uint64_t> _timeouts;
+
+    /**
+     *  Number of truncated responses
+     *  @var std::atomic
+     */
+    std::atomic<uint64_t> _truncated;
+
+    /**
+     *  The round-trip-time histogram
+     *  @var std::atomic[]
+     */
+    std::atomic<uint64_t> _rtt[buckets];
+
+public:
+    /**
+     *  Constructor, all counters start at zero
+     */
+    Stats()
+    {
+        // zero the plain counters
+        _sent.store(0, std::memory_order_relaxed);
+        _received.store(0, std::memory_order_relaxed);
+        _retransmitted.store(0, std::memory_order_relaxed);
+        _timeouts.store(0, std::memory_order_relaxed);
+        _truncated.store(0, std::memory_order_relaxed);
+
+        // and the histogram
+        for (auto &bucket : _rtt) bucket.store(0, std::memory_order_relaxed);
+    }
+
+    /**
+     *  No copying, the live counters stay with the nameserver (use
+     *  snapshot() to take a copy)
+     *  @param  that
+     */
+    Stats(const Stats &that) = delete;
+
+    /**
+     *  Destructor
+     */
+    virtual ~Stats() = default;
+
+    /**
+     *  Count a sent datagram
+     */
+    void sent() { _sent.fetch_add(1, std::memory_order_relaxed); }
+
+    /**
+     *  Count a received response
+     */
+    void received() { _received.fetch_add(1, std::memory_order_relaxed); }
+
+    /**
+     *  Count a retransmitted datagram
+     */
+    void retransmitted() { _retransmitted.fetch_add(1, std::memory_order_relaxed); }
+
+    /**
+     *  Count an attempt that got no answer in time
+     */
+    void timeout() { _timeouts.fetch_add(1, std::memory_order_relaxed); }
+
+    /**
+     *  Count a truncated response
+     */
+    void truncated() { _truncated.fetch_add(1, std::memory_order_relaxed); }
+
+    /**
+     *  Feed a round-trip measurement into the histogram
+     *  @param  rtt     measured round-trip time in seconds
+     */
+    void sample(double rtt)
+    {
+        // the upper bound of the first bucket
+        double limit = 0.0002; size_t bucket = 0;
+
+        // find the first bucket whose upper bound fits the sample, the
+        // last bucket catches everything slower
+        while (bucket < buckets - 1 && rtt >= limit) { limit *= 2; bucket += 1; }
+
+        // count the sample
+        _rtt[bucket].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /**
+     *  Take a copy of the counters
+     *  @return Snapshot
+     */
+    Snapshot snapshot() const
+    {
+        // the copy to fill
+        Snapshot result;
+
+        // copy the plain counters
+        result.sent = _sent.load(std::memory_order_relaxed);
+        result.received = _received.load(std::memory_order_relaxed);
+        result.retransmitted = _retransmitted.load(std::memory_order_relaxed);
+        result.timeouts = _timeouts.load(std::memory_order_relaxed);
+        result.truncated = _truncated.load(std::memory_order_relaxed);
+
+        // and the histogram
+        for (size_t i = 0; i < buckets; ++i) result.rtt[i] = _rtt[i].load(std::memory_order_relaxed);
+
+        // expose the copy
+        return result;
+    }
+};
+
+/**
+ *  End of namespace
+ */
+}
@@ -26,6 +26,7 @@
 #include "extractor.h"
 #include "response.h"
 #include "type.h"
+#include <string>
 
 /**
  *  Begin of namespace
@@ -136,6 +137,45 @@ public:
     size_t size() const { return _record.size() - 3; }
 };
 
+/**
+ *  Traits for Response::extract<TLSA>(), so that the association data
+ *  can be pulled straight out of the wire data without intermediate
+ *  objects
+ */
+template <> struct Typed<TLSA>
+{
+    /**
+     *  The value of a TLSA record: the three selector bytes plus the
+     *  association data (the certificate, public key or hash thereof)
+     */
+    struct Value
+    {
+        uint8_t usage;
+        uint8_t selector;
+        uint8_t hashing;
+        std::string data;
+    };
+
+    /**
+     *  The type constant and the minimal rdata size
+     */
+    static constexpr ns_type type = TYPE_TLSA;
+    static constexpr size_t minsize = 3;
+
+    /**
+     *  Convert the raw rdata into the value
+     *  @param  response    the full response
+     *  @param  data        the rdata of the record
+     *  @param  size        size of the rdata
+     *  @return Value
+     */
+    static Value convert(const Response &response, const unsigned char *data, size_t size)
+    {
+        // the association data follows the three header bytes
+        return Value{ data[0], data[1], data[2], std::string((const char *)data + 3, size - 3) };
+    }
+};
+
 /**
  *  End of namespace
  */
@@ -0,0 +1,237 @@
+/**
+ *  Transfer.h
+ *
+ *  Streaming zone transfer (axfr, rfc 5936). The transfer runs over a
+ *  dedicated tcp connection to the primary nameserver of the zone, and
+ *  the multi-message record stream is parsed incrementally: every record
+ *  is handed to the caller the moment its message arrives, and only one
+ *  dns message (at most 64kb) is ever buffered, so memory use is
+ *  constant no matter how big the zone is.
+ *
+ *  Like the other operations this is a self-destructing class: after the
+ *  final callback (onFinished or onFailure) the object destructs itself,
+ *  call cancel() to get rid of it earlier.
+ *
+ *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include "monitor.h"
+#include "watchable.h"
+#include "ip.h"
+#include "query.h"
+#include <string>
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Forward declarations
+ */
+class Context;
+class Loop;
+class Response;
+class Record;
+
+/**
+ *  Class definition
+ */
+class Transfer : private Monitor, private Watchable
+{
+public:
+    /**
+     *  Interface to be implemented by the listener
+     */
+    class Handler
+    {
+    public:
+        /**
+         *  Called for every record in the zone, the moment the message
+         *  holding it arrives. The record (and the response it points
+         *  into) are only valid for the duration of the call, so data
+         *  that is needed later must be copied out. The opening soa
+         *  record is included, its closing repetition is not, so every
+         *  record of the zone is reported exactly once
+         *  @param  transfer    the reporting transfer
+         *  @param  response    the message holding the record
+         *  @param  record      the record
+         */
+        virtual void onRecord(const Transfer *transfer, const Response &response, const Record &record) = 0;
+
+        /**
+         *  Called when the full zone has been received
+         *  @param  transfer    the reporting transfer
+         *  @param  records     total number of records that were reported
+         *  @param  serial      the serial of the transferred zone
+         */
+        virtual void onFinished(const Transfer *transfer, size_t records, uint32_t serial) = 0;
+
+        /**
+         *  Called when the transfer failed (connection failure, a
+         *  refusing nameserver, or a malformed stream)
+         *  @param  transfer    the reporting transfer
+         */
+        virtual void onFailure(const Transfer *transfer) = 0;
+    };
+
+private:
+    /**
+     *  The event loop to which the socket is bound
+     *  @var Loop
+     */
+    Loop *_loop;
+
+    /**
+     *  The listener for the records and the final result
+     *  @var Handler
+     */
+    Handler *_handler;
+
+    /**
+     *  The query that asks for the zone
+     *  @var Query
+     */
+    Query _query;
+
+    /**
+     *  The tcp socket to the nameserver
+     *  @var int
+     */
+    int _fd = -1;
+
+    /**
+     *  Identifier of the monitor in the event loop
+     *  @var void*
+     */
+    void *_identifier = nullptr;
+
+    /**
+     *  The events that are currently monitored
+     *  @var int
+     */
+    int _events = 0;
+
+    /**
+     *  Has the tcp handshake completed?
+     *  @var bool
+     */
+    bool _connected = false;
+
+    /**
+     *  Outgoing bytes (the length-prefixed query) that have not yet been
+     *  accepted by the kernel
+     *  @var std::string
+     */
+    std::string _out;
+
+    /**
+     *  Incoming bytes that do not yet form a complete message (never more
+     *  than one message, this is what keeps memory use constant)
+     *  @var std::string
+     */
+    std::string _in;
+
+    /**
+     *  Number of records reported so far
+     *  @var size_t
+     */
+    size_t _records = 0;
+
+    /**
+     *  The serial from the opening soa record, the transfer is complete
+     *  when a soa with this very serial shows up again
+     *  @var uint32_t
+     */
+    uint32_t _serial = 0;
+
+    /**
+     *  Update the events for which the socket is monitored
+     *  @param  events      the events to monitor (1 = readable, 2 = writable)
+     */
+    void monitor(int events);
+
+    /**
+     *  Try to hand the buffered outgoing bytes to the kernel
+     *  @return bool        false when the connection failed (object destructed)
+     */
+    bool flush();
+
+    /**
+     *  Process one complete message from the stream
+     *  @param  buffer      the message (without the length prefix)
+     *  @param  size        size of the message
+     *  @return bool        false when the transfer ended (object destructed)
+     */
+    bool process(const unsigned char *buffer, size_t size);
+
+    /**
+     *  Report failure to the handler and self-destruct
+     */
+    void fail();
+
+    /**
+     *  Method that is called by the event loop when the socket becomes
+     *  readable and/or writable
+     */
+    virtual void notify() override;
+
+    /**
+     *  Private destructor, the object destructs itself
+     */
+    virtual ~Transfer();
+
+    /**
+     *  Constructor, accessible for the context only (use
+     *  Context::transfer() to start a zone transfer)
+     *  @param  loop        the event loop
+     *  @param  nameserver  the primary nameserver holding the zone
+     *  @param  domain      the zone to transfer
+     *  @param  handler     listener for the records
+     *  @param  port        the port to connect to
+     *  @throws std::runtime_error
+     */
+    Transfer(Loop *loop, const Ip &nameserver, const char *domain, Handler *handler, uint16_t port = 53);
+
+    /**
+     *  The context constructs transfers
+     */
+    friend class Context;
+
+public:
+    /**
+     *  No copying
+     *  @param  that
+     */
+    Transfer(const Transfer &that) = delete;
+
+    /**
+     *  Number of records that have been reported so far
+     *  @return size_t
+     */
+    size_t records() const { return _records; }
+
+    /**
+     *  Cancel the transfer, no further calls to the handler follow and
+     *  the object destructs itself
+     */
+    void cancel()
+    {
+        // no report, just destruct
+        delete this;
+    }
+};
+
+/**
+ *  End of namespace
+ */
+}
@@ -17,6 +17,8 @@
  *  Dependencies
  */
 #include "extractor.h"
+#include "view.h"
+#include <string>
 
 /**
  *  Begin of namespace
@@ -30,17 +32,26 @@ class TXT : public Extractor
 {
 private:
     /**
-     *  The actual buffer
+     *  The flattened buffer, only allocated when a caller asks for the
+     *  null-terminated data() (the view-based accessors work straight on
+     *  the response buffer and never need this copy)
      *  @var char *_data;
      */
-    char *_data = nullptr;
-    
+    mutable char *_data = nullptr;
+
     /**
      *  Size of the data
      *  @var size_t
      */
     size_t _size = 0;
 
+    /**
+     *  Number of character-strings that make up the record (txt rdata
+     *  is split in parts of at most 255 bytes each)
+     *  @var size_t
+     */
+    size_t _parts = 0;
+
 public:
     /**
      *  The constructor
@@ -54,70 +65,161 @@ public:
         auto *buffer = _record.data();
         size_t size = _record.size();
 
-        // number of parts processed
-        size_t parts = 0;
-        
-        // keep processing parts
-        while (_size + parts < size)
+        // keep processing parts, we only measure here, copying is
+        // postponed until a caller actually wants the flattened buffer
+        while (_size + _parts < size)
         {
             // check the size of current part
-            size_t size = buffer[_size + parts];
-            
+            size_t partsize = buffer[_size + _parts];
+
             // skip on empty
-            if (size == 0) break;
-            
+            if (partsize == 0) break;
+
             // update counters
-            _size += size;
-            parts += 1;
+            _size += partsize;
+            _parts += 1;
         }
+    }
+
+    /**
+     *  Destructor
+     */
+    virtual ~TXT()
+    {
+        // deallocate memory
+        delete[] _data;
+    }
+
+    /**
+     *  Get the value as one null-terminated string
+     *  This concatenates the character-strings into a private buffer, if
+     *  you merely want to inspect the data it is cheaper to use the
+     *  segment() method that leaves the data inside the response buffer
+     *  @return const char *
+     */
+    const char *data() const
+    {
+        // if the flattened copy was already made
+        if (_data != nullptr) return _data;
 
         // allocate enough data
         _data = new char[_size + 1];
-        
+
         // last char must be end-of-string character
         _data[_size] = 0;
-        
+
+        // the raw record data
+        auto *buffer = _record.data();
+
         // number of data already copied
         size_t copied = 0;
-        
+
         // now copy all the parts
-        for (size_t i = 0; i < parts; ++i)
+        for (size_t i = 0; i < _parts; ++i)
         {
             // size of the next part
             size_t partsize = *(buffer + copied + i);
-        
+
             // copy data
             memcpy(_data + copied, buffer + copied + i + 1, partsize);
-            
+
             // update number of bytes copied
             copied += partsize;
         }
+
+        // expose the copy
+        return _data;
     }
 
     /**
-     *  Destructor
+     *  Size of the data
+     *  @return size_t
      */
-    virtual ~TXT()
+    size_t size() const { return _size; }
+
+    /**
+     *  Number of character-strings that make up the record
+     *  @return size_t
+     */
+    size_t segments() const { return _parts; }
+
+    /**
+     *  Get a view on one character-string, pointing straight into the
+     *  response buffer without any copying. The view stays valid for as
+     *  long as the response is in scope
+     *  @param  index       the segment number (must be smaller than segments())
+     *  @return View
+     */
+    View segment(size_t index) const
     {
-        // deallocate memory
-        delete[] _data;
+        // the raw record data
+        auto *buffer = _record.data();
+
+        // position of the requested segment
+        size_t offset = 0;
+
+        // skip the earlier segments (each is prefixed with its size)
+        for (size_t i = 0; i < index; ++i) offset += buffer[offset] + 1;
+
+        // expose a view on the segment, right behind the size-byte
+        return View((const char *)buffer + offset + 1, buffer[offset]);
     }
-    
+};
+
+/**
+ *  Traits for Response::extract<TXT>(), so that the value can be pulled
+ *  straight out of the wire data without intermediate objects
+ */
+template <> struct Typed<TXT>
+{
     /**
-     *  Get the value
-     *  @return const char *
+     *  The value of a TXT record: the character-strings concatenated
      */
-    const char *data() const { return _data; }
-    
+    using Value = std::string;
+
     /**
-     *  Size of the data
-     *  @return size_t
+     *  The type constant and the minimal rdata size
      */
-    size_t size() const { return _size; }
+    static constexpr ns_type type = TYPE_TXT;
+    static constexpr size_t minsize = 0;
+
+    /**
+     *  Convert the raw rdata into the value
+     *  @param  response    the full response
+     *  @param  data        the rdata of the record
+     *  @param  size        size of the rdata
+     *  @return Value
+     */
+    static Value convert(const Response &response, const unsigned char *data, size_t size)
+    {
+        // the concatenation of all character-strings
+        std::string result;
+
+        // walk over the length-prefixed parts
+        for (size_t pos = 0; pos < size; )
+        {
+            // size of the next part
+            size_t partsize = data[pos];
+
+            // an empty part terminates the record
+            if (partsize == 0) break;
+
+            // watch out for a part that runs past the rdata
+            if (pos + 1 + partsize > size) break;
+
+            // append the part
+            result.append((const char *)data + pos + 1, partsize);
+
+            // move to the next part
+            pos += partsize + 1;
+        }
+
+        // expose the value
+        return result;
+    }
 };
-    
+
 /**
  *  End of namespace
  */
 }
-
@@ -22,7 +22,6 @@
 #include <stdlib.h>
 #include <sys/socket.h>
 #include "monitor.h"
-#include "received.h"
 #include <list>
 #include <string>
 
@@ -70,12 +69,41 @@ public:
     int setintopt(int optname, int32_t optval);
     
 private:
+    /**
+     *  Number of datagrams that a single recvmmsg() system call can pick
+     *  up, and the buffer space for each of them (comfortably more than
+     *  the 1200 bytes that we advertise in the edns section of a query)
+     */
+    static constexpr size_t _batchsize = 64;
+    static constexpr size_t _datagramsize = 4096;
+
     /**
      *  The core object
      *  @var Core
      */
     Core *_core;
-    
+
+    /**
+     *  Receive buffers for a whole batch of datagrams, allocated once
+     *  (lazily) and reused for every recvmmsg() call
+     *  @var std::vector
+     */
+    std::vector<unsigned char> _receivebuffer;
+
+    /**
+     *  Datagrams that could not be sent right away because the socket
+     *  buffer was full, waiting for the socket to become writable
+     *  @var std::list
+     */
+    std::list<std::pair<struct sockaddr_storage,std::vector<unsigned char>>> _outgoing;
+
+    /**
+     *  The events for which the socket is currently being monitored
+     *  (1 = readability, 2 = writability)
+     *  @var int
+     */
+    int _events = 1;
+
     /**
      *  The filedescriptor of the socket
      *  @var int
@@ -100,21 +128,61 @@ private:
     virtual void notify() override;
     
     /**
-     *  Send a query to a certain nameserver
+     *  Send a message to a certain nameserver
      *  @param  address     target address
-     *  @param  size        size of the address
-     *  @param  query       query to send
+     *  @param  addrsize    size of the address
+     *  @param  data        the message to send
+     *  @param  size        size of the message
      *  @return bool
      */
-    bool send(const struct sockaddr *address, size_t size, const Query &query);
+    bool send(const struct sockaddr *address, size_t addrsize, const unsigned char *data, size_t size);
 
     /**
-     *  Open the socket (this is optional, the socket is automatically opened when you start sending to it)
-     *  @param  version
-     *  @return bool
+     *  Add a datagram to the backlog of messages that still have to go
+     *  out, and start monitoring the socket for writability
+     *  @param  address     target address
+     *  @param  addrsize    size of the address
+     *  @param  data        the message to send
+     *  @param  size        size of the message
+     *  @return bool        was the message queued?
      */
-    bool open(int version);
+    bool enqueue(const struct sockaddr *address, size_t addrsize, const unsigned char *data, size_t size);
+
+    /**
+     *  Flush the backlog of outgoing messages, each sendmmsg() call
+     *  hands a whole batch of datagrams to the kernel
+     */
+    void flush();
+
+    /**
+     *  Should the socket be bound with the SO_REUSEPORT option, and to
+     *  which port (0 means: an ephemeral port)? Sockets that are bound
+     *  to the same port with this option get their incoming datagrams
+     *  sharded over the receive queues by the kernel
+     *  @var bool
+     */
+    bool _reuseport = false;
+
+    /**
+     *  The port to bind to (only meaningful in reuseport mode)
+     *  @var uint16_t
+     */
+    uint16_t _port = 0;
+
+    /**
+     *  Has the socket been connect()ed to the nameserver? A connected
+     *  socket skips the per-datagram route lookup in the kernel and gets
+     *  icmp errors (like port-unreachable) reported right away
+     *  @var bool
+     */
+    bool _connected = false;
 
+    /**
+     *  Connect the socket to the nameserver
+     *  @param  ip      IP address of the nameserver
+     *  @return bool
+     */
+    bool connect(const Ip &ip);
 
 public:
     /**
@@ -136,6 +204,61 @@ public:
      */
     virtual ~Udp();
 
+    /**
+     *  Open the socket (this is optional, the socket is automatically opened when you start sending to it)
+     *  @param  version
+     *  @return bool
+     */
+    bool open(int version);
+
+    /**
+     *  Enable the SO_REUSEPORT option: the socket is explicitly bound at
+     *  open-time, to the given port (or to an ephemeral port when 0 is
+     *  passed), must be called before the socket is opened
+     *  @param  port    the port to bind to
+     */
+    void reuseport(uint16_t port) { _reuseport = true; _port = port; }
+
+    /**
+     *  The local port to which the socket is bound (0 if not yet open)
+     *  @return uint16_t
+     */
+    uint16_t localport() const;
+
+    /**
+     *  The number of datagrams that the kernel dropped on this socket
+     *  because the receive buffer was full (0 on platforms without the
+     *  SO_MEMINFO option)
+     *  @return size_t
+     */
+    size_t drops() const;
+
+    /**
+     *  Update the receive buffer size of the (open) socket
+     *  @param  size    the buffer size to set
+     *  @return bool
+     */
+    bool rcvbuf(int32_t size) { return _fd >= 0 && setintopt(SO_RCVBUF, size) == 0; }
+
+    /**
+     *  Poll the socket directly and process whatever came in, without
+     *  waiting for the readiness callback of the event loop. This is the
+     *  building block of the opt-in busy-poll receive mode (see
+     *  Context::spin()), normal code never needs this
+     *  @return bool    was a datagram received and processed?
+     */
+    bool spin();
+
+    /**
+     *  Send a message to the socket
+     *  Watch out: you need to be consistent in calling this with either ipv4 or ipv6 addresses
+     *  @param  ip      IP address of the target nameserver
+     *  @param  data    the message to send
+     *  @param  size    size of the message
+     *  @return bool
+     */
+    bool send(const Ip &ip, const unsigned char *data, size_t size);
+
     /**
      *  Send a query to the socket
      *  Watch out: you need to be consistent in calling this with either ipv4 or ipv6 addresses
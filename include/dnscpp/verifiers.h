@@ -0,0 +1,211 @@
+/**
+ *  Verifiers.h
+ *
+ *  Worker thread pool for expensive cryptographic checks. DNS-CPP does
+ *  not run crypto itself, but applications that verify DNSSEC
+ *  signatures (see Signable) normally do so inline on the event-loop
+ *  thread, so a burst of signed responses stalls datagram processing
+ *  and inflates latency for unrelated lookups.
+ *
+ *  This class keeps the receive path non-blocking: jobs are queued to
+ *  worker threads, and their verdicts are posted back to the loop
+ *  thread through a pipe that is registered with the user-supplied
+ *  event loop via the normal Loop/Monitor interface. The callback
+ *  therefore always runs on the loop thread, so no locking is needed
+ *  in user space.
+ *
+ *  Jobs run on a worker thread and must only touch data that they own
+ *  themselves: copy the signed data (and signature bytes) into the
+ *  job closure instead of capturing a Response or RRSIG by reference,
+ *  because those point into buffers owned by the loop thread.
+ *
+ *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <deque>
+#include "monitor.h"
+#include "loop.h"
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Class definition
+ */
+class Verifiers : private Monitor
+{
+public:
+    /**
+     *  The type of a job: runs on a worker thread and returns the
+     *  verdict (true when the signature turned out to be valid)
+     *  @type   function
+     */
+    using Job = std::function<bool()>;
+
+    /**
+     *  The type of the callback that receives the verdict, this one
+     *  runs on the loop thread
+     *  @type   function
+     */
+    using Callback = std::function<void(bool valid)>;
+
+private:
+    /**
+     *  Pointer to the event loop supplied by user space
+     *  @var Loop
+     */
+    Loop *_loop;
+
+    /**
+     *  The notification pipe, workers write to [1] when a verdict is
+     *  ready and the loop thread reads from [0]
+     *  @var int[]
+     */
+    int _fds[2];
+
+    /**
+     *  Identifier of the read end inside the event loop
+     *  @var void *
+     */
+    void *_identifier = nullptr;
+
+    /**
+     *  The worker threads
+     *  @var std::vector
+     */
+    std::vector<std::thread> _threads;
+
+    /**
+     *  Mutex that protects the queues
+     *  @var std::mutex
+     */
+    std::mutex _mutex;
+
+    /**
+     *  Condition on which idle workers wait
+     *  @var std::condition_variable
+     */
+    std::condition_variable _condition;
+
+    /**
+     *  Are the workers being shut down?
+     *  @var bool
+     */
+    bool _stop = false;
+
+    /**
+     *  One job that is waiting for a worker
+     */
+    struct Pending
+    {
+        /**
+         *  The job to run
+         *  @var Job
+         */
+        Job job;
+
+        /**
+         *  The callback for the verdict
+         *  @var Callback
+         */
+        Callback callback;
+    };
+
+    /**
+     *  Jobs that are waiting for a worker
+     *  @var std::deque
+     */
+    std::deque<Pending> _jobs;
+
+    /**
+     *  One verdict that is waiting for the loop thread
+     */
+    struct Verdict
+    {
+        /**
+         *  The callback for the verdict
+         *  @var Callback
+         */
+        Callback callback;
+
+        /**
+         *  The verdict itself
+         *  @var bool
+         */
+        bool valid;
+    };
+
+    /**
+     *  Verdicts that are waiting to be delivered on the loop thread
+     *  @var std::deque
+     */
+    std::deque<Verdict> _verdicts;
+
+    /**
+     *  The main function of each worker thread
+     */
+    void run();
+
+    /**
+     *  Method that is called by the event loop when the pipe becomes
+     *  readable, meaning that verdicts can be delivered
+     */
+    virtual void notify() override;
+
+public:
+    /**
+     *  Constructor
+     *  @param  loop        the event loop of the loop thread
+     *  @param  threads     number of worker threads
+     *  @throws std::runtime_error
+     */
+    Verifiers(Loop *loop, size_t threads);
+
+    /**
+     *  No copying, the workers hold a pointer to this object
+     *  @param  that
+     */
+    Verifiers(const Verifiers &that) = delete;
+
+    /**
+     *  Destructor, waits for the workers to finish their current job,
+     *  verdicts that were not yet delivered are dropped
+     */
+    virtual ~Verifiers();
+
+    /**
+     *  Number of worker threads
+     *  @return size_t
+     */
+    size_t threads() const { return _threads.size(); }
+
+    /**
+     *  Queue a job to the pool. The job runs on a worker thread, the
+     *  callback with its verdict runs on the loop thread afterwards. A
+     *  job that throws counts as an invalid signature.
+     *  @param  job         the check to run
+     *  @param  callback    the callback for the verdict
+     */
+    void offload(const Job &job, const Callback &callback);
+};
+
+/**
+ *  End of namespace
+ */
+}
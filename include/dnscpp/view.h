@@ -0,0 +1,122 @@
+/**
+ *  View.h
+ *
+ *  A non-owning view on a sequence of characters, comparable to the
+ *  std::string_view class of later c++ standards (the library sticks to
+ *  c++11). Views are handed out by record classes like TXT and CAA and
+ *  point straight into the response buffer, so that rdata can be
+ *  inspected without copying it into a freshly allocated string first.
+ *  A view is only valid for as long as the response that it points
+ *  into stays in scope.
+ *
+ *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include <string.h>
+#include <string>
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Class definition
+ */
+class View
+{
+private:
+    /**
+     *  Start of the characters (watch out, not null-terminated)
+     *  @var const char *
+     */
+    const char *_data;
+
+    /**
+     *  Number of characters
+     *  @var size_t
+     */
+    size_t _size;
+
+public:
+    /**
+     *  Constructor
+     *  @param  data        start of the characters
+     *  @param  size        number of characters
+     */
+    View(const char *data, size_t size) : _data(data), _size(size) {}
+
+    /**
+     *  Constructor for an empty view
+     */
+    View() : _data(nullptr), _size(0) {}
+
+    /**
+     *  Destructor
+     */
+    virtual ~View() = default;
+
+    /**
+     *  Start of the characters (not null-terminated!)
+     *  @return const char *
+     */
+    const char *data() const { return _data; }
+
+    /**
+     *  Number of characters
+     *  @return size_t
+     */
+    size_t size() const { return _size; }
+
+    /**
+     *  Is the view empty?
+     *  @return bool
+     */
+    bool empty() const { return _size == 0; }
+
+    /**
+     *  Iterate over the characters
+     *  @return const char *
+     */
+    const char *begin() const { return _data; }
+    const char *end() const { return _data + _size; }
+
+    /**
+     *  Compare with a null-terminated string
+     *  @param  that        the string to compare with
+     *  @return bool
+     */
+    bool operator==(const char *that) const
+    {
+        // sizes and contents must both match
+        return strlen(that) == _size && memcmp(_data, that, _size) == 0;
+    }
+
+    /**
+     *  Compare with a null-terminated string
+     *  @param  that        the string to compare with
+     *  @return bool
+     */
+    bool operator!=(const char *that) const { return !operator==(that); }
+
+    /**
+     *  Explicit conversion to a real string, for the callers that do
+     *  want a private copy after all
+     *  @return std::string
+     */
+    explicit operator std::string() const { return std::string(_data, _size); }
+};
+
+/**
+ *  End of namespace
+ */
+}
@@ -12,12 +12,6 @@
  */
 #pragma once
 
-/**
- *  Dependencies
- */
-#include <vector>
-#include <algorithm>
-
 /**
  *  Set up namespace
  */
@@ -35,33 +29,27 @@ class Watchable
 {
 private:
     /**
-     *  The monitors
-     *  @var std::vector
+     *  Head of the intrusive list of watchers that currently monitor this
+     *  object. The watchers live on the stack of the caller and the list
+     *  links run through the watchers themselves, so that registering and
+     *  removing a watcher costs a couple of pointer stores and never
+     *  allocates -- this happens around every userspace callback, tens of
+     *  thousands of times per second
+     *  @var Watcher
      */
-    std::vector<Watcher*> _monitors;
+    Watcher *_watchers = nullptr;
 
     /**
-     *  Add a monitor
-     *  @param  monitor
+     *  Add a watcher (defined in watcher.h, it touches the watcher internals)
+     *  @param  watcher
      */
-    void add(Watcher *monitor)
-    {
-        // add to the vector
-        _monitors.push_back(monitor);
-    }
+    inline void add(Watcher *watcher);
 
     /**
-     *  Remove a monitor
-     *  @param  monitor
+     *  Remove a watcher
+     *  @param  watcher
      */
-    void remove(Watcher *monitor)
-    {
-        // put the monitor at the end of the vector
-        auto iter = std::remove(_monitors.begin(), _monitors.end(), monitor);
-
-        // make the vector smaller
-        _monitors.erase(iter, _monitors.end());
-    }
+    inline void remove(Watcher *watcher);
 
 public:
     /**
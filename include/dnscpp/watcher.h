@@ -38,6 +38,13 @@ private:
      */
     Watchable *_watchable;
 
+    /**
+     *  The next watcher that monitors the same object (the watchable keeps
+     *  an intrusive list that runs through the watchers themselves)
+     *  @var    Watcher
+     */
+    Watcher *_next = nullptr;
+
     /**
      *  Invalidate the object
      */
@@ -127,7 +134,32 @@ public:
     friend class Watchable;
 };
 
+/**
+ *  Register a watcher: push it to the front of the intrusive list
+ *  @param  watcher
+ */
+inline void Watchable::add(Watcher *watcher)
+{
+    // two pointer stores, no allocation
+    watcher->_next = _watchers; _watchers = watcher;
+}
+
+/**
+ *  Remove a watcher from the intrusive list
+ *  @param  watcher
+ */
+inline void Watchable::remove(Watcher *watcher)
+{
+    // walk the links (in practice there is one watcher, so this is one step)
+    for (Watcher **current = &_watchers; *current != nullptr; current = &(*current)->_next)
+    {
+        // skip other watchers
+        if (*current != watcher) continue;
 
+        // unlink it and leap out
+        *current = watcher->_next; return;
+    }
+}
 
 /**
  *  End of namespace
@@ -0,0 +1,297 @@
+/**
+ *  Wheel.h
+ *
+ *  Timer wheel that schedules lookups by the time at which they want to
+ *  run. Lookups are hashed into a ring of time-bucketed slots, so that
+ *  scheduling and collecting due lookups are constant-time operations
+ *  regardless of the number of lookups in flight, and lookups with
+ *  short delays (hedging, adaptive retransmits) are not stuck behind
+ *  lookups with longer delays that happen to be older.
+ *
+ *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include <deque>
+#include <vector>
+#include <memory>
+#include <algorithm>
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Forward declarations
+ */
+class Lookup;
+
+/**
+ *  Class definition
+ */
+class Wheel
+{
+private:
+    /**
+     *  Width of one slot in seconds. This is the precision of the wheel:
+     *  a lookup can run up to this much later than it asked for
+     */
+    constexpr static double _granularity = 0.1;
+
+    /**
+     *  Number of slots in the ring, together with the granularity this
+     *  sets the horizon (51.2 seconds). Delays beyond the horizon are
+     *  parked in the furthest slot and rescheduled when they come up
+     */
+    constexpr static size_t _slots = 512;
+
+    /**
+     *  The ring of slots (allocated lazily, most contexts that only do
+     *  a couple of lookups never need the full ring)
+     *  @var std::vector
+     */
+    std::vector<std::deque<std::shared_ptr<Lookup>>> _buckets;
+
+    /**
+     *  The lookups that are due (their slot has been passed by the hand)
+     *  @var std::deque
+     */
+    std::deque<std::shared_ptr<Lookup>> _due;
+
+    /**
+     *  The slot that the hand currently points at
+     *  @var size_t
+     */
+    size_t _current = 0;
+
+    /**
+     *  The time at which the current slot begins
+     *  @var double
+     */
+    double _time = 0.0;
+
+    /**
+     *  Number of lookups that sit in the slots (excluding the due ones)
+     *  @var size_t
+     */
+    size_t _pending = 0;
+
+    /**
+     *  Bring the hand up to date: all slots that the hand passes are
+     *  emptied into the due-queue
+     *  @param  now     current time
+     */
+    void advance(double now)
+    {
+        // when the slots are empty the hand can simply jump ahead
+        if (_pending == 0) { _time = std::max(_time, now); return; }
+
+        // when the hand lags more than a full revolution, everything in
+        // the ring is due (this avoids a long catch-up loop after idle time)
+        if (now - _time >= _slots * _granularity)
+        {
+            // empty all slots, in clock-order for fairness
+            for (size_t i = 0; i < _slots; ++i)
+            {
+                // the next slot
+                auto &bucket = _buckets[(_current + i) % _slots];
+
+                // move its lookups to the due-queue
+                while (!bucket.empty()) { _due.push_back(bucket.front()); bucket.pop_front(); }
+            }
+
+            // the ring is empty now
+            _pending = 0; _time = now; return;
+        }
+
+        // move the hand slot by slot
+        while (now >= _time + _granularity)
+        {
+            // the slot that the hand leaves behind
+            auto &bucket = _buckets[_current];
+
+            // everything in it is due now
+            while (!bucket.empty()) { _due.push_back(bucket.front()); bucket.pop_front(); _pending -= 1; }
+
+            // move to the next slot
+            _current = (_current + 1) % _slots;
+            _time += _granularity;
+        }
+    }
+
+public:
+    /**
+     *  Constructor
+     */
+    Wheel() = default;
+
+    /**
+     *  No copying
+     *  @param  that
+     */
+    Wheel(const Wheel &that) = delete;
+
+    /**
+     *  Destructor
+     */
+    virtual ~Wheel() = default;
+
+    /**
+     *  Number of lookups in the wheel
+     *  @return size_t
+     */
+    size_t size() const { return _pending + _due.size(); }
+
+    /**
+     *  Is the wheel completely empty?
+     *  @return bool
+     */
+    bool empty() const { return _pending == 0 && _due.empty(); }
+
+    /**
+     *  Schedule a lookup to run after a certain delay
+     *  @param  lookup  the lookup to schedule
+     *  @param  delay   delay in seconds (<= 0.0 to run right away)
+     *  @param  now     current time
+     */
+    void schedule(const std::shared_ptr<Lookup> &lookup, double delay, double now)
+    {
+        // allocate the ring on first use
+        if (_buckets.empty()) _buckets.resize(_slots);
+
+        // bring the hand up to date first
+        advance(now);
+
+        // lookups that want to run right away skip the ring
+        if (delay <= 0.0) return _due.push_back(lookup);
+
+        // number of whole slots ahead of the hand: at least one (so that a
+        // rescheduled lookup always lands in the future), and delays beyond
+        // the horizon are parked in the furthest slot (the owner detects
+        // that they are not yet runnable when they come up, and reschedules)
+        size_t ticks = std::max((size_t)1, std::min((size_t)(delay / _granularity), _slots - 1));
+
+        // add to the right slot
+        _buckets[(_current + ticks) % _slots].push_back(lookup);
+
+        // one more pending lookup
+        _pending += 1;
+    }
+
+    /**
+     *  Schedule a lookup to run right away, ahead of all other lookups
+     *  that are already due (for latency-critical lookups that should
+     *  not wait for queued batch work)
+     *  @param  lookup  the lookup to schedule
+     *  @param  now     current time
+     */
+    void promote(const std::shared_ptr<Lookup> &lookup, double now)
+    {
+        // allocate the ring on first use
+        if (_buckets.empty()) _buckets.resize(_slots);
+
+        // bring the hand up to date first
+        advance(now);
+
+        // jump the queue of due lookups
+        _due.push_front(lookup);
+    }
+
+    /**
+     *  Get the next lookup that is due (or nullptr when nothing is due)
+     *  @param  now     current time
+     *  @return std::shared_ptr<Lookup>
+     */
+    std::shared_ptr<Lookup> pop(double now)
+    {
+        // bring the hand up to date
+        advance(now);
+
+        // is anything due at all?
+        if (_due.empty()) return nullptr;
+
+        // take the oldest due lookup
+        auto result = _due.front(); _due.pop_front();
+
+        // hand it over
+        return result;
+    }
+
+    /**
+     *  Take all lookups that satisfy a predicate out of the wheel in
+     *  one pass over the ring (used by the bulk-cancel path, so that a
+     *  mass cancellation does not search the wheel once per lookup)
+     *  @param  match   functor that decides whether a lookup is taken
+     *  @param  result  the extracted lookups are appended to this
+     */
+    template <typename Match>
+    void extract(const Match &match, std::vector<std::shared_ptr<Lookup>> &result)
+    {
+        // helper that moves the matching lookups out of one queue
+        auto drain = [this, &match, &result](std::deque<std::shared_ptr<Lookup>> &queue, bool pending) {
+
+            // move the matching lookups to the back of the queue (stable,
+            // so the order of the survivors is preserved)
+            auto iter = std::stable_partition(queue.begin(), queue.end(), [&match](const std::shared_ptr<Lookup> &lookup) {
+                return !match(lookup);
+            });
+
+            // hand over the matches
+            for (auto it = iter; it != queue.end(); ++it) result.push_back(std::move(*it));
+
+            // update the counter of pending (not-yet-due) lookups
+            if (pending) _pending -= std::distance(iter, queue.end());
+
+            // and remove them from the queue
+            queue.erase(iter, queue.end());
+        };
+
+        // process all slots of the ring, and the lookups that are due
+        for (auto &bucket : _buckets) drain(bucket, true);
+        drain(_due, false);
+    }
+
+    /**
+     *  Time until the next lookup becomes due
+     *  @param  now     current time
+     *  @return double  delay in seconds (0.0 when something is already due, < 0 when empty)
+     */
+    double next(double now)
+    {
+        // bring the hand up to date
+        advance(now);
+
+        // something could already be due
+        if (!_due.empty()) return 0.0;
+
+        // or the wheel could be completely empty
+        if (_pending == 0) return -1.0;
+
+        // look for the first occupied slot (a bounded scan over the ring)
+        for (size_t i = 0; i < _slots; ++i)
+        {
+            // skip empty slots
+            if (_buckets[(_current + i) % _slots].empty()) continue;
+
+            // the slot is emptied when the hand passes its far edge
+            return std::max(0.0, _time + (i + 1) * _granularity - now);
+        }
+
+        // unreachable (there were pending lookups)
+        return -1.0;
+    }
+};
+
+/**
+ *  End of namespace
+ */
+}
@@ -0,0 +1,301 @@
+/**
+ *  Zone.h
+ *
+ *  Class that gives access to a compiled, memory-mapped, read-only local
+ *  policy zone: a file holding blocked domains and internal rewrites that
+ *  is consulted before any query goes out on the wire. Because the file
+ *  is mmap()'ed read-only, loading is instant no matter how many entries
+ *  it holds, and the pages are shared between all worker processes that
+ *  map the same file.
+ *
+ *  The file is produced with the ZoneBuilder class (normally by an
+ *  offline tool) and loaded with Context::loadzone(). The format is a
+ *  flat open-addressing hash table over the (lowercased) names, with the
+ *  payload of each entry stored behind it: whether the name is blocked,
+ *  whether the entry also covers subdomains, and the addresses to answer
+ *  with. The file is written and read on the same machine, so the fields
+ *  are stored in host byte order.
+ *
+ *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include <stdint.h>
+#include <map>
+#include <vector>
+#include <string>
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Forward declarations
+ */
+class Handler;
+class Operation;
+class Request;
+class Ip;
+
+/**
+ *  Class definition
+ */
+class Zone
+{
+private:
+    /**
+     *  Layout of the file header
+     */
+    struct Header
+    {
+        /**
+         *  Magic bytes identifying the format ("DNSCPPZ1")
+         *  @var char[]
+         */
+        char magic[8];
+
+        /**
+         *  Number of slots in the hash table (a power of two)
+         *  @var uint64_t
+         */
+        uint64_t slots;
+
+        /**
+         *  Number of entries stored in the table
+         *  @var uint64_t
+         */
+        uint64_t entries;
+    };
+
+    /**
+     *  Layout of one slot in the hash table
+     */
+    struct Slot
+    {
+        /**
+         *  Hash of the name stored in this slot
+         *  @var uint64_t
+         */
+        uint64_t hash;
+
+        /**
+         *  Offset of the entry in the file (0 for an empty slot, the
+         *  file header makes sure that 0 is never a valid entry offset)
+         *  @var uint64_t
+         */
+        uint64_t offset;
+    };
+
+    /**
+     *  Flags stored in the first byte of each entry
+     */
+    static constexpr unsigned char _subdomains = 1;
+    static constexpr unsigned char _blocked = 2;
+
+    /**
+     *  Address of the memory mapping (nullptr when no zone is loaded)
+     *  @var void *
+     */
+    void *_address = nullptr;
+
+    /**
+     *  Size of the memory mapping
+     *  @var size_t
+     */
+    size_t _size = 0;
+
+    /**
+     *  Access to the file header
+     *  @return Header
+     */
+    const Header *header() const { return (const Header *)_address; }
+
+    /**
+     *  Access to the slot table (right behind the header)
+     *  @return Slot
+     */
+    const Slot *slots() const { return (const Slot *)((const char *)_address + sizeof(Header)); }
+
+    /**
+     *  Find the entry for an exact (already normalized) name
+     *  @param  name    the name to look for (lowercase, no trailing dot)
+     *  @return const unsigned char *   the entry (nullptr if there is no match)
+     */
+    const unsigned char *find(const char *name) const;
+
+    /**
+     *  Find the entry that applies to a query: the exact name, or the
+     *  closest enclosing entry that also covers subdomains and that can
+     *  actually answer the given query type
+     *  @param  qname   the name that is being queried
+     *  @param  qtype   the record type that is being queried
+     *  @return const unsigned char *   the entry (nullptr if there is no match)
+     */
+    const unsigned char *applicable(const char *qname, uint16_t qtype) const;
+
+    /**
+     *  The ZoneBuilder writes entries in exactly the layout that the
+     *  private helpers above expect
+     */
+    friend class ZoneBuilder;
+
+public:
+    /**
+     *  Default constructor, no zone is loaded yet
+     */
+    Zone() = default;
+
+    /**
+     *  No copying (the class holds a memory mapping)
+     *  @param  that
+     */
+    Zone(const Zone &that) = delete;
+
+    /**
+     *  Destructor
+     */
+    virtual ~Zone();
+
+    /**
+     *  Load a compiled zone file, replacing the zone that was loaded
+     *  before (if any). The file is mapped read-only into memory, so
+     *  this returns immediately no matter how big the file is
+     *  @param  filename    the file to map
+     *  @return bool        was the file valid and mapped?
+     */
+    bool load(const char *filename);
+
+    /**
+     *  Number of entries in the loaded zone (0 when nothing is loaded)
+     *  @return size_t
+     */
+    size_t size() const { return _address == nullptr ? 0 : header()->entries; }
+
+    /**
+     *  Does the zone hold an answer for a certain query? Blocked names
+     *  match any type, rewrites only match A/AAAA queries for which the
+     *  entry actually holds an address of that family
+     *  @param  qname   the name that is being queried
+     *  @param  qtype   the record type that is being queried
+     *  @return bool
+     */
+    bool match(const char *qname, uint16_t qtype) const;
+
+    /**
+     *  Notify a user-space handler about the answer for a certain query
+     *  (blocked names are reported as nxdomain, rewrites with a locally
+     *  constructed response holding the configured addresses)
+     *  @param  request         the original request
+     *  @param  handler         user-space object that should be notified
+     *  @param  operation       the operation-pointer that should be passed
+     *  @return bool            was the handler called?
+     */
+    bool notify(const Request &request, Handler *handler, const Operation *operation) const;
+};
+
+/**
+ *  Class to compile a zone file that can later be loaded by the Zone
+ *  class, normally used by an offline tool that turns a list of blocked
+ *  domains and internal rewrites into the binary format
+ */
+class ZoneBuilder
+{
+private:
+    /**
+     *  The policy collected for one name
+     */
+    struct Policy
+    {
+        /**
+         *  Is the name blocked (answered with nxdomain)?
+         *  @var bool
+         */
+        bool blocked = false;
+
+        /**
+         *  Does the entry also cover subdomains?
+         *  @var bool
+         */
+        bool subdomains = false;
+
+        /**
+         *  The ipv4 addresses to answer A queries with (raw, 4 bytes each)
+         *  @var std::vector
+         */
+        std::vector<std::string> ipv4;
+
+        /**
+         *  The ipv6 addresses to answer AAAA queries with (raw, 16 bytes each)
+         *  @var std::vector
+         */
+        std::vector<std::string> ipv6;
+    };
+
+    /**
+     *  All collected entries, indexed by normalized name
+     *  @var std::map
+     */
+    std::map<std::string,Policy> _entries;
+
+    /**
+     *  Normalize a name: fold to lowercase and strip the trailing dot
+     *  @param  name        the name to normalize
+     *  @return std::string
+     */
+    static std::string normalize(const char *name);
+
+public:
+    /**
+     *  Default constructor
+     */
+    ZoneBuilder() = default;
+
+    /**
+     *  Destructor
+     */
+    virtual ~ZoneBuilder() = default;
+
+    /**
+     *  Block a name: queries for it (and, by default, for everything
+     *  under it) are answered with nxdomain
+     *  @param  name        the name to block
+     *  @param  subdomains  should subdomains be blocked too?
+     */
+    void block(const char *name, bool subdomains = true);
+
+    /**
+     *  Add a rewrite: A/AAAA queries for the name are answered with the
+     *  given address (call multiple times for multiple addresses)
+     *  @param  name        the name to rewrite
+     *  @param  ip          the address to answer with
+     *  @param  subdomains  should subdomains get the same answer?
+     */
+    void add(const char *name, const Ip &ip, bool subdomains = false);
+
+    /**
+     *  Number of entries collected so far
+     *  @return size_t
+     */
+    size_t size() const { return _entries.size(); }
+
+    /**
+     *  Write the compiled zone to a file
+     *  @param  filename    the file to (over)write
+     *  @return bool        was the file written?
+     */
+    bool save(const char *filename) const;
+};
+
+/**
+ *  End of namespace
+ */
+}
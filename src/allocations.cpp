@@ -0,0 +1,110 @@
+/**
+ *  Allocations.cpp
+ *
+ *  Implementation file for the allocation accounting. The counters
+ *  always exist (so that code reading them does not have to be
+ *  conditional), the global operator-new override that feeds them is
+ *  only compiled when the library is built with -DDNSCPP_ALLOCATIONS.
+ *
+ *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Dependencies
+ */
+#include "../include/dnscpp/allocations.h"
+#include <stdlib.h>
+#include <new>
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  The per-thread counters
+ */
+thread_local uint64_t Allocations::_count = 0;
+thread_local uint64_t Allocations::_bytes = 0;
+
+/**
+ *  Is accounting compiled in at all?
+ *  @return bool
+ */
+bool Allocations::enabled()
+{
+#ifdef DNSCPP_ALLOCATIONS
+    // the operator-new override below is active
+    return true;
+#else
+    // the counters stay at zero
+    return false;
+#endif
+}
+
+/**
+ *  End of namespace
+ */
+}
+
+/**
+ *  The accounting overrides of the global allocation functions: they
+ *  forward to malloc()/free() (which is what the default operators do
+ *  as well, so mixing with code from other translation units is safe)
+ *  and bump the per-thread counters on the way. Only compiled in the
+ *  opt-in accounting build.
+ */
+#ifdef DNSCPP_ALLOCATIONS
+
+/**
+ *  The allocating operators
+ *  @param  size    the requested size
+ *  @return void*
+ */
+void *operator new(size_t size)
+{
+    // count the allocation
+    DNS::Allocations::record(size);
+
+    // the actual allocation
+    void *pointer = malloc(size);
+
+    // the throwing variant may not return nullptr
+    if (pointer == nullptr) throw std::bad_alloc();
+
+    // done
+    return pointer;
+}
+void *operator new[](size_t size)
+{
+    // identical to the scalar variant
+    return operator new(size);
+}
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+    // count the allocation
+    DNS::Allocations::record(size);
+
+    // the actual allocation (nullptr is allowed here)
+    return malloc(size);
+}
+void *operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+    // identical to the scalar variant
+    return operator new(size, std::nothrow);
+}
+
+/**
+ *  The matching deallocating operators (frees are not counted, for
+ *  regression tracking the allocation rate is what matters)
+ *  @param  pointer     the block to release
+ */
+void operator delete(void *pointer) noexcept { free(pointer); }
+void operator delete[](void *pointer) noexcept { free(pointer); }
+void operator delete(void *pointer, size_t) noexcept { free(pointer); }
+void operator delete[](void *pointer, size_t) noexcept { free(pointer); }
+void operator delete(void *pointer, const std::nothrow_t &) noexcept { free(pointer); }
+void operator delete[](void *pointer, const std::nothrow_t &) noexcept { free(pointer); }
+
+#endif
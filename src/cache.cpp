@@ -0,0 +1,398 @@
+/**
+ *  Cache.cpp
+ *
+ *  Implementation file for the Cache class
+ *
+ *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Dependencies
+ */
+#include "../include/dnscpp/cache.h"
+#include "../include/dnscpp/response.h"
+#include "../include/dnscpp/question.h"
+#include "../include/dnscpp/answer.h"
+#include "../include/dnscpp/type.h"
+#include "../include/dnscpp/soa.h"
+#include <fstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Constructor
+ *  @param  response    the response to store
+ *  @param  expires     time at which the entry expires
+ */
+Cache::Entry::Entry(const Response &response, double expires) :
+    _buffer(response.data(), response.data() + response.size()),
+    _expires(expires) {}
+
+/**
+ *  Update the max number of cached responses (set to 0 to disable caching)
+ *  @param  value       the new capacity
+ */
+void Cache::capacity(size_t value)
+{
+    // store the property
+    _capacity = value;
+
+    // if the cache shrank we might have to throw away entries right away
+    while (_entries.size() > _capacity) _entries.erase(_entries.begin());
+}
+
+/**
+ *  Remove expired entries, and if that is not enough make some more room
+ *  @param  now     current time
+ */
+void Cache::prune(double now)
+{
+    // remove all entries that are no longer valid anyway
+    for (auto iter = _entries.begin(); iter != _entries.end(); )
+    {
+        // remove the entry if it expired, otherwise we move on
+        if (iter->second->expired(now)) iter = _entries.erase(iter);
+        else ++iter;
+    }
+
+    // if the cache is still full we sacrifice an arbitrary entry
+    if (_entries.size() >= _capacity) _entries.erase(_entries.begin());
+}
+
+/**
+ *  Look for a cached response for a certain hostname and record-type
+ *  This method returns nullptr if there is no (still valid) match, unless
+ *  the stale-parameter is set, in which case an expired entry is returned too
+ *  @param  now         current time
+ *  @param  hostname    the hostname to look for
+ *  @param  type        the record-type
+ *  @param  stale       are expired entries acceptable too?
+ *  @return std::shared_ptr<Entry>
+ */
+std::shared_ptr<Cache::Entry> Cache::find(double now, const char *hostname, uint16_t type, bool stale) const
+{
+    // look for a match
+    auto iter = _entries.find(std::make_pair(std::string(hostname), type));
+
+    // if there is no match at all
+    if (iter == _entries.end()) return nullptr;
+
+    // the entry should still be valid (unless the caller accepts stale entries)
+    if (!stale && iter->second->expired(now)) return nullptr;
+
+    // register the hit, so that the refresh-ahead logic knows which entries are hot
+    iter->second->hit();
+
+    // expose the entry
+    return iter->second;
+}
+
+/**
+ *  Collect the hot entries that are about to expire
+ *  @param  now         current time
+ *  @param  window      how far ahead of the expiration we look (seconds)
+ *  @param  threshold   min number of cache-hits to consider an entry hot
+ *  @return std::list   the hostname+type combinations to re-query
+ */
+std::list<std::pair<std::string,uint16_t>> Cache::expiring(double now, double window, size_t threshold)
+{
+    // the result variable
+    std::list<std::pair<std::string,uint16_t>> result;
+
+    // check all entries
+    for (auto &entry : _entries)
+    {
+        // entries that already expired are no use (too late to refresh-ahead)
+        if (entry.second->expired(now)) continue;
+
+        // the entry should expire within the window
+        if (entry.second->expires() > now + window) continue;
+
+        // the entry should be hot enough
+        if (entry.second->hits() < threshold) continue;
+
+        // skip entries for which a refresh is already running
+        if (entry.second->refreshing()) continue;
+
+        // mark the entry so that it is not reported again
+        entry.second->refreshing(true);
+
+        // add to the result
+        result.push_back(entry.first);
+    }
+
+    // done
+    return result;
+}
+
+/**
+ *  Helper function to calculate the lifetime of a negative (nxdomain or
+ *  no-data) response, which is defined by RFC 2308 as the minimum of the
+ *  ttl and the minimum-field of the SOA record in the authority section
+ *  @param  response    the response to inspect
+ *  @return uint32_t    the lifetime in seconds (0 if the response is not cacheable)
+ */
+static uint32_t negativettl(const Response &response)
+{
+    // look for the SOA record in the authority section
+    for (size_t i = 0; i < response.nameservers(); ++i)
+    {
+        // extract the record
+        Record record(response, ns_s_ns, i);
+
+        // skip records that do not hold the SOA
+        if (record.type() != TYPE_SOA) continue;
+
+        // parse the SOA to get the minimum-field
+        SOA soa(response, record);
+
+        // the smallest of the record-ttl and the minimum-field is decisive
+        return std::min(record.ttl(), soa.minimum());
+    }
+
+    // without a SOA record we have no idea how long the answer stays valid,
+    // so we should not cache it at all
+    return 0;
+}
+
+/**
+ *  Helper method to calculate how long a response may be cached
+ *  @param  response    the response to inspect
+ *  @return uint32_t    lifetime in seconds (0 if the response is not cacheable)
+ */
+uint32_t Cache::ttl(const Response &response)
+{
+    // truncated messages are incomplete and never cached
+    if (response.truncated()) return 0;
+
+    // besides successful responses we also cache negative answers (nxdomain
+    // errors and no-data responses), all other errors are not cacheable
+    if (response.rcode() != 0 && response.rcode() != ns_r_nxdomain) return 0;
+
+    // prevent exceptions (parsing the response could fail)
+    try
+    {
+        // negative answers (nxdomain or a response without answer-records) get
+        // the lifetime that rfc 2308 prescribes
+        if (response.rcode() == ns_r_nxdomain || response.answers() == 0) return negativettl(response);
+
+        // for positive answers we use the smallest ttl of all the answer-records
+        uint32_t result = UINT32_MAX;
+
+        // iterate over the answer-records
+        for (size_t i = 0; i < response.answers(); ++i) result = std::min(result, Answer(response, i).ttl());
+
+        // done
+        return result;
+    }
+    catch (...)
+    {
+        // the response could not be parsed, we should not cache it
+        return 0;
+    }
+}
+
+/**
+ *  Store a response in the cache
+ *  @param  now         current time
+ *  @param  response    the received response
+ */
+void Cache::insert(double now, const Response &response)
+{
+    // do nothing if caching is disabled
+    if (_capacity == 0) return;
+
+    // calculate the lifetime of the response
+    uint32_t lifetime = ttl(response);
+
+    // responses with a zero lifetime should not be cached at all
+    if (lifetime == 0) return;
+
+    // prevent exceptions (parsing the response could fail)
+    try
+    {
+        // extract the original question to get the key under which we store the entry
+        Question question(response);
+
+        // if the cache is full we first have to make room
+        if (_entries.size() >= _capacity) prune(now);
+
+        // store the entry (possibly overwriting an older entry for the same question)
+        _entries[std::make_pair(std::string(question.name()), question.type())] = std::make_shared<Entry>(response, now + lifetime);
+    }
+    catch (...)
+    {
+        // the response could not be parsed, we simply do not cache it
+    }
+}
+
+/**
+ *  The magic value at the start of a snapshot-file (also acts as version)
+ *  @var uint32_t
+ */
+static const uint32_t SNAPSHOT_MAGIC = 0x444e5053;      // "DNPS"
+
+/**
+ *  Layout of the fixed-size part in front of each entry in a snapshot-file
+ *  The raw response data follows directly after this struct, there are no
+ *  pointers or offsets so the file can simply be mapped into memory
+ */
+struct SnapshotEntry
+{
+    /**
+     *  Time at which the entry is no longer valid
+     *  @var double
+     */
+    double expires;
+
+    /**
+     *  Size of the raw response that follows
+     *  @var uint32_t
+     */
+    uint32_t size;
+};
+
+/**
+ *  Write a snapshot of the cache to a file
+ *  @param  filename    file to write the snapshot to
+ *  @return bool        was the snapshot written?
+ */
+bool Cache::persist(const char *filename) const
+{
+    // open the file for writing
+    std::ofstream stream(filename, std::ofstream::binary | std::ofstream::trunc);
+
+    // file should be open by now
+    if (!stream.is_open()) return false;
+
+    // start with the magic value so that restore() can recognize the format
+    stream.write((const char *)&SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+
+    // write all entries one after the other
+    for (const auto &entry : _entries)
+    {
+        // the fixed-size part
+        SnapshotEntry header{entry.second->expires(), (uint32_t)entry.second->size()};
+
+        // write the header followed by the raw response
+        stream.write((const char *)&header, sizeof(header));
+        stream.write((const char *)entry.second->data(), entry.second->size());
+    }
+
+    // the snapshot was written if all writes succeeded
+    return stream.good();
+}
+
+/**
+ *  Load a snapshot that was earlier written with persist()
+ *  @param  filename    file holding the snapshot
+ *  @param  now         current time
+ *  @return bool        was the snapshot loaded?
+ */
+bool Cache::restore(const char *filename, double now)
+{
+    // without capacity there is no point in loading anything
+    if (_capacity == 0) return false;
+
+    // open the file
+    int fd = open(filename, O_RDONLY);
+
+    // check for success
+    if (fd < 0) return false;
+
+    // we need the size of the file
+    struct stat info;
+
+    // if the file cannot be inspected or is too small to even hold the magic
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(SNAPSHOT_MAGIC))
+    {
+        // cleanup and fail
+        ::close(fd);
+
+        // report failure
+        return false;
+    }
+
+    // map the entire file into memory, so that loading does not need any read-calls
+    void *address = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    // the descriptor is no longer needed, the mapping stays valid without it
+    ::close(fd);
+
+    // check for failure
+    if (address == MAP_FAILED) return false;
+
+    // pointers to iterate over the mapping
+    auto *current = (const unsigned char *)address;
+    auto *end = current + info.st_size;
+
+    // the file should start with the magic value
+    if (memcmp(current, &SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0)
+    {
+        // unrecognized format, cleanup and fail
+        munmap(address, info.st_size);
+
+        // report failure
+        return false;
+    }
+
+    // skip the magic
+    current += sizeof(SNAPSHOT_MAGIC);
+
+    // iterate over the entries (stop when the cache is full)
+    while (current + sizeof(SnapshotEntry) <= end && _entries.size() < _capacity)
+    {
+        // copy the fixed-size part to the stack (the mapping may not be aligned)
+        SnapshotEntry header;
+        memcpy(&header, current, sizeof(header));
+
+        // move to the response data
+        current += sizeof(header);
+
+        // a corrupt file could hold a size that runs past the end
+        if (current + header.size > end) break;
+
+        // entries that already expired are not loaded
+        if (header.expires > now)
+        {
+            // parsing the response could fail for a corrupt file
+            try
+            {
+                // parse the response to get access to the question
+                Response response(current, header.size);
+
+                // extract the original question for the key
+                Question question(response);
+
+                // merge into the cache (existing entries are preserved, they are fresher)
+                _entries.emplace(std::make_pair(std::string(question.name()), question.type()), std::make_shared<Entry>(response, header.expires));
+            }
+            catch (...)
+            {
+                // skip the corrupt entry
+            }
+        }
+
+        // move to the next entry
+        current += header.size;
+    }
+
+    // cleanup the mapping (the entries hold their own copies)
+    munmap(address, info.st_size);
+
+    // done
+    return true;
+}
+
+/**
+ *  End of namespace
+ */
+}
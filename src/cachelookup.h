@@ -0,0 +1,144 @@
+/**
+ *  CacheLookup.h
+ *
+ *  Class that implements a lookup that can be answered from the
+ *  in-memory response cache, so that no datagram has to be sent
+ *  to a nameserver at all
+ *
+ *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include "../include/dnscpp/cache.h"
+#include "../include/dnscpp/response.h"
+#include "../include/dnscpp/handler.h"
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Class definition
+ */
+class CacheLookup : public Lookup
+{
+private:
+    /**
+     *  The cached entry that holds the response
+     *  @var std::shared_ptr<Cache::Entry>
+     */
+    std::shared_ptr<Cache::Entry> _entry;
+
+    /**
+     *  Is the operation ready?
+     *  @var bool
+     */
+    bool _ready = false;
+
+    /**
+     *  Method that is called when it is time to process this lookup
+     *  @param  now     current time
+     *  @return bool    should it be rescheduled?
+     */
+    virtual bool execute(double now) override
+    {
+        // do nothing if ready
+        if (_ready) return false;
+
+        // remember that the operation is ready
+        _ready = true;
+
+        // make a copy of the cached buffer, because we have to patch the id
+        // (the cached response was the answer to an earlier query with a different id)
+        // @todo the ttls in the response are the original ones, they could be lowered
+        std::vector<unsigned char> buffer(_entry->data(), _entry->data() + _entry->size());
+
+        // overwrite the id with the id of our own query
+        buffer[0] = _query.id() >> 8;
+        buffer[1] = _query.id();
+
+        // pass the response to user-space
+        _handler->onReceived(this, Response(buffer.data(), buffer.size()));
+
+        // no need to reschedule
+        return false;
+    }
+
+    /**
+     *  How long should we wait until the next runtime?
+     *  @param  now         current time
+     *  @return double      delay in seconds
+     */
+    virtual double delay(double now) const override
+    {
+        // should run right away
+        return 0.0;
+    }
+
+    /**
+     *  How many credits are left (meaning: how many datagrams do we still have to send?)
+     *  @return size_t      number of attempts
+     */
+    virtual size_t credits() const override
+    {
+        // cached lookups do not send anything at all
+        return 0;
+    }
+
+    /**
+     *  Cancel the lookup
+     */
+    virtual void cancel() override
+    {
+        // if already reported back to user-space
+        if (_handler == nullptr) return;
+
+        // remember the handler
+        auto *handler = _handler;
+
+        // get rid of the handler to avoid that the result is reported
+        _handler = nullptr;
+
+        // the last instruction is to report it back to user-space
+        handler->onCancelled(this);
+    }
+
+
+public:
+    /**
+     *  Constructor
+     *  To keep the behavior of lookups consistent with the behavior of remote lookups, the
+     *  response is not reported right away, but in a later tick of the event loop
+     *  @param  domain
+     *  @param  type
+     *  @param  entry
+     *  @param  handler
+     */
+    CacheLookup(const char *domain, int type, const std::shared_ptr<Cache::Entry> &entry, Handler *handler) :
+        Lookup(handler, ns_o_query, domain, type, false), _entry(entry) {}
+
+    /**
+     *  Destructor
+     *  This is a self-destructing class
+     */
+    virtual ~CacheLookup()
+    {
+        // if the operation is destructed while it was still running, it means that the
+        // operation was prematurely cancelled from user-space, let the handler know
+        if (!_ready) _handler->onCancelled(this);
+    }
+};
+
+/**
+ *  End of namespace
+ */
+}
@@ -18,6 +18,7 @@
  *  Dependencies
  */
 #include <algorithm>
+#include <vector>
 #include <arpa/inet.h>
 
 /**
@@ -50,6 +51,69 @@ private:
     size_t _size;
     
     
+    /**
+     *  One buffer that was returned to the pool
+     */
+    struct Pooled
+    {
+        /**
+         *  The buffer itself
+         *  @var unsigned char *
+         */
+        unsigned char *buffer;
+
+        /**
+         *  Allocated size of the buffer
+         *  @var size_t
+         */
+        size_t allocated;
+    };
+
+    /**
+     *  Pool of buffers from earlier canonicalizers. Verification runs
+     *  canonicalize record-sets over and over and the buffers stabilize
+     *  at a handful of sizes, so recycling them avoids almost all
+     *  malloc/realloc traffic. The pool is per thread, so no locking
+     *  @return std::vector
+     */
+    static std::vector<Pooled> &pool()
+    {
+        // one pool per thread
+        static thread_local std::vector<Pooled> instance;
+
+        // expose it
+        return instance;
+    }
+
+    /**
+     *  Get a buffer, from the pool when possible
+     *  @param  minimum     minimal allocation size
+     *  @param  allocated   output-parameter for the actual allocated size
+     *  @return unsigned char *
+     */
+    static unsigned char *acquire(size_t minimum, size_t &allocated)
+    {
+        // check the pooled buffers
+        for (auto iter = pool().begin(); iter != pool().end(); ++iter)
+        {
+            // skip buffers that are too small
+            if (iter->allocated < minimum) continue;
+
+            // this buffer is big enough, take it out of the pool
+            auto result = *iter; pool().erase(iter);
+
+            // expose it
+            allocated = result.allocated;
+            return result.buffer;
+        }
+
+        // no pooled buffer was usable, make a fresh allocation
+        allocated = std::max(size_t(4096), minimum);
+
+        // allocate it
+        return (unsigned char *)malloc(allocated);
+    }
+
     /**
      *  Make sure that there is plenty of space
      *  @param  required        required number of bytes
@@ -105,27 +169,27 @@ public:
      *  Constructor
      *  @throws std::runtime_error
      */
-    Canonicalizer() :
-        _buffer((unsigned char *)malloc(4096)),
-        _allocated(4096),
-        _size(0)
+    Canonicalizer() : _size(0)
     {
+        // get a buffer, recycled when possible
+        _buffer = acquire(4096, _allocated);
+
         // leap out on failure
         if (_buffer == nullptr) throw std::runtime_error("allocation failure");
     }
-    
+
     /**
      *  Copy constructor
      *  @param  that
      */
-    Canonicalizer(const Canonicalizer &that) :
-        _buffer((unsigned char *)malloc(that._allocated)),
-        _allocated(that._allocated),
-        _size(that._size)
+    Canonicalizer(const Canonicalizer &that) : _size(that._size)
     {
+        // get a buffer that is big enough, recycled when possible
+        _buffer = acquire(that._allocated, _allocated);
+
         // leap out on failure
         if (_buffer == nullptr) throw std::runtime_error("allocation failure");
-        
+
         // fill the buffer
         memcpy(_buffer, that._buffer, _size);
     }
@@ -150,8 +214,13 @@ public:
      */
     virtual ~Canonicalizer()
     {
-        // deallocte the buffer
-        if (_buffer) free(_buffer);
+        // moved-from objects have nothing to give back
+        if (_buffer == nullptr) return;
+
+        // give the buffer back to the pool, unless the pool is full
+        // already, then it is simply deallocated
+        if (pool().size() < 16) pool().push_back(Pooled{ _buffer, _allocated });
+        else free(_buffer);
     }
     
     /**
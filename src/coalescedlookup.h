@@ -0,0 +1,140 @@
+/**
+ *  CoalescedLookup.h
+ *
+ *  When a query is started while an identical query (same domain and
+ *  record-type) is already in flight, we do not send out an extra
+ *  datagram. Instead, the new caller gets a lightweight operation that
+ *  piggybacks on the running RemoteLookup, which fans out its single
+ *  response to all attached operations.
+ *
+ *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include "../include/dnscpp/operation.h"
+#include "../include/dnscpp/handler.h"
+#include "remotelookup.h"
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Class definition
+ */
+class CoalescedLookup : public Operation
+{
+private:
+    /**
+     *  The lookup that is actually on the wire and that we piggyback on
+     *  @var RemoteLookup
+     */
+    RemoteLookup *_main;
+
+    /**
+     *  Cancel the operation
+     */
+    virtual void cancel() override
+    {
+        // if already reported back to user-space
+        if (_handler == nullptr) return;
+
+        // remember the handler
+        auto *handler = _handler;
+
+        // get rid of the handler to avoid that the result is reported
+        _handler = nullptr;
+
+        // the main lookup should no longer know us (it keeps running for others)
+        _main->detach(this);
+
+        // report back to user-space
+        handler->onCancelled(this);
+
+        // nobody references this operation any more
+        delete this;
+    }
+
+public:
+    /**
+     *  Constructor
+     *  @param  main        the in-flight lookup to piggyback on
+     *  @param  domain      the domain of the lookup
+     *  @param  type        type of records to look for
+     *  @param  bits        the bits to include in the request
+     *  @param  handler     user space object interested in the result
+     *  @throws std::runtime_error
+     */
+    CoalescedLookup(RemoteLookup *main, const char *domain, int type, const Bits &bits, DNS::Handler *handler) :
+        Operation(handler, ns_o_query, domain, type, bits), _main(main) {}
+
+    /**
+     *  Destructor is public (unlike the base class) because the main lookup
+     *  destructs us after it fanned out its response
+     */
+    virtual ~CoalescedLookup() = default;
+
+    /**
+     *  Method that is called by the main lookup when the response came in
+     *  @param  response    the received response
+     */
+    void notify(const Response &response)
+    {
+        // if already cancelled from user-space
+        if (_handler == nullptr) return;
+
+        // remember the handler and forget it (to avoid double reports)
+        auto *handler = _handler;
+        _handler = nullptr;
+
+        // pass the response to user-space
+        handler->onReceived(this, response);
+    }
+
+    /**
+     *  Method that is called by the main lookup when it times out
+     */
+    void expire()
+    {
+        // if already cancelled from user-space
+        if (_handler == nullptr) return;
+
+        // remember the handler and forget it (to avoid double reports)
+        auto *handler = _handler;
+        _handler = nullptr;
+
+        // pass the timeout to user-space
+        handler->onTimeout(this);
+    }
+
+    /**
+     *  Method that is called by the main lookup when it is destructed
+     *  while the operation was still in progress
+     */
+    void abort()
+    {
+        // if already cancelled from user-space
+        if (_handler == nullptr) return;
+
+        // remember the handler and forget it (to avoid double reports)
+        auto *handler = _handler;
+        _handler = nullptr;
+
+        // pass the cancellation to user-space
+        handler->onCancelled(this);
+    }
+};
+
+/**
+ *  End of namespace
+ */
+}
@@ -0,0 +1,113 @@
+/**
+ *  ConfigWatcher.cpp
+ *
+ *  Implementation file for the ConfigWatcher class
+ *
+ *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Dependencies
+ */
+#include "../include/dnscpp/configwatcher.h"
+#include "../include/dnscpp/core.h"
+#include "../include/dnscpp/loop.h"
+#include <sys/inotify.h>
+#include <stdexcept>
+#include <unistd.h>
+#include <string.h>
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Constructor
+ *  @param  core        the core object that should pick up the changes
+ *  @throws std::runtime_error
+ */
+ConfigWatcher::ConfigWatcher(Core *core) : _core(core)
+{
+    // create the inotify instance
+    _fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+    // check for success
+    if (_fd < 0) throw std::runtime_error("failed to initialize inotify");
+
+    // we watch the /etc directory instead of the files themselves, because
+    // editors and configuration tools typically replace the files with a
+    // rename (which would invalidate a watch on the file itself)
+    if (inotify_add_watch(_fd, "/etc", IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0)
+    {
+        // cleanup the descriptor
+        ::close(_fd);
+
+        // report the error
+        throw std::runtime_error("failed to watch /etc");
+    }
+
+    // we want to be notified when the descriptor becomes readable
+    _identifier = _core->loop()->add(_fd, 1, this);
+}
+
+/**
+ *  Destructor
+ */
+ConfigWatcher::~ConfigWatcher()
+{
+    // tell the event loop that we are no longer interested in notifications
+    _core->loop()->remove(_identifier, _fd, this);
+
+    // close the descriptor
+    ::close(_fd);
+}
+
+/**
+ *  Method that is called from user-space when the inotify descriptor
+ *  becomes readable (meaning: something in /etc changed)
+ */
+void ConfigWatcher::notify()
+{
+    // did one of the files that we care about change?
+    bool hosts = false; bool resolvconf = false;
+
+    // buffer big enough for a batch of events
+    char buffer[4096];
+
+    // keep reading until the descriptor is drained
+    while (true)
+    {
+        // get the next batch of events
+        auto bytes = read(_fd, buffer, sizeof(buffer));
+
+        // if there were no more events
+        if (bytes <= 0) break;
+
+        // iterate over the events in the buffer
+        for (ssize_t pos = 0; pos < bytes; )
+        {
+            // the event structure lives at the current position
+            auto *event = (const struct inotify_event *)(buffer + pos);
+
+            // check if the event is about one of the files that we watch
+            if (event->len > 0 && strcmp(event->name, "hosts") == 0) hosts = true;
+            if (event->len > 0 && strcmp(event->name, "resolv.conf") == 0) resolvconf = true;
+
+            // move to the next event
+            pos += sizeof(struct inotify_event) + event->len;
+        }
+    }
+
+    // if nothing relevant changed we are ready
+    if (!hosts && !resolvconf) return;
+
+    // tell the core to pick up the changes
+    _core->reload(hosts, resolvconf);
+}
+
+/**
+ *  End of namespace
+ */
+}
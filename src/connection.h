@@ -1,9 +1,12 @@
 /**
  *  Connection.h
- * 
- *  Class that is responsible for making a TCP connection to the
- *  nameserver, and to send the query to it, and to handle the response
- * 
+ *
+ *  Class that is responsible for sending one query to the nameserver
+ *  over TCP, and for handling the response. The actual connection is a
+ *  persistent pipeline owned by the nameserver, so many Connection
+ *  objects (one per query) share one TCP connection and no handshake
+ *  is needed for every truncated response.
+ *
  *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
  *  @copyright 2020 Copernica BV
  */
@@ -16,8 +19,7 @@
 /**
  *  Dependencies
  */
-#include "connector.h"
-#include "receiver.h"
+#include "pipeline.h"
 
 /**
  *  Begin of namespace
@@ -27,7 +29,7 @@ namespace DNS {
 /**
  *  Class definition
  */
-class Connection : private Connector::Handler, private Receiver::Handler
+class Connection : private Pipeline::Subscriber
 {
 public:
     /**
@@ -42,7 +44,7 @@ public:
          *  @param  response        the received response
          */
         virtual void onReceived(Connection *connection, const Response &response) = 0;
-        
+
         /**
          *  Called when the connection could not be used
          *  @param  connector       the reporting connection
@@ -53,120 +55,80 @@ public:
 
 private:
     /**
-     *  The actual TCP socket
-     *  @var Tcp
-     */
-    Tcp _tcp;
-    
-    /**
-     *  The initial procedure (setting up the connection) is the responsibility
-     *  of the connector class
-     *  @var Connector
+     *  The pipeline over which the query travels (owned by the nameserver)
+     *  @var Pipeline
      */
-    Connector _connector;
-    
-    /**
-     *  After the connector has done it's work, the responsibilty is
-     *  handed over to the receiver that will do it's best to receive
-     *  a response
-     *  @var Receiver
-     */
-    Receiver _receiver;
-    
+    Pipeline *_pipeline;
+
     /**
-     *  Reference to the query that should be sent over the connection
-     *  @var Query
+     *  Id of the query, needed to unsubscribe from the pipeline
+     *  @var uint16_t
      */
-    const Query &_query;
-    
+    uint16_t _id;
+
     /**
      *  The truncated response that we already received
      *  @var Response
      */
     Response _truncated;
-    
+
     /**
      *  The handler that will receive the response
      *  @var Handler
      */
     Handler *_handler;
 
-
-    /**
-     *  Called when the connection has been set up
-     *  @param  connector
-     *  @param  tcp
-     */
-    virtual void onConnected(Connector *connector, Tcp *tcp) override
-    {
-        // now that the socket is connected, we can send out the query, if
-        // that succeeds we tell the receiver that he can start waiting for the response
-        if (_tcp.send(_query)) _receiver.start();
-        
-        // the query could not be sent, report this as an error
-        else _handler->onFailure(this, _truncated);
-    }
-    
     /**
-     *  Called when the connection could not be set up
-     *  @param  connector
-     *  @param  tcp
+     *  Called when the response to the query has been received
+     *  @param  pipeline        the reporting pipeline
+     *  @param  response        the received response
      */
-    virtual void onFailure(Connector *connector, Tcp *tcp) override
+    virtual void onReceived(Pipeline *pipeline, const Response &response) override
     {
-        // connection could not be set up, report this
-        _handler->onFailure(this, _truncated);
-    }
-    
-    /**
-     *  Method that is called when the response has been received
-     *  @param  receiver        reporting object
-     *  @param  response        the response data
-     */
-    virtual void onReceived(Receiver *receiver, const Response &response) override
-    {
-        // because we have only sent a single query, we can stop with receiving more
-        _receiver.stop();
-
         // report to the parent
         _handler->onReceived(this, response);
     }
-    
+
     /**
-     *  Method that is called when the response was not received
-     *  @param  receiver        reporting object
+     *  Called when the connection failed before the response came in
+     *  @param  pipeline        the reporting pipeline
      */
-    virtual void onFailure(Receiver *receiver) override
+    virtual void onFailure(Pipeline *pipeline) override
     {
-        // error while receiving data, pass on
+        // the tcp attempt failed, report the truncated response instead
         _handler->onFailure(this, _truncated);
     }
 
 public:
     /**
      *  Constructor
-     *  @param  loop        the event loop
-     *  @param  ip          the IP address to connect to
+     *  @param  pipeline    the persistent connection to the nameserver
      *  @param  query       the query to send over the connection
      *  @param  response    the response that was already received
      *  @param  handler     parent object that is notified about the result
+     *  @throws std::runtime_error
      */
-    Connection(Loop *loop, const Ip &ip, const Query &query, const Response &response, Handler *handler) :
-        _tcp(loop, ip),
-        _connector(&_tcp, ip, this),
-        _receiver(&_tcp, this),
-        _query(query),
+    Connection(Pipeline *pipeline, const Query &query, const Response &response, Handler *handler) :
+        _pipeline(pipeline),
+        _id(query.id()),
         _truncated(response),
-        _handler(handler) {}
-        
+        _handler(handler)
+    {
+        // hand the query to the pipeline
+        if (!_pipeline->send(query, this)) throw std::runtime_error("failed to send query over tcp");
+    }
+
     /**
      *  Destructor
      */
-    virtual ~Connection() = default;
+    virtual ~Connection()
+    {
+        // we are no longer interested in the response
+        _pipeline->unsubscribe(_id, this);
+    }
 };
 
 /**
  *  End of namespace
  */
 }
-
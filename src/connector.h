@@ -100,7 +100,20 @@ public:
     {
         // try to connect
         if (!tcp->connect(ip, 53)) throw std::runtime_error("failed to connect");
-        
+
+        // monitor the socket for writability, because that means that the socket is connected
+        _identifier = tcp->monitor(2, this);
+    }
+
+    /**
+     *  Constructor for a socket on which the connect was already started
+     *  by the caller (for example with tcp fast open), we only wait for
+     *  the handshake to complete
+     *  @param  socket      the socket socket
+     *  @param  handler     object that is notified on success
+     */
+    Connector(Tcp *tcp, Handler *handler) : _tcp(tcp), _handler(handler)
+    {
         // monitor the socket for writability, because that means that the socket is connected
         _identifier = tcp->monitor(2, this);
     }
@@ -11,8 +11,14 @@
  *  Dependencies
  */
 #include "../include/dnscpp/context.h"
+#include "../include/dnscpp/now.h"
+#include "../include/dnscpp/sharedcache.h"
+#include "../include/dnscpp/configwatcher.h"
 #include "remotelookup.h"
 #include "locallookup.h"
+#include "zonelookup.h"
+#include "cachelookup.h"
+#include "searcher.h"
 
 /**
  *  Begin of namespace
@@ -20,24 +26,139 @@
 namespace DNS {
 
 /**
- *  Do a dns lookup
+ *  Attach a cache segment in shared memory
+ *  @param  name      name of the shared memory segment (e.g. "/dnscpp-cache")
+ *  @param  slots     number of slots in the table (only relevant for the creator)
+ *  @param  writer    is this process the single designated writer?
+ *  @throws std::runtime_error
+ */
+void Context::sharedcache(const char *name, size_t slots, bool writer)
+{
+    // replace the current segment (if any)
+    _sharedcache.reset(new SharedCache(name, slots, writer));
+}
+
+/**
+ *  Enable or disable automatic reloading of the configuration files
+ *  @param  value     should the configuration files be watched?
+ *  @throws std::runtime_error
+ */
+void Context::autoreload(bool value)
+{
+    // when disabling we simply drop the watcher
+    if (!value) return _watcher.reset();
+
+    // do nothing if a watcher is already in place
+    if (_watcher != nullptr) return;
+
+    // install a new watcher (could throw)
+    _watcher.reset(new ConfigWatcher(this));
+}
+
+/**
+ *  Do a dns lookup (the actual implementation behind the query() overloads)
  *  @param  name        the record name to look for
  *  @param  type        type of record (normally you ask for an 'a' record)
  *  @param  bits        bits to include in the query
+ *  @param  options     per-lookup timing overrides (or nullptr)
  *  @param  handler     object that will be notified when the query is ready
+ *  @param  urgent      is this a latency-critical lookup?
  *  @return Operation   object to interact with the operation while it is in progress
  */
-Operation *Context::query(const char *domain, ns_type type, const Bits &bits, Handler *handler)
+Operation *Context::lookup(const char *domain, ns_type type, const Bits &bits, const Options *options, Handler *handler, bool urgent)
 {
+    // short hostnames are completed with the search domains from the
+    // resolver configuration: all candidates are probed concurrently and
+    // the first positive answer wins (absolute names, and names with at
+    // least "ndots" dots, are considered fully qualified and skip this)
+    if (Searcher::applicable(domain, searchpaths(), ndots()))
+    {
+        // constructing could throw (for example when the name is invalid)
+        try
+        {
+            // the searcher launches one lookup per candidate (the candidates
+            // are absolute names, so they do not get expanded again)
+            return (new Searcher(this, domain, type, bits, handler))->start(this, options, urgent);
+        }
+        catch (...)
+        {
+            // invalid parameters were supplied
+            return nullptr;
+        }
+    }
+
+    // the memory-mapped policy zone (if one was loaded) goes first: a hit
+    // (blocked name or internal rewrite) never reaches the network
+    if (_zone.match(domain, type)) return local(new ZoneLookup(_zone, domain, type, handler), urgent);
+
     // for A and AAAA lookups we also check the /etc/hosts file
-    if (type == ns_t_a    && _hosts.lookup(domain, 4)) return add(new LocalLookup(_hosts, domain, type, handler));
-    if (type == ns_t_aaaa && _hosts.lookup(domain, 6)) return add(new LocalLookup(_hosts, domain, type, handler));
-    
+    if (type == ns_t_a    && _hosts.lookup(domain, 4)) return local(new LocalLookup(_hosts, domain, type, handler), urgent);
+    if (type == ns_t_aaaa && _hosts.lookup(domain, 6)) return local(new LocalLookup(_hosts, domain, type, handler), urgent);
+
+    // current time (we need it a couple of times below)
+    Now now;
+
+    // maybe an earlier response is still in the in-memory cache (in serve-stale
+    // mode we even accept entries that are already expired)
+    auto entry = _cache.find(now, domain, type, _servestale);
+
+    // if we have a cached response we can answer without network traffic
+    if (entry)
+    {
+        // if the entry is expired (only possible in serve-stale mode) we start a
+        // background lookup to refresh it, unless such a lookup is already running
+        // (the refreshed response reaches the cache via the normal report-path)
+        if (entry->expired(now) && !entry->refreshing())
+        {
+            // avoid that the next stale hit starts yet another refresh
+            entry->refreshing(true);
+
+            // the lookup reports to a set of no-op callbacks, the cache is updated as side-effect
+            try { add(new RemoteLookup(this, domain, type, bits, new Callbacks([](const Operation*, const Response&){}, [](const Operation*, int){}))); }
+            catch (...) { /* invalid domain, the stale answer is all we have */ }
+        }
+
+        // answer with the cached response
+        return local(new CacheLookup(domain, type, entry, handler), urgent);
+    }
+
+    // maybe another worker process already resolved this query via the shared segment
+    if (_sharedcache != nullptr)
+    {
+        // the shared segment copies the raw response into a local buffer
+        std::vector<unsigned char> buffer; double expires = 0.0;
+
+        // check the segment
+        if (_sharedcache->find(now, domain, type, buffer, expires))
+        {
+            // parsing could fail if the slot was overwritten with garbage
+            try
+            {
+                // wrap the buffer in a regular cache-entry so that we can reuse the CacheLookup
+                auto shared = std::make_shared<Cache::Entry>(Response(buffer.data(), buffer.size()), expires);
+
+                // answer with the shared response
+                return local(new CacheLookup(domain, type, shared, handler), urgent);
+            }
+            catch (...)
+            {
+                // entry could not be parsed, we fall through to a regular lookup
+            }
+        }
+    }
+
+    // if an identical lookup is already in flight we attach the new caller to
+    // that lookup instead of putting a second identical query on the wire
+    auto *coalesced = coalesce(domain, type, bits, handler);
+
+    // if the caller could indeed be attached
+    if (coalesced) return coalesced;
+
     // the request can throw (for example when the domain is invalid
     try
     {
         // we are going to create a self-destructing request
-        return add(new RemoteLookup(this, domain, type, bits, handler));
+        return add(new RemoteLookup(this, domain, type, bits, handler, options), urgent);
     }
     catch (...)
     {
@@ -46,6 +167,37 @@ Operation *Context::query(const char *domain, ns_type type, const Bits &bits, Ha
     }
 }
 
+/**
+ *  Submit many lookups in one call, with one shared handler
+ *  @param  queries     the (domain, type) pairs to look up
+ *  @param  bits        bits to include in the queries
+ *  @param  handler     object that is notified for each result
+ *  @return operations  per-item operation handles (in input order)
+ */
+std::vector<Operation*> Context::query_many(const std::vector<std::pair<const char*,ns_type>> &queries, const Bits &bits, Handler *handler)
+{
+    // the per-item handles
+    std::vector<Operation*> result;
+
+    // one allocation for all the handles
+    result.reserve(queries.size());
+
+    // while the batch is active, add() postpones the timer bookkeeping
+    batch(true);
+
+    // submit all items via the normal code path (hosts file, cache,
+    // coalescing), items with invalid parameters become null handles
+    for (const auto &item : queries) result.push_back(query(item.first, item.second, bits, handler));
+
+    // finishing the batch installs the one timer for all the lookups,
+    // on the next timer-expiration the initial datagrams leave in one
+    // burst, in submission order
+    batch(false);
+
+    // expose the handles
+    return result;
+}
+
 /**
  *  Do a reverse IP lookup, this is only meaningful for PTR lookups
  *  @param  ip          the ip address to lookup
@@ -53,10 +205,10 @@ Operation *Context::query(const char *domain, ns_type type, const Bits &bits, Ha
  *  @param  handler     object that will be notified when the query is ready
  *  @return operation   object to interact with the operation while it is in progress
  */
-Operation *Context::query(const Ip &ip, const Bits &bits, Handler *handler) 
+Operation *Context::query(const Ip &ip, const Bits &bits, Handler *handler)
 {
     // if the /etc/hosts file already holds a record
-    if (_hosts.lookup(ip)) return add(new LocalLookup(_hosts, ip, handler));
+    if (_hosts.lookup(ip)) return local(new LocalLookup(_hosts, ip, handler));
 
     // pass on to the regular query method
     return query(Reverse(ip), TYPE_PTR, bits, handler);
@@ -77,6 +229,74 @@ Operation *Context::query(const char *domain, ns_type type, const Bits &bits, co
     return query(domain, type, bits, new Callbacks(success, failure));
 }
 
+/**
+ *  Combined dual-stack lookup: resolve both the A and the AAAA records
+ *  of a domain in one operation with a single combined callback
+ *  @param  domain      the domain to resolve
+ *  @param  bits        bits to include in the queries
+ *  @param  handler     object notified about the combined result
+ *  @param  early       report as soon as the first family answers?
+ *  @return Dual        the operation (or nullptr on failure)
+ */
+Dual *Context::dual(const char *domain, const Bits &bits, Dual::Handler *handler, bool early)
+{
+    // prevent exceptions (the domain could be invalid)
+    try
+    {
+        // construct the combined operation, it starts both lookups
+        return new Dual(this, domain, bits, handler, early);
+    }
+    catch (...)
+    {
+        // report an error
+        return nullptr;
+    }
+}
+
+/**
+ *  Resolve the mail exchanges of a domain in one composite operation
+ *  @param  domain      the domain whose mail exchanges are resolved
+ *  @param  bits        bits to include in the queries
+ *  @param  handler     object notified about the combined result
+ *  @return Exchanges   the operation (or nullptr on failure)
+ */
+Exchanges *Context::exchanges(const char *domain, const Bits &bits, Exchanges::Handler *handler)
+{
+    // prevent exceptions (the domain could be invalid)
+    try
+    {
+        // construct the composite operation, it starts the MX lookup
+        return new Exchanges(this, domain, bits, handler);
+    }
+    catch (...)
+    {
+        // report an error
+        return nullptr;
+    }
+}
+
+/**
+ *  Transfer a full zone (axfr) from its primary nameserver
+ *  @param  nameserver  the primary nameserver holding the zone
+ *  @param  domain      the zone to transfer
+ *  @param  handler     object notified about the records
+ *  @return Transfer    the operation (or nullptr on failure)
+ */
+Transfer *Context::transfer(const Ip &nameserver, const char *domain, Transfer::Handler *handler)
+{
+    // prevent exceptions (the domain could be invalid, or the connect could fail)
+    try
+    {
+        // construct the operation, it connects and sends the query
+        return new Transfer(loop(), nameserver, domain, handler, _dnsport);
+    }
+    catch (...)
+    {
+        // report an error
+        return nullptr;
+    }
+}
+
 /**
  *  Do a reverse dns lookup and pass the result to callbacks
  *  @param  ip          the ip address to lookup
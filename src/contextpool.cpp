@@ -0,0 +1,198 @@
+/**
+ *  ContextPool.cpp
+ *
+ *  Implementation file for the ContextPool class
+ *
+ *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Dependencies
+ */
+#include "../include/dnscpp/contextpool.h"
+#include <stdexcept>
+#include <ctype.h>
+#include <pthread.h>
+#include <sched.h>
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Constructor
+ *  @param  loops       the event loops, one per shard
+ *  @param  defaults    load settings from /etc/resolv.conf?
+ *  @throws std::runtime_error
+ */
+ContextPool::ContextPool(const std::vector<Loop*> &loops, bool defaults)
+{
+    // we need at least one loop
+    if (loops.empty()) throw std::runtime_error("a context-pool needs at least one event loop");
+
+    // reserve room for the shards
+    _shards.reserve(loops.size());
+
+    // construct one shard per loop
+    for (auto *loop : loops) _shards.emplace_back(new Shard(loop, defaults));
+}
+
+/**
+ *  Constructor that also assigns a cpu to each shard
+ *  @param  loops       the event loops, one per shard
+ *  @param  cpus        the cpu for each shard (same order as loops)
+ *  @param  defaults    load settings from /etc/resolv.conf?
+ *  @throws std::runtime_error
+ */
+ContextPool::ContextPool(const std::vector<Loop*> &loops, const std::vector<int> &cpus, bool defaults) :
+    ContextPool(loops, defaults)
+{
+    // every shard needs a cpu
+    if (cpus.size() != _shards.size()) throw std::runtime_error("a context-pool needs one cpu per shard");
+
+    // assign the cpus
+    for (size_t i = 0; i < _shards.size(); ++i)
+    {
+        // remember the cpu for the pin() call of the loop thread
+        _shards[i]->cpu = cpus[i];
+
+        // the shard's sockets steer their incoming datagrams to that cpu
+        _shards[i]->context.affinity(cpus[i]);
+    }
+}
+
+/**
+ *  Bind the calling thread to the cpu of one shard
+ *  @param  index       index of the shard
+ *  @return bool        was the thread successfully bound?
+ */
+bool ContextPool::pin(size_t index)
+{
+    // the cpu of the shard (shards without a cpu cannot be pinned)
+    int cpu = _shards[index]->cpu;
+
+    // check whether a cpu was assigned
+    if (cpu < 0) return false;
+
+    // the set holding just that one cpu
+    cpu_set_t cpus;
+
+    // fill the set
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+
+    // bind the calling thread (the thread that is about to run the
+    // shard's loop), the memory that the shard allocates from now on is
+    // first-touched from, and thus placed on, the local numa node
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0;
+}
+
+/**
+ *  Pick the shard for a certain domain
+ *  @param  domain      the domain that is being looked up
+ *  @return size_t      index of the shard to use
+ */
+size_t ContextPool::select(const char *domain) const
+{
+    // fnv-1a over the lowercased domain, so that the case-randomization
+    // that some stub-resolvers apply does not spread one domain over
+    // multiple shards (and thus over multiple caches)
+    size_t hash = 14695981039346656037ULL;
+
+    // mix in all characters
+    for (const char *c = domain; *c; ++c) hash = (hash ^ (unsigned char)tolower(*c)) * 1099511628211ULL;
+
+    // reduce to a shard index
+    return hash % _shards.size();
+}
+
+/**
+ *  Submit a lookup, may be called from any thread
+ *  @param  domain      the domain to look up
+ *  @param  type        type of records to look for
+ *  @param  bits        the bits to include in the query
+ *  @param  handler     user space handler
+ *  @return bool        was the lookup submitted?
+ */
+bool ContextPool::publish(const char *domain, ns_type type, const Bits &bits, Handler *handler)
+{
+    // the preferred shard, based on the domain hash
+    size_t index = select(domain);
+
+    // current load of that shard
+    size_t load = _shards[index]->pending.load(std::memory_order_relaxed);
+
+    // when the preferred shard has a real backlog we look for a quieter one:
+    // losing cache-locality for this one lookup is better than queueing it
+    // behind a pile of work while other shards sit idle
+    if (load >= 16)
+    {
+        // the best alternative seen so far
+        size_t best = index; size_t bestload = load;
+
+        // compare all shards
+        for (size_t i = 0; i < _shards.size(); ++i)
+        {
+            // load of this shard (a racy read, but an approximation is all we need)
+            size_t candidate = _shards[i]->pending.load(std::memory_order_relaxed);
+
+            // remember it if it beats the best so far
+            if (candidate < bestload) { best = i; bestload = candidate; }
+        }
+
+        // only divert when the difference is substantial, so that lookups
+        // do not ping-pong between shards with similar load
+        if (bestload * 2 <= load) index = best;
+    }
+
+    // the shard that gets the lookup
+    auto &shard = *_shards[index];
+
+    // constructing the wrapper could throw (out of memory)
+    try
+    {
+        // wrap the handler, so that we hear when the lookup completes
+        auto *bridge = new Bridge(&shard.pending, handler);
+
+        // the shard has one more lookup in flight
+        shard.pending.fetch_add(1, std::memory_order_relaxed);
+
+        // hand over to the inbox of the shard
+        if (shard.inbox.publish(domain, type, bits, bridge)) return true;
+
+        // the submission failed, undo the administration
+        shard.pending.fetch_sub(1, std::memory_order_relaxed);
+
+        // get rid of the wrapper
+        delete bridge;
+
+        // report the failure
+        return false;
+    }
+    catch (...)
+    {
+        // out of memory
+        return false;
+    }
+}
+
+/**
+ *  Submit a lookup with default bits
+ *  @param  domain      the domain to look up
+ *  @param  type        type of records to look for
+ *  @param  handler     user space handler
+ *  @return bool        was the lookup submitted?
+ */
+bool ContextPool::publish(const char *domain, ns_type type, Handler *handler)
+{
+    // pass on with the default bits of the selected shard (all shards have
+    // identical defaults unless user space configured them differently)
+    return publish(domain, type, _shards.front()->context.bits(), handler);
+}
+
+/**
+ *  End of namespace
+ */
+}
@@ -14,6 +14,13 @@
 #include "../include/dnscpp/lookup.h"
 #include "../include/dnscpp/loop.h"
 #include "../include/dnscpp/watcher.h"
+#include "../include/dnscpp/sharedcache.h"
+#include "../include/dnscpp/configwatcher.h"
+#include "../include/dnscpp/verifiers.h"
+#include "../include/dnscpp/callbacks.h"
+#include "remotelookup.h"
+#include "slab.h"
+#include "dname.h"
 
 /**
  *  Begin of namespace
@@ -42,6 +49,8 @@ Core::Core(Loop *loop, bool defaults) : _loop(loop)
     _interval = settings.timeout();
     _attempts = settings.attempts();
     _rotate = settings.rotate();
+    _searchpaths = settings.searchpaths();
+    _ndots = settings.ndots();
 
     // we also have to load /etc/hosts
     if (!_hosts.load()) throw std::runtime_error("failed to load /etc/hosts");
@@ -62,6 +71,8 @@ Core::Core(Loop *loop, const ResolvConf &settings) : _loop(loop)
     _interval = settings.timeout();
     _attempts = settings.attempts();
     _rotate = settings.rotate();
+    _searchpaths = settings.searchpaths();
+    _ndots = settings.ndots();
 }
 
 
@@ -72,46 +83,427 @@ Core::~Core()
 {
     // stop timer (in case it is still running)
     if (_timer == nullptr) return;
-    
+
     // stop the timer
     _loop->cancel(_timer, this);
 }
 
+/**
+ *  Expose the pool of worker threads for expensive cryptographic checks
+ *  @return Verifiers
+ */
+Verifiers *Core::verifiers()
+{
+    // without configured workers there is no pool
+    if (_workers == 0) return nullptr;
+
+    // create the pool on first use
+    if (_verifiers == nullptr) _verifiers.reset(new Verifiers(_loop, _workers));
+
+    // expose the pool
+    return _verifiers.get();
+}
+
+/**
+ *  Store a response in the cache(s)
+ *  @param  now         current time
+ *  @param  response    the received response
+ */
+void Core::store(double now, const Response &response)
+{
+    // the in-process cache checks cacheability itself
+    _cache.insert(now, response);
+
+    // if there is no shared segment we are done
+    if (_sharedcache == nullptr) return;
+
+    // calculate how long the response stays valid
+    uint32_t lifetime = Cache::ttl(response);
+
+    // responses with a zero lifetime are not shared either
+    if (lifetime == 0) return;
+
+    // store in the shared segment (a no-op if we are not the designated writer)
+    _sharedcache->insert(now, now + lifetime, response);
+}
+
+/**
+ *  Spin on the sockets of all nameservers for a given budget, processing
+ *  responses that arrive during the spin right away instead of waiting
+ *  for the readiness callback of the event loop
+ *  @param  budget      how long to spin (in seconds)
+ *  @return bool        was a datagram received and processed?
+ */
+bool Core::spin(double budget)
+{
+    // structure for the monotonic clock (the budgets are in microseconds
+    // territory, the coarse clock behind the Now class is far too rough)
+    struct timespec time;
+
+    // the moment at which we give up
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    double deadline = time.tv_sec + time.tv_nsec * 1e-9 + budget;
+
+    // keep polling until something arrives or the budget runs out
+    do
+    {
+        // check the socket pools of all nameservers, the first datagram
+        // (batch) that is processed concludes the spin
+        for (auto &nameserver : _nameservers) if (nameserver.spin()) return true;
+
+        // the current time
+        clock_gettime(CLOCK_MONOTONIC, &time);
+    }
+    while (time.tv_sec + time.tv_nsec * 1e-9 < deadline);
+
+    // nothing came in, the caller falls back to the event loop
+    return false;
+}
+
+/**
+ *  Pick up changes to the configuration files without disturbing the
+ *  operations that are currently running
+ *  @param  hosts       did /etc/hosts change?
+ *  @param  resolvconf  did /etc/resolv.conf change?
+ */
+void Core::reload(bool hosts, bool resolvconf)
+{
+    // merge the new entries from /etc/hosts (entries that are already known are kept)
+    if (hosts) _hosts.load();
+
+    // if the nameserver configuration did not change we are ready
+    if (!resolvconf) return;
+
+    // parsing the file could fail, in which case we keep the current configuration
+    try
+    {
+        // parse the new configuration
+        ResolvConf settings;
+
+        // remove the nameservers that are no longer configured
+        for (auto iter = _nameservers.begin(); iter != _nameservers.end(); )
+        {
+            // check if this nameserver still occurs in the new configuration
+            bool found = false;
+
+            // compare with the parsed addresses
+            for (size_t i = 0; !found && i < settings.nameservers(); ++i) found = settings.nameserver(i) == iter->ip();
+
+            // keep or remove the nameserver (lookups that were waiting for it
+            // simply proceed with their next attempt on a remaining server)
+            if (found) ++iter;
+            else iter = _nameservers.erase(iter);
+        }
+
+        // add the nameservers that are new in the configuration
+        for (size_t i = 0; i < settings.nameservers(); ++i)
+        {
+            // check if we already have this nameserver
+            bool found = false;
+
+            // compare with the current instances
+            for (const auto &nameserver : _nameservers)
+            {
+                // compare the addresses
+                if (!(found = nameserver.ip() == settings.nameserver(i))) continue;
+
+                // we have a match
+                break;
+            }
+
+            // add the nameserver if it is indeed new
+            if (!found) _nameservers.emplace_back(this, settings.nameserver(i));
+        }
+
+        // the search domains simply follow the new configuration
+        _searchpaths = settings.searchpaths();
+        _ndots = settings.ndots();
+    }
+    catch (...)
+    {
+        // /etc/resolv.conf could not be parsed, we keep the current configuration
+    }
+}
+
+/**
+ *  Add a route: queries for the zone (and everything below it) are
+ *  only sent to the given nameserver
+ *  @param  zone        the zone for which a specific route applies
+ *  @param  nameserver  ip of a nameserver responsible for the zone
+ */
+void Core::route(const char *zone, const Ip &nameserver)
+{
+    // zones are stored lowercase and without trailing dot, so that the
+    // lookup does not have to normalize in multiple ways
+    std::string name(zone);
+
+    // remove a possible trailing dot
+    if (!name.empty() && name.back() == '.') name.pop_back();
+
+    // lowercase the zone
+    for (auto &c : name) c = tolower(c);
+
+    // add the nameserver to the zone (creating the zone if needed)
+    _routes[name].push_back(nameserver);
+}
+
+/**
+ *  Find the route that applies to a certain domain, using a longest
+ *  suffix match over the configured zones
+ *  @param  domain      the domain that is being looked up
+ *  @return std::vector the nameservers to use (or nullptr)
+ */
+const std::vector<Ip> *Core::route(const char *domain) const
+{
+    // most setups have no routes at all, leave right away then
+    if (_routes.empty()) return nullptr;
+
+    // normalize the domain in the same way as the stored zones
+    std::string name(domain);
+
+    // remove a possible trailing dot
+    if (!name.empty() && name.back() == '.') name.pop_back();
+
+    // lowercase the domain
+    for (auto &c : name) c = tolower(c);
+
+    // walk over the suffixes of the domain, most specific first, so that
+    // a route for "corp.example.com" wins from a route for "example.com"
+    for (size_t pos = 0; true; )
+    {
+        // look for a zone that matches the current suffix
+        auto iter = _routes.find(pos == 0 ? name : name.substr(pos));
+
+        // if there is a match we have found the longest one
+        if (iter != _routes.end()) return &iter->second;
+
+        // find the next label boundary
+        auto dot = name.find('.', pos);
+
+        // if there are no more labels we are ready
+        if (dot == std::string::npos) break;
+
+        // continue with the suffix that starts after the dot
+        pos = dot + 1;
+    }
+
+    // check for a catch-all route for the root zone
+    auto iter = _routes.find(std::string());
+
+    // expose the catch-all route (or nullptr)
+    return iter == _routes.end() ? nullptr : &iter->second;
+}
+
+/**
+ *  Register a remote lookup in the administration of in-flight lookups
+ *  @param  domain      the domain of the lookup
+ *  @param  type        type of records that are looked up
+ *  @param  lookup      the lookup that goes out on the wire
+ */
+void Core::enlist(const char *domain, uint16_t type, RemoteLookup *lookup)
+{
+    // add to the administration (if an identical lookup is already listed
+    // -- possible for internal refresh-lookups -- we keep the existing one)
+    _inflight.emplace(std::make_pair(std::string(domain), type), lookup);
+}
+
+/**
+ *  Remove a remote lookup from the administration of in-flight lookups
+ *  @param  domain      the domain of the lookup
+ *  @param  type        type of records that were looked up
+ *  @param  lookup      the lookup that is no longer in flight
+ */
+void Core::delist(const char *domain, uint16_t type, const RemoteLookup *lookup)
+{
+    // find the entry
+    auto iter = _inflight.find(std::make_pair(std::string(domain), type));
+
+    // it should be there, and it should be ours (it could be a different
+    // lookup if multiple identical lookups were started internally)
+    if (iter == _inflight.end() || iter->second != lookup) return;
+
+    // remove from the administration
+    _inflight.erase(iter);
+}
+
+/**
+ *  Try to coalesce a new query onto an identical lookup that is already in flight
+ *  @param  domain      the domain of the lookup
+ *  @param  type        type of records to look for
+ *  @param  bits        the bits to include in the request
+ *  @param  handler     user space object interested in the result
+ *  @return Operation
+ */
+Operation *Core::coalesce(const char *domain, uint16_t type, const Bits &bits, Handler *handler)
+{
+    // check the administration
+    auto iter = _inflight.find(std::make_pair(std::string(domain), type));
+
+    // if there is no identical lookup in flight
+    if (iter == _inflight.end()) return nullptr;
+
+    // attach the new caller to the existing lookup
+    return iter->second->coalesce(domain, type, bits, handler);
+}
+
+/**
+ *  Get the precompiled query for a domain/type/bits combination,
+ *  compiling and caching it on first use
+ *  @param  domain      the domain to look up
+ *  @param  type        record-type to look up
+ *  @param  bits        the bits to include in the query
+ *  @return Query       the precompiled query
+ *  @throws std::runtime_error
+ */
+const Query &Core::compile(const char *domain, ns_type type, const Bits &bits)
+{
+    // the bits that influence the wire form of a query
+    int flags = (bits.AD() ? BIT_AD : 0) | (bits.CD() ? BIT_CD : 0) | (bits.DO() ? BIT_DO : 0);
+
+    // check if the very same query was compiled before
+    for (auto iter = _templates.begin(); iter != _templates.end(); ++iter)
+    {
+        // all parts of the key must match
+        if (iter->type != type || iter->flags != flags || iter->payload != bits.payload()) continue;
+        if (!Dname::equal(iter->domain.data(), domain)) continue;
+
+        // keep the most recently used templates in front, so that the
+        // hottest domains stay cached
+        if (iter != _templates.begin()) _templates.splice(_templates.begin(), _templates, iter);
+
+        // expose the precompiled query
+        return *_templates.front().query;
+    }
+
+    // compile the query (this runs the name compression and header
+    // encoding, and could throw for invalid domains)
+    std::unique_ptr<Query> query(new Query(ns_o_query, domain, type, bits));
+
+    // store in the cache, most recently used in front
+    _templates.emplace_front(Template{ domain, uint16_t(type), flags, bits.payload(), std::move(query) });
+
+    // the cache is kept small, repeated lookups for the same couple of
+    // domains are the case that it exists for
+    if (_templates.size() > 64) _templates.pop_back();
+
+    // expose the precompiled query
+    return *_templates.front().query;
+}
+
 /**
  *  Add a new lookup to the list
  *  @param  lookup
+ *  @param  urgent      is this a latency-critical lookup?
  *  @return Operation
  */
-Operation *Core::add(Lookup *lookup)
+Operation *Core::add(Lookup *lookup, bool urgent)
 {
-    // add to the operations
-    if (_lookups.size() < _capacity)
+    // add to the operations (urgent lookups never end up in the overflow:
+    // an interactive lookup should not queue behind piles of batch work)
+    if (urgent || _lookups.size() < _capacity)
     {
-        // put at the beginning of the list (because we want to run it immediately)
-        _lookups.emplace_front(lookup);
-        
-        // if we already have a timer the expires immediately
-        if (_timer && _immediate) return lookup;
-    
-        // stop existing timer
-        if (_timer) _loop->cancel(_timer, this);
-        
-        // reschedule the timer
-        _timer = _loop->timer(0.0, this);
-        
-        // this is an immediate-timer
-        _immediate = true;
+        // wrap in a shared pointer, with the control block coming from a
+        // slab too, so that submitting a lookup stays allocation-free
+        std::shared_ptr<Lookup> ptr(lookup, std::default_delete<Lookup>(), SlabAllocator<Lookup>());
+
+        // urgent lookups jump the queue of lookups that are already due,
+        // regular ones run right away too, but in submission order
+        if (urgent) _lookups.promote(ptr, Now());
+        else _lookups.schedule(ptr, 0.0, Now());
+
+        // during a batched submission the timer is installed only once,
+        // when the whole batch has been added
+        if (_batching) _rearm = true;
+
+        // otherwise make sure an immediate timer is running
+        else arm();
     }
     else
     {
-        // we already have too many operations in progress, delay it
-        _scheduled.emplace_back(lookup);
+        // we already have too many operations in progress, delay it (the
+        // control block comes from the slab here too)
+        _scheduled.emplace_back(lookup, std::default_delete<Lookup>(), SlabAllocator<Lookup>());
     }
     
     // expose the operation
     return lookup;
 }
 
+/**
+ *  Cancel many operations in one call
+ *  @param  tag         the tag to match (nullptr to cancel everything)
+ *  @return size_t      number of operations that were cancelled
+ */
+size_t Core::cancel_many(const void *tag)
+{
+    // the matching lookups are collected first, so that the callbacks
+    // to userspace (which could submit new lookups, or cancel more) do
+    // not run while we are modifying the internal structures
+    std::vector<std::shared_ptr<Lookup>> victims;
+
+    // a full cancel extracts everything
+    if (tag == nullptr) victims.reserve(_lookups.size() + _scheduled.size() + _ready.size());
+
+    // does a lookup belong to the group that is being cancelled?
+    auto match = [tag](const std::shared_ptr<Lookup> &lookup) {
+        return tag == nullptr || lookup->tag() == tag;
+    };
+
+    // one pass over the timer wheel
+    _lookups.extract(match, victims);
+
+    // and over the overflow queue and the lookups that merely wait for
+    // a response (same move-to-the-back-and-erase technique)
+    for (auto *queue : { &_scheduled, &_ready })
+    {
+        // move the matching lookups to the back
+        auto iter = std::stable_partition(queue->begin(), queue->end(), [&match](const std::shared_ptr<Lookup> &lookup) {
+            return !match(lookup);
+        });
+
+        // hand them over and erase them in one go
+        for (auto it = iter; it != queue->end(); ++it) victims.push_back(std::move(*it));
+        queue->erase(iter, queue->end());
+    }
+
+    // for a full cancel the coalescing administration and the
+    // per-nameserver subscriber tables can be cleared wholesale, the
+    // per-lookup cleanup then finds empty structures and costs nothing
+    if (tag == nullptr)
+    {
+        // no lookup is in flight any more
+        _inflight.clear();
+
+        // drop all subscribers in one go
+        for (auto &nameserver : _nameservers) nameserver.reset();
+    }
+
+    // remember the count (the vector is consumed below)
+    size_t result = victims.size();
+
+    // inform userspace, every lookup gets its onCancelled() callback
+    for (const auto &lookup : victims) lookup->cancel();
+
+    // when victims goes out of scope the lookups are released en masse
+    return result;
+}
+
+/**
+ *  Install the immediate timer because a new lookup is due
+ */
+void Core::arm()
+{
+    // if we already have a timer that expires immediately
+    if (_timer && _immediate) return;
+
+    // re-arm the existing timer object, or install the very first one
+    if (_timer) _timer = _loop->update(_timer, 0.0, this);
+    else _timer = _loop->timer(0.0, this);
+
+    // this is an immediate-timer
+    _immediate = true;
+}
+
 /**
  *  Calculate the delay until the next job
  *  @return double      the delay in seconds (or < 0 if there is no need to run a timer)
@@ -125,15 +517,19 @@ double Core::delay(double now)
         if (nameserver.busy()) return 0.0;
     }
     
-    // if there is nothing scheduled
-    if (_lookups.empty() && _ready.empty()) return -1.0;
-    
-    // if only one is set
-    if (_lookups.empty()) return _ready.front()->delay(now);
-    if (_ready.empty()) return _lookups.front()->delay(now);
-    
-    // get the minimum
-    return std::min(_lookups.front()->delay(now), _ready.front()->delay(now));
+    // delay until the next lookup should run (or < 0 when nothing is scheduled)
+    double result = _lookups.next(now);
+
+    // also check the lookups that are merely waiting for a response
+    if (!_ready.empty()) result = result < 0 ? _ready.front()->delay(now) : std::min(result, _ready.front()->delay(now));
+
+    // when refresh-ahead is active and there are cached entries, the timer
+    // should keep ticking so that we can periodically check for hot entries
+    // that are about to expire (a low frequency scan is good enough)
+    if (_prefetch > 0 && _cache.size() > 0) result = result < 0 ? 1.0 : std::min(result, 1.0);
+
+    // done
+    return result;
 }
 
 /**
@@ -151,11 +547,14 @@ void Core::reschedule(double now)
     // if timer was immediate and stays immediate, not changes are needed
     if (seconds == 0.0 && _timer != nullptr && _immediate) return;
 
-    // if the timer is already running we have to reset it
-    if (_timer != nullptr) _loop->cancel(_timer, this);
-    
-    // check when the next operation should run
-    _timer = seconds < 0 ? nullptr : _loop->timer(seconds, this);
+    // when no timer is needed any longer, the running one is cancelled
+    if (seconds < 0) { _loop->cancel(_timer, this); _timer = nullptr; }
+
+    // otherwise we re-arm the existing timer object, or install a first one
+    else if (_timer != nullptr) _timer = _loop->update(_timer, seconds, this);
+    else _timer = _loop->timer(seconds, this);
+
+    // remember whether this timer expires right away
     _immediate = seconds == 0.0;
 }
 
@@ -175,9 +574,9 @@ bool Core::process(const std::shared_ptr<Lookup> &lookup, double now)
     
     // if no more attempts are expected, we put it in a special list
     if (lookup->credits() == 0) _ready.push_back(lookup);
-    
+
     // remember the lookup for the next attempt
-    else _lookups.push_back(lookup);
+    else _lookups.schedule(lookup, lookup->delay(now), now);
     
     // done
     return true;
@@ -212,9 +611,11 @@ void Core::proceed(double now, size_t count)
  */
 void Core::expire()
 {
-    // forget the timer
-    _loop->cancel(_timer, this); _timer = nullptr;
-    
+    // the timer has fired so it is no longer pending: we keep the object
+    // around so that reschedule() can re-arm it instead of allocating a
+    // fresh timer, but it no longer counts as a pending immediate timer
+    _immediate = false;
+
     // a call to userspace might destruct `this`
     Watcher watcher(this);
     
@@ -223,13 +624,19 @@ void Core::expire()
     
     // number of calls made
     size_t calls = 0;
-    
+
+    // the time at which this iteration must stop making calls to userspace (leftover
+    // work is not lost: reschedule() at the end arms an immediate timer whenever
+    // responses are still buffered or due lookups remain, so the remainder runs in
+    // the very next loop iteration) -- zero means that there is no time budget
+    double deadline = _maxtime > 0.0 ? now + _maxtime : 0.0;
+
     // first we are going to check the nameservers if they have some data to process
     for (auto &nameserver : _nameservers)
     {
         // because processing a response may lead to user-space destructing everything,
         // we leap out if there was indeed something processed
-        size_t count = nameserver.process(_maxcalls - calls);
+        size_t count = nameserver.process(_maxcalls - calls, deadline);
         
         // if nothing was processed we move one
         if (count == 0) continue;
@@ -244,28 +651,43 @@ void Core::expire()
         proceed(now, count);
         
         // is it meaningful to proceed
-        if (calls > _maxcalls) break;        
+        if (calls > _maxcalls) break;
+
+        // also leap out when the time budget ran out
+        if (deadline > 0.0 && double(Now()) >= deadline) { reschedule(now); return; }
     }
-    
+
     // there was no data to process, so we are going to run jobs
-    while (calls < _maxcalls && !_lookups.empty())
+    while (calls < _maxcalls)
     {
-        // get the oldest operation
-        if (!process(_lookups.front(), now)) break;
-        
+        // stop when the time budget has run out, due lookups that are left in the
+        // wheel make delay() return zero so an immediate timer picks them up
+        if (deadline > 0.0 && double(Now()) >= deadline) break;
+
+        // get the next due operation from the wheel
+        auto lookup = _lookups.pop(now);
+
+        // leap out when nothing is due
+        if (lookup == nullptr) break;
+
+        // a lookup can come up slightly early (wheel precision, or it was parked
+        // beyond the wheel horizon), in that case it goes back into the wheel
+        if (!process(lookup, now)) { _lookups.schedule(lookup, lookup->delay(now), now); continue; }
+
         // maybe the userspace call ended up in `this` being destructed
         if (!watcher.valid()) return;
-        
+
         // log one extra call (this is not entirely correct, maybe there was no call to userspace)
         calls += 1;
-        
-        // forget this lookup because we ran it
-        _lookups.pop_front();
     }
     
     // look at lookups that can no longer be repeated, but for which we're waiting for answer
     while (calls < _maxcalls && !_ready.empty())
     {
+        // the time budget applies here too, the remaining entries in the
+        // ready-list cause delay() to return zero so they run right after
+        if (deadline > 0.0 && double(Now()) >= deadline) break;
+
         // get the oldest operation
         if (!process(_ready.front(), now)) break;
 
@@ -281,11 +703,72 @@ void Core::expire()
 
     // if there are more slots for scheduled operations, we start them now
     if (_capacity > _lookups.size()) proceed(now, _capacity - _lookups.size());
-    
+
+    // start background lookups for hot cache entries that are about to expire
+    if (_prefetch > 0) prefetch(now);
+
+    // check the kernel drop counters and grow the receive buffers if needed
+    if (_autotune) autotune();
+
     // reset the timer
     reschedule(now);
 }
 
+/**
+ *  Check the kernel drop counters of all sockets, and grow the receive
+ *  buffers when the kernel turns out to be dropping datagrams
+ */
+void Core::autotune()
+{
+    // total number of datagrams that the kernel dropped so far
+    size_t total = 0;
+
+    // add up the counters of all nameservers
+    for (auto &nameserver : _nameservers) total += nameserver.drops();
+
+    // if nothing was dropped since the previous check the buffers are fine
+    if (total <= _kerneldrops) return;
+
+    // remember the level for the next check
+    _kerneldrops = total;
+
+    // the buffers are too small: double them, starting from a sensible floor
+    // when user-space never set an explicit size (note that the kernel itself
+    // caps the size at rmem_max, growing beyond that needs sysctl changes)
+    _buffersize = std::min(std::max(_buffersize, (int32_t)131072) * 2, (int32_t)8388608);
+
+    // apply the new size to all open sockets (newly opened sockets pick up
+    // the setting via the normal buffersize() path)
+    for (auto &nameserver : _nameservers) nameserver.rcvbuf(_buffersize);
+}
+
+/**
+ *  Start background lookups for hot cache entries that are about to expire
+ *  @param  now     current time
+ */
+void Core::prefetch(double now)
+{
+    // collect the hot entries that expire before we would send our next datagram
+    // anyway (the cache marks them, so they are not reported twice)
+    auto candidates = _cache.expiring(now, _interval, _prefetch);
+
+    // start a background lookup for each of them
+    for (const auto &candidate : candidates)
+    {
+        // constructing the lookup could throw (although unlikely, the name was valid before)
+        try
+        {
+            // the lookup reports to a set of no-op callbacks, the refreshed response
+            // reaches the cache via the normal report-path
+            add(new RemoteLookup(this, candidate.first.data(), (ns_type)candidate.second, _bits, new Callbacks([](const Operation*, const Response&){}, [](const Operation*, int){})));
+        }
+        catch (...)
+        {
+            // the entry will simply expire
+        }
+    }
+}
+
 
     
 /**
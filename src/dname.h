@@ -0,0 +1,194 @@
+/**
+ *  Dname.h
+ *
+ *  Case-insensitive domain-name comparison. Names are compared all
+ *  over the library (suffix matching, dnssec chain handling, hostname
+ *  lookups in /etc/hosts) and with dnssec validation enabled this
+ *  easily runs millions of times per minute, so the equality check is
+ *  vectorized: sixteen (sse2) or thirty-two (avx2, selected at
+ *  runtime) characters are case-folded and compared per step, with a
+ *  plain scalar loop for other architectures and for the tail.
+ *
+ *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include <string.h>
+#include <stddef.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Class definition
+ */
+class Dname
+{
+private:
+    /**
+     *  Fold one ascii character to lowercase
+     *  @param  c       the character
+     *  @return char    the folded character
+     */
+    static char fold(char c) { return c >= 'A' && c <= 'Z' ? c + 32 : c; }
+
+    /**
+     *  Byte-at-a-time comparison, used on architectures without vector
+     *  support and for the tail behind the vectorized loops
+     *  @param  a       first buffer
+     *  @param  b       second buffer
+     *  @param  size    number of characters to compare
+     *  @return bool    are the buffers equal apart from case?
+     */
+    static bool scalar(const char *a, const char *b, size_t size)
+    {
+        // compare character by character
+        for (size_t i = 0; i < size; ++i) if (fold(a[i]) != fold(b[i])) return false;
+
+        // no difference found
+        return true;
+    }
+
+#if defined(__x86_64__)
+    /**
+     *  Fold sixteen characters to lowercase at once
+     *  @param  chars   the characters
+     *  @return __m128i the folded characters
+     */
+    static __m128i fold16(__m128i chars)
+    {
+        // mask of the characters in the 'A'..'Z' range (signed compares
+        // are fine because ascii stays below 128)
+        __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(chars, _mm_set1_epi8('A' - 1)), _mm_cmpgt_epi8(_mm_set1_epi8('Z' + 1), chars));
+
+        // add 0x20 to exactly those characters
+        return _mm_add_epi8(chars, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+    }
+
+    /**
+     *  Comparison in steps of sixteen characters
+     *  @param  a       first buffer
+     *  @param  b       second buffer
+     *  @param  size    number of characters to compare
+     *  @return bool    are the buffers equal apart from case?
+     */
+    static bool sse2(const char *a, const char *b, size_t size)
+    {
+        // position in the buffers
+        size_t pos = 0;
+
+        // handle whole vectors
+        for (; pos + 16 <= size; pos += 16)
+        {
+            // load and fold sixteen characters from both buffers
+            __m128i x = fold16(_mm_loadu_si128((const __m128i *)(a + pos)));
+            __m128i y = fold16(_mm_loadu_si128((const __m128i *)(b + pos)));
+
+            // all sixteen must match
+            if (_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) != 0xffff) return false;
+        }
+
+        // the tail is handled by the scalar loop
+        return scalar(a + pos, b + pos, size - pos);
+    }
+
+    /**
+     *  Fold thirty-two characters to lowercase at once (only called on
+     *  cpus that support avx2)
+     *  @param  chars   the characters
+     *  @return __m256i the folded characters
+     */
+    __attribute__((target("avx2")))
+    static __m256i fold32(__m256i chars)
+    {
+        // mask of the characters in the 'A'..'Z' range
+        __m256i upper = _mm256_and_si256(_mm256_cmpgt_epi8(chars, _mm256_set1_epi8('A' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), chars));
+
+        // add 0x20 to exactly those characters
+        return _mm256_add_epi8(chars, _mm256_and_si256(upper, _mm256_set1_epi8(0x20)));
+    }
+
+    /**
+     *  Comparison in steps of thirty-two characters
+     *  @param  a       first buffer
+     *  @param  b       second buffer
+     *  @param  size    number of characters to compare
+     *  @return bool    are the buffers equal apart from case?
+     */
+    __attribute__((target("avx2")))
+    static bool avx2(const char *a, const char *b, size_t size)
+    {
+        // position in the buffers
+        size_t pos = 0;
+
+        // handle whole vectors
+        for (; pos + 32 <= size; pos += 32)
+        {
+            // load and fold thirty-two characters from both buffers
+            __m256i x = fold32(_mm256_loadu_si256((const __m256i *)(a + pos)));
+            __m256i y = fold32(_mm256_loadu_si256((const __m256i *)(b + pos)));
+
+            // all thirty-two must match
+            if ((unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y)) != 0xffffffffu) return false;
+        }
+
+        // the remainder fits in the sixteen-character version
+        return sse2(a + pos, b + pos, size - pos);
+    }
+#endif
+
+public:
+    /**
+     *  Case-insensitive equality of two buffers of known size
+     *  @param  a       first buffer
+     *  @param  b       second buffer
+     *  @param  size    number of characters to compare
+     *  @return bool    are the buffers equal apart from case?
+     */
+    static bool equal(const char *a, const char *b, size_t size)
+    {
+#if defined(__x86_64__)
+        // check the cpu once, at first use
+        static const bool wide = __builtin_cpu_supports("avx2");
+
+        // use the widest supported kernel (sse2 is x86-64 baseline)
+        return wide ? avx2(a, b, size) : sse2(a, b, size);
+#else
+        // other architectures compare character by character
+        return scalar(a, b, size);
+#endif
+    }
+
+    /**
+     *  Case-insensitive equality of two null-terminated names
+     *  @param  a       first name
+     *  @param  b       second name
+     *  @return bool    are the names equal apart from case?
+     */
+    static bool equal(const char *a, const char *b)
+    {
+        // the lengths must match before the contents can
+        size_t size = strlen(a);
+
+        // compare contents only when the sizes agree
+        return strlen(b) == size && equal(a, b, size);
+    }
+};
+
+/**
+ *  End of namespace
+ */
+}
@@ -0,0 +1,61 @@
+/**
+ *  Dual.cpp
+ *
+ *  Implementation file for the Dual class
+ *
+ *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Dependencies
+ */
+#include "../include/dnscpp/dual.h"
+#include "../include/dnscpp/context.h"
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Constructor
+ *  @param  context     the context that performs the lookups
+ *  @param  domain      the domain to resolve
+ *  @param  bits        bits to include in the queries
+ *  @param  handler     object notified about the combined result
+ *  @param  early       report as soon as the first family answers?
+ *  @throws std::runtime_error
+ */
+Dual::Dual(Context *context, const char *domain, const Bits &bits, Handler *handler, bool early) :
+    _handler(handler), _early(early)
+{
+    // start both lookups back-to-back, they share the timeout and
+    // interval settings of the context so they run to one deadline
+    _ipv4 = context->query(domain, ns_t_a, bits, this);
+
+    // prevent that a failure of the second lookup leaves the first one
+    // with a handler that points to a half-constructed object
+    try
+    {
+        // the lookup for the other address family
+        _ipv6 = context->query(domain, ns_t_aaaa, bits, this);
+    }
+    catch (...)
+    {
+        // forget the first lookup before cancelling, so that the
+        // synchronous onCancelled() callback is ignored
+        auto *ipv4 = _ipv4; _ipv4 = nullptr;
+
+        // cancel it
+        if (ipv4) ipv4->cancel();
+
+        // pass on the error
+        throw;
+    }
+}
+
+/**
+ *  End of namespace
+ */
+}
@@ -0,0 +1,80 @@
+/**
+ *  Exchanges.cpp
+ *
+ *  Implementation file for the Exchanges class
+ *
+ *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Dependencies
+ */
+#include "../include/dnscpp/exchanges.h"
+#include "../include/dnscpp/context.h"
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Constructor
+ *  @param  context     the context that performs the lookups
+ *  @param  domain      the domain whose mail exchanges are resolved
+ *  @param  bits        bits to include in the queries
+ *  @param  handler     object notified about the combined result
+ *  @throws std::runtime_error
+ */
+Exchanges::Exchanges(Context *context, const char *domain, const Bits &bits, Handler *handler) :
+    _context(context), _handler(handler), _domain(domain), _bits(bits)
+{
+    // start the MX lookup of the first phase
+    _mx = context->query(domain, ns_t_mx, bits, this);
+
+    // query() returns null for invalid parameters, the factory method
+    // turns this exception into a null result
+    if (_mx == nullptr) throw std::runtime_error("invalid domain");
+}
+
+/**
+ *  Start the address lookups for all exchanges (the second phase)
+ */
+void Exchanges::fanout()
+{
+    // the (domain, type) pairs for the fan-out: the A and the AAAA
+    // lookup for every exchange
+    std::vector<std::pair<const char*,ns_type>> queries;
+
+    // two queries per exchange
+    queries.reserve(_exchanges.size() * 2);
+
+    // fill the batch
+    for (const auto &exchange : _exchanges)
+    {
+        // both address families
+        queries.emplace_back(exchange.hostname.c_str(), ns_t_a);
+        queries.emplace_back(exchange.hostname.c_str(), ns_t_aaaa);
+    }
+
+    // submit the whole batch in one call: the timer is re-armed once
+    // and the datagrams leave in a single burst over the shared
+    // nameserver sockets, right after the MX answer came in
+    auto operations = _context->query_many(queries, _bits, this);
+
+    // remember which lookup belongs to which exchange (items with
+    // invalid parameters got a null handle and are skipped)
+    for (size_t i = 0; i < operations.size(); ++i)
+    {
+        // two consecutive lookups per exchange
+        if (operations[i]) _pending.emplace(operations[i], i / 2);
+    }
+
+    // when nothing could be submitted there is nothing to wait for
+    if (_pending.empty()) report();
+}
+
+/**
+ *  End of namespace
+ */
+}
@@ -167,6 +167,20 @@ public:
      */
     virtual ~FakeResponse() = default;
     
+    /**
+     *  Update the result code of the message (for example to turn it
+     *  into an nxdomain answer for a blocked name)
+     *  @param  value   the result code
+     */
+    void rcode(uint8_t value)
+    {
+        // get access to the header
+        HEADER *header = (HEADER *)_buffer;
+
+        // update the code
+        header->rcode = value;
+    }
+
     /**
      *  Expose the data
      *  @return const char *
@@ -221,8 +235,9 @@ public:
         // update number of answers
         header->ancount = htons(answers() + 1);
         
-        // add type, class, ttl and size of the data
-        put16(ns_t_a);
+        // add type, class, ttl and size of the data (the type follows
+        // the family of the address)
+        put16(ip.version() == 4 ? ns_t_a : ns_t_aaaa);
         put16(ns_c_in);
         put32(0);
         put16(ip.size());
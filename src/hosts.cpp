@@ -1,8 +1,8 @@
 /**
  *  Hosts.cpp
- * 
+ *
  *  Implementation file for the Hosts class
- * 
+ *
  *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
  *  @copyright 2020 Copernica BV
  */
@@ -10,9 +10,9 @@
 /**
  *  Dependencies
  */
-#include <fstream>
 #include <vector>
 #include <list>
+#include <algorithm>
 #include "../include/dnscpp/ip.h"
 #include "../include/dnscpp/hosts.h"
 #include "../include/dnscpp/response.h"
@@ -20,6 +20,11 @@
 #include "../include/dnscpp/question.h"
 #include "../include/dnscpp/reverse.h"
 #include "fakeresponse.h"
+#include "dname.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 /**
  *  Begin of namespace
@@ -36,14 +41,59 @@ static size_t linesize(const char *line, size_t size)
 {
     // number of characters that can be trimmed
     size_t trim = 0;
-    
+
     // check the trailing characters
     while (size > trim && isspace(line[size-1-trim])) ++trim;
-    
+
     // done
     return size - trim;
 }
 
+/**
+ *  Helper function to get the next whitespace-separated token from a line,
+ *  without copying or modifying the underlying buffer
+ *  @param  current     current position in the line (is updated)
+ *  @param  end         end of the line
+ *  @param  size        output-parameter for the size of the token
+ *  @return const char* start of the token (nullptr if there are no more tokens)
+ */
+static const char *token(const char *&current, const char *end, size_t &size)
+{
+    // skip leading whitespace
+    while (current < end && isspace(*current)) ++current;
+
+    // if we reached the end of the line there is no token
+    if (current >= end) return nullptr;
+
+    // remember the start of the token
+    const char *result = current;
+
+    // proceed to the end of the token
+    while (current < end && !isspace(*current)) ++current;
+
+    // expose the size and the token
+    size = current - result;
+    return result;
+}
+
+/**
+ *  Helper function to hash a hostname without looking at case, because
+ *  hostnames in /etc/hosts are case-insensitive (fnv-1a)
+ *  @param  hostname    the hostname to hash
+ *  @return size_t
+ */
+static size_t hash(const char *hostname)
+{
+    // the fnv-1a offset-basis
+    size_t result = 2166136261u;
+
+    // mix in all characters of the hostname
+    for (const char *c = hostname; *c; ++c) result = (result ^ (uint8_t)tolower(*c)) * 16777619u;
+
+    // done
+    return result;
+}
+
 /**
  *  Constructor
  *  @param  filename        the filename to parse
@@ -55,6 +105,98 @@ Hosts::Hosts(const char *filename)
     if (!load(filename)) throw std::runtime_error(std::string(filename) + ": failed to open file");
 }
 
+/**
+ *  Make sure the hash table has room for a number of extra entries
+ *  @param  count       expected number of extra entries
+ */
+void Hosts::reserve(size_t count)
+{
+    // the number of slots that we want: double the number of entries so that
+    // the table never gets more than half full (linear probing stays fast then)
+    size_t required = (_entries + count) * 2;
+
+    // if the current table is already big enough
+    if (_host2ip.size() >= required) return;
+
+    // round up to the next power of two, so that the modulo in the probe
+    // sequence is a simple bitwise and
+    size_t slots = 64;
+
+    // keep doubling
+    while (slots < required) slots *= 2;
+
+    // construct the new table
+    std::vector<std::pair<const char *,const Ip *>> table(slots);
+
+    // install the new (empty) table, the old one ends up in our local variable
+    _host2ip.swap(table);
+
+    // reinserting does not change the number of entries, so reset the counter
+    _entries = 0;
+
+    // reinsert all old entries
+    for (const auto &slot : table)
+    {
+        // skip the empty slots
+        if (slot.first) insert(slot.first, slot.second);
+    }
+}
+
+/**
+ *  Insert one hostname-to-ip combination into the hash table
+ *  @param  hostname    the hostname (must be in stable storage)
+ *  @param  ip          the ip (must be in stable storage)
+ */
+void Hosts::insert(const char *hostname, const Ip *ip)
+{
+    // make sure there is room (this is a no-op most of the time)
+    reserve(1);
+
+    // mask for the probe sequence (table size is a power of two)
+    size_t mask = _host2ip.size() - 1;
+
+    // probe until we find a free slot
+    for (size_t slot = hash(hostname) & mask; true; slot = (slot + 1) & mask)
+    {
+        // skip slots that are already occupied
+        if (_host2ip[slot].first != nullptr) continue;
+
+        // claim the slot
+        _host2ip[slot] = std::make_pair(hostname, ip);
+
+        // one more slot in use
+        _entries += 1;
+
+        // done
+        return;
+    }
+}
+
+/**
+ *  Check if a certain hostname-to-ip combination is already indexed
+ *  @param  hostname    the hostname
+ *  @param  ip          the ip
+ *  @return bool
+ */
+bool Hosts::contains(const char *hostname, const Ip &ip) const
+{
+    // if the table is completely empty there can be no match
+    if (_entries == 0) return false;
+
+    // mask for the probe sequence (table size is a power of two)
+    size_t mask = _host2ip.size() - 1;
+
+    // probe until we run into an empty slot
+    for (size_t slot = hash(hostname) & mask; true; slot = (slot + 1) & mask)
+    {
+        // an empty slot means that there is no match at all
+        if (_host2ip[slot].first == nullptr) return false;
+
+        // check if the slot holds the exact same combination
+        if (Dname::equal(_host2ip[slot].first, hostname) && *_host2ip[slot].second == ip) return true;
+    }
+}
+
 /**
  *  Load a certain file
  *  All lines in the file are merged with the lines already in memory
@@ -64,27 +206,61 @@ Hosts::Hosts(const char *filename)
 bool Hosts::load(const char *filename)
 {
     // open the file for reading
-    std::ifstream stream(filename);
-    
+    int fd = open(filename, O_RDONLY | O_CLOEXEC);
+
     // file should be open by now
-    if (!stream.is_open()) return false;
-    
-    // keep readling lines until the end
-    while (!stream.eof())
+    if (fd < 0) return false;
+
+    // we need the size of the file
+    struct stat info;
+
+    // if the file cannot be inspected
+    if (fstat(fd, &info) != 0) { ::close(fd); return false; }
+
+    // empty files need no parsing at all
+    if (info.st_size == 0) { ::close(fd); return true; }
+
+    // map the entire file into memory, so that we can tokenize it in place
+    // instead of copying every line around
+    void *address = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    // the descriptor is no longer needed, the mapping stays valid without it
+    ::close(fd);
+
+    // check for failure
+    if (address == MAP_FAILED) return false;
+
+    // begin and end of the mapping
+    auto *current = (const char *)address;
+    auto *end = current + info.st_size;
+
+    // count the number of lines, so that the hash table can be sized up front
+    // instead of being rehashed over and over while we parse (a line normally
+    // holds one ip with one or a couple of hostnames)
+    size_t lines = std::count(current, end, '\n') + 1;
+
+    // size the table up front
+    reserve(lines * 2);
+
+    // iterate over the lines
+    while (current < end)
     {
-        // we are going to read lines, we need a local variable for that
-        std::string line;
-    
-        // go read the line
-        getline(stream, line);
-        
-        // remove trailing whitespace
-        line.resize(linesize(line.data(), line.size()));
-        
-        // parse the line
-        parse(line.data(), line.size());
+        // find the end of the current line
+        auto *newline = (const char *)memchr(current, '\n', end - current);
+
+        // the last line might not have a trailing newline
+        if (newline == nullptr) newline = end;
+
+        // parse the line (without trailing whitespace)
+        parse(current, linesize(current, newline - current));
+
+        // move to the next line
+        current = newline + 1;
     }
-    
+
+    // cleanup the mapping (all relevant data has been copied into own structures)
+    munmap(address, info.st_size);
+
     // done
     return true;
 }
@@ -99,46 +275,71 @@ bool Hosts::parse(const char *line, size_t size)
 {
     // skip empty lines and comments
     if (size == 0 || line[0] == '#') return true;
-    
-    // we are going to tokenize the string, for which we need a helper variable
-    char *state = nullptr;
 
-    // convert the buffer so that we can make changes to it
-    std::vector<char> buffer(line, line + size + 1);
-    
+    // current position in the line and the size of the current token
+    const char *current = line; size_t tokensize = 0;
+
+    // end of the line
+    const char *end = line + size;
+
     // parse the first token holding the IP address
-    auto *first = strtok_r(buffer.data(), "\t\r\n ", &state);
-    
+    auto *first = token(current, end, tokensize);
+
     // if there was not even an ip address
     if (first == nullptr) return true;
-    
+
+    // the Ip constructor needs a null-terminated string, copy to a small buffer
+    char buffer[64];
+
+    // addresses that do not even fit in the buffer can impossibly be valid
+    if (tokensize >= sizeof(buffer)) return false;
+
+    // copy and terminate
+    memcpy(buffer, first, tokensize); buffer[tokensize] = '\0';
+
     // prevent exceptions
     try
     {
         // parse the ip (could throw)
-        Ip ip(first);
-        
+        _ips.emplace_back(buffer);
+
+        // get a reference to the parsed ip (deque elements have stable addresses)
+        const auto &ip = _ips.back();
+
+        // was the ip actually used (it is not when all combinations on the
+        // line are already known, which happens when a file is reloaded)
+        bool used = false;
+
         // now we are going to parse all hostnames
         while (true)
         {
             // get the next token, holding a hostname
-            auto *token = strtok_r(nullptr, "\t\r\n ", &state);
-            
+            auto *host = token(current, end, tokensize);
+
             // stop when ready
-            if (token == nullptr) return true;
-            
+            if (host == nullptr) break;
+
             // turn the token into a string
             // @todo check if hostname is valid
-            _hostnames.emplace_back(token);
-            
+            _hostnames.emplace_back(host, tokensize);
+
             // get reference to the last item
             const auto &hostname = _hostnames.back();
-            
-            // insert into the maps
-            _host2ip.emplace(std::make_pair(hostname.data(), ip));
+
+            // if the combination is already known (a reload) we undo the copy and move on
+            if (contains(hostname.data(), ip)) { _hostnames.pop_back(); continue; }
+
+            // insert into the index and into the reverse map
+            insert(hostname.data(), &ip);
             _ip2host.emplace(std::make_pair(ip, hostname.data()));
+
+            // the ip is referenced now
+            used = true;
         }
-        
+
+        // if nothing on the line was new, the copied ip can be removed again
+        if (!used) _ips.pop_back();
+
         // success
         return true;
     }
@@ -149,6 +350,171 @@ bool Hosts::parse(const char *line, size_t size)
     }
 }
 
+/**
+ *  Add a single hostname-to-ip combination at runtime
+ *  @param  hostname    the hostname
+ *  @param  ip          the address to associate with the hostname
+ *  @return bool        was the entry added (false if it already existed)?
+ */
+bool Hosts::add(const char *hostname, const Ip &ip)
+{
+    // if the combination is already indexed there is nothing to do
+    if (contains(hostname, ip)) return false;
+
+    // copy hostname and address into stable storage
+    _hostnames.emplace_back(hostname);
+    _ips.push_back(ip);
+
+    // get references to the copies (list elements have stable addresses)
+    const auto &name = _hostnames.back();
+    const auto &addr = _ips.back();
+
+    // insert into the index and into the reverse map
+    insert(name.data(), &addr);
+    _ip2host.emplace(std::make_pair(addr, name.data()));
+
+    // the entry was added
+    return true;
+}
+
+/**
+ *  Remove entries from the index (the workhorse behind the public
+ *  remove() methods)
+ *  @param  hostname    the hostname to remove
+ *  @param  ip          the specific address to remove (nullptr for all)
+ *  @return bool        was anything removed?
+ */
+bool Hosts::purge(const char *hostname, const Ip *ip)
+{
+    // if the table is completely empty there can be no match
+    if (_entries == 0) return false;
+
+    // was anything removed?
+    bool result = false;
+
+    // the addresses of the removed entries, so that unreferenced ips can
+    // be reclaimed from storage afterwards
+    std::vector<const Ip *> removed;
+
+    // open addressing does not support in-place deletion (a cleared slot
+    // would break the probe chains), so we move the table aside and
+    // reinsert all surviving entries, just like reserve() does on growth
+    std::vector<std::pair<const char *,const Ip *>> table(_host2ip.size());
+
+    // install the fresh (empty) table, the old one ends up in our local variable
+    _host2ip.swap(table);
+
+    // reinserting resets the number of entries
+    _entries = 0;
+
+    // check all old entries
+    for (const auto &slot : table)
+    {
+        // skip the empty slots
+        if (slot.first == nullptr) continue;
+
+        // entries for other hostnames (or for other addresses when a specific
+        // combination is being removed) go straight back into the table
+        if (!Dname::equal(slot.first, hostname) || (ip != nullptr && !(*slot.second == *ip))) { insert(slot.first, slot.second); continue; }
+
+        // this entry is being dropped
+        result = true;
+
+        // remember the address so that it can be reclaimed below
+        removed.push_back(slot.second);
+
+        // remove the reverse mapping for this exact combination
+        auto range = _ip2host.equal_range(*slot.second);
+
+        // look for the entry that points at this very hostname string
+        for (auto iter = range.first; iter != range.second; ++iter)
+        {
+            // skip entries for other copies of the hostname
+            if (iter->second != slot.first) continue;
+
+            // remove this one and stop
+            _ip2host.erase(iter); break;
+        }
+
+        // each hostname copy is referenced by exactly one slot, so the
+        // string itself can be reclaimed too
+        for (auto iter = _hostnames.begin(); iter != _hostnames.end(); ++iter)
+        {
+            // skip other strings
+            if (iter->data() != slot.first) continue;
+
+            // remove this one and stop
+            _hostnames.erase(iter); break;
+        }
+    }
+
+    // reclaim the addresses that are no longer referenced (multiple hostnames
+    // on one hosts-file line share a single ip object, so we have to check)
+    for (const auto *candidate : removed)
+    {
+        // is the address still in use by a surviving entry?
+        bool used = false;
+
+        // check the whole table
+        for (const auto &slot : _host2ip) if (slot.second == candidate) { used = true; break; }
+
+        // references remain, the object has to stay
+        if (used) continue;
+
+        // remove from storage (a no-op when the same shared address was
+        // already reclaimed for an earlier removed entry)
+        for (auto iter = _ips.begin(); iter != _ips.end(); ++iter)
+        {
+            // skip other addresses
+            if (&*iter != candidate) continue;
+
+            // remove this one and stop
+            _ips.erase(iter); break;
+        }
+    }
+
+    // done
+    return result;
+}
+
+/**
+ *  Remove all entries for a certain hostname at runtime
+ *  @param  hostname    the hostname to remove
+ *  @return bool        was anything removed?
+ */
+bool Hosts::remove(const char *hostname)
+{
+    // pass on to the workhorse
+    return purge(hostname, nullptr);
+}
+
+/**
+ *  Remove a single hostname-to-ip combination at runtime
+ *  @param  hostname    the hostname
+ *  @param  ip          the specific address to remove
+ *  @return bool        was the entry removed?
+ */
+bool Hosts::remove(const char *hostname, const Ip &ip)
+{
+    // pass on to the workhorse
+    return purge(hostname, &ip);
+}
+
+/**
+ *  Replace all entries for a hostname with a single new address
+ *  @param  hostname    the hostname
+ *  @param  ip          the new (only) address for the hostname
+ *  @return bool        was the entry installed?
+ */
+bool Hosts::replace(const char *hostname, const Ip &ip)
+{
+    // get rid of the old entries (if any)
+    purge(hostname, nullptr);
+
+    // install the new one
+    return add(hostname, ip);
+}
+
 /**
  *  Lookup an IP address given a hostname
  *  This method returns nullptr if there is no match
@@ -158,21 +524,24 @@ bool Hosts::parse(const char *line, size_t size)
  */
 const Ip *Hosts::lookup(const char *hostname, unsigned int version) const
 {
-    // look for a match
-    const auto &range = _host2ip.equal_range(hostname);
-    
-    // go check the entire range
-    for (auto iter = range.first; iter != range.second; ++iter)
+    // if the table is completely empty there can be no match
+    if (_entries == 0) return nullptr;
+
+    // mask for the probe sequence (table size is a power of two)
+    size_t mask = _host2ip.size() - 1;
+
+    // probe until we run into an empty slot
+    for (size_t slot = hash(hostname) & mask; true; slot = (slot + 1) & mask)
     {
-        // get a reference to the ip
-        const auto &ip = iter->second;
-        
+        // an empty slot means that there is no match at all
+        if (_host2ip[slot].first == nullptr) return nullptr;
+
+        // skip slots that hold a different hostname
+        if (!Dname::equal(_host2ip[slot].first, hostname)) continue;
+
         // is this a match?
-        if (version == 0 || ip.version() == version) return &ip;
+        if (version == 0 || _host2ip[slot].second->version() == version) return _host2ip[slot].second;
     }
-    
-    // no match
-    return nullptr;
 }
 
 /**
@@ -185,10 +554,10 @@ const char *Hosts::lookup(const Ip &ip) const
 {
     // look for a match
     const auto &iter = _ip2host.find(ip);
-    
+
     // if there is no match
     if (iter == _ip2host.end()) return nullptr;
-    
+
     // expose the ip
     return iter->second;
 }
@@ -204,7 +573,7 @@ bool Hosts::notify(const Request &request, Handler *handler, const Operation *op
 {
     // extract the question
     Question question(request);
-    
+
     // construct the fake response message that we will pass to user-space
     FakeResponse response(request, question);
 
@@ -213,36 +582,43 @@ bool Hosts::notify(const Request &request, Handler *handler, const Operation *op
     {
         // parse the reverse name
         Reverse reverse(question.name());
-        
+
         // get the associated hostname
         auto *hostname = lookup(reverse.ip());
-        
+
         // add to the response message
         if (hostname) response.append(question.name(), hostname);
     }
-    else
+    else if (_entries > 0)
     {
-        // do the lookup of ip-addresses of the requested host
-        const auto &range = _host2ip.equal_range(question.name());
-    
-        // look for matches
-        for (auto iter = range.first; iter != range.second; ++iter)
+        // mask for the probe sequence (table size is a power of two)
+        size_t mask = _host2ip.size() - 1;
+
+        // probe the index until we run into an empty slot, so that we visit
+        // all addresses that are associated with the hostname
+        for (size_t slot = hash(question.name()) & mask; true; slot = (slot + 1) & mask)
         {
+            // an empty slot means that there are no further matches
+            if (_host2ip[slot].first == nullptr) break;
+
+            // skip slots that hold a different hostname
+            if (!Dname::equal(_host2ip[slot].first, question.name())) continue;
+
             // get a reference to the ip
-            const auto &ip = iter->second;
-            
+            const auto &ip = *_host2ip[slot].second;
+
             // is this a match?
             if (ip.version() == 4 && question.type() != TYPE_A) continue;
             if (ip.version() == 6 && question.type() != TYPE_AAAA) continue;
-            
+
             // we have a matc
             response.append(question.name(), ip);
         }
     }
-    
+
     // send back the answer
     handler->onReceived(operation, Response(response.data(), response.size()));
-    
+
     // done
     return true;
 }
@@ -251,4 +627,3 @@ bool Hosts::notify(const Request &request, Handler *handler, const Operation *op
  *  End of namespace
  */
 }
-
@@ -0,0 +1,176 @@
+/**
+ *  Inbox.cpp
+ *
+ *  Implementation file for the Inbox class
+ *
+ *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Dependencies
+ */
+#include "../include/dnscpp/inbox.h"
+#include "../include/dnscpp/context.h"
+#include "../include/dnscpp/loop.h"
+#include "../include/dnscpp/handler.h"
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <stdexcept>
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Constructor, must be called on the loop thread
+ *  @param  context     the context that will run the lookups
+ *  @throws std::runtime_error
+ */
+Inbox::Inbox(Context *context) : _context(context), _submissions(nullptr)
+{
+    // the eventfd is nonblocking so that a spurious wakeup cannot stall the
+    // loop thread, and a counter-overflow cannot stall the producers
+    _fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    // it should be there
+    if (_fd < 0) throw std::runtime_error("failed to create eventfd");
+
+    // register with the event loop so that we hear about wakeups (1 = readability)
+    _identifier = _context->loop()->add(_fd, 1, this);
+}
+
+/**
+ *  Destructor, must be called on the loop thread
+ */
+Inbox::~Inbox()
+{
+    // remove from the event loop
+    _context->loop()->remove(_identifier, _fd, this);
+
+    // close the eventfd
+    close(_fd);
+
+    // take whatever is still in the queue
+    auto *submission = _submissions.exchange(nullptr, std::memory_order_acquire);
+
+    // discard the undrained submissions (their lookups never started, so
+    // there is no result or cancellation to report)
+    while (submission)
+    {
+        // remember the next node before we destruct this one
+        auto *next = submission->next;
+
+        // get rid of the node
+        delete submission;
+
+        // move on
+        submission = next;
+    }
+}
+
+/**
+ *  Submit a lookup, may be called from any thread
+ *  @param  domain      the domain to look up
+ *  @param  type        type of records to look for
+ *  @param  bits        the bits to include in the query
+ *  @param  handler     handler that is notified on the loop thread
+ *  @return bool        was the submission accepted?
+ */
+bool Inbox::publish(const char *domain, ns_type type, const Bits &bits, Handler *handler)
+{
+    // constructing the node could throw (out of memory)
+    try
+    {
+        // the node that will travel to the loop thread
+        auto *submission = new Submission(domain, type, bits, handler);
+
+        // push onto the stack: point the node at the current head, and swing
+        // the head to the node (retrying when another producer was faster)
+        submission->next = _submissions.load(std::memory_order_relaxed);
+
+        // the compare-exchange updates submission->next on failure
+        while (!_submissions.compare_exchange_weak(submission->next, submission, std::memory_order_release, std::memory_order_relaxed));
+
+        // wake up the loop thread (the eventfd simply counts the writes,
+        // failure is harmless: the fd was already readable then)
+        uint64_t one = 1; auto result = write(_fd, &one, sizeof(one)); (void)result;
+
+        // the submission is on its way
+        return true;
+    }
+    catch (...)
+    {
+        // out of memory
+        return false;
+    }
+}
+
+/**
+ *  Submit a lookup with the default bits
+ *  @param  domain      the domain to look up
+ *  @param  type        type of records to look for
+ *  @param  handler     handler that is notified on the loop thread
+ *  @return bool        was the submission accepted?
+ */
+bool Inbox::publish(const char *domain, ns_type type, Handler *handler)
+{
+    // pass on with the default bits of the context
+    return publish(domain, type, _context->bits(), handler);
+}
+
+/**
+ *  Method that is called by the event loop when the eventfd becomes
+ *  readable, this runs on the loop thread and drains the queue
+ */
+void Inbox::notify()
+{
+    // reset the eventfd counter (nonblocking, the value is irrelevant)
+    uint64_t count; auto result = read(_fd, &count, sizeof(count)); (void)result;
+
+    // take the whole stack in one atomic operation
+    auto *submission = _submissions.exchange(nullptr, std::memory_order_acquire);
+
+    // the stack is in reverse order of submission, restore the order so
+    // that lookups start in the order in which they were submitted
+    Submission *pending = nullptr;
+
+    // reverse the list
+    while (submission)
+    {
+        // remember the next node
+        auto *next = submission->next;
+
+        // move the node to the front of the reversed list
+        submission->next = pending; pending = submission;
+
+        // move on
+        submission = next;
+    }
+
+    // start a lookup for each submission
+    while (pending)
+    {
+        // remember the next node before the lookup runs
+        auto *next = pending->next;
+
+        // start the lookup
+        auto *operation = _context->query(pending->domain.data(), pending->type, pending->bits, pending->handler);
+
+        // when the lookup could not even be constructed (invalid domain) the
+        // handler is told that it will never hear anything again
+        if (operation == nullptr) pending->handler->onCancelled(nullptr);
+
+        // the node is no longer needed
+        delete pending;
+
+        // move on
+        pending = next;
+    }
+}
+
+/**
+ *  End of namespace
+ */
+}
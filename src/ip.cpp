@@ -50,12 +50,13 @@ static bool isv4mapped(const struct in6_addr &addr)
  */
 static Ip extract(const Record &record)
 {
-    // check the record
-    switch (record.type()) {
-    case TYPE_A:    return A(record).ip();
-    case TYPE_AAAA: return AAAA(record).ip();
-    default:        throw std::runtime_error("Ips can only be extracted from A and AAAA records");
-    }
+    // check the record against the compile-time registry (this also
+    // validates the rdata size, so the extractors below cannot fail)
+    if (matches<A>(record)) return A(record).ip();
+    if (matches<AAAA>(record)) return AAAA(record).ip();
+
+    // any other type is not convertible
+    throw std::runtime_error("Ips can only be extracted from A and AAAA records");
 }
     
 /**
@@ -65,9 +66,12 @@ static Ip extract(const Record &record)
  */
 Ip::Ip(const char *ip)
 {
+    // start with an all-zero buffer (the padding after an ipv4 address takes part in compare() and hash())
+    wipe();
+
     // hints for the call to getaddrinfo()
     struct addrinfo hints;
-    
+
     // fill in the hints
     hints.ai_family = AF_UNSPEC;                    // allow IPv4 or IPv6
     hints.ai_socktype = SOCK_STREAM;                // one protocol to get only one address
@@ -130,6 +134,9 @@ Ip::Ip(const char *ip)
  */
 Ip::Ip(const struct in6_addr *ipv6)
 {
+    // start with an all-zero buffer (the padding after an ipv4 address takes part in compare() and hash())
+    wipe();
+
     // are we ipv4 mapped?
     if (isv4mapped(*ipv6))
     {
@@ -156,6 +163,9 @@ Ip::Ip(const struct in6_addr *ipv6)
  */
 Ip::Ip(const struct sockaddr *addr)
 {
+    // start with an all-zero buffer (the padding after an ipv4 address takes part in compare() and hash())
+    wipe();
+
     // check the type of address
     switch (addr->sa_family) {
     case AF_INET:   
@@ -206,6 +216,9 @@ Ip::Ip(const Record &record) : Ip(extract(record)) {}
  */
 Ip &Ip::operator=(const struct in6_addr *ip)
 {
+    // reset the buffer so that the padding bytes are zero again
+    wipe();
+
     // the other address could be an ipv4 address mapped in an ipv6 address
     if (isv4mapped(*ip))
     {
@@ -291,6 +304,22 @@ Ip &Ip::operator&=(const Ip &that)
 }
 
 
+/**
+ *  Format the address into a caller-supplied buffer, without making
+ *  any allocation
+ *  @param  buffer      the buffer to write to (gets null-terminated)
+ *  @param  size        size of the buffer
+ *  @return size_t      length of the formatted text (0 if the buffer is too small)
+ */
+size_t Ip::print(char *buffer, size_t size) const
+{
+    // convert based on the version, inet_ntop() checks the buffer size itself
+    if (inet_ntop(version() == 4 ? AF_INET : AF_INET6, (const void *)&_data, buffer, size) == nullptr) return 0;
+
+    // expose the length of the text
+    return strlen(buffer);
+}
+
 /**
  *  Write to a stream
  *  @param  stream
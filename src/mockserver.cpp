@@ -0,0 +1,322 @@
+/**
+ *  MockServer.cpp
+ *
+ *  Implementation file for the MockServer class
+ *
+ *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Dependencies
+ */
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdexcept>
+#include "../include/dnscpp/mockserver.h"
+#include "../include/dnscpp/now.h"
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Constructor, binds the socket on the loopback interface
+ *  @param  loop        the event loop
+ *  @param  port        port to bind to (0 picks a free port)
+ *  @throws std::runtime_error
+ */
+MockServer::MockServer(Loop *loop, uint16_t port) : _loop(loop)
+{
+    // create the socket
+    _fd = socket(AF_INET, SOCK_DGRAM, 0);
+
+    // leap out on failure
+    if (_fd < 0) throw std::runtime_error("failed to create mock socket");
+
+    // the loop drains the socket without blocking
+    fcntl(_fd, F_SETFL, fcntl(_fd, F_GETFL) | O_NONBLOCK);
+
+    // the socket should not leak to child processes
+    fcntl(_fd, F_SETFD, FD_CLOEXEC);
+
+    // the loopback address to bind to
+    struct sockaddr_in address;
+
+    // fill the members
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    // bind it
+    if (bind(_fd, (struct sockaddr *)&address, sizeof(address)) != 0)
+    {
+        // no leaking descriptors
+        close(_fd);
+
+        // the caller should know
+        throw std::runtime_error("failed to bind mock socket");
+    }
+
+    // ask the kernel which port was picked
+    socklen_t addrsize = sizeof(address);
+    getsockname(_fd, (struct sockaddr *)&address, &addrsize);
+
+    // remember the port
+    _port = ntohs(address.sin_port);
+
+    // have the event loop watch the socket for readability
+    _identifier = _loop->add(_fd, 1, this);
+}
+
+/**
+ *  Destructor
+ */
+MockServer::~MockServer()
+{
+    // cancel a pending timer
+    if (_timer != nullptr) _loop->cancel(_timer, this);
+
+    // the loop no longer has to watch the socket
+    _loop->remove(_identifier, _fd, this);
+
+    // close the socket
+    close(_fd);
+}
+
+/**
+ *  Draw the next deterministic random number (splitmix64)
+ *  @return uint64_t
+ */
+uint64_t MockServer::draw()
+{
+    // advance the state
+    uint64_t result = (_state += 0x9e3779b97f4a7c15ULL);
+
+    // scramble the output
+    result = (result ^ (result >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    result = (result ^ (result >> 27)) * 0x94d049bb133111ebULL;
+
+    // done
+    return result ^ (result >> 31);
+}
+
+/**
+ *  Draw a fraction between zero and one
+ *  @return double
+ */
+double MockServer::fraction()
+{
+    // the top 53 bits make a double in [0,1)
+    return (draw() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/**
+ *  Update the answer latency range
+ *  @param  mindelay    lower bound in seconds
+ *  @param  maxdelay    upper bound in seconds
+ */
+void MockServer::latency(double mindelay, double maxdelay)
+{
+    // store, keeping the bounds sane
+    _mindelay = std::max(0.0, mindelay);
+    _maxdelay = std::max(_mindelay, maxdelay);
+}
+
+/**
+ *  Method that is called by the event loop when the socket becomes readable
+ */
+void MockServer::notify()
+{
+    // keep reading until the socket is drained
+    while (true)
+    {
+        // space for one datagram and the source address
+        unsigned char buffer[4096]; struct sockaddr_storage from;
+
+        // size of the address
+        socklen_t addrsize = sizeof(from);
+
+        // read one query
+        auto size = recvfrom(_fd, buffer, sizeof(buffer), MSG_DONTWAIT, (struct sockaddr *)&from, &addrsize);
+
+        // the socket is drained when nothing comes out any more
+        if (size <= 0) return;
+
+        // handle the query
+        handle(buffer, size, (struct sockaddr *)&from, addrsize);
+    }
+}
+
+/**
+ *  Handle one incoming query
+ *  @param  buffer      the received datagram
+ *  @param  size        size of the datagram
+ *  @param  address     where it came from
+ *  @param  addrsize    size of that address
+ */
+void MockServer::handle(const unsigned char *buffer, size_t size, const struct sockaddr *address, size_t addrsize)
+{
+    // queries without a full header and question are ignored
+    if (size < 12) return;
+
+    // a configured fraction of the queries is simply lost
+    if (_loss > 0.0 && fraction() < _loss) return;
+
+    // walk over the question name to find the end of the question
+    size_t pos = 12;
+
+    // labels are length-prefixed, compression should not occur here
+    while (pos < size && buffer[pos] != 0)
+    {
+        // compressed or otherwise invalid labels make the query bogus
+        if (buffer[pos] & 0xc0) return;
+
+        // on to the next label
+        pos += 1 + buffer[pos];
+    }
+
+    // the root label plus type and class must fit
+    if (pos + 5 > size) return;
+
+    // end of the question section
+    size_t end = pos + 5;
+
+    // the question type and class
+    uint16_t qtype = uint16_t(buffer[pos + 1]) << 8 | buffer[pos + 2];
+    uint16_t qclass = uint16_t(buffer[pos + 3]) << 8 | buffer[pos + 4];
+
+    // the answer starts as a byte-for-byte copy of header plus question,
+    // so the id and the exact case of the name are echoed (dns 0x20)
+    std::vector<unsigned char> message(buffer, buffer + end);
+
+    // this is a response (qr), recursion is available (ra), and we keep
+    // the rd flag of the query; the rcode becomes noerror
+    message[2] |= 0x80;
+    message[3] = (message[3] & 0x70) | 0x80;
+
+    // exactly one question, and no records in the other sections yet
+    message[4] = 0; message[5] = 1;
+    message[6] = message[7] = 0;
+    message[8] = message[9] = 0;
+    message[10] = message[11] = 0;
+
+    // a configured fraction of the answers is truncated, which makes
+    // the lookup retry over tcp
+    if (_truncation > 0.0 && fraction() < _truncation)
+    {
+        // set the tc bit, the answer section stays empty
+        message[2] |= 0x02;
+    }
+
+    // a-queries for the in class get one answer record
+    else if (qtype == 1 && qclass == 1)
+    {
+        // the record: a pointer to the name in the question, type a,
+        // class in, a one minute ttl, and 127.0.0.1 as rdata
+        const unsigned char record[] = { 0xc0, 0x0c, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00, 0x00, 0x3c, 0x00, 0x04, 127, 0, 0, 1 };
+
+        // append it
+        message.insert(message.end(), record, record + sizeof(record));
+
+        // one answer
+        message[7] = 1;
+    }
+
+    // send it, right away or after the configured latency
+    answer(std::move(message), address, addrsize);
+}
+
+/**
+ *  Send or schedule an answer
+ *  @param  message     the wire-format answer
+ *  @param  address     where to send it
+ *  @param  addrsize    size of that address
+ */
+void MockServer::answer(std::vector<unsigned char> &&message, const struct sockaddr *address, size_t addrsize)
+{
+    // the latency of this answer
+    double delay = _mindelay + fraction() * (_maxdelay - _mindelay);
+
+    // undelayed answers leave right away
+    if (delay <= 0.0)
+    {
+        // best effort, a mock does not care about full socket buffers
+        sendto(_fd, message.data(), message.size(), MSG_DONTWAIT, address, addrsize);
+    }
+    else
+    {
+        // the entry for the schedule
+        Delayed delayed;
+
+        // fill it
+        delayed.message = std::move(message);
+        memcpy(delayed.address, address, std::min(addrsize, sizeof(delayed.address)));
+        delayed.addrsize = addrsize;
+
+        // current time
+        double now = Now();
+
+        // schedule it
+        _delayed.emplace(now + delay, std::move(delayed));
+
+        // make sure the timer fires for the earliest answer
+        reschedule(now);
+    }
+}
+
+/**
+ *  Bring the timer in sync with the earliest scheduled answer
+ *  @param  now         current time
+ */
+void MockServer::reschedule(double now)
+{
+    // a running timer is reset
+    if (_timer != nullptr) { _loop->cancel(_timer, this); _timer = nullptr; }
+
+    // without scheduled answers there is nothing to time
+    if (_delayed.empty()) return;
+
+    // arm the timer for the earliest answer
+    _timer = _loop->timer(std::max(0.0, _delayed.begin()->first - now), this);
+}
+
+/**
+ *  Method that is called by the event loop when the timer expires
+ */
+void MockServer::expire()
+{
+    // forget the timer
+    _loop->cancel(_timer, this); _timer = nullptr;
+
+    // current time
+    double now = Now();
+
+    // send all answers that are due
+    while (!_delayed.empty() && _delayed.begin()->first <= now)
+    {
+        // the answer to send
+        auto &delayed = _delayed.begin()->second;
+
+        // send it (best effort)
+        sendto(_fd, delayed.message.data(), delayed.message.size(), MSG_DONTWAIT, (struct sockaddr *)delayed.address, delayed.addrsize);
+
+        // remove it from the schedule
+        _delayed.erase(_delayed.begin());
+    }
+
+    // rearm for the answers that are not yet due
+    reschedule(now);
+}
+
+/**
+ *  End of namespace
+ */
+}
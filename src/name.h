@@ -21,6 +21,7 @@
  */
 #include <iostream>
 #include "canonicalizer.h"
+#include "dname.h"
 
 /**
  *  Begin of namespace
@@ -86,7 +87,16 @@ private:
         {
             return _size;
         }
-        
+
+        /**
+         *  The start of the label inside the original string
+         *  @return const char *
+         */
+        const char *data() const
+        {
+            return _label;
+        }
+
         /**
          *  Compare with a different label
          *  @param  that
@@ -94,12 +104,18 @@ private:
          */
         int compare(const Label &that) const
         {
+            // identical labels are by far the most common case (chain
+            // validation compares a name mostly against itself), and the
+            // vectorized equality check is much cheaper than an ordered
+            // compare
+            if (_size == that._size && Dname::equal(_label, that._label, _size)) return 0;
+
             // compare the overlapping parts
             auto result = strncasecmp(_label, that._label, std::min(_size, that._size));
-            
+
             // if we found a difference already, we found the smaller one
             if (result != 0) return result;
-            
+
             // both names have a common prefix, the short label is the first one
             return _size - that._size;
         }
@@ -146,7 +162,17 @@ private:
         // expose the requested label
         return _labels[_labels.size() - 1 - index];
     }
-    
+
+    /**
+     *  Private constructor for ancestor names: the labels were already
+     *  located when the child was constructed, so the parent is built
+     *  from the existing index instead of re-scanning the string
+     *  @param  that        the name to take labels from
+     *  @param  skip        number of leading labels to drop
+     */
+    Name(const Name &that, size_t skip) :
+        _labels(that._labels.begin() + skip, that._labels.end()) {}
+
 
 public:
     /**
@@ -189,7 +215,58 @@ public:
         // expose the number of labels
         return _labels.size();
     }
-    
+
+    /**
+     *  The parent name (the name minus its leftmost label). Because the
+     *  label boundaries were already located at construction this is a
+     *  couple of array hops, no string is scanned again: walking the
+     *  whole ancestor chain of a name is linear instead of quadratic
+     *  @return Name        the parent (the root for single-label names)
+     */
+    Name parent() const
+    {
+        // reuse the existing label index
+        return Name(*this, _labels.empty() ? 0 : 1);
+    }
+
+    /**
+     *  The ancestor of the name that has a certain number of labels, as
+     *  a pointer into the original string (so "www.mail.example.com"
+     *  with count 2 gives "example.com"). This is an O(1) array hop,
+     *  the string that was used for construction must still be in scope
+     *  @param  count       number of labels to keep (1 <= count <= labels())
+     *  @return const char *
+     */
+    const char *suffix(size_t count) const
+    {
+        // expose the start of the first kept label
+        return back(count - 1).data();
+    }
+
+    /**
+     *  Check if this name equals, or lives under, a different name (a
+     *  suffix comparison by whole labels: "www.example.com" ends with
+     *  "example.com", but not with "ample.com"). No strings are scanned,
+     *  the label indexes of both names are compared back-to-front
+     *  @param  that        the potential ancestor
+     *  @return bool
+     */
+    bool endswith(const Name &that) const
+    {
+        // an ancestor cannot have more labels
+        if (that.labels() > labels()) return false;
+
+        // compare the trailing labels
+        for (size_t i = 0; i < that.labels(); ++i)
+        {
+            // every label must match
+            if (back(i).compare(that.back(i)) != 0) return false;
+        }
+
+        // all labels of the ancestor occur at the back of this name
+        return true;
+    }
+
     /**
      *  Compare with a different name, ordering them according to the
      *  rules of RFC 4034 section 6,1
@@ -15,6 +15,11 @@
 #include "../include/dnscpp/loop.h"
 #include "../include/dnscpp/now.h"
 #include "../include/dnscpp/watcher.h"
+#include "../include/dnscpp/type.h"
+#include "../include/dnscpp/record.h"
+#include "pipeline.h"
+#include "random.h"
+#include "tracepoints.h"
 
 /**
  *  Begin of namespace
@@ -27,12 +32,125 @@ namespace DNS {
  *  @param  ip      nameserver IP
  *  @throws std::runtime_error
  */
-Nameserver::Nameserver(Core *core, const Ip &ip) : _core(core), _ip(ip), _udp(core, this) {}
+Nameserver::Nameserver(Core *core, const Ip &ip) : _core(core), _ip(ip), _printable(ip), _responses(core->backlog())
+{
+    // construct the socket pool (always at least one socket, the cast is
+    // needed because the base is private)
+    for (size_t i = 0; i < std::max((size_t)1, core->sockets()); ++i) _sockets.emplace_back(core, static_cast<Udp::Handler*>(this));
+
+    // generate the random client cookie that identifies us towards this
+    // nameserver (the server cookie is appended once the server sends one)
+    for (size_t i = 0; i < 8; ++i) _cookie[i] = Random::instance().draw();
+
+    // take over the rate limit that was configured on the core
+    ratelimit(core->rate(), core->burst());
+}
 
 /**
  *  Destructor
  */
-Nameserver::~Nameserver() {}
+Nameserver::~Nameserver()
+{
+    // a pending delayed close is no longer meaningful
+    if (_idletimer) _core->loop()->cancel(_idletimer, this);
+}
+
+/**
+ *  Called when the last subscriber lost interest: close the sockets
+ *  right away, or schedule the delayed close of keep-warm mode
+ */
+void Nameserver::idle()
+{
+    // without a keep-warm period the sockets close right away
+    if (_core->keepwarm() <= 0.0) { for (auto &socket : _sockets) socket.close(); return; }
+
+    // a delayed close could already be pending (when the final
+    // unsubscribes come in one by one this method runs just once)
+    if (_idletimer) return;
+
+    // keep the sockets (and their event-loop registration) open for
+    // the grace period, a burst that follows shortly reuses them
+    _idletimer = _core->loop()->timer(_core->keepwarm(), this);
+}
+
+/**
+ *  Cancel a pending delayed close because the sockets are in use again
+ */
+void Nameserver::warm()
+{
+    // forget the timer
+    _core->loop()->cancel(_idletimer, this);
+
+    // no close is pending any more
+    _idletimer = nullptr;
+}
+
+/**
+ *  Called by the event loop when the keep-warm grace period is over
+ */
+void Nameserver::expire()
+{
+    // the timer is done, cancel and forget it
+    _core->loop()->cancel(_idletimer, this);
+    _idletimer = nullptr;
+
+    // in the meantime a new subscriber could have arrived (it then
+    // cancelled the timer, but be defensive about loop implementations
+    // that still deliver an expiration that raced the cancel)
+    if (_subscribers > 0) return;
+
+    // the grace period passed without new traffic
+    for (auto &socket : _sockets) socket.close();
+}
+
+/**
+ *  The persistent TCP connection to this nameserver
+ *  @return Pipeline
+ */
+Pipeline *Nameserver::pipeline()
+{
+    // a broken connection is discarded, so that a fresh one is built below
+    if (_pipeline && _pipeline->broken()) _pipeline.reset();
+
+    // construct the pipeline on first use (this could throw), over
+    // dns-over-tls when the user enabled that
+    if (!_pipeline) _pipeline.reset(new Pipeline(_core->loop(), _ip, _core->secure(), _core->dnsport()));
+
+    // expose the pipeline
+    return _pipeline.get();
+}
+
+/**
+ *  Bind all sockets of the pool to one shared port with SO_REUSEPORT
+ */
+void Nameserver::shard()
+{
+    // with a single socket there is nothing to shard
+    if (_sockets.size() < 2) return;
+
+    // the first socket picks the (ephemeral) port for the whole pool
+    auto iter = _sockets.begin();
+
+    // enable the option (port 0 means: let the kernel choose) and open the
+    // socket right away because we need to know the chosen port
+    iter->reuseport(0);
+
+    // if the socket cannot be opened we keep the normal per-socket ports
+    if (!iter->open(_ip.version())) return;
+
+    // the port that the rest of the pool should share
+    auto port = iter->localport();
+
+    // bind all other sockets to the same port
+    for (++iter; iter != _sockets.end(); ++iter)
+    {
+        // same option, but now with an explicit port
+        iter->reuseport(port);
+
+        // open the socket right away too
+        iter->open(_ip.version());
+    }
+}
 
 /**
  *  Send a datagram to the nameserver
@@ -41,8 +159,96 @@ Nameserver::~Nameserver() {}
  */
 bool Nameserver::datagram(const Query &query)
 {
-    // send the message
-    return _udp.send(_ip, query);
+    // the rate limiter decides first whether the query may go out at all,
+    // lookups that are refused simply retry when the next token accrues
+    if (!consume(Now())) return false;
+
+    // stripe queries over the socket pool based on the query-id, so that
+    // retransmits of the same query leave from the same source port
+    auto iter = std::next(_sockets.begin(), query.id() % _sockets.size());
+
+    // buffer in which the query is annotated with the dns cookie for this
+    // nameserver (big enough for the biggest query plus the biggest cookie)
+    unsigned char buffer[HFIXEDSZ + QFIXEDSZ + MAXCDNAME + 45];
+
+    // attach the cookie (this fails for exotic queries without edns section,
+    // which are then simply sent in their original form)
+    auto size = query.cookie(buffer, _cookie, _cookiesize);
+
+    // send the annotated message, or the original query as fallback
+    bool result = size > 0 ? iter->send(_ip, buffer, size) : iter->send(_ip, query);
+
+    // if nothing went out we do not count the query either
+    if (!result) return false;
+
+    // halve the counters every so often, so that the loss score describes
+    // the recent past and a recovered server can work its way back up
+    if (_queries >= 64) { _queries /= 2; _answers /= 2; }
+
+    // one more query in flight
+    _queries += 1;
+
+    // count the datagram in the stats too
+    _stats.sent();
+
+    // done
+    return true;
+}
+
+/**
+ *  Update the cached server cookie from a received response
+ *  @param  response    the response that possibly carries a cookie
+ */
+void Nameserver::cookie(const Response &response)
+{
+    // prevent exceptions (parsing a record could fail)
+    try
+    {
+        // look for the edns pseudo-record in the additional section
+        for (size_t i = 0; i < response.additional(); ++i)
+        {
+            // the next additional record
+            Record record(response, ns_s_ar, i);
+
+            // we are only interested in the edns pseudo-record
+            if (record.type() != TYPE_OPT) continue;
+
+            // the rdata holds a list of options
+            auto *data = record.data(); size_t size = record.size();
+
+            // walk over the options
+            for (size_t pos = 0; pos + 4 <= size; )
+            {
+                // the option-code and option-length
+                uint16_t code = ns_get16(data + pos);
+                uint16_t length = ns_get16(data + pos + 2);
+
+                // prevent running outside the rdata
+                if (pos + 4 + length > size) return;
+
+                // options other than the cookie are skipped
+                if (code != 10) { pos += 4 + length; continue; }
+
+                // a valid cookie echoes our 8-byte client cookie followed by
+                // an 8 to 32 byte server cookie, anything else is ignored
+                if (length < 16 || length > 40) return;
+                if (memcmp(data + pos + 4, _cookie, 8) != 0) return;
+
+                // remember the full cookie for subsequent queries
+                memcpy(_cookie, data + pos + 4, length);
+
+                // including the new size
+                _cookiesize = length;
+
+                // done
+                return;
+            }
+        }
+    }
+    catch (...)
+    {
+        // an unparsable record means no cookie
+    }
 }
 
 /**
@@ -60,65 +266,104 @@ void Nameserver::onReceived(time_t now, const sockaddr *address, const unsigned
     if (_ip != ip) return;
 
     // if nobody is interested there is no point in handling the message
-    if (_handlers.empty()) return;
+    if (_subscribers == 0) return;
 
-    // add to the responses
-    _responses.emplace_back(address, buffer, size);
-    
-    // let the core that we need to process this queue
-    _core->reschedule(now);
+    // messages that do not even hold a full dns header are never valid
+    if (size < 12) return;
+
+    // the query-id lives in the first two bytes of the header (in network
+    // byte order), we peek at it before we spend any work on the message
+    uint16_t id = uint16_t(buffer[0]) << 8 | buffer[1];
+
+    // if no subscriber is waiting for this id the message is unsolicited
+    // (spoofed, or a late answer to a lookup that is already gone): we drop
+    // it now, a couple of instructions against the full parse it costs later
+    if (_handlers[id].empty()) return;
+
+    // was the queue empty before this message?
+    bool first = _responses.empty();
+
+    // add to the responses (one copy into a preallocated slot, when the
+    // ring is full the message is dropped and the sender will retry)
+    if (!_responses.push(buffer, size)) return;
+
+    // count the response in the stats
+    _stats.received();
+
+    // let the core know that we need to process this queue, but only for the
+    // first message of a batch: the timer is already set for the rest of it
+    if (first) _core->reschedule(now);
 }
 
 /**
  *  Process queued messages
  *  @param  size_t          max number of calls to userspace
+ *  @param  deadline        stop processing when the coarse clock passes this time (0.0 = no deadline)
  *  @return size_t          number of processed answers
  */
-size_t Nameserver::process(size_t maxcalls)
+size_t Nameserver::process(size_t maxcalls, double deadline)
 {
     // if there is nothing to process
     if (_responses.empty()) return 0;
-    
+
     // result variable
     size_t result = 0;
-    
+
     // we are going to make a call to userspace, so we keep monitoring if `this` is not destructed
     Watcher watcher(this);
-    
+
     // look for a response
     while (result < maxcalls && watcher.valid() && !_responses.empty())
     {
+        // stop when the time budget has run out (reading the coarse clock is just
+        // a vdso load, so doing this once per call to userspace is essentially free),
+        // leftover responses stay buffered and will be picked up by the immediate
+        // timer that Core::reschedule() arms whenever buffered responses remain
+        if (deadline > 0.0 && double(Now()) >= deadline) break;
+
         // avoid exceptions (parsing the response could fail)
         try
         {
             // note that the _handler->onReceived() triggers a call to user-space that might destruct 'this',
             // which also causes _responses to be destructed. To avoid silly crashes we copy the oldest message
-            // to the local stack in a one-item-big list
-            decltype(_responses) oneitem;
-            
-            // move the first item from the _responses to the one-item list
-            oneitem.splice(oneitem.begin(), _responses, _responses.begin(), std::next(_responses.begin()));
-            
-            // get the first element
-            const auto &front = oneitem.front();
+            // to the local stack before it is popped from the ring
+            unsigned char buffer[Ring::slotsize];
+
+            // size of the oldest message
+            size_t size = _responses.frontsize();
+
+            // copy it to the stack
+            memcpy(buffer, _responses.front(), size);
+
+            // the slot can be reused now
+            _responses.pop();
 
             // parse the response
-            Response response(front.data(), front.size());
-        
-            // filter on the response, the beginning is simply the handler at nullptr
-            auto begin = _handlers.lower_bound(std::make_pair(response.id(), nullptr));
+            Response response(buffer, size);
+
+            // pick up the server cookie when the response carries one
+            cookie(response);
+
+            // the subscribers that wait for this query id live in one slot
+            auto &subscribers = _handlers[response.id()];
 
-            // iterate over those elements, notifying each handler
-            for (auto iter = begin; iter != _handlers.end(); ++iter) 
+            // iterate over the slot, notifying each handler
+            for (size_t i = 0; i < subscribers.size(); ++i)
             {
-                // if this element is not applicable any more, we're going to leap out (we're done)
-                if (iter->first != response.id()) break;
-
-                // call the onreceived for the element
-                if (iter->second->onReceived(this, response)) result += 1;
-                
-                // the message was processed, we no longer need other handlers
-                break;
+                // call the onreceived for the element, if the handler did not
+                // process the message (because it belongs to a different query
+                // that happens to use the same id) we try the next handler
+                if (!subscribers[i]->onReceived(this, response)) continue;
+
+                // the message was processed, so one of our recent queries
+                // got its answer (this feeds the loss score)
+                _answers += 1;
+
+                // tracepoint: a response reached its lookup
+                DNSCPP_PROBE1(response_matched, response.id());
+
+                // we no longer need other handlers
+                result += 1; break;
             }
         }
         catch (const std::runtime_error &error)
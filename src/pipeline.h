@@ -0,0 +1,465 @@
+/**
+ *  Pipeline.h
+ *
+ *  A persistent TCP connection to a nameserver over which many queries
+ *  can be in flight at the same time (rfc 7766). Queries are written
+ *  back-to-back over the connection and responses are matched to their
+ *  subscribers by query-id, so they may come back in a different order
+ *  than the queries were sent in. Because the connection stays open,
+ *  falling back to tcp after a truncated response costs one round-trip
+ *  instead of a full handshake plus query plus teardown per lookup.
+ *
+ *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include "connector.h"
+#include "tls.h"
+#include "../include/dnscpp/response.h"
+#include "../include/dnscpp/query.h"
+#include "../include/dnscpp/watchable.h"
+#include "../include/dnscpp/watcher.h"
+#include <memory>
+#include <string>
+#include <map>
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Class definition
+ */
+class Pipeline : private Connector::Handler, private Monitor, private Watchable
+{
+public:
+    /**
+     *  Interface to be implemented by objects that sent a query over
+     *  the pipeline and that are waiting for their response
+     */
+    class Subscriber
+    {
+    public:
+        /**
+         *  Called when the response to the query has been received
+         *  @param  pipeline        the reporting pipeline
+         *  @param  response        the received response
+         */
+        virtual void onReceived(Pipeline *pipeline, const Response &response) = 0;
+
+        /**
+         *  Called when the connection failed before the response came in
+         *  @param  pipeline        the reporting pipeline
+         */
+        virtual void onFailure(Pipeline *pipeline) = 0;
+    };
+
+private:
+    /**
+     *  The actual socket, either a plain TCP socket or a TLS socket
+     *  (for DNS-over-TLS)
+     *  @var std::unique_ptr<Tcp>
+     */
+    std::unique_ptr<Tcp> _tcp;
+
+    /**
+     *  The address of the nameserver, the actual connect is postponed
+     *  until the first query is queued so that it can ride in the syn
+     *  packet (tcp fast open)
+     *  @var Ip
+     */
+    Ip _ip;
+
+    /**
+     *  The port to connect to (53 for plain dns, 853 for dns-over-tls)
+     *  @var uint16_t
+     */
+    uint16_t _port;
+
+    /**
+     *  While the handshake is in progress the connector waits for the
+     *  socket to become writable, it is discarded once connected
+     *  @var std::unique_ptr<Connector>
+     */
+    std::unique_ptr<Connector> _connector;
+
+    /**
+     *  Has the connection been established?
+     *  @var bool
+     */
+    bool _connected = false;
+
+    /**
+     *  Is the connection broken? Broken pipelines should be discarded
+     *  by the owner and replaced with a fresh one
+     *  @var bool
+     */
+    bool _broken = false;
+
+    /**
+     *  Outgoing bytes (length-prefixed queries) that have not yet been
+     *  accepted by the kernel
+     *  @var std::string
+     */
+    std::string _out;
+
+    /**
+     *  Incoming bytes that do not yet form a complete response
+     *  @var std::string
+     */
+    std::string _in;
+
+    /**
+     *  The subscribers that are waiting for a response, keyed by
+     *  query-id (a multimap because random ids can collide)
+     *  @var std::multimap
+     */
+    std::multimap<uint16_t,Subscriber*> _subscribers;
+
+    /**
+     *  Identifier of the monitor in the event loop
+     *  @var void *
+     */
+    void *_identifier = nullptr;
+
+    /**
+     *  The events that are currently monitored
+     *  @var int
+     */
+    int _events = 0;
+
+    /**
+     *  Update the events for which the socket is monitored
+     *  @param  events      the events to monitor (1 = readable, 2 = writable)
+     */
+    void monitor(int events)
+    {
+        // nothing to do when nothing changes
+        if (events == _events) return;
+
+        // install or update the monitor
+        if (_identifier == nullptr) _identifier = _tcp->monitor(events, this);
+        else _identifier = _tcp->update(_identifier, events, this);
+
+        // remember the events
+        _events = events;
+    }
+
+    /**
+     *  Start connecting to the nameserver, called when the first query
+     *  has been queued
+     */
+    void connect()
+    {
+        // for dns-over-tls we do a plain connect (putting queries in the
+        // syn makes no sense, the tls handshake has to run first anyway)
+        if (_port != 53)
+        {
+            // ordinary non-blocking connect
+            if (!_tcp->connect(_ip, _port)) return fail();
+        }
+        else
+        {
+            // try to put the queued queries in the syn packet right away (tcp
+            // fast open): with a cached cookie for this nameserver the response
+            // can come a full round-trip earlier, without one this degrades to
+            // an ordinary connect and the queries leave after the handshake
+            auto result = _tcp->fastopen(_ip, _port, (const unsigned char *)_out.data(), _out.size());
+
+            // bytes that made it into the syn do not have to be sent again
+            if (result >= 0) _out.erase(0, result);
+
+            // a plain syn without data was sent when errno is EINPROGRESS, for
+            // anything else fast open is unavailable and we connect normally
+            else if (errno != EINPROGRESS && !_tcp->connect(_ip, _port)) return fail();
+        }
+
+        // wait for the handshake to complete
+        _connector.reset(new Connector(_tcp.get(), this));
+    }
+
+    /**
+     *  Mark the connection as broken, and inform all subscribers
+     */
+    void fail()
+    {
+        // mark as broken, so that the owner replaces us
+        _broken = true;
+
+        // stop monitoring the socket
+        if (_identifier) { _tcp->remove(_identifier, this); _identifier = nullptr; _events = 0; }
+
+        // the callbacks might destruct `this`
+        Watcher watcher(this);
+
+        // inform all subscribers
+        while (!_subscribers.empty())
+        {
+            // take the first subscriber out of the administration
+            auto iter = _subscribers.begin();
+            auto *subscriber = iter->second;
+            _subscribers.erase(iter);
+
+            // inform it
+            subscriber->onFailure(this);
+
+            // leap out if the callback destructed the pipeline
+            if (!watcher.valid()) return;
+        }
+    }
+
+    /**
+     *  Try to hand the buffered outgoing bytes to the kernel
+     */
+    void flush()
+    {
+        // keep writing while there is something to write
+        while (_connected && !_out.empty())
+        {
+            // hand over to the kernel
+            auto result = _tcp->write((const unsigned char *)_out.data(), _out.size());
+
+            // remove the bytes that were accepted
+            if (result > 0) { _out.erase(0, result); continue; }
+
+            // a full socket buffer simply means we wait for writability
+            if (result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+
+            // any other failure breaks the connection
+            return fail();
+        }
+
+        // we always watch readability, and writability while output is pending
+        if (_connected) monitor(_out.empty() ? 1 : 3);
+    }
+
+    /**
+     *  Called when the connection has been set up
+     *  @param  connector
+     *  @param  tcp
+     */
+    virtual void onConnected(Connector *connector, Tcp *tcp) override
+    {
+        // the connection is up now
+        _connected = true;
+
+        // the connector has done its job
+        _connector.reset();
+
+        // start watching the socket and send the queries that were queued
+        // up while the handshake was in progress
+        monitor(1); flush();
+    }
+
+    /**
+     *  Called when the connection could not be set up
+     *  @param  connector
+     *  @param  tcp
+     */
+    virtual void onFailure(Connector *connector, Tcp *tcp) override
+    {
+        // the connector has done its job
+        _connector.reset();
+
+        // nothing will ever be sent or received
+        fail();
+    }
+
+    /**
+     *  Method that is called by the event loop when the socket becomes
+     *  readable and/or writable
+     */
+    virtual void notify() override
+    {
+        // first get pending output out of the door
+        if (!_out.empty()) flush();
+
+        // flushing could have broken the connection
+        if (_broken) return;
+
+        // temporary buffer to drain the socket
+        unsigned char buffer[65536];
+
+        // keep reading until the socket is drained
+        while (true)
+        {
+            // get the next chunk
+            auto result = _tcp->receive(buffer, sizeof(buffer));
+
+            // a blocking operation means the socket is drained
+            if (result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+
+            // an orderly shutdown by the peer, or an error, breaks the pipeline
+            if (result <= 0) return fail();
+
+            // append to the incoming buffer
+            _in.append((const char *)buffer, result);
+
+            // a partial read also means the socket is drained
+            if ((size_t)result < sizeof(buffer)) break;
+        }
+
+        // the callbacks might destruct `this`
+        Watcher watcher(this);
+
+        // number of bytes of the buffer that have been consumed, we do not
+        // erase per response because that would move the remainder of the
+        // buffer once per response, but once for the whole batch instead
+        size_t consumed = 0;
+
+        // process all complete responses in the buffer
+        while (_in.size() - consumed >= 2)
+        {
+            // the two-byte length prefix
+            size_t size = (uint8_t)_in[consumed] << 8 | (uint8_t)_in[consumed+1];
+
+            // wait for more data if the response is not yet complete
+            if (_in.size() - consumed < size + 2) break;
+
+            // the response is complete so it will be consumed, even if it
+            // turns out to be unparsable
+            consumed += size + 2;
+
+            // prevent exceptions (parsing the response could fail)
+            try
+            {
+                // parse the response
+                Response response((const unsigned char *)_in.data() + consumed - size, size);
+
+                // find the subscriber that is waiting for this id
+                auto iter = _subscribers.find(response.id());
+
+                // is somebody indeed waiting for it? (late responses to
+                // cancelled queries are simply dropped)
+                if (iter != _subscribers.end())
+                {
+                    // remember the subscriber and remove it first, because
+                    // the callback might add new subscriptions
+                    auto *subscriber = iter->second;
+                    _subscribers.erase(iter);
+
+                    // pass on the response
+                    subscriber->onReceived(this, response);
+
+                    // leap out if the callback destructed the pipeline
+                    if (!watcher.valid()) return;
+                }
+            }
+            catch (...)
+            {
+                // an unparsable response is skipped (the subscriber will
+                // eventually time out via its own bookkeeping)
+            }
+        }
+
+        // remove all consumed responses in one go, the string keeps its
+        // capacity so steady-state traffic allocates nothing here
+        _in.erase(0, consumed);
+    }
+
+public:
+    /**
+     *  Constructor
+     *  Note that this does not yet connect: the connect is started when
+     *  the first query is queued, so that it can travel in the syn packet
+     *  @param  loop        the event loop
+     *  @param  ip          the IP address of the nameserver
+     *  @param  secure      use dns-over-tls instead of plain dns?
+     *  @param  port        the port for plain dns (tls always uses 853)
+     *  @throws std::runtime_error
+     */
+    Pipeline(Loop *loop, const Ip &ip, bool secure = false, uint16_t port = 53) :
+        _tcp(secure ? new Tls(loop, ip) : new Tcp(loop, ip)),
+        _ip(ip), _port(secure ? 853 : port) {}
+
+    /**
+     *  No copying
+     *  @param  that
+     */
+    Pipeline(const Pipeline &that) = delete;
+
+    /**
+     *  Destructor
+     */
+    virtual ~Pipeline()
+    {
+        // stop monitoring the socket
+        if (_identifier) _tcp->remove(_identifier, this);
+    }
+
+    /**
+     *  Is the connection broken? The owner should then discard this
+     *  pipeline and construct a fresh one
+     *  @return bool
+     */
+    bool broken() const { return _broken; }
+
+    /**
+     *  Send a query over the pipeline, the subscriber is informed when
+     *  the response comes in (or when the connection fails)
+     *  @param  query       the query to send
+     *  @param  subscriber  object waiting for the response
+     *  @return bool        was the query accepted by the pipeline?
+     */
+    bool send(const Query &query, Subscriber *subscriber)
+    {
+        // broken pipelines accept nothing
+        if (_broken) return false;
+
+        // append the tcp framing: a two-byte length prefix plus the query,
+        // many queries simply queue up back-to-back in this buffer
+        _out.push_back((char)(query.size() >> 8));
+        _out.push_back((char)(query.size() & 0xff));
+        _out.append((const char *)query.data(), query.size());
+
+        // for the very first query we still have to start the handshake,
+        // when connected we try to get the bytes out right away
+        if (!_connected && _connector == nullptr) connect();
+        else if (_connected) flush();
+
+        // connecting or flushing could have broken the connection, the
+        // caller is not registered yet then and gets no onFailure() callback
+        if (_broken) return false;
+
+        // register the subscriber
+        _subscribers.emplace(query.id(), subscriber);
+
+        // the response comes in later
+        return true;
+    }
+
+    /**
+     *  Remove a subscriber (because it lost interest in the response)
+     *  @param  id          the query-id it subscribed to
+     *  @param  subscriber  the subscriber to remove
+     */
+    void unsubscribe(uint16_t id, Subscriber *subscriber)
+    {
+        // all subscribers with this id
+        auto range = _subscribers.equal_range(id);
+
+        // find the exact entry
+        for (auto iter = range.first; iter != range.second; ++iter)
+        {
+            // skip other subscribers that happen to use the same id
+            if (iter->second != subscriber) continue;
+
+            // remove it and leap out
+            _subscribers.erase(iter); return;
+        }
+    }
+};
+
+/**
+ *  End of namespace
+ */
+}
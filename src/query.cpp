@@ -11,12 +11,15 @@
  *  Dependencies
  */
 #include <string.h>
+#include <ctype.h>
 #include "../include/dnscpp/query.h"
 #include <arpa/nameser.h>
 #include <arpa/inet.h>
 #include <stdexcept>
 #include "randombits.h"
+#include "random.h"
 #include "compressor.h"
+#include "dname.h"
 #include "../include/dnscpp/type.h"
 #include "../include/dnscpp/question.h"
 #include "../include/dnscpp/response.h"
@@ -113,7 +116,77 @@ Query::Query(int op, const char *dname, int type, const Bits &bits, const unsign
     while (false);
     
     // add the edns-pseudo-section
-    edns(bits.dnssec());
+    edns(bits);
+}
+
+/**
+ *  Constructor that copies a precompiled query (a template) and
+ *  optionally stamps a fresh random id into the copy
+ *  @param  that        the precompiled query to copy
+ *  @param  restamp     stamp a fresh random id into the copy?
+ */
+Query::Query(const Query &that, bool restamp, bool dns0x20) : _size(that._size)
+{
+    // copy only the part of the buffer that is actually in use
+    memcpy(_buffer, that._buffer, that._size);
+
+    // randomize the case of the query-name when asked for
+    if (dns0x20) randomize();
+
+    // done if the id of the template may be kept
+    if (!restamp) return;
+
+    // for simpler access to the header-properties, we use a local variable
+    HEADER *header = (HEADER *)_buffer;
+
+    // we need a fresh random id so that it cannot be guessed
+    header->id = RandomBits();
+}
+
+/**
+ *  Randomize the case of the letters in the query-name (dns 0x20
+ *  encoding). Nameservers echo the question verbatim, so the randomized
+ *  case adds roughly one unguessable bit per letter on top of the
+ *  sixteen-bit query id, making off-path spoofing of udp responses much
+ *  harder -- which is what makes larger edns payload sizes safe to use
+ */
+void Query::randomize()
+{
+    // position inside the name (right after the header) and random bits
+    // that have not been used yet
+    unsigned char *pos = _buffer + HFIXEDSZ;
+    uint64_t bits = 0; size_t left = 0;
+
+    // walk over the labels of the name (the first name in a message is
+    // never compressed, so this is a plain length-prefixed sequence)
+    while (*pos)
+    {
+        // size of the current label
+        size_t size = *pos++;
+
+        // process all characters of the label
+        for (size_t i = 0; i < size; ++i)
+        {
+            // only letters have case
+            if (!isalpha(pos[i])) continue;
+
+            // refill the pool of random bits when it runs dry
+            if (left == 0) { bits = Random::instance().draw(); left = 64; }
+
+            // flip the case when the next random bit says so (0x20 is
+            // exactly the bit that separates upper- from lowercase ascii)
+            if (bits & 1) pos[i] ^= 0x20;
+
+            // the bit has been used now
+            bits >>= 1; left -= 1;
+        }
+
+        // move on to the next label
+        pos += size;
+    }
+
+    // remember that responses must now echo this exact case
+    _dns0x20 = true;
 }
 
 /**
@@ -151,9 +224,18 @@ bool Query::contains(const Question &record) const
             // now run the tests
             if (type != record.type()) continue;
             if (dnsclass != record.dnsclass()) continue;
-            
-            // type and class are then same, we just need the same name
-            if (ns_samename(name, record.name()) > 0) return true;
+
+            // type and class are the same, we just need the same name
+            // (vectorized case-insensitive compare)
+            if (!Dname::equal(name, record.name())) continue;
+
+            // when the case of the query-name was randomized (dns 0x20
+            // encoding) the response must echo the exact same case,
+            // otherwise it is treated as forged
+            if (_dns0x20 && strcmp(name, record.name()) != 0) continue;
+
+            // the question matches
+            return true;
         }
         catch (...)
         {
@@ -174,10 +256,10 @@ bool Query::contains(const Question &record) const
  *  solves this by allowing an extra pseudo-record to be added to each
  *  message with room for some additional flags and properties. This method
  *  adds that extra pseudo-section to the query.
- *  @param  dnssec      do we want to have DNSSEC responses?
+ *  @param  bits        the bits (payload size, dnssec) to advertise
  *  @return bool
  */
-bool Query::edns(bool dnssec)
+bool Query::edns(const Bits &bits)
 {
     // check if there is enough room
     if (remaining() < 11) return false;
@@ -185,23 +267,24 @@ bool Query::edns(bool dnssec)
     // the first field for a record is the domain name, this is not in use
     // so we add an empty string (or the root domain, which is the same)
     _buffer[_size++] = 0;
-    
+
     // the type of the pseudo-record is "opt"
     put16(TYPE_OPT);
-    
-    // we advertise that we support 1200 bytes for our response buffer size, 
-    // this is the same buffer size as libresolv seems to use. Their ratio
-    // is that this limits the risk that dgram message get fragmented,
-    // which makes the system vulnerable for injection
-    put16(1200);
-    
-    // extended rcode (0 because the normal rcode is good enough) and the 
+
+    // advertise the max response size that we are willing to receive over
+    // udp, this is configurable because the best value is a trade-off: big
+    // enough to keep responses off the expensive tcp fallback path, but
+    // small enough that datagrams do not get fragmented (which would make
+    // the system vulnerable for injection)
+    put16(bits.payload());
+
+    // extended rcode (0 because the normal rcode is good enough) and the
     // edns version (also 0 because that is the mose up-to-date version)
     _buffer[_size++] = 0;
     _buffer[_size++] = 0;
-    
+
     // extra flags to say that dnssec is supported
-    put16(dnssec ? NS_OPT_DNSSEC_OK : 0);
+    put16(bits.dnssec() ? NS_OPT_DNSSEC_OK : 0);
     
     // the next section contains a key-value list of extra options, but
     // since we do not support such extra options, we have a zero-length list
@@ -217,6 +300,43 @@ bool Query::edns(bool dnssec)
     return true;
 }
 
+/**
+ *  Copy the query into an external buffer, with a dns cookie option
+ *  (rfc 7873) appended to the edns pseudo-record
+ *  @param  buffer      target buffer, should hold size() + 44 bytes
+ *  @param  cookie      the cookie (client cookie, plus server cookie when known)
+ *  @param  size        size of the cookie (between 8 and 40 bytes)
+ *  @return size_t      size of the annotated query (0 when not possible)
+ */
+size_t Query::cookie(unsigned char *buffer, const unsigned char *cookie, size_t size) const
+{
+    // the protocol allows an 8-byte client cookie plus up to 32 bytes server cookie
+    if (size < 8 || size > 40) return 0;
+
+    // the edns pseudo-record is the last record in the query, check that it
+    // is indeed there: an empty name (the root domain), type "opt" and an
+    // empty option-list (that is how our own edns() method left it behind)
+    if (_size < HFIXEDSZ + 11) return 0;
+    if (_buffer[_size-11] != 0) return 0;
+    if (ns_get16(_buffer + _size - 10) != TYPE_OPT) return 0;
+    if (ns_get16(_buffer + _size - 2) != 0) return 0;
+
+    // copy the entire query
+    memcpy(buffer, _buffer, _size);
+
+    // the option is appended at the end: the option-code for cookies,
+    // the option-length and then the cookie itself
+    ns_put16(10, buffer + _size);
+    ns_put16(size, buffer + _size + 2);
+    memcpy(buffer + _size + 4, cookie, size);
+
+    // the rdata of the pseudo-record is no longer empty
+    ns_put16(size + 4, buffer + _size - 2);
+
+    // expose the new size
+    return _size + size + 4;
+}
+
 /**
  *  The ID inside this object
  *  @return uint16_t
@@ -0,0 +1,169 @@
+/**
+ *  Random.h
+ *
+ *  Fast random number generator (xoshiro256**) for query ids, source
+ *  ports, cookies and similar unpredictable-but-not-secret values. Each
+ *  thread has its own securely seeded instance, so draws are a couple of
+ *  cycles and contexts that run on different threads never contend on
+ *  shared libc state (glibc's rand() takes a lock).
+ *
+ *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include <stdint.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Class definition
+ */
+class Random
+{
+private:
+    /**
+     *  The internal state of the generator (must never be all-zero,
+     *  which the seeding procedure guarantees)
+     *  @var uint64_t[]
+     */
+    uint64_t _state[4];
+
+    /**
+     *  Helper function for the xoshiro256** algorithm
+     *  @param  value   the value to rotate
+     *  @param  bits    number of bits to rotate by
+     *  @return uint64_t
+     */
+    static uint64_t rotate(uint64_t value, int bits)
+    {
+        // rotate the bits to the left
+        return (value << bits) | (value >> (64 - bits));
+    }
+
+    /**
+     *  Constructor, seeds the state from the kernel random source
+     */
+    Random()
+    {
+        // number of state bytes that have been seeded so far
+        size_t filled = 0;
+
+        // read the seed from the kernel random source
+        int fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+
+        // read as much seed material as the kernel gives us
+        if (fd >= 0)
+        {
+            // keep reading until the state is full
+            while (filled < sizeof(_state))
+            {
+                // read the next chunk
+                auto bytes = read(fd, (unsigned char *)_state + filled, sizeof(_state) - filled);
+
+                // leap out on failure, the fallback below kicks in
+                if (bytes <= 0) break;
+
+                // more state has been filled
+                filled += bytes;
+            }
+
+            // close the random source again
+            close(fd);
+        }
+
+        // if the random source was not usable we fall back on mixing in
+        // the time and the address of the object, which at least differs
+        // per thread and per run
+        if (filled >= sizeof(_state)) return;
+
+        // the current time
+        struct timeval now; gettimeofday(&now, nullptr);
+
+        // fill the state with splitmix64 over the fallback entropy
+        uint64_t seed = uint64_t(now.tv_sec) ^ (uint64_t(now.tv_usec) << 24) ^ uint64_t((uintptr_t)this);
+
+        // generate the four state words
+        for (auto &word : _state)
+        {
+            // the splitmix64 step, this also guarantees a non-zero state
+            seed += 0x9e3779b97f4a7c15ULL;
+            uint64_t z = seed;
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+            word = z ^ (z >> 31);
+        }
+    }
+
+public:
+    /**
+     *  Destructor
+     */
+    virtual ~Random() = default;
+
+    /**
+     *  The generator of the current thread
+     *  @return Random
+     */
+    static Random &instance()
+    {
+        // one securely seeded instance per thread
+        static thread_local Random random;
+
+        // expose it
+        return random;
+    }
+
+    /**
+     *  Draw sixty-four random bits (the xoshiro256** algorithm)
+     *  @return uint64_t
+     */
+    uint64_t draw()
+    {
+        // the output is formed from the state
+        uint64_t result = rotate(_state[1] * 5, 7) * 9;
+
+        // advance the state
+        uint64_t t = _state[1] << 17;
+        _state[2] ^= _state[0];
+        _state[3] ^= _state[1];
+        _state[1] ^= _state[2];
+        _state[0] ^= _state[3];
+        _state[2] ^= t;
+        _state[3] = rotate(_state[3], 45);
+
+        // done
+        return result;
+    }
+
+    /**
+     *  Draw sixteen random bits, for query ids and source ports
+     *  @return uint16_t
+     */
+    uint16_t draw16() { return uint16_t(draw()); }
+
+    /**
+     *  Draw thirty-two random bits
+     *  @return uint32_t
+     */
+    uint32_t draw32() { return uint32_t(draw()); }
+};
+
+/**
+ *  End of namespace
+ */
+}
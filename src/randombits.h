@@ -1,8 +1,8 @@
 /**
  *  RandomBits.h
- * 
+ *
  *  Class to create a random ID that can be used to identify a request
- * 
+ *
  *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
  *  @copyright 2020 Copernica BV
  */
@@ -15,7 +15,7 @@
 /**
  *  Dependencies
  */
-#include <sys/time.h>
+#include "random.h"
 
 /**
  *  Begin of namespace
@@ -29,37 +29,35 @@ class RandomBits
 {
 private:
     /**
-     *  Internally we implement this by fetching the current time
-     *  @var struct timeval
+     *  The bits come from the fast per-thread generator (older versions
+     *  derived them from the current time, which was both slower and
+     *  guessable)
+     *  @var uint16_t
      */
-  struct timeval _tv;
+    uint16_t _value;
 
 public:
     /**
      *  Constructor
      */
-    RandomBits()
-    {
-        // get the current time
-        gettimeofday(&_tv, nullptr);
-    }
-    
+    RandomBits() : _value(Random::instance().draw16()) {}
+
     /**
      *  Destructor
      */
     virtual ~RandomBits() = default;
-    
+
     /**
      *  Cast to a uint16_t
      *  @return uint16_t
      */
     operator uint16_t () const
     {
-        // combine the members
-        return (_tv.tv_sec << 8) ^ _tv.tv_usec;
+        // expose the drawn bits
+        return _value;
     }
 };
-    
+
 /**
  *  End of namespace
  */
@@ -11,6 +11,7 @@
  *  Dependencies
  */
 #include "remotelookup.h"
+#include "coalescedlookup.h"
 #include "connection.h"
 #include "../include/dnscpp/core.h"
 #include "../include/dnscpp/response.h"
@@ -18,12 +19,40 @@
 #include "../include/dnscpp/handler.h"
 #include "../include/dnscpp/question.h"
 #include "fakeresponse.h"
+#include "slab.h"
+#include "random.h"
+#include "tracepoints.h"
+#include <algorithm>
 
 /**
  *  Begin of namespace
  */
 namespace DNS {
 
+/**
+ *  Remote lookups are created and destroyed at a very high rate, so they
+ *  are allocated from a thread-local slab instead of via the general
+ *  purpose allocator, making steady-state query submission allocation-free
+ *  @param  size        size of the object to allocate
+ *  @return void*
+ */
+void *RemoteLookup::operator new(size_t size)
+{
+    // all instances have the same size (the class is final), so every
+    // allocation can come from the slab
+    return SlabAllocator<RemoteLookup>::slab().allocate();
+}
+
+/**
+ *  Give the memory back to the slab
+ *  @param  ptr         pointer that came out of operator new
+ */
+void RemoteLookup::operator delete(void *ptr)
+{
+    // back to the slab
+    SlabAllocator<RemoteLookup>::slab().deallocate(ptr);
+}
+
 /**
  *  Constructor
  *  @param  core        dns core object
@@ -31,15 +60,36 @@ namespace DNS {
  *  @param  type        the type of the request
  *  @param  bits        bits to include
  *  @param  handler     user space object
+ *  @param  options     per-lookup timing overrides (or nullptr)
  */
-RemoteLookup::RemoteLookup(Core *core, const char *domain, ns_type type, const Bits &bits, DNS::Handler *handler) : 
-    Lookup(handler, ns_o_query, domain, type, bits), _core(core), _id(rand()) {}
+RemoteLookup::RemoteLookup(Core *core, const char *domain, ns_type type, const Bits &bits, DNS::Handler *handler, const Options *options) :
+    Lookup(handler, core->compile(domain, type, bits), core->dns0x20()), _core(core), _start(Now()),
+    _timeout(options && options->timeout >= 0.0 ? options->timeout : core->timeout()),
+    _interval(options && options->interval >= 0.0 ? options->interval : core->interval()),
+    _attempts(options && options->attempts > 0 ? options->attempts : core->attempts()),
+    _id(Random::instance().draw32()), _key(domain, type)
+{
+    // register in the administration of in-flight lookups, so that identical
+    // queries that are started in the meantime can be coalesced onto this one
+    _core->enlist(domain, type, this);
+}
 
 /**
  *  Destructor
  */
 RemoteLookup::~RemoteLookup()
 {
+    // if there are still coalesced operations attached, the lookup was destructed
+    // while it was in progress, their handlers are informed of the cancellation
+    while (!_coalesced.empty())
+    {
+        // take the first operation out of the list
+        auto *coalesced = _coalesced.front(); _coalesced.pop_front();
+
+        // inform the handler, and destruct the operation (we are the owner)
+        coalesced->abort(); delete coalesced;
+    }
+
     // cleanup the job (note that we have this cleanup-function because we
     // normally want to cleanup _before_ we report back to userspace, because
     // you never know what userspace will do (maybe even destruct the _core pointer),
@@ -48,6 +98,49 @@ RemoteLookup::~RemoteLookup()
     cleanup();
 }
 
+/**
+ *  Attach an extra subscriber for an identical query
+ *  @param  domain      the domain of the lookup
+ *  @param  type        type of records to look for
+ *  @param  bits        the bits to include in the request
+ *  @param  handler     user space object interested in the result
+ *  @return Operation
+ */
+Operation *RemoteLookup::coalesce(const char *domain, int type, const Bits &bits, DNS::Handler *handler)
+{
+    // if the lookup already reported its result it can no longer take subscribers
+    // (this should not happen, completed lookups leave the in-flight administration)
+    if (_handler == nullptr && _coalesced.empty()) return nullptr;
+
+    // constructing the operation could throw
+    try
+    {
+        // create an operation that piggybacks on this lookup
+        auto *result = new CoalescedLookup(this, domain, type, bits, handler);
+
+        // remember it, so that we can fan out our response later
+        _coalesced.push_back(result);
+
+        // expose the operation
+        return result;
+    }
+    catch (...)
+    {
+        // invalid parameters were supplied
+        return nullptr;
+    }
+}
+
+/**
+ *  Remove a coalesced operation (because it was cancelled from user-space)
+ *  @param  lookup      the operation to forget
+ */
+void RemoteLookup::detach(CoalescedLookup *lookup)
+{
+    // remove from the list (the operation destructs itself)
+    _coalesced.remove(lookup);
+}
+
 /**
  *  How many credits are left (meaning: how many datagrams do we still have to send?)
  *  @return size_t      number of attempts
@@ -58,7 +151,7 @@ size_t RemoteLookup::credits() const
     if (_connection) return 0;
     
     // number of attempts left
-    return _core->attempts() > _count ? _core->attempts() - _count : 0;
+    return _attempts > _count ? _attempts - _count : 0;
 }
 
 /**
@@ -69,14 +162,31 @@ size_t RemoteLookup::credits() const
 double RemoteLookup::delay(double now) const
 {
     // if the operation is ready, we should run asap (so that it is removed)
-    // if the operation never ran it should also run immediately
-    if (_count == 0 || _handler == nullptr) return 0.0;
+    // if the operation never ran it should also run immediately (note that we
+    // check _last too: a lookup that could not send because the socket was
+    // saturated has no datagrams out, but should still wait for the interval)
+    if ((_count == 0 && _last == 0.0) || (_handler == nullptr && _coalesced.empty())) return 0.0;
     
     // if already doing a tcp lookup, or when all attemps have passed, we wait until the expire-time
-    if (_connection || _count >= _core->attempts()) return std::max(0.0, _last + _core->timeout() - now);
-    
+    if (_connection || _count >= _attempts) return std::max(0.0, _last + _timeout - now);
+
+    // if the previous attempt was held back by the rate limiter of the
+    // nameserver we only wait until its next token accrues
+    if (_backoff > 0.0) return std::max(_last + _backoff - now, 0.0);
+
+    // the time before the next datagram goes out: preferably derived from the
+    // measured round-trips of the nameserver that we are waiting for, so that
+    // we neither hammer slow resolvers nor sit idle after a real loss, with
+    // the static interval as fallback when there are no measurements yet
+    double interval = _rto > 0.0 ? _rto : _interval;
+
+    // in hedged mode the other nameservers are probed after a much shorter
+    // delay (the first couple of attempts each go to a different server),
+    // so that one slow resolver does not dictate the tail latency
+    if (_core->hedge() > 0.0 && _count < _core->nameservers().size()) interval = std::min(interval, _core->hedge());
+
     // wait until we can send a next datagram
-    return std::max(_last + _core->interval() - now, 0.0);
+    return std::max(_last + interval - now, 0.0);
 }
 
 /**
@@ -95,7 +205,10 @@ Handler *RemoteLookup::cleanup()
     
     // forget the tcp connection
     _connection.reset();
-    
+
+    // we are no longer in flight, so identical queries should no longer attach to us
+    _core->delist(_key.first.data(), _key.second, this);
+
     // unsubscribe from the nameservers
     for (auto &nameserver : _core->nameservers()) nameserver.unsubscribe(this, _query.id());
     
@@ -103,15 +216,58 @@ Handler *RemoteLookup::cleanup()
     return handler;
 }
 
-/** 
+/**
+ *  Count an unanswered attempt in the stats of the nameserver to which
+ *  the latest datagram was sent
+ */
+void RemoteLookup::expired()
+{
+    // find the server back by its ip (it could be gone after a config change)
+    for (auto &nameserver : _core->nameservers())
+    {
+        // skip other servers
+        if (nameserver.ip() != _target) continue;
+
+        // count the unanswered attempt
+        nameserver.stats().timeout(); return;
+    }
+}
+
+/**
  *  Time out the job because no appropriate response was received in time
  *  @return bool        should the lookup be resheduled?
  */
 bool RemoteLookup::timeout()
 {
+    // tracepoint: this lookup gave up
+    DNSCPP_PROBE3(lookup_timeout, _key.first.data(), _key.second, _count);
+
+    // timed-out lookups always go to the slow-lookup log
+    _core->slowlog(_key.first.data(), _key.second, _count > 0 ? &_target : nullptr, _count, Now() - _start);
+
+    // the final attempt went unanswered too, count it in the stats of its
+    // server (unless we were waiting for tcp: the last datagram did get
+    // an answer then, albeit a truncated one)
+    if (_count > 0 && !_connection) expired();
+
+    // the coalesced operations are informed first, the call to our own handler
+    // comes last because userspace may destruct everything
+    while (!_coalesced.empty())
+    {
+        // take the first operation out of the list
+        auto *coalesced = _coalesced.front(); _coalesced.pop_front();
+
+        // inform the handler, and destruct the operation (we are the owner)
+        coalesced->expire(); delete coalesced;
+    }
+
     // before we report to userspace we cleanup the object
-    cleanup()->onTimeout(this);
-    
+    auto *handler = cleanup();
+
+    // report to userspace (the handler could be gone if the original caller
+    // cancelled while coalesced operations were still attached)
+    if (handler) handler->onTimeout(this);
+
     // done (we do not have to run again)
     return false;
 }
@@ -123,46 +279,113 @@ bool RemoteLookup::timeout()
  */
 bool RemoteLookup::execute(double now)
 {
-    // if the result has already been reported to user-space, we do not have to do anything
-    if (_handler == nullptr) return false;
+    // if the result has already been reported to user-space (and no coalesced
+    // operations are waiting either), we do not have to do anything
+    if (_handler == nullptr && _coalesced.empty()) return false;
     
     // when job times out
-    if ((_connection || _count >= _core->attempts()) && now > _last + _core->timeout()) return timeout();
+    if ((_connection || _count >= _attempts) && now > _last + _timeout) return timeout();
 
     // if we reached the max attempts we stop sending out more datagrams, but we keep active
-    if (_count >= _core->attempts()) return true;
+    if (_count >= _attempts) return true;
     
     // if the operation is already using tcp we simply wait for that
     if (_connection) return true;
 
-    // access to the nameservers + the number we have
+    // check if a specific route applies to this domain (split-horizon setups
+    // send internal zones to internal resolvers only)
+    auto *route = _core->route(_key.first.data());
+
+    // access to the nameservers
     auto &nameservers = _core->nameservers();
-    size_t nscount = nameservers.size();
-    
+
+    // number of nameservers that may be used for this query
+    size_t nscount = 0;
+
+    // count the usable nameservers
+    for (auto &nameserver : nameservers)
+    {
+        // skip nameservers that are not part of the route
+        if (route && std::find(route->begin(), route->end(), nameserver.ip()) == route->end()) continue;
+
+        // one more usable nameserver
+        nscount += 1;
+    }
+
     // what if there are no nameservers?
     if (nscount == 0) return timeout();
 
     // which nameserver should we sent now?
     size_t target = _core->rotate() ? (_count + _id) % nscount : _count % nscount;
-    
+
+    // in weighted mode the first attempt goes to the server with the best
+    // recent latency/loss score, so that a degraded server no longer gets
+    // its rotation-share of first attempts; retries keep using the rotation
+    // above so that they spread over the other servers, and a small
+    // exploration fraction (one in sixteen lookups) sticks to rotation so
+    // that a recovered server can earn its score back
+    if (_core->weighted() && _count == 0 && _id % 16 != 0)
+    {
+        // best score seen so far, and the index of the candidate
+        double best = 0.0; size_t candidate = 0;
+
+        // compare all usable nameservers
+        for (auto &nameserver : nameservers)
+        {
+            // skip nameservers that are not part of the route
+            if (route && std::find(route->begin(), route->end(), nameserver.ip()) == route->end()) continue;
+
+            // the score of this server (lower is better)
+            double score = nameserver.score();
+
+            // is this the best server so far?
+            if (best == 0.0 || score < best) { best = score; target = candidate; }
+
+            // on to the next usable server
+            candidate += 1;
+        }
+    }
+
     // iterator for the next loop
     size_t i = 0;
-    
+
     // send a datagram to each nameserver
     for (auto &nameserver : nameservers)
     {
+        // skip nameservers that are not part of the route
+        if (route && std::find(route->begin(), route->end(), nameserver.ip()) == route->end()) continue;
+
         // is this the target nameserver? (we use ++ postfix operator on purpose)
         if (target != i++) continue;
-        
-        // send a datagram to this server
-        nameserver.datagram(_query);
-        
+
+        // send a datagram to this server, if the query is refused we do not
+        // burn an attempt: when the rate limiter held it back we retry the
+        // moment the next token accrues, and when the socket (plus backlog)
+        // was saturated we retry after the normal interval so that the
+        // send-pressure can drain first
+        if (!nameserver.datagram(_query)) { _backoff = nameserver.available(now); _last = now; return true; }
+
+        // a datagram beyond the first is a retransmission, and means that
+        // the previous attempt went unanswered, count both in the stats
+        if (_count > 0) { nameserver.stats().retransmitted(); expired(); }
+
+        // remember the target so that an unanswered attempt can later be
+        // attributed to the right server
+        _target = nameserver.ip();
+
+        // the attempt went out, so there is no backoff to respect
+        _backoff = 0.0;
+
         // in the first iteration we have not yet subscribed
         if (_count < nscount) nameserver.subscribe(this, _query.id());
 
+        // capture the adaptive retransmission timeout of this server now,
+        // so that delay() does not have to find the server back later
+        _rto = nameserver.rto();
+
         // one more message has been sent
         _count += 1; _last = now;
-        
+
         // for now we do not yet send the next message
         break;
     }
@@ -179,28 +402,68 @@ bool RemoteLookup::execute(double now)
  */
 void RemoteLookup::report(const Response &response)
 {
-    // if the result has already been reported, we do nothing here
-    if (_handler == nullptr) return;
-    
-    // for NXDOMAIN errors we need special treatment (maybe the hostname _does_ exists in 
+    // if the result has already been reported (and no coalesced operations
+    // are waiting either), we do nothing here
+    if (_handler == nullptr && _coalesced.empty()) return;
+
+    // tracepoint: this lookup got its answer
+    DNSCPP_PROBE3(lookup_complete, _key.first.data(), _key.second, _count);
+
+    // time since the lookup was started
+    double elapsed = Now() - _start;
+
+    // lookups that crossed the threshold go to the slow-lookup log
+    if (_core->slow() > 0.0 && elapsed >= _core->slow()) _core->slowlog(_key.first.data(), _key.second, _count > 0 ? &_target : nullptr, _count, elapsed);
+
+    // store the response in the cache(s), so that identical queries that are
+    // started in the near future can be answered from memory (the caches check
+    // themselves whether the response is cacheable at all)
+    _core->store(Now(), response);
+
+    // for NXDOMAIN errors we need special treatment (maybe the hostname _does_ exists in
     // /etc/hosts?) For all other type of results the message can be passed to userspace
-    if (response.rcode() != ns_r_nxdomain) return cleanup()->onReceived(this, response);
+    if (response.rcode() != ns_r_nxdomain) return distribute(response);
 
     // extract the original question, to find out the host for which we were looking
     Question question(response);
-    
+
     // there was a NXDOMAIN error, which we should not communicate if our /etc/hosts
     // file does have a record for this hostname, check this
-    if (!_core->exists(question.name())) return cleanup()->onReceived(this, response);
-    
+    if (!_core->exists(question.name())) return distribute(response);
+
     // get the original request (so that the response can match the request)
     Request request(this);
-    
+
     // construct a fake-response message (it is fake because we have not actually received it)
     FakeResponse fake(request, question);
 
     // send the fake-response to user-space
-    cleanup()->onReceived(this, Response(fake.data(), fake.size()));
+    distribute(Response(fake.data(), fake.size()));
+}
+
+/**
+ *  Hand a response over to all coalesced operations and to our own handler
+ *  @param  response
+ */
+void RemoteLookup::distribute(const Response &response)
+{
+    // the coalesced operations are informed first, the call to our own handler
+    // comes last because userspace may destruct everything
+    while (!_coalesced.empty())
+    {
+        // take the first operation out of the list
+        auto *coalesced = _coalesced.front(); _coalesced.pop_front();
+
+        // inform the handler, and destruct the operation (we are the owner)
+        coalesced->notify(response); delete coalesced;
+    }
+
+    // before we report to userspace we cleanup the object
+    auto *handler = cleanup();
+
+    // report to userspace (the handler could be gone if the original caller
+    // cancelled while coalesced operations were still attached)
+    if (handler) handler->onReceived(this, response);
 }
 
 /**
@@ -217,12 +480,22 @@ bool RemoteLookup::onReceived(Nameserver *nameserver, const Response &response)
     
     // if we're already busy with a tcp connection we ignore further dgram responses
     if (_connection) return false;
-    
+
+    // if the query went out exactly once the response unambiguously answers
+    // that one datagram, and the round-trip is a valid sample for the
+    // retransmission timeout of this server (karn's algorithm: responses to
+    // retransmitted queries could belong to any of the copies, we skip those)
+    if (_count == 1 && _last > 0.0) nameserver->measure(Now() - _last);
+
     // if the response was not truncated, we can report it to userspace
     if (!response.truncated()) { report(response); return true; }
 
-    // switch to tcp mode to retry the query to get a non-truncated response
-    _connection.reset(new Connection(_core->loop(), nameserver->ip(), _query, response, this));
+    // count the truncated response in the stats of the server
+    nameserver->stats().truncated();
+
+    // switch to tcp mode to retry the query to get a non-truncated response,
+    // the query is pipelined over the persistent connection of the nameserver
+    _connection.reset(new Connection(nameserver->pipeline(), _query, response, this));
     
     // remember the start-time of the connection to reset the timeout-period
     _last = Now();
@@ -238,8 +511,8 @@ bool RemoteLookup::onReceived(Nameserver *nameserver, const Response &response)
  */
 void RemoteLookup::onReceived(Connection *connection, const Response &response)
 {
-    // if the operation was already cancelled
-    if (_handler == nullptr) return;
+    // if the operation was already cancelled (and nobody coalesced onto it)
+    if (_handler == nullptr && _coalesced.empty()) return;
 
     // ignore responses that do not match with the query
     // @todo should we check for more? like whether the response is indeed a response
@@ -256,11 +529,11 @@ void RemoteLookup::onReceived(Connection *connection, const Response &response)
  */
 void RemoteLookup::onFailure(Connection *connection, const Response &truncated)
 {
-    // if the operation was already cancelled
-    if (_handler == nullptr) return;
-    
+    // if the operation was already cancelled (and nobody coalesced onto it)
+    if (_handler == nullptr && _coalesced.empty()) return;
+
     // we failed to get the regular response, so we send back the truncated response
-    cleanup()->onReceived(this, truncated);
+    distribute(truncated);
 }
 
 /**
@@ -270,9 +543,19 @@ void RemoteLookup::cancel()
 {
     // do nothing if already cancelled
     if (_handler == nullptr) return;
-    
-    // cleanup, and remove to userspace
-    cleanup()->onCancelled(this);
+
+    // if no other callers coalesced onto this lookup we can tear it down
+    if (_coalesced.empty()) return cleanup()->onCancelled(this);
+
+    // other callers are still interested in the response, so the lookup keeps
+    // running, we only detach and inform the original caller
+    auto *handler = _handler;
+
+    // forget the handler
+    _handler = nullptr;
+
+    // report back to user-space
+    handler->onCancelled(this);
 }
 
 /**
@@ -22,6 +22,7 @@
 #include "../include/dnscpp/lookup.h"
 #include "../include/dnscpp/request.h"
 #include "../include/dnscpp/bits.h"
+#include "../include/dnscpp/options.h"
 #include "../include/dnscpp/now.h"
 #include "connection.h"
 
@@ -35,11 +36,12 @@ namespace DNS {
  */
 class Core;
 class Handler;
+class CoalescedLookup;
 
 /**
  *  Class definition
  */
-class RemoteLookup : public Lookup, private Nameserver::Handler, private Connection::Handler
+class RemoteLookup final : public Lookup, private Nameserver::Handler, private Connection::Handler
 {
 private:
     /**
@@ -48,6 +50,23 @@ private:
      */
     Core *_core;
 
+    /**
+     *  When was the lookup started? (used by the slow-lookup log)
+     *  @var double
+     */
+    double _start;
+
+    /**
+     *  The timing knobs of this lookup, captured at construction from
+     *  the core settings or from the per-lookup overrides (so that an
+     *  interactive lookup can run with a tighter budget than the batch
+     *  lookups on the same context)
+     *  @var double / size_t
+     */
+    double _timeout;
+    double _interval;
+    size_t _attempts;
+
     /**
      *  When was the last time that the job ran?
      *  @var double
@@ -65,6 +84,39 @@ private:
      *  @var size_t
      */
     size_t _id;
+
+    /**
+     *  The retransmission timeout of the nameserver to which the latest
+     *  datagram was sent, captured at send-time (0.0 when that server has
+     *  no round-trip measurements yet, the static interval applies then)
+     *  @var double
+     */
+    double _rto = 0.0;
+
+    /**
+     *  When the latest attempt was refused by the rate limiter of the
+     *  nameserver, this holds the time until its next token accrues, so
+     *  that we retry exactly then instead of after a full interval (0.0
+     *  when the attempt was sent, or refused for a different reason)
+     *  @var double
+     */
+    double _backoff = 0.0;
+
+    /**
+     *  The ip of the nameserver to which the latest datagram was sent,
+     *  so that an attempt that goes unanswered can be counted in the
+     *  stats of the right server (we store the ip and not a pointer,
+     *  because the nameserver could be removed on a config change)
+     *  @var Ip
+     */
+    Ip _target;
+
+    /**
+     *  The domain and record-type of the query, used as key in the core's
+     *  administration of in-flight lookups
+     *  @var std::pair<std::string,uint16_t>
+     */
+    std::pair<std::string,uint16_t> _key;
     
     /**
      *  If we got a truncated response, we start a tcp connection to get the full response
@@ -72,6 +124,13 @@ private:
      */
     std::unique_ptr<Connection> _connection;
 
+    /**
+     *  Operations for identical queries that were started while this lookup
+     *  was already in flight, the single response is fanned out to all of them
+     *  @var std::list<CoalescedLookup*>
+     */
+    std::list<CoalescedLookup*> _coalesced;
+
     /**
      *  Method that is called when a dgram response is received
      *  @param  nameserver  the reporting nameserver
@@ -106,12 +165,18 @@ private:
      */
     double expires() const;
 
-    /** 
+    /**
      *  Time out the job because no appropriate response was received in time
      *  @return bool
      */
     bool timeout();
 
+    /**
+     *  Count an unanswered attempt in the stats of the nameserver to
+     *  which the latest datagram was sent
+     */
+    void expired();
+
     /**
      *  Wait for internal buffers to catch up (dns-cpp uses an internal buffer
      *  that may hold the response, but that is not yet parsed)
@@ -139,6 +204,12 @@ private:
      */
     void report(const Response &response);
 
+    /**
+     *  Hand a response over to all coalesced operations and to our own handler
+     *  @param  response
+     */
+    void distribute(const Response &response);
+
     /**
      *  Cleanup the object
      *  @return Handler
@@ -157,6 +228,21 @@ private:
     virtual void cancel() override;
 
 public:
+    /**
+     *  Remote lookups are created and destroyed at a very high rate, so
+     *  they are allocated from a thread-local slab instead of via the
+     *  general purpose allocator
+     *  @param  size        size of the object to allocate
+     *  @return void*
+     */
+    static void *operator new(size_t size);
+
+    /**
+     *  Give the memory back to the slab
+     *  @param  ptr         pointer that came out of operator new
+     */
+    static void operator delete(void *ptr);
+
     /**
      *  Constructor
      *  @param  core        dns core object
@@ -164,8 +250,10 @@ public:
      *  @param  type        type of records to look for
      *  @param  bits        the bits to include in the request
      *  @param  handler     user space object interested in the result
+     *  @param  options     per-lookup timing overrides (or nullptr for
+     *                      the context-wide settings)
      */
-    RemoteLookup(Core *core, const char *domain, ns_type type, const Bits &bits, DNS::Handler *handler);
+    RemoteLookup(Core *core, const char *domain, ns_type type, const Bits &bits, DNS::Handler *handler, const Options *options = nullptr);
     
     /**
      *  No copying
@@ -178,6 +266,22 @@ public:
      */
     virtual ~RemoteLookup();
 
+    /**
+     *  Attach an extra subscriber for an identical query, so that no second
+     *  datagram has to go out on the wire (returns nullptr on failure)
+     *  @param  domain      the domain of the lookup
+     *  @param  type        type of records to look for
+     *  @param  bits        the bits to include in the request
+     *  @param  handler     user space object interested in the result
+     *  @return Operation   the operation that the extra caller can interact with
+     */
+    Operation *coalesce(const char *domain, int type, const Bits &bits, DNS::Handler *handler);
+
+    /**
+     *  Remove a coalesced operation (because it was cancelled from user-space)
+     *  @param  lookup      the operation to forget
+     */
+    void detach(CoalescedLookup *lookup);
 };
 
 /**
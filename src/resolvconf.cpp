@@ -15,6 +15,9 @@
 #include <ctype.h>
 #include <fstream>
 #include <iostream>
+#include <sys/stat.h>
+#include <mutex>
+#include <map>
 
 /**
  *  Begin of namespace
@@ -75,6 +78,66 @@ static size_t check(const char *line, size_t size, const char *required)
  *  @throws std::runtime_error
  */
 ResolvConf::ResolvConf(const char *filename, bool strict)
+{
+    // an already parsed copy of a file, plus the stat-info that tells us
+    // whether the file changed since it was parsed
+    struct Entry {
+        time_t mtime;
+        off_t size;
+        ResolvConf settings;
+    };
+
+    // the process-wide cache of parsed files and the mutex protecting it
+    // (contexts could be constructed from multiple threads)
+    static std::mutex mutex;
+    static std::map<std::string,Entry> cache;
+
+    // stat the file so that we can validate a cached copy
+    struct stat info;
+    bool stated = stat(filename, &info) == 0;
+
+    // check the cache (an unstattable file skips the cache and fails below)
+    if (stated)
+    {
+        // the cache is shared between threads
+        std::unique_lock<std::mutex> lock(mutex);
+
+        // do we have an up-to-date copy of this very file?
+        auto iter = cache.find(filename);
+
+        // if so we are done with a plain copy instead of a parse
+        if (iter != cache.end() && iter->second.mtime == info.st_mtime && iter->second.size == info.st_size)
+        {
+            // take over the cached settings
+            *this = iter->second.settings; return;
+        }
+    }
+
+    // no valid copy, open and parse the actual file (could throw)
+    load(filename, strict);
+
+    // keep the parsed settings around for the next construction
+    if (stated)
+    {
+        // the cache is shared between threads
+        std::unique_lock<std::mutex> lock(mutex);
+
+        // update the existing slot, or install a new one (no operator[],
+        // because default-constructing an entry would parse the file again)
+        auto iter = cache.find(filename);
+        if (iter != cache.end()) { iter->second.mtime = info.st_mtime; iter->second.size = info.st_size; iter->second.settings = *this; }
+        else cache.emplace(filename, Entry{ info.st_mtime, info.st_size, *this });
+    }
+}
+
+/**
+ *  Open and parse the configuration file (the slow path, only taken when
+ *  the process-wide cache holds no up-to-date copy of the file)
+ *  @param  filename        the file to parse
+ *  @param  strict          run in strict mode (do not allow unsupported options)
+ *  @throws std::runtime_error
+ */
+void ResolvConf::load(const char *filename, bool strict)
 {
     // open the file for reading
     std::ifstream stream(filename);
@@ -152,8 +215,15 @@ void ResolvConf::nameserver(const char *line, size_t size)
  */
 void ResolvConf::domain(const char *line, size_t size)
 {
-    // report error
-    throw std::runtime_error(std::string("not implemented: domain ") + line);
+    // "domain" is the historic single-entry variant of "search", the two
+    // lines override each other and the last one in the file wins
+    _searchpaths.clear();
+
+    // skip empty values
+    if (size == 0) return;
+
+    // the single domain is the whole search list (minus a trailing dot)
+    _searchpaths.emplace_back(line, line[size-1] == '.' ? size - 1 : size);
 }
 
 /**
@@ -164,8 +234,25 @@ void ResolvConf::domain(const char *line, size_t size)
  */
 void ResolvConf::search(const char *line, size_t size)
 {
-    // report error
-    throw std::runtime_error(std::string("not implemented: search ") + line);
+    // a new "search" line overrides an earlier "search" or "domain" line
+    _searchpaths.clear();
+
+    // iterate over the whitespace-separated domains
+    for (size_t start = 0; start < size; )
+    {
+        // skip leading whitespace
+        if (isspace(line[start])) { ++start; continue; }
+
+        // find the end of this domain
+        size_t end = start;
+        while (end < size && !isspace(line[end])) ++end;
+
+        // store the domain (minus a trailing dot)
+        _searchpaths.emplace_back(line + start, line[end-1] == '.' ? end - start - 1 : end - start);
+
+        // proceed with the next domain
+        start = end;
+    }
 }
 
 /**
@@ -214,6 +301,9 @@ void ResolvConf::option(const char *option, size_t size)
     // maybe this is the attempts option? parse it and cap it to 5.
     else if (strncmp(option, "attempts:", 9) == 0) _attempts = std::min(5, atoi(option + 9));
 
+    // maybe this is the ndots option? parse it and cap it to 15 (per the conf)
+    else if (strncmp(option, "ndots:", 6) == 0) _ndots = std::min(15, atoi(option + 6));
+
     // unknown option...
 }
   
@@ -0,0 +1,349 @@
+/**
+ *  Searcher.h
+ *
+ *  Internal operation that implements search-domain expansion: when a
+ *  query is made for a short hostname (fewer dots than the "ndots"
+ *  setting), the name is completed with each of the configured search
+ *  domains, and all candidates are probed concurrently. The candidate
+ *  lookups leave in one batch so they share one deadline, and the first
+ *  positive answer wins: the other candidates are then cancelled. When
+ *  every candidate fails, the failure is reported once.
+ *
+ *  This is not a user-space class: Context::query() constructs it
+ *  transparently, and to user-space it is just the Operation that was
+ *  returned. Like the other lookups it destructs itself after the
+ *  result has been reported.
+ *
+ *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include "../include/dnscpp/context.h"
+#include "../include/dnscpp/operation.h"
+#include "../include/dnscpp/handler.h"
+#include "../include/dnscpp/response.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Class definition
+ */
+class Searcher : public Operation, private DNS::Handler
+{
+private:
+    /**
+     *  The record type that is looked up
+     *  @var ns_type
+     */
+    ns_type _type;
+
+    /**
+     *  Bits to include in the candidate queries
+     *  @var Bits
+     */
+    Bits _bits;
+
+    /**
+     *  The candidate names (the name completed with each search domain,
+     *  plus the literal name), all made absolute with a trailing dot so
+     *  that the candidate lookups are not expanded again
+     *  @var std::vector<std::string>
+     */
+    std::vector<std::string> _candidates;
+
+    /**
+     *  Handles of the candidate lookups that are under way (finished
+     *  lookups are set to nullptr)
+     *  @var std::vector<Operation*>
+     */
+    std::vector<Operation*> _lookups;
+
+    /**
+     *  Number of candidate lookups that have not yet completed
+     *  @var size_t
+     */
+    size_t _pending = 0;
+
+    /**
+     *  Are the candidates still being launched? (during start-up a
+     *  synchronously completing lookup reports before its handle is
+     *  even stored, and the conclusion is postponed)
+     *  @var bool
+     */
+    bool _starting = true;
+
+    /**
+     *  The first positive answer that came in
+     *  @var std::unique_ptr<Response>
+     */
+    std::unique_ptr<Response> _response;
+
+    /**
+     *  The rcode of the most recent failure
+     *  @var int
+     */
+    int _rcode = ns_r_servfail;
+
+    /**
+     *  Mark one of the candidate lookups as finished
+     *  @param  operation   the lookup that finished
+     *  @return bool        was this indeed one of our pending lookups?
+     */
+    bool finish(const Operation *operation)
+    {
+        // during start-up the reporting lookup is the one that is being
+        // launched right now, its handle was not even stored yet
+        if (_starting) { --_pending; return true; }
+
+        // find the handle
+        for (auto &lookup : _lookups)
+        {
+            // skip the other lookups
+            if (lookup != operation) continue;
+
+            // forget the handle
+            lookup = nullptr; --_pending; return true;
+        }
+
+        // a lookup that we already gave up on (this happens for the
+        // onCancelled() call that follows our own call to cancel())
+        return false;
+    }
+
+    /**
+     *  Conclude the operation: report the result and self-destruct
+     */
+    void conclude()
+    {
+        // the candidates that are still under way are no longer interesting
+        if (_pending > 0)
+        {
+            // take over the handles first, so that the synchronous
+            // onCancelled() callbacks that follow are ignored
+            std::vector<Operation*> lookups; lookups.swap(_lookups); _pending = 0;
+
+            // cancel what is still pending
+            for (auto *lookup : lookups) { if (lookup) lookup->cancel(); }
+        }
+
+        // forget the handler, the report is the very last thing we do
+        auto *handler = _handler; _handler = nullptr;
+
+        // report the winning answer, or the failure when all candidates failed
+        if (_response) handler->onResolved(this, *_response);
+        else handler->onFailure(this, _rcode);
+
+        // the operation is no longer needed
+        delete this;
+    }
+
+    /**
+     *  Called when one of the candidates succeeded
+     *  @param  operation   the lookup that finished
+     *  @param  response    the received response
+     */
+    virtual void onResolved(const Operation *operation, const Response &response) override
+    {
+        // forget the lookup (leap out for lookups we already gave up on)
+        if (!finish(operation)) return;
+
+        // the first positive answer is the one that is reported
+        if (!_response) _response.reset(new Response(response));
+
+        // during start-up the conclusion waits until all candidates are launched
+        if (_starting) return;
+
+        // a positive answer concludes the operation
+        conclude();
+    }
+
+    /**
+     *  Called when one of the candidates failed
+     *  @param  operation   the lookup that finished
+     *  @param  rcode       the received rcode
+     */
+    virtual void onFailure(const Operation *operation, int rcode) override
+    {
+        // forget the lookup (leap out for lookups we already gave up on)
+        if (!finish(operation)) return;
+
+        // remember the failure
+        _rcode = rcode;
+
+        // during start-up the conclusion waits until all candidates are launched
+        if (_starting) return;
+
+        // conclude when this was the last candidate
+        if (_pending == 0) conclude();
+    }
+
+    /**
+     *  Called when one of the candidates was cancelled behind our back
+     *  (for example via Context::cancel_many())
+     *  @param  operation   the lookup that was cancelled
+     */
+    virtual void onCancelled(const Operation *operation) override
+    {
+        // forget the lookup (leap out for lookups we already gave up on)
+        if (!finish(operation)) return;
+
+        // conclude when there is nothing left to wait for
+        if (!_starting && _pending == 0) conclude();
+    }
+
+    /**
+     *  Private destructor, the object destructs itself
+     */
+    virtual ~Searcher() = default;
+
+public:
+    /**
+     *  Constructor. This merely builds the candidate list, the actual
+     *  lookups are launched by start() (reporting "delete this" from
+     *  inside a constructor is not allowed, and in synchronous mode a
+     *  candidate could complete immediately)
+     *  @param  context     the context with the search-domain settings
+     *  @param  domain      the short hostname to expand
+     *  @param  type        record type to look up
+     *  @param  bits        bits to include in the queries
+     *  @param  handler     user space handler
+     *  @throws std::runtime_error
+     */
+    Searcher(Context *context, const char *domain, ns_type type, const Bits &bits, DNS::Handler *handler) :
+        Operation(handler, ns_o_query, domain, type, bits), _type(type), _bits(bits)
+    {
+        // the name completed with each of the search domains
+        for (const auto &path : context->searchpaths())
+        {
+            // skip nonsensical empty entries
+            if (path.empty()) continue;
+
+            // add the completed candidate
+            _candidates.push_back(std::string(domain) + "." + path + ".");
+        }
+
+        // the literal name is probed too, it comes last because a name
+        // with few dots is more likely meant relative to a search domain
+        _candidates.push_back(std::string(domain) + ".");
+    }
+
+    /**
+     *  No copying
+     *  @param  that
+     */
+    Searcher(const Searcher &that) = delete;
+
+    /**
+     *  Check whether a query-name qualifies for search-domain expansion
+     *  @param  domain      the name that is being looked up
+     *  @param  searchpaths the configured search domains
+     *  @param  ndots       the ndots setting
+     *  @return bool        should the name be expanded?
+     */
+    static bool applicable(const char *domain, const std::vector<std::string> &searchpaths, size_t ndots)
+    {
+        // without search domains there is nothing to expand with
+        if (searchpaths.empty()) return false;
+
+        // empty names are left to the regular code path
+        if (domain == nullptr || *domain == '\0') return false;
+
+        // count the dots in the name
+        size_t dots = 0; size_t length = 0;
+        for (const char *c = domain; *c; ++c, ++length) { if (*c == '.') ++dots; }
+
+        // absolute names (trailing dot) are never expanded
+        if (domain[length-1] == '.') return false;
+
+        // names with at least ndots dots are considered fully qualified
+        return dots < ndots;
+    }
+
+    /**
+     *  Launch the candidate lookups. The candidates leave in one batch,
+     *  so they share one deadline
+     *  @param  context     the context that performs the lookups
+     *  @param  options     per-lookup timing overrides (or nullptr)
+     *  @param  urgent      is this a latency-critical lookup?
+     *  @return Operation   the handle that is exposed to user-space
+     */
+    Operation *start(Context *context, const Options *options, bool urgent)
+    {
+        // launch all candidates
+        for (const auto &candidate : _candidates)
+        {
+            // the count before the launch, so that a lookup that completes
+            // synchronously (hosts-file or cache hit) is detectable
+            size_t pending = _pending;
+
+            // the callback could come before the call below returns
+            ++_pending;
+
+            // launch the candidate (could fail for oversized names)
+            auto *lookup = options == nullptr ?
+                context->query(candidate.c_str(), _type, _bits, static_cast<DNS::Handler*>(this), urgent) :
+                context->query(candidate.c_str(), _type, _bits, *options, static_cast<DNS::Handler*>(this), urgent);
+
+            // failed launches do not count
+            if (lookup == nullptr) { --_pending; continue; }
+
+            // when the lookup already completed synchronously the callback
+            // has restored the old count, the handle must then not be stored
+            if (_pending == pending) continue;
+
+            // remember the handle so that the lookup can be cancelled later
+            _lookups.push_back(lookup);
+        }
+
+        // the start-up phase is over
+        _starting = false;
+
+        // conclude right away when a candidate already answered, or when
+        // nothing is pending (everything failed, or no candidate could
+        // even be launched)
+        if (_response != nullptr || _pending == 0) conclude();
+
+        // expose the handle (when the operation concluded synchronously
+        // the result was already delivered, just like any other lookup
+        // that completes during the call)
+        return this;
+    }
+
+    /**
+     *  Cancel the operation, all pending candidate lookups are cancelled
+     */
+    virtual void cancel() override
+    {
+        // take over the handles first, so that the synchronous
+        // onCancelled() callbacks that follow are ignored
+        std::vector<Operation*> lookups; lookups.swap(_lookups); _pending = 0;
+
+        // cancel the lookups that are still under way
+        for (auto *lookup : lookups) { if (lookup) lookup->cancel(); }
+
+        // let the base class report the cancellation to user-space
+        Operation::cancel();
+
+        // unlike scheduler-owned lookups nobody else cleans us up
+        delete this;
+    }
+};
+
+/**
+ *  End of namespace
+ */
+}
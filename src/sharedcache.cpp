@@ -0,0 +1,286 @@
+/**
+ *  SharedCache.cpp
+ *
+ *  Implementation file for the SharedCache class
+ *
+ *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Dependencies
+ */
+#include "../include/dnscpp/sharedcache.h"
+#include "../include/dnscpp/response.h"
+#include "../include/dnscpp/question.h"
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <strings.h>
+#include <string.h>
+#include <ctype.h>
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Helper function to hash a hostname + record-type to a number
+ *  The hostname is hashed without looking at case, because dns names
+ *  are case-insensitive (fnv-1a over the lowercased characters)
+ *  @param  hostname    the hostname
+ *  @param  type        the record-type
+ *  @return uint32_t
+ */
+static uint32_t hash(const char *hostname, uint16_t type)
+{
+    // the fnv-1a offset-basis
+    uint32_t result = 2166136261u;
+
+    // mix in all characters of the hostname
+    for (const char *c = hostname; *c; ++c)
+    {
+        // mix in the lowercased character
+        result = (result ^ (uint8_t)tolower(*c)) * 16777619u;
+    }
+
+    // mix in both bytes of the type
+    result = (result ^ (type >> 8)) * 16777619u;
+    result = (result ^ (type & 0xff)) * 16777619u;
+
+    // done
+    return result;
+}
+
+/**
+ *  Constructor
+ *  @param  name        name of the segment (e.g. "/dnscpp-cache")
+ *  @param  slots       number of slots in the table (only relevant for the creator)
+ *  @param  writer      is this instance the single designated writer?
+ *  @throws std::runtime_error
+ */
+SharedCache::SharedCache(const char *name, size_t slots, bool writer) : _writer(writer)
+{
+    // open (or create) the shared memory segment
+    int fd = shm_open(name, O_RDWR | O_CREAT, 0600);
+
+    // check for failure
+    if (fd < 0) throw std::runtime_error(std::string(name) + ": failed to open shared memory segment");
+
+    // the size that we want the segment to have
+    size_t size = sizeof(Header) + slots * sizeof(Slot);
+
+    // check the current size of the segment (maybe some other process already created it)
+    struct stat info;
+
+    // if the segment cannot even be inspected we cannot trust it
+    if (fstat(fd, &info) != 0)
+    {
+        // cleanup and report
+        ::close(fd);
+
+        // report the error
+        throw std::runtime_error(std::string(name) + ": failed to inspect shared memory segment");
+    }
+
+    // if the segment is still empty we have to size it now
+    if (info.st_size == 0 && ftruncate(fd, size) != 0)
+    {
+        // sizing failed, cleanup and report
+        ::close(fd);
+
+        // report the error
+        throw std::runtime_error(std::string(name) + ": failed to size shared memory segment");
+    }
+
+    // if another process already created the segment we adopt its size
+    if (info.st_size > 0) size = info.st_size;
+
+    // map the segment into our address space
+    void *address = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    // the descriptor is no longer needed, the mapping stays valid without it
+    ::close(fd);
+
+    // check for failure
+    if (address == MAP_FAILED) throw std::runtime_error(std::string(name) + ": failed to map shared memory segment");
+
+    // store the mapping
+    _header = (Header *)address;
+    _size = size;
+
+    // if the header was not yet initialized, we do that now (this is safe because
+    // a freshly created segment is all zeroes, and all processes would write the
+    // exact same values anyway)
+    if (_header->magic == 0)
+    {
+        // fill in the number of slots first, and only then the magic
+        _header->slots = (size - sizeof(Header)) / sizeof(Slot);
+        _header->magic = MAGIC;
+    }
+
+    // if the segment holds something else we do not want to touch it
+    if (_header->magic != MAGIC)
+    {
+        // cleanup the mapping
+        munmap(_header, _size);
+
+        // report the error
+        throw std::runtime_error(std::string(name) + ": shared memory segment has unexpected layout");
+    }
+}
+
+/**
+ *  Destructor
+ */
+SharedCache::~SharedCache()
+{
+    // remove the mapping (the segment itself stays alive for the other processes)
+    if (_header) munmap(_header, _size);
+}
+
+/**
+ *  Get access to the slot that may hold a certain question
+ *  @param  hostname    the hostname
+ *  @param  type        the record-type
+ *  @return Slot
+ */
+SharedCache::Slot *SharedCache::slot(const char *hostname, uint16_t type) const
+{
+    // the table starts right after the header
+    auto *slots = (Slot *)(_header + 1);
+
+    // the table is direct-mapped: one possible slot per question
+    return slots + hash(hostname, type) % _header->slots;
+}
+
+/**
+ *  Look for a cached response for a certain hostname and record-type
+ *  @param  now         current time
+ *  @param  hostname    the hostname to look for
+ *  @param  type        the record-type
+ *  @param  buffer      buffer in which the response is stored
+ *  @param  expires     on success the expire-time of the entry is stored here
+ *  @return bool        was a still-valid response found?
+ */
+bool SharedCache::find(double now, const char *hostname, uint16_t type, std::vector<unsigned char> &buffer, double &expires) const
+{
+    // size of the hostname
+    size_t namesize = strlen(hostname);
+
+    // hostnames that do not even fit in a slot can never match
+    if (namesize > sizeof(Slot().name)) return false;
+
+    // get the applicable slot
+    auto *entry = slot(hostname, type);
+
+    // a seqlock-read may have to be retried when the writer interferes, but
+    // we do not want to spin forever, a couple of attempts is more than enough
+    for (size_t attempt = 0; attempt < 3; ++attempt)
+    {
+        // read the sequence counter before we touch the data
+        uint32_t before = entry->sequence;
+
+        // if the counter is odd the writer is busy with this very slot
+        if (before & 1) continue;
+
+        // copy the interesting properties to the local stack
+        double slotexpires = entry->expires;
+        uint16_t slottype = entry->type;
+        uint16_t slotnamesize = entry->namesize;
+        uint16_t slotsize = entry->size;
+
+        // copy the name and response data too (the checks come after the copy,
+        // because the writer may change the slot under our feet at any moment)
+        char name[sizeof(Slot().name)];
+        memcpy(name, (const void *)entry->name, sizeof(name));
+
+        // copy the response
+        buffer.assign(entry->buffer, entry->buffer + std::min(slotsize, (uint16_t)sizeof(Slot().buffer)));
+
+        // if the counter changed in the meantime our copies are garbage, retry
+        if (entry->sequence != before) continue;
+
+        // the copies are consistent, now check whether the slot actually holds our question
+        if (slotsize == 0 || slottype != type || slotnamesize != namesize) return false;
+
+        // compare the hostname (case-insensitive, the name in the slot is not null-terminated)
+        if (strncasecmp(name, hostname, namesize) != 0) return false;
+
+        // the entry should still be valid
+        if (now >= slotexpires) return false;
+
+        // expose the expire-time
+        expires = slotexpires;
+
+        // found a valid response
+        return true;
+    }
+
+    // the writer kept interfering, treat it as a cache-miss
+    return false;
+}
+
+/**
+ *  Store a response in the shared segment
+ *  @param  now         current time
+ *  @param  expires     time at which the response expires
+ *  @param  response    the received response
+ */
+void SharedCache::insert(double now, double expires, const Response &response)
+{
+    // only the designated writer is allowed to touch the segment
+    if (!_writer) return;
+
+    // responses that do not fit in a slot are simply not shared
+    if (response.size() > sizeof(Slot().buffer)) return;
+
+    // prevent exceptions (parsing the response could fail)
+    try
+    {
+        // extract the original question
+        Question question(response);
+
+        // size of the hostname
+        size_t namesize = strlen(question.name());
+
+        // hostnames that do not fit are not shared either
+        if (namesize > sizeof(Slot().name)) return;
+
+        // get the applicable slot (possibly overwriting an unrelated older entry,
+        // the table is direct-mapped so there is exactly one candidate)
+        auto *entry = slot(question.name(), question.type());
+
+        // bump the counter to an odd value to tell readers that the slot is in flux
+        entry->sequence += 1;
+
+        // make sure the counter-update is visible before we touch the data
+        __sync_synchronize();
+
+        // fill in the slot
+        entry->expires = expires;
+        entry->type = question.type();
+        entry->namesize = namesize;
+        entry->size = response.size();
+        memcpy((void *)entry->name, question.name(), namesize);
+        memcpy((void *)entry->buffer, response.data(), response.size());
+
+        // make sure the data is visible before we release the slot
+        __sync_synchronize();
+
+        // back to an even value: the slot is consistent again
+        entry->sequence += 1;
+    }
+    catch (...)
+    {
+        // the response could not be parsed, we simply do not share it
+    }
+}
+
+/**
+ *  End of namespace
+ */
+}
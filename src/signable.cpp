@@ -0,0 +1,395 @@
+/**
+ *  Signable.cpp
+ *
+ *  Implementation file for the Signable class
+ *
+ *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Dependencies
+ */
+#include <algorithm>
+#include <ctype.h>
+#include <map>
+#include <list>
+#include "../include/dnscpp/signable.h"
+#include "../include/dnscpp/type.h"
+#include "random.h"
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Helper function to append a sixteen bit number in network byte order
+ *  @param  out         buffer to append to
+ *  @param  value       the value to append
+ */
+static void put16(std::vector<unsigned char> &out, uint16_t value)
+{
+    // add two bytes
+    out.push_back(value >> 8);
+    out.push_back(value);
+}
+
+/**
+ *  Helper function to append a thirty-two bit number in network byte order
+ *  @param  out         buffer to append to
+ *  @param  value       the value to append
+ */
+static void put32(std::vector<unsigned char> &out, uint32_t value)
+{
+    // add four bytes
+    out.push_back(value >> 24);
+    out.push_back(value >> 16);
+    out.push_back(value >> 8);
+    out.push_back(value);
+}
+
+/**
+ *  One remembered verification outcome
+ */
+struct Verdict
+{
+    /**
+     *  Digest of the signed data
+     *  @var uint64_t
+     */
+    uint64_t key;
+
+    /**
+     *  Did the verifier approve the signature?
+     *  @var bool
+     */
+    bool valid;
+};
+
+/**
+ *  The per-thread cache of verification outcomes, most recently used
+ *  entry in front (no locking needed because each thread has its own)
+ *  @return std::list
+ */
+static std::list<Verdict> &verdicts()
+{
+    // one cache per thread
+    static thread_local std::list<Verdict> instance;
+
+    // expose it
+    return instance;
+}
+
+/**
+ *  Calculate a digest of the signed data. This is a seeded fnv-1a hash:
+ *  not cryptographic, but the seed is drawn at random per thread so
+ *  colliding inputs cannot be precomputed offline. The signed data
+ *  already embeds the keytag and the signature metadata, and the actual
+ *  signature bytes are hashed in as well, so identical digests mean
+ *  identical verification inputs
+ *  @param  data        the assembled signed data
+ *  @param  size        size of that data
+ *  @param  extra       the signature bytes
+ *  @param  extrasize   size of the signature
+ *  @return uint64_t
+ */
+static uint64_t digest(const unsigned char *data, size_t size, const unsigned char *extra, size_t extrasize)
+{
+    // the per-thread seed, drawn once
+    static thread_local uint64_t seed = Random::instance().draw();
+
+    // fnv-1a offset basis, mixed with the seed
+    uint64_t result = seed ^ 14695981039346656037ULL;
+
+    // mix in the signed data
+    for (size_t i = 0; i < size; ++i) result = (result ^ data[i]) * 1099511628211ULL;
+
+    // the sizes, so concatenations that shift bytes between the two
+    // inputs do not collide
+    result = (result ^ size) * 1099511628211ULL;
+
+    // and the signature bytes
+    for (size_t i = 0; i < extrasize; ++i) result = (result ^ extra[i]) * 1099511628211ULL;
+
+    // done
+    return result;
+}
+
+/**
+ *  Helper method that writes a domain name in canonical wire form
+ *  @param  out         buffer to append to
+ *  @param  name        the name to encode
+ *  @param  labels      number of labels according to the signature
+ */
+void Signable::encode(std::vector<unsigned char> &out, const char *name, size_t labels)
+{
+    // the start of each label of the name
+    const char *parts[128]; size_t count = 0;
+
+    // locate all labels (names have at most 127 labels)
+    for (const char *current = name; *current && count < 128; )
+    {
+        // remember the start of this label
+        parts[count++] = current;
+
+        // find the next dot
+        const char *dot = strchr(current, '.');
+
+        // if there is no next label we are done
+        if (dot == nullptr) break;
+
+        // continue behind the dot
+        current = dot + 1;
+    }
+
+    // number of labels to keep: when the signature covers fewer labels
+    // than the owner name has, the name was synthesized from a wildcard
+    // and the signed name is "*" plus the rightmost labels
+    size_t keep = (labels == 0 || labels >= count) ? count : labels;
+
+    // write the wildcard label when applicable
+    if (keep < count) { out.push_back(1); out.push_back('*'); }
+
+    // write the labels that are covered
+    for (size_t i = count - keep; i < count; ++i)
+    {
+        // find the end of this label
+        const char *dot = strchr(parts[i], '.');
+
+        // size of the label
+        size_t size = dot == nullptr ? strlen(parts[i]) : size_t(dot - parts[i]);
+
+        // write the length byte
+        out.push_back(size);
+
+        // write the label in lowercase (canonical form)
+        for (size_t j = 0; j < size; ++j) out.push_back(tolower(parts[i][j]));
+    }
+
+    // names end with the root label
+    out.push_back(0);
+}
+
+/**
+ *  Append the rdata-prefix of the signature
+ *  @param  signature   the signature
+ */
+void Signable::prefix(const RRSIG &signature)
+{
+    // type covered, algorithm and label count
+    put16(_data, signature.typeCovered());
+    _data.push_back(uint8_t(signature.algorithm()));
+    _data.push_back(signature.labels());
+
+    // original ttl and the validity interval
+    put32(_data, signature.originalTtl());
+    put32(_data, signature.validUntil());
+    put32(_data, signature.validFrom());
+
+    // the keytag
+    put16(_data, signature.keytag());
+
+    // the signer name, in canonical (lowercase) form
+    encode(_data, signature.signer(), 0);
+}
+
+/**
+ *  Build the canonical form of the rrset that a signature covers
+ *  @param  signature   the signature
+ *  @param  records     all records of the section (already collected)
+ *  @return std::vector the canonicalized rrset
+ */
+std::vector<unsigned char> Signable::rrset(const RRSIG &signature, const std::deque<Record> &records)
+{
+    // the records that the signature covers
+    std::vector<const Record*> covered;
+
+    // collect the covered records
+    for (const auto &record : records)
+    {
+        // skip records that the signature does not cover
+        if (signature.covers(record)) covered.push_back(&record);
+    }
+
+    // sort the records in canonical rdata order (RFC 4034 section 6.3:
+    // compare the rdata as left-justified octet sequences, a record that
+    // is a prefix of an other record sorts first)
+    std::sort(covered.begin(), covered.end(), [](const Record *a, const Record *b) {
+
+        // compare the overlapping parts
+        int result = memcmp(a->data(), b->data(), std::min(a->size(), b->size()));
+
+        // if there was a difference we know the order
+        if (result != 0) return result < 0;
+
+        // the shorter rdata comes first
+        return a->size() < b->size();
+    });
+
+    // the resulting canonical rrset
+    std::vector<unsigned char> result;
+
+    // append all covered records
+    for (const auto *record : covered)
+    {
+        // the owner name in canonical form (possibly wildcard-reduced)
+        encode(result, record->name(), signature.labels());
+
+        // type, class and the original ttl from the signature
+        put16(result, record->type());
+        put16(result, record->dnsclass());
+        put32(result, signature.originalTtl());
+
+        // the rdata, prefixed with its size
+        put16(result, record->size());
+        result.insert(result.end(), record->data(), record->data() + record->size());
+    }
+
+    // done
+    return result;
+}
+
+/**
+ *  Private constructor that combines a signature-prefix with an already
+ *  canonicalized rrset
+ *  @param  signature   the signature
+ *  @param  records     the canonicalized rrset
+ */
+Signable::Signable(const RRSIG &signature, const std::vector<unsigned char> &records)
+{
+    // the rdata-prefix of the signature
+    prefix(signature);
+
+    // append the shared rrset bytes
+    _data.insert(_data.end(), records.begin(), records.end());
+}
+
+/**
+ *  Constructor, builds the signed data for one signature
+ *  @param  response    the response that holds signature and records
+ *  @param  signature   the signature to reconstruct the data for
+ *  @throws std::runtime_error
+ */
+Signable::Signable(const Response &response, const RRSIG &signature)
+{
+    // collect the records of the answer section in one pass
+    std::deque<Record> records;
+
+    // walk over the section
+    for (const auto &record : response.section(ns_s_an)) records.push_back(record);
+
+    // the rdata-prefix of the signature
+    prefix(signature);
+
+    // the canonical rrset behind it
+    auto covered = rrset(signature, records);
+
+    // append
+    _data.insert(_data.end(), covered.begin(), covered.end());
+}
+
+/**
+ *  Verify all signatures in the answer section of a response in one pass
+ *  @param  response    the response to verify
+ *  @param  verifier    callback that performs the cryptographic check
+ *  @param  cache       may cached outcomes be used?
+ *  @return size_t      number of signatures that the verifier approved
+ */
+size_t Signable::verify(const Response &response, const Verifier &verifier, bool cache)
+{
+    // collect the records of the answer section in one pass (the deque
+    // gives stable references, which the RRSIG extractor relies on)
+    std::deque<Record> records;
+
+    // walk over the section
+    for (const auto &record : response.section(ns_s_an)) records.push_back(record);
+
+    // canonicalized rrsets that were built already, keyed by the covered
+    // type and the original ttl (signatures over the same rrset share
+    // the exact same canonical bytes)
+    std::map<uint64_t,std::vector<unsigned char>> rrsets;
+
+    // number of approved signatures
+    size_t result = 0;
+
+    // now process all signatures
+    for (const auto &record : records)
+    {
+        // we only care about the signatures
+        if (record.type() != TYPE_RRSIG) continue;
+
+        // prevent exceptions (a malformed signature should not abort the batch)
+        try
+        {
+            // extract the signature properties
+            RRSIG signature(response, record);
+
+            // key under which the covered rrset is cached
+            uint64_t key = (uint64_t(signature.typeCovered()) << 32) | signature.originalTtl();
+
+            // check if the rrset was canonicalized before
+            auto iter = rrsets.find(key);
+
+            // canonicalize it now if not
+            if (iter == rrsets.end()) iter = rrsets.emplace(key, rrset(signature, records)).first;
+
+            // assemble the signed data (prefix plus shared rrset)
+            Signable signable(signature, iter->second);
+
+            // the outcome is fully determined by the signed data and the
+            // signature bytes, so we may have seen this check before
+            uint64_t hash = digest(signable.data(), signable.size(), signature.signature(), signature.size());
+
+            // the remembered outcome, if there is one
+            const Verdict *verdict = nullptr;
+
+            // consult the per-thread cache of earlier outcomes
+            if (cache) for (auto entry = verdicts().begin(); entry != verdicts().end(); ++entry)
+            {
+                // skip outcomes of other inputs
+                if (entry->key != hash) continue;
+
+                // found, move it to the front so frequently repeated
+                // checks stay in the cache
+                verdicts().splice(verdicts().begin(), verdicts(), entry);
+
+                // expose the outcome
+                verdict = &verdicts().front(); break;
+            }
+
+            // run the actual cryptographic check when the outcome is
+            // not known yet, and remember it for next time
+            if (verdict == nullptr)
+            {
+                // let the caller run the cryptographic check
+                bool valid = verifier(signature, signable.data(), signable.size());
+
+                // remember the outcome in front of the cache
+                verdicts().push_front(Verdict{ hash, valid });
+
+                // keep the cache bounded, drop the least recently used
+                if (verdicts().size() > 256) verdicts().pop_back();
+
+                // this is the outcome to count
+                verdict = &verdicts().front();
+            }
+
+            // count the approved signatures
+            if (verdict->valid) result += 1;
+        }
+        catch (...)
+        {
+            // a signature that cannot even be parsed is never valid
+            continue;
+        }
+    }
+
+    // expose the number of approved signatures
+    return result;
+}
+
+/**
+ *  End of namespace
+ */
+}
@@ -0,0 +1,218 @@
+/**
+ *  Slab.h
+ *
+ *  Simple slab for fixed-size allocations. Freed blocks go onto a
+ *  free-list and are handed out again, so that objects that are
+ *  created and destroyed at a high rate (lookups, shared-ptr control
+ *  blocks) do not go through the general purpose allocator for every
+ *  instance. The slab is not thread-safe: each user keeps its own
+ *  (thread-local) instance.
+ *
+ *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include <vector>
+#include <memory>
+#include <cstddef>
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Class definition
+ */
+template <size_t SIZE>
+class Slab
+{
+private:
+    /**
+     *  One block: while free it holds the pointer to the next free
+     *  block, while in use it holds the payload
+     */
+    union Block
+    {
+        /**
+         *  Pointer to the next free block (only valid while free)
+         *  @var Block
+         */
+        Block *next;
+
+        /**
+         *  The payload (only valid while in use)
+         *  @var char[]
+         */
+        alignas(alignof(std::max_align_t)) unsigned char data[SIZE];
+    };
+
+    /**
+     *  Head of the free-list
+     *  @var Block
+     */
+    Block *_free = nullptr;
+
+    /**
+     *  The chunks of blocks that were carved so far (only released when
+     *  the slab itself is destructed)
+     *  @var std::vector
+     */
+    std::vector<std::unique_ptr<Block[]>> _chunks;
+
+public:
+    /**
+     *  Constructor
+     */
+    Slab() = default;
+
+    /**
+     *  No copying
+     *  @param  that    other slab
+     */
+    Slab(const Slab &that) = delete;
+
+    /**
+     *  Destructor
+     */
+    virtual ~Slab() = default;
+
+    /**
+     *  Get a block of SIZE bytes
+     *  @return void*
+     */
+    void *allocate()
+    {
+        // when the free-list is empty we carve a new chunk of blocks
+        if (_free == nullptr)
+        {
+            // each chunk holds a fixed number of blocks
+            size_t count = 64;
+
+            // allocate the chunk (this is the only operation that goes to
+            // the general purpose allocator)
+            _chunks.emplace_back(new Block[count]);
+
+            // link all blocks of the chunk onto the free-list
+            for (size_t i = 0; i < count; ++i)
+            {
+                // the next fresh block
+                auto *block = &_chunks.back()[i];
+
+                // push onto the free-list
+                block->next = _free; _free = block;
+            }
+        }
+
+        // take the first free block
+        auto *block = _free; _free = block->next;
+
+        // hand out its payload
+        return block->data;
+    }
+
+    /**
+     *  Give a block back to the slab
+     *  @param  ptr     pointer that was returned by allocate()
+     */
+    void deallocate(void *ptr)
+    {
+        // the payload sits at the start of the block
+        auto *block = reinterpret_cast<Block*>(ptr);
+
+        // push onto the free-list
+        block->next = _free; _free = block;
+    }
+};
+
+/**
+ *  Allocator that hands out single elements from a thread-local slab,
+ *  used for the control blocks of the shared-ptrs around lookups;
+ *  allocations of more than one element fall through to the regular
+ *  allocator
+ */
+template <typename T>
+struct SlabAllocator
+{
+    /**
+     *  The type that this allocator allocates
+     */
+    typedef T value_type;
+
+    /**
+     *  Constructor
+     */
+    SlabAllocator() = default;
+
+    /**
+     *  Rebind-constructor (allocators for other types are all stateless)
+     *  @param  that    allocator for a different type
+     */
+    template <typename U> SlabAllocator(const SlabAllocator<U> &that) {}
+
+    /**
+     *  The thread-local slab that backs single-element allocations
+     *  @return Slab
+     */
+    static Slab<sizeof(T)> &slab()
+    {
+        // one slab per type per thread (lookups are created and destroyed
+        // on the loop thread, so no locking is needed)
+        static thread_local Slab<sizeof(T)> instance;
+
+        // expose the instance
+        return instance;
+    }
+
+    /**
+     *  Allocate a number of elements
+     *  @param  count   number of elements
+     *  @return T*
+     */
+    T *allocate(size_t count)
+    {
+        // single elements come from the slab, anything else from the heap
+        if (count == 1) return static_cast<T*>(slab().allocate());
+
+        // fall through to the regular allocator
+        return static_cast<T*>(::operator new(count * sizeof(T)));
+    }
+
+    /**
+     *  Release a number of elements
+     *  @param  ptr     pointer that was returned by allocate()
+     *  @param  count   number of elements
+     */
+    void deallocate(T *ptr, size_t count)
+    {
+        // single elements go back to the slab
+        if (count == 1) return slab().deallocate(ptr);
+
+        // the rest goes back to the heap
+        ::operator delete(ptr);
+    }
+};
+
+/**
+ *  All slab-allocators for the same type are interchangeable
+ *  @param  left        first allocator
+ *  @param  right       second allocator
+ *  @return bool
+ */
+template <typename T, typename U>
+bool operator==(const SlabAllocator<T> &left, const SlabAllocator<U> &right) { return true; }
+template <typename T, typename U>
+bool operator!=(const SlabAllocator<T> &left, const SlabAllocator<U> &right) { return false; }
+
+/**
+ *  End of namespace
+ */
+}
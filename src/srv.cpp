@@ -0,0 +1,123 @@
+/**
+ *  SRV.cpp
+ *
+ *  Implementation file for the SRV class (the ordering of a whole
+ *  rrset, the per-record accessors live in the header)
+ *
+ *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Dependencies
+ */
+#include "../include/dnscpp/srv.h"
+#include "../include/dnscpp/response.h"
+#include "../include/dnscpp/record.h"
+#include "random.h"
+#include <algorithm>
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Extract and order the whole SRV rrset of a response in one pass
+ *  @param  response    the response holding the SRV records
+ *  @param  section     the section to extract from
+ *  @return std::vector the ordered targets
+ */
+std::vector<SRV::Target> SRV::order(const Response &response, ns_sect section)
+{
+    // the targets as they appear in the response
+    std::vector<Target> candidates;
+
+    // walk over the section
+    for (size_t i = 0; i < response.records(section); ++i)
+    {
+        // prevent exceptions (a malformed record could fail to parse)
+        try
+        {
+            // the next record
+            Record record(response, section, i);
+
+            // other record types (the cname chain for example) are skipped
+            if (record.type() != TYPE_SRV) continue;
+
+            // extract the fields
+            SRV srv(response, record);
+
+            // a target of "." means the service is decidedly not available
+            if (strcmp(srv.hostname(), ".") == 0) continue;
+
+            // remember the candidate
+            candidates.push_back(Target{ srv.hostname(), srv.priority(), srv.weight(), srv.port() });
+        }
+        catch (...)
+        {
+            // a malformed record is skipped
+        }
+    }
+
+    // group by priority (stable, so the order of the weighted pass
+    // below is not influenced by how the nameserver shuffled the set)
+    std::stable_sort(candidates.begin(), candidates.end(), [](const Target &a, const Target &b) {
+        return a.priority < b.priority;
+    });
+
+    // the ordered result
+    std::vector<Target> result;
+
+    // one allocation for all targets
+    result.reserve(candidates.size());
+
+    // process one priority group at a time
+    for (size_t begin = 0; begin < candidates.size(); )
+    {
+        // find the end of the group with this priority
+        size_t end = begin;
+        while (end < candidates.size() && candidates[end].priority == candidates[begin].priority) ++end;
+
+        // rfc 2782 prescribes that zero-weight targets come first in
+        // the running-sum order, so that they still get a small chance
+        std::stable_sort(candidates.begin() + begin, candidates.begin() + end, [](const Target &a, const Target &b) {
+            return a.weight == 0 && b.weight != 0;
+        });
+
+        // repeatedly select one target, weight-proportionally, until
+        // the group is exhausted
+        for (size_t remaining = end - begin; remaining > 0; --remaining)
+        {
+            // the sum of the weights of the targets that are left
+            uint32_t total = 0;
+            for (size_t i = begin; i < begin + remaining; ++i) total += candidates[i].weight;
+
+            // a random number in [0, total], targets with a higher
+            // weight span a bigger part of the range
+            uint32_t draw = total == 0 ? 0 : Random::instance().draw32() % (total + 1);
+
+            // find the first target whose running sum reaches the draw
+            size_t chosen = begin; uint32_t sum = candidates[begin].weight;
+            while (sum < draw && chosen + 1 < begin + remaining) sum += candidates[++chosen].weight;
+
+            // the chosen target is next in the final order
+            result.push_back(candidates[chosen]);
+
+            // move the last not-yet-chosen target into the hole, the
+            // order of the remainder does not matter for the algorithm
+            candidates[chosen] = candidates[begin + remaining - 1];
+        }
+
+        // continue with the next priority group
+        begin = end;
+    }
+
+    // done
+    return result;
+}
+
+/**
+ *  End of namespace
+ */
+}
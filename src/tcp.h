@@ -18,7 +18,6 @@
  */
 #include <netinet/tcp.h>
 #include <unistd.h>
-#include "blocking.h"
 #include "../include/dnscpp/loop.h"
 
 /**
@@ -31,7 +30,7 @@ namespace DNS {
  */
 class Tcp
 {
-private:
+protected:
     /**
      *  The event loop to which the filedescriptor is bound
      *  @var Loop
@@ -43,8 +42,8 @@ private:
      *  @var int
      */
     int _fd;
-    
-    
+
+
 public:
     /**
      *  Constructor
@@ -132,6 +131,60 @@ public:
         }
     }
 
+    /**
+     *  Start connecting and hand the first data to the kernel in one go
+     *  (tcp fast open): when the kernel has a cookie for the peer the data
+     *  rides in the syn packet, without one this degrades to a plain syn
+     *  (errno is EINPROGRESS then, just like an ordinary connect)
+     *  @param  ip          the address to connect to
+     *  @param  port        the port to connect to
+     *  @param  data        the data to send in the syn
+     *  @param  size        size of the data
+     *  @return ssize_t     number of bytes that made it into the syn
+     */
+    ssize_t fastopen(const Ip &ip, uint16_t port, const unsigned char *data, size_t size)
+    {
+#ifdef MSG_FASTOPEN
+        // should we connect in the ipv4 or ipv6 fashion?
+        if (ip.version() == 6)
+        {
+            // structure to initialize
+            struct sockaddr_in6 info;
+
+            // fill the members
+            memset(&info, 0, sizeof(info));
+            info.sin6_family = AF_INET6;
+            info.sin6_port = htons(port);
+
+            // copy the address
+            memcpy(&info.sin6_addr, (const struct in6_addr *)ip, sizeof(struct in6_addr));
+
+            // connect and send in one operation
+            return ::sendto(_fd, data, size, MSG_NOSIGNAL | MSG_FASTOPEN, (struct sockaddr *)&info, sizeof(info));
+        }
+        else
+        {
+            // structure to initialize
+            struct sockaddr_in info;
+
+            // fill the members
+            memset(&info, 0, sizeof(info));
+            info.sin_family = AF_INET;
+            info.sin_port = htons(port);
+
+            // copy the address
+            memcpy(&info.sin_addr, (const struct in_addr *)ip, sizeof(struct in_addr));
+
+            // connect and send in one operation
+            return ::sendto(_fd, data, size, MSG_NOSIGNAL | MSG_FASTOPEN, (struct sockaddr *)&info, sizeof(info));
+        }
+#else
+        // the platform does not support fast open, the caller falls back
+        // on an ordinary connect
+        errno = EOPNOTSUPP; return -1;
+#endif
+    }
+
     /**
      *  The error state of the socket -- this can be used to check whether the socket is connected
      *  @return int
@@ -148,47 +201,29 @@ public:
         return error;
     }
 
-    /**
-     *  Send a full query
-     *  This is a blocking operation. Although it would have been better to make this
-     *  non-blocking operation, it would make the code more complex and in reality we
-     *  only send small messages over the socket, so we do not expect any buffering to
-     *  take place anyway - so we have kept the code simple
-     *  @param  query       the query to send
-     *  @return bool        was the query sent?
-     */
-    ssize_t send(const Query &query)
-    {
-        // make the socket blocking
-        Blocking blocking(_fd);
-        
-        // the first two bytes should contain the message size
-        uint16_t size = htons(query.size());
-        
-        // send the size
-        auto result1 = ::send(_fd, &size, sizeof(size), MSG_NOSIGNAL | MSG_MORE);
-        
-        // was this a success?
-        if (result1 < 2) return false;
-        
-        // now send the entire query
-        auto result2 = ::send(_fd, query.data(), query.size(), MSG_NOSIGNAL);
-        
-        // report the result
-        return result2 >= (ssize_t)query.size();
-    }
-    
     /**
      *  Receive data from the connection
      *  @param  buffer      buffer to be filled
      *  @param  size        size of the buffer
      *  @return ssize_t     number of bytes received
      */
-    ssize_t receive(unsigned char *buffer, size_t size)
+    virtual ssize_t receive(unsigned char *buffer, size_t size)
     {
         // pass on
         return ::recv(_fd, buffer, size, 0);
     }
+
+    /**
+     *  Write raw data to the (non-blocking) connection
+     *  @param  buffer      the data to send
+     *  @param  size        size of the data
+     *  @return ssize_t     number of bytes that the kernel accepted
+     */
+    virtual ssize_t write(const unsigned char *buffer, size_t size)
+    {
+        // pass on
+        return ::send(_fd, buffer, size, MSG_NOSIGNAL);
+    }
     
     /**
      *  Monitor the socket for certain activity
@@ -202,6 +237,19 @@ public:
         return _loop->add(_fd, events, monitor);
     }
     
+    /**
+     *  Update the events for which an already installed monitor watches
+     *  @param  identifier  the identifier of the monitor
+     *  @param  events      the new events to monitor for
+     *  @param  monitor     the original monitor object
+     *  @return void*       the (possibly new) identifier of the monitor
+     */
+    void *update(void *identifier, int events, Monitor *monitor)
+    {
+        // pass on to the loop
+        return _loop->update(identifier, _fd, events, monitor);
+    }
+
     /**
      *  Remove a monitor from the socket
      *  @param  identifier  the identifier of the monitor
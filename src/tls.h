@@ -0,0 +1,267 @@
+/**
+ *  Tls.h
+ *
+ *  TLS variant of the Tcp socket, used for DNS-over-TLS (rfc 7858).
+ *  The class runs the handshake lazily and non-blockingly the first
+ *  time data is written or read, and caches the TLS session per
+ *  nameserver IP so that reconnects can be resumed in a single
+ *  round-trip instead of a full handshake.
+ *
+ *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include <unordered_map>
+#include "tcp.h"
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Class definition
+ */
+class Tls : public Tcp
+{
+private:
+    /**
+     *  The TLS state of the connection
+     *  @var SSL
+     */
+    SSL *_ssl;
+
+    /**
+     *  The address of the peer, used as key in the session cache
+     *  @var Ip
+     */
+    Ip _ip;
+
+    /**
+     *  Has the handshake been completed?
+     *  @var bool
+     */
+    bool _handshaken = false;
+
+    /**
+     *  The cache of sessions per nameserver IP, so that a reconnect to
+     *  the same nameserver can resume an earlier session (a hash table,
+     *  the Ip class hashes cheaply and no ordering is needed)
+     *  @return std::unordered_map
+     */
+    static std::unordered_map<Ip,SSL_SESSION*> &sessions()
+    {
+        // the one and only cache
+        static std::unordered_map<Ip,SSL_SESSION*> instance;
+
+        // expose it
+        return instance;
+    }
+
+    /**
+     *  Callback that openssl calls when the peer hands out a session
+     *  (with tls 1.3 this happens in a ticket after the handshake)
+     *  @param  ssl         the connection that received the session
+     *  @param  session     the session to cache
+     *  @return int         do we keep a reference to the session?
+     */
+    static int store(SSL *ssl, SSL_SESSION *session)
+    {
+        // the Tls object that owns the connection
+        auto *self = (Tls *)SSL_get_app_data(ssl);
+
+        // the slot in the cache for this nameserver
+        auto &slot = sessions()[self->_ip];
+
+        // an older session is no longer interesting
+        if (slot != nullptr) SSL_SESSION_free(slot);
+
+        // store the new session
+        slot = session;
+
+        // we keep the reference (so openssl should not free the session)
+        return 1;
+    }
+
+    /**
+     *  The one and only ssl context, shared by all connections so that
+     *  they also share the session cache
+     *  @return SSL_CTX
+     */
+    static SSL_CTX *context()
+    {
+        // the one and only context
+        static SSL_CTX *instance = nullptr;
+
+        // no need to create it twice
+        if (instance != nullptr) return instance;
+
+        // create the context
+        instance = SSL_CTX_new(TLS_client_method());
+
+        // check for failure
+        if (instance == nullptr) throw std::runtime_error("failed to create tls context");
+
+        // we do our own client-side session caching (keyed by nameserver
+        // IP), the built-in cache is server-side only
+        SSL_CTX_set_session_cache_mode(instance, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+
+        // install the callback that fills our cache
+        SSL_CTX_sess_set_new_cb(instance, &Tls::store);
+
+        // expose the context
+        return instance;
+    }
+
+    /**
+     *  Map an openssl error to an errno-style failure, so that the
+     *  caller can treat this class exactly like a plain socket
+     *  @param  result      the return value of the ssl call
+     *  @return ssize_t     always -1 (with errno set)
+     */
+    ssize_t failure(int result)
+    {
+        // find out what went wrong
+        auto error = SSL_get_error(_ssl, result);
+
+        // when the engine needs more tcp traffic we behave like a socket
+        // that would block, the caller then waits for the next event
+        if (error == SSL_ERROR_WANT_READ || error == SSL_ERROR_WANT_WRITE) errno = EAGAIN;
+
+        // anything else is fatal for the connection
+        else errno = ECONNRESET;
+
+        // always a failure
+        return -1;
+    }
+
+    /**
+     *  Try to make progress with the handshake
+     *  @return bool        has the handshake been completed?
+     */
+    bool handshake()
+    {
+        // nothing to do when the handshake is already complete
+        if (_handshaken) return true;
+
+        // make progress
+        auto result = SSL_do_handshake(_ssl);
+
+        // are we done? (the session is cached via the callback)
+        if (result == 1) return _handshaken = true;
+
+        // not done yet, set errno for the caller
+        failure(result);
+
+        // the handshake is still in progress (or failed)
+        return false;
+    }
+
+public:
+    /**
+     *  Constructor
+     *  @param  loop        user space event loop
+     *  @param  ip          the address that we will connect to
+     *  @throws std::runtime_error
+     */
+    Tls(Loop *loop, const Ip &ip) : Tcp(loop, ip), _ssl(SSL_new(context())), _ip(ip)
+    {
+        // check whether the state was created
+        if (_ssl == nullptr) throw std::runtime_error("failed to create tls state");
+
+        // link the state to the socket
+        SSL_set_fd(_ssl, _fd);
+
+        // we are the client in the handshake
+        SSL_set_connect_state(_ssl);
+
+        // we need access to `this` inside the session callback
+        SSL_set_app_data(_ssl, this);
+
+        // partial writes should succeed partially (like a plain socket),
+        // and the caller may move its buffer between retries
+        SSL_set_mode(_ssl, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+
+        // do we have a session from an earlier connection to this
+        // nameserver? resuming it saves a round-trip in the handshake
+        auto iter = sessions().find(ip);
+
+        // pass it to the new connection
+        if (iter != sessions().end()) SSL_set_session(_ssl, iter->second);
+    }
+
+    /**
+     *  No copying
+     *  @param  that
+     */
+    Tls(const Tls &that) = delete;
+
+    /**
+     *  Destructor
+     */
+    virtual ~Tls()
+    {
+        // forget the tls state (the socket is closed by the base class)
+        SSL_free(_ssl);
+    }
+
+    /**
+     *  Receive data from the connection
+     *  @param  buffer      buffer to be filled
+     *  @param  size        size of the buffer
+     *  @return ssize_t     number of bytes received
+     */
+    virtual ssize_t receive(unsigned char *buffer, size_t size) override
+    {
+        // the handshake has to finish first
+        if (!handshake()) return -1;
+
+        // pass on to the engine
+        auto result = SSL_read(_ssl, buffer, size);
+
+        // on success we report the number of decrypted bytes
+        if (result > 0) return result;
+
+        // an orderly tls shutdown behaves like end-of-file on a socket
+        if (SSL_get_error(_ssl, result) == SSL_ERROR_ZERO_RETURN) return 0;
+
+        // map the error to errno
+        return failure(result);
+    }
+
+    /**
+     *  Write raw data to the (non-blocking) connection
+     *  @param  buffer      the data to send
+     *  @param  size        size of the data
+     *  @return ssize_t     number of bytes that were accepted
+     */
+    virtual ssize_t write(const unsigned char *buffer, size_t size) override
+    {
+        // the handshake has to finish first
+        if (!handshake()) return -1;
+
+        // pass on to the engine
+        auto result = SSL_write(_ssl, buffer, size);
+
+        // on success we report the number of accepted bytes
+        if (result > 0) return result;
+
+        // map the error to errno
+        return failure(result);
+    }
+};
+
+/**
+ *  End of namespace
+ */
+}
@@ -0,0 +1,57 @@
+/**
+ *  Tracepoints.h
+ *
+ *  Static tracepoints (systemtap/usdt style) on the lookup hot path, so
+ *  that production latency incidents can be debugged with bpftrace or
+ *  perf without attaching uprobes to mangled private symbols that move
+ *  with every release.
+ *
+ *  The probes are compiled out by default and cost nothing: build with
+ *  -DDNSCPP_TRACEPOINTS (which requires the systemtap-sdt-dev headers)
+ *  to enable them. An enabled-but-unattached probe is a single nop
+ *  instruction, so tracing-ready builds are essentially free as well.
+ *
+ *  The provider is "dnscpp", the probes are:
+ *
+ *      query_sent(id, size, fd)        datagram handed to the kernel
+ *      datagram_received(id, size, fd) datagram read from the socket
+ *      response_matched(id)            response delivered to its lookup
+ *      lookup_complete(domain, type, attempts)
+ *      lookup_timeout(domain, type, attempts)
+ *
+ *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  The real probes, only when explicitly enabled
+ */
+#ifdef DNSCPP_TRACEPOINTS
+
+/**
+ *  Dependencies
+ */
+#include <sys/sdt.h>
+
+/**
+ *  Forward to the systemtap macros, with "dnscpp" as provider
+ */
+#define DNSCPP_PROBE1(name, a)          DTRACE_PROBE1(dnscpp, name, a)
+#define DNSCPP_PROBE2(name, a, b)       DTRACE_PROBE2(dnscpp, name, a, b)
+#define DNSCPP_PROBE3(name, a, b, c)    DTRACE_PROBE3(dnscpp, name, a, b, c)
+
+#else
+
+/**
+ *  Compiled out: the macros expand to nothing at all
+ */
+#define DNSCPP_PROBE1(name, a)
+#define DNSCPP_PROBE2(name, a, b)
+#define DNSCPP_PROBE3(name, a, b, c)
+
+#endif
@@ -0,0 +1,335 @@
+/**
+ *  Transfer.cpp
+ *
+ *  Implementation file for the streaming zone transfer
+ *
+ *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Dependencies
+ */
+#include "../include/dnscpp/transfer.h"
+#include "../include/dnscpp/loop.h"
+#include "../include/dnscpp/response.h"
+#include "../include/dnscpp/answer.h"
+#include "../include/dnscpp/type.h"
+#include "../include/dnscpp/soa.h"
+#include "../include/dnscpp/watcher.h"
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Constructor
+ *  @param  loop        the event loop
+ *  @param  nameserver  the primary nameserver holding the zone
+ *  @param  domain      the zone to transfer
+ *  @param  handler     listener for the records
+ *  @param  port        the port to connect to
+ *  @throws std::runtime_error
+ */
+Transfer::Transfer(Loop *loop, const Ip &nameserver, const char *domain, Handler *handler, uint16_t port) :
+    _loop(loop),
+    _handler(handler),
+    _query(ns_o_query, domain, ns_t_axfr, Bits())
+{
+    // create a non-blocking tcp socket of the right family
+    _fd = socket(nameserver.version() == 6 ? AF_INET6 : AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+    // check if the socket was correctly created
+    if (_fd < 0) throw std::runtime_error("failed to create socket");
+
+    // set the nodelay flag so that the query leaves right after the handshake
+    int nodelay = true;
+    setsockopt(_fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(int));
+
+    // result of the connect call
+    int result;
+
+    // should we connect in the ipv4 or ipv6 fashion?
+    if (nameserver.version() == 6)
+    {
+        // structure to initialize
+        struct sockaddr_in6 info;
+
+        // fill the members
+        memset(&info, 0, sizeof(info));
+        info.sin6_family = AF_INET6;
+        info.sin6_port = htons(port);
+
+        // copy the address
+        memcpy(&info.sin6_addr, (const struct in6_addr *)nameserver, sizeof(struct in6_addr));
+
+        // start the non-blocking connect
+        result = ::connect(_fd, (struct sockaddr *)&info, sizeof(info));
+    }
+    else
+    {
+        // structure to initialize
+        struct sockaddr_in info;
+
+        // fill the members
+        memset(&info, 0, sizeof(info));
+        info.sin_family = AF_INET;
+        info.sin_port = htons(port);
+
+        // copy the address
+        memcpy(&info.sin_addr, (const struct in_addr *)nameserver, sizeof(struct in_addr));
+
+        // start the non-blocking connect
+        result = ::connect(_fd, (struct sockaddr *)&info, sizeof(info));
+    }
+
+    // an immediate failure is reported via an exception
+    if (result != 0 && errno != EINPROGRESS && errno != EWOULDBLOCK)
+    {
+        // the socket is useless
+        close(_fd);
+
+        // report the problem
+        throw std::runtime_error("failed to connect");
+    }
+
+    // queue the length-prefixed query, it leaves once the handshake is done
+    _out.push_back((char)(_query.size() >> 8));
+    _out.push_back((char)(_query.size() & 0xff));
+    _out.append((const char *)_query.data(), _query.size());
+
+    // wait for the socket to become writable, that means it is connected
+    _identifier = _loop->add(_fd, 2, this); _events = 2;
+}
+
+/**
+ *  Destructor
+ */
+Transfer::~Transfer()
+{
+    // stop monitoring the socket
+    if (_identifier) _loop->remove(_identifier, _fd, this);
+
+    // close the socket
+    if (_fd >= 0) close(_fd);
+}
+
+/**
+ *  Update the events for which the socket is monitored
+ *  @param  events      the events to monitor (1 = readable, 2 = writable)
+ */
+void Transfer::monitor(int events)
+{
+    // nothing to do when nothing changes
+    if (events == _events) return;
+
+    // update the monitor
+    _identifier = _loop->update(_identifier, _fd, events, this);
+
+    // remember the events
+    _events = events;
+}
+
+/**
+ *  Report failure to the handler and self-destruct
+ */
+void Transfer::fail()
+{
+    // the callback might call cancel() and destruct us itself
+    Watcher watcher(this);
+
+    // get rid of the handler so that nothing else is reported
+    auto *handler = _handler; _handler = nullptr;
+
+    // report the failure
+    handler->onFailure(this);
+
+    // self-destruct (unless the callback already did)
+    if (watcher.valid()) delete this;
+}
+
+/**
+ *  Try to hand the buffered outgoing bytes to the kernel
+ *  @return bool        false when the connection failed (object destructed)
+ */
+bool Transfer::flush()
+{
+    // keep writing while there is something to write
+    while (!_out.empty())
+    {
+        // hand over to the kernel
+        auto result = ::send(_fd, _out.data(), _out.size(), MSG_NOSIGNAL);
+
+        // remove the bytes that were accepted
+        if (result > 0) { _out.erase(0, result); continue; }
+
+        // a full socket buffer simply means we wait for writability
+        if (result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+
+        // any other failure breaks the transfer
+        fail(); return false;
+    }
+
+    // we always watch readability, and writability while output is pending
+    monitor(_out.empty() ? 1 : 3);
+
+    // the transfer continues
+    return true;
+}
+
+/**
+ *  Process one complete message from the stream
+ *  @param  buffer      the message (without the length prefix)
+ *  @param  size        size of the message
+ *  @return bool        false when the transfer ended (object destructed)
+ */
+bool Transfer::process(const unsigned char *buffer, size_t size)
+{
+    // the callbacks might cancel the transfer
+    Watcher watcher(this);
+
+    // prevent exceptions (the message could be malformed)
+    try
+    {
+        // parse the message
+        Response response(buffer, size);
+
+        // a nameserver that refuses the transfer reports an error code
+        if (response.rcode() != 0) { fail(); return false; }
+
+        // number of records in this message
+        size_t count = response.answers();
+
+        // walk over the answer records
+        for (size_t i = 0; i < count; ++i)
+        {
+            // the next record
+            Answer record(response, i);
+
+            // soa records open and close the transfer
+            if (record.type() == TYPE_SOA)
+            {
+                // extract the serial
+                SOA soa(response, record);
+
+                // the repetition of the opening soa closes the transfer
+                if (_records > 0 && soa.serial() == _serial)
+                {
+                    // get rid of the handler, reporting is the last thing we do
+                    auto *handler = _handler; _handler = nullptr;
+
+                    // report completion
+                    handler->onFinished(this, _records, _serial);
+
+                    // self-destruct (unless the callback already did via cancel())
+                    if (watcher.valid()) delete this;
+
+                    // the transfer has ended
+                    return false;
+                }
+
+                // the very first record announces the serial of the zone
+                if (_records == 0) _serial = soa.serial();
+            }
+
+            // a stream that does not open with a soa is not a zone transfer
+            else if (_records == 0) { fail(); return false; }
+
+            // report the record
+            _handler->onRecord(this, response, record);
+
+            // the callback could have cancelled the transfer
+            if (!watcher.valid()) return false;
+
+            // one more record was delivered
+            _records += 1;
+        }
+    }
+    catch (...)
+    {
+        // a malformed message breaks the transfer
+        fail(); return false;
+    }
+
+    // the transfer continues
+    return true;
+}
+
+/**
+ *  Method that is called by the event loop when the socket becomes
+ *  readable and/or writable
+ */
+void Transfer::notify()
+{
+    // when the handshake is still in progress, activity means that it completed
+    if (!_connected)
+    {
+        // find out the error state of the socket
+        int error; unsigned int length = sizeof(int);
+
+        // a socket in an error state means the connect failed
+        if (getsockopt(_fd, SOL_SOCKET, SO_ERROR, &error, &length) < 0 || error != 0) return fail();
+
+        // the connection is up now
+        _connected = true;
+    }
+
+    // first get pending output out of the door
+    if (!_out.empty() && !flush()) return;
+
+    // temporary buffer to drain the socket
+    unsigned char buffer[65536];
+
+    // keep reading until the socket is drained
+    while (true)
+    {
+        // get the next chunk
+        auto result = ::recv(_fd, buffer, sizeof(buffer), 0);
+
+        // a blocking operation means the socket is drained
+        if (result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+
+        // an orderly shutdown before the final soa, or an error, is a failure
+        if (result <= 0) return fail();
+
+        // append to the incoming buffer
+        _in.append((const char *)buffer, result);
+
+        // number of bytes of the buffer that have been consumed, erasing is
+        // done once for the whole chunk instead of once per message
+        size_t consumed = 0;
+
+        // process all complete messages in the buffer, so that never more
+        // than one partial message stays buffered, no matter the zone size
+        while (_in.size() - consumed >= 2)
+        {
+            // the two-byte length prefix
+            size_t size = (uint8_t)_in[consumed] << 8 | (uint8_t)_in[consumed+1];
+
+            // wait for more data if the message is not yet complete
+            if (_in.size() - consumed < size + 2) break;
+
+            // the message is complete so it will be consumed
+            consumed += size + 2;
+
+            // process it (false means the transfer ended and we are destructed)
+            if (!process((const unsigned char *)_in.data() + consumed - size, size)) return;
+        }
+
+        // remove all consumed messages in one go
+        _in.erase(0, consumed);
+
+        // a partial read also means the socket is drained
+        if ((size_t)result < sizeof(buffer)) break;
+    }
+}
+
+/**
+ *  End of namespace
+ */
+}
@@ -20,7 +20,10 @@
 #include <sys/socket.h>
 #include <stdexcept>
 #include <unistd.h>
+#include "tracepoints.h"
 #include <poll.h>
+#include <errno.h>
+#include <string.h>
 
 /**
  *  Begin of namespace
@@ -70,9 +73,9 @@ bool Udp::open(int version)
     // if already open
     if (_fd >= 0) return true;
     
-    // try to open it (note that we do not set the NONBLOCK option, because we have not implemented 
-    // buffering for the sendto() call (this could be a future optimization)
-    _fd = socket(version == 6 ? AF_INET6 : AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    // try to open it (non-blocking, datagrams that do not fit in the socket
+    // buffer are kept in a backlog and flushed when the socket is writable again)
+    _fd = socket(version == 6 ? AF_INET6 : AF_INET, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
     
     // check for success
     if (_fd < 0) return false;
@@ -85,13 +88,83 @@ bool Udp::open(int version)
         setintopt(SO_RCVBUF, _core->buffersize());
     }
 
+#ifdef SO_INCOMING_CPU
+    // when the context is bound to a cpu we ask the kernel to steer the
+    // incoming datagrams of this socket to that very cpu, so that receive
+    // processing happens on the core (and numa node) that runs the loop
+    if (_core->affinity() >= 0) setintopt(SO_INCOMING_CPU, _core->affinity());
+#endif
+
+#ifdef SO_BUSY_POLL
+    // in busy-poll mode the kernel polls the device queue for the given
+    // number of microseconds before a blocking read gives up, saving the
+    // interrupt-and-wakeup round trip for responses that arrive quickly
+    if (_core->busypoll() > 0) setintopt(SO_BUSY_POLL, _core->busypoll());
+#endif
+
+    // in reuseport mode the socket is bound explicitly, so that multiple
+    // sockets can share one port and the kernel shards the incoming
+    // responses over their receive queues
+    if (_reuseport)
+    {
+        // set the option before binding
+        setintopt(SO_REUSEPORT, 1);
+
+        // should we bind in the ipv4 or the ipv6 fashion?
+        if (version == 6)
+        {
+            // structure to initialize
+            struct sockaddr_in6 info;
+
+            // fill the members (wildcard address, the requested port)
+            memset(&info, 0, sizeof(info));
+            info.sin6_family = AF_INET6;
+            info.sin6_port = htons(_port);
+
+            // bind the socket
+            bind(_fd, (struct sockaddr *)&info, sizeof(info));
+        }
+        else
+        {
+            // structure to initialize
+            struct sockaddr_in info;
+
+            // fill the members (wildcard address, the requested port)
+            memset(&info, 0, sizeof(info));
+            info.sin_family = AF_INET;
+            info.sin_port = htons(_port);
+
+            // bind the socket
+            bind(_fd, (struct sockaddr *)&info, sizeof(info));
+        }
+    }
+
     // we want to be notified when the socket receives data
     _identifier = _core->loop()->add(_fd, 1, this);
-    
+
     // done
     return true;
 }
 
+/**
+ *  The local port to which the socket is bound
+ *  @return uint16_t
+ */
+uint16_t Udp::localport() const
+{
+    // not-yet-opened sockets have no port
+    if (_fd < 0) return 0;
+
+    // structure that will hold the local address (big enough for ipv4 and ipv6)
+    struct sockaddr_in6 info; socklen_t size = sizeof(info);
+
+    // ask the kernel
+    if (getsockname(_fd, (struct sockaddr *)&info, &size) != 0) return 0;
+
+    // the port lives at the same offset for ipv4 and ipv6
+    return ntohs(info.sin6_port);
+}
+
 /**
  *  Close the socket
  *  @return bool
@@ -106,10 +179,13 @@ bool Udp::close()
     
     // close the socket
     ::close(_fd);
-    
+
     // remember that socket is closed
-    _fd = -1; _identifier = nullptr;
-    
+    _fd = -1; _identifier = nullptr; _events = 1; _connected = false;
+
+    // messages that were still queued will never be sent now
+    _outgoing.clear();
+
     // done
     return true;
 }
@@ -143,30 +219,170 @@ void Udp::notify()
 {
     // do nothing if there is no socket (how is that possible!?)
     if (_fd < 0) return;
-    
-    // the buffer to receive the response in
-    // @todo use a macro
-    unsigned char buffer[65536];
 
-    // structure will hold the source address (we use an ipv6 struct because that is also big enough for ipv4)
-    struct sockaddr_in6 from; socklen_t fromlen = sizeof(from);
+    // make sure the receive buffers exist, this is a single allocation
+    // that is reused for the rest of the lifetime of the socket
+    if (_receivebuffer.empty()) _receivebuffer.resize(_batchsize * _datagramsize);
+
+    // per-message structures for the recvmmsg() call
+    struct mmsghdr messages[_batchsize];
+    struct iovec iovecs[_batchsize];
+
+    // structures that will hold the source addresses (we use ipv6 structs because they are also big enough for ipv4)
+    struct sockaddr_in6 froms[_batchsize];
 
     // get current time
     Now now;
 
     // we want to get as much messages at onces as possible, but not run forever
-    // @todo use scatter-gather io to optimize this further
-    for (size_t messages = 0; messages < 1024; ++messages)
+    for (size_t total = 0; total < 1024; )
     {
-        // reveive the message (the DONTWAIT option is needed because this is a blocking socket, but we dont want to block now)
-        auto bytes = recvfrom(_fd, buffer, sizeof(buffer), MSG_DONTWAIT, (struct sockaddr *)&from, &fromlen);
-        
-        // if there were no bytes, leap out
-        if (bytes <= 0) break;
+        // prepare the structures for one batch
+        for (size_t i = 0; i < _batchsize; ++i)
+        {
+            // each message gets its own slice of the receive buffer
+            iovecs[i].iov_base = _receivebuffer.data() + i * _datagramsize;
+            iovecs[i].iov_len = _datagramsize;
+
+            // fill in the message header
+            messages[i].msg_hdr.msg_name = &froms[i];
+            messages[i].msg_hdr.msg_namelen = sizeof(froms[i]);
+            messages[i].msg_hdr.msg_iov = &iovecs[i];
+            messages[i].msg_hdr.msg_iovlen = 1;
+            messages[i].msg_hdr.msg_control = nullptr;
+            messages[i].msg_hdr.msg_controllen = 0;
+            messages[i].msg_hdr.msg_flags = 0;
+        }
+
+        // drain a whole batch of datagrams with a single system call (the DONTWAIT
+        // option is needed because this is a blocking socket, but we dont want to block now)
+        auto count = recvmmsg(_fd, messages, _batchsize, MSG_DONTWAIT, nullptr);
+
+        // if there were no messages, leap out
+        if (count <= 0) break;
+
+        // pass all received messages to the handler
+        for (int i = 0; i < count; ++i)
+        {
+            // messages that did not fit in the buffer are truncated beyond repair, skip
+            // those (a well-behaved server never sends more than we advertised via edns)
+            if (messages[i].msg_hdr.msg_flags & MSG_TRUNC) continue;
+
+            // the message as raw bytes, for the tracepoint and the handler
+            auto *bytes = (unsigned char *)iovecs[i].iov_base;
 
-        // pass to the handler
-        _handler->onReceived(now, (struct sockaddr *)&from, buffer, bytes);
-    } 
+            // tracepoint: a datagram was read from the socket
+            DNSCPP_PROBE3(datagram_received, messages[i].msg_len >= 2 ? uint16_t(bytes[0]) << 8 | bytes[1] : 0, messages[i].msg_len, _fd);
+
+            // pass to the handler
+            _handler->onReceived(now, (struct sockaddr *)&froms[i], bytes, messages[i].msg_len);
+        }
+
+        // update the number of messages that have been handled
+        total += count;
+
+        // a partial batch means that the socket has been fully drained
+        if ((size_t)count < _batchsize) break;
+    }
+
+    // the notification might also mean that the socket became writable
+    // again, so this is the moment to flush the backlog of outgoing messages
+    if (!_outgoing.empty()) flush();
+}
+
+/**
+ *  Poll the socket directly and process whatever came in, without
+ *  waiting for the readiness callback of the event loop
+ *  @return bool    was a datagram received and processed?
+ */
+bool Udp::spin()
+{
+    // only open sockets can hold datagrams
+    if (_fd < 0) return false;
+
+    // leap out if nothing is waiting
+    if (!readable()) return false;
+
+    // drain and process the datagrams that came in
+    notify();
+
+    // something was processed
+    return true;
+}
+
+/**
+ *  The number of datagrams that the kernel dropped on this socket
+ *  because the receive buffer was full
+ *  @return size_t
+ */
+size_t Udp::drops() const
+{
+    // the counter comes from the SO_MEMINFO option, which not all
+    // platforms have (it appeared in linux 4.6)
+#ifdef SO_MEMINFO
+    // not-yet-opened sockets have dropped nothing
+    if (_fd < 0) return 0;
+
+    // the option fills an array of counters
+    uint32_t info[16]; socklen_t size = sizeof(info);
+
+    // ask the kernel
+    if (getsockopt(_fd, SOL_SOCKET, SO_MEMINFO, info, &size) != 0) return 0;
+
+    // the drop-counter (SK_MEMINFO_DROPS) is the ninth element
+    if (size < 9 * sizeof(uint32_t)) return 0;
+
+    // expose the counter
+    return info[8];
+#else
+    // the counter is not available
+    return 0;
+#endif
+}
+
+/**
+ *  Connect the socket to the nameserver
+ *  @param  ip      IP address of the nameserver
+ *  @return bool
+ */
+bool Udp::connect(const Ip &ip)
+{
+    // should we connect in the ipv4 or the ipv6 fashion?
+    if (ip.version() == 6)
+    {
+        // structure to initialize
+        struct sockaddr_in6 info;
+
+        // fill the members
+        memset(&info, 0, sizeof(info));
+        info.sin6_family = AF_INET6;
+        info.sin6_port = htons(_core->dnsport());
+
+        // copy the address
+        memcpy(&info.sin6_addr, (const struct in6_addr *)ip, sizeof(struct in6_addr));
+
+        // connect the socket (when this fails we fall back on sendto())
+        _connected = ::connect(_fd, (struct sockaddr *)&info, sizeof(info)) == 0;
+    }
+    else
+    {
+        // structure to initialize
+        struct sockaddr_in info;
+
+        // fill the members
+        memset(&info, 0, sizeof(info));
+        info.sin_family = AF_INET;
+        info.sin_port = htons(_core->dnsport());
+
+        // copy address
+        memcpy(&info.sin_addr, (const struct in_addr *)ip, sizeof(struct in_addr));
+
+        // connect the socket (when this fails we fall back on sendto())
+        _connected = ::connect(_fd, (struct sockaddr *)&info, sizeof(info)) == 0;
+    }
+
+    // done
+    return _connected;
 }
 
 /**
@@ -176,9 +392,35 @@ void Udp::notify()
  *  @return bool
  */
 bool Udp::send(const Ip &ip, const Query &query)
+{
+    // pass on the raw message
+    return send(ip, query.data(), query.size());
+}
+
+/**
+ *  Send a message to a nameserver (+open the socket when needed)
+ *  @param  ip      IP address of the nameserver
+ *  @param  data    the message to send
+ *  @param  size    size of the message
+ *  @return bool
+ */
+bool Udp::send(const Ip &ip, const unsigned char *data, size_t size)
 {
     // if the socket is not yet open we need to open it
-    if (_fd < 0 && !open(ip.version())) return false;
+    if (_fd < 0)
+    {
+        // open the socket
+        if (!open(ip.version())) return false;
+
+        // a socket only ever talks to one nameserver, so we connect it right
+        // away: the kernel then does the route lookup once instead of for
+        // every datagram, and reports icmp errors (port-unreachable) right
+        // away instead of us having to wait for the full timeout
+        connect(ip);
+    }
+
+    // connected sockets have a short path without any address bookkeeping
+    if (_connected) return send(nullptr, 0, data, size);
 
     // should we bind in the ipv4 or ipv6 fashion?
     if (ip.version() == 6)
@@ -188,7 +430,7 @@ bool Udp::send(const Ip &ip, const Query &query)
 
         // fill the members
         info.sin6_family = AF_INET6;
-        info.sin6_port = htons(53);
+        info.sin6_port = htons(_core->dnsport());
         info.sin6_flowinfo = 0;
         info.sin6_scope_id = 0;
 
@@ -196,7 +438,7 @@ bool Udp::send(const Ip &ip, const Query &query)
         memcpy(&info.sin6_addr, (const struct in6_addr *)ip, sizeof(struct in6_addr));
         
         // pass on to other method
-        return send((struct sockaddr *)&info, sizeof(struct sockaddr_in6), query);
+        return send((struct sockaddr *)&info, sizeof(struct sockaddr_in6), data, size);
     }
     else
     {
@@ -205,28 +447,133 @@ bool Udp::send(const Ip &ip, const Query &query)
 
         // fill the members
         info.sin_family = AF_INET;
-        info.sin_port = htons(53);
+        info.sin_port = htons(_core->dnsport());
 
         // copy address
         memcpy(&info.sin_addr, (const struct in_addr *)ip, sizeof(struct in_addr));
 
         // pass on to other method
-        return send((const sockaddr *)&info, sizeof(struct sockaddr_in), query);
+        return send((const sockaddr *)&info, sizeof(struct sockaddr_in), data, size);
     }
 }
 
 /**
- *  Send a query to a certain nameserver
+ *  Send a message to a certain nameserver
  *  @param  address     target address
- *  @param  size        size of the address
- *  @param  query       query to send
+ *  @param  addrsize    size of the address
+ *  @param  data        the message to send
+ *  @param  size        size of the message
  *  @return bool
  */
-bool Udp::send(const struct sockaddr *address, size_t size, const Query &query)
+bool Udp::send(const struct sockaddr *address, size_t addrsize, const unsigned char *data, size_t size)
 {
-    // send over the socket
-    // @todo include MSG_DONTWAIT + implement non-blocking????
-    return sendto(_fd, query.data(), query.size(), MSG_NOSIGNAL, address, size) >= 0;
+    // tracepoint: a query leaves (possibly via the backlog below)
+    DNSCPP_PROBE3(query_sent, size >= 2 ? uint16_t(data[0]) << 8 | data[1] : 0, size, _fd);
+
+    // if there already is a backlog we append to it, so that messages
+    // leave the socket in the same order in which they were handed to us
+    if (!_outgoing.empty()) return enqueue(address, addrsize, data, size);
+
+    // the socket is not saturated, try to send right away (connected
+    // sockets are called without address)
+    auto result = address ?
+        sendto(_fd, data, size, MSG_NOSIGNAL, address, addrsize) :
+        ::send(_fd, data, size, MSG_NOSIGNAL);
+
+    // was the message handed to the kernel?
+    if (result >= 0) return true;
+
+    // real failures are reported to the caller, only a full socket buffer
+    // is handled here by falling back on the backlog
+    if (errno != EAGAIN && errno != EWOULDBLOCK) return false;
+
+    // the socket is full, queue the message and wait for writability
+    return enqueue(address, addrsize, data, size);
+}
+
+/**
+ *  Add a datagram to the backlog of messages that still have to go out
+ *  @param  address     target address
+ *  @param  addrsize    size of the address
+ *  @param  data        the message to send
+ *  @param  size        size of the message
+ *  @return bool        was the message queued?
+ */
+bool Udp::enqueue(const struct sockaddr *address, size_t addrsize, const unsigned char *data, size_t size)
+{
+    // an unbounded backlog would just hide a structurally overloaded socket,
+    // the caller should back off instead (it does not burn an attempt then)
+    if (_outgoing.size() >= 1024) return false;
+
+    // add an empty entry to the backlog
+    _outgoing.emplace_back();
+
+    // get a reference to it
+    auto &entry = _outgoing.back();
+
+    // copy the target address and the message (connected sockets have no
+    // address, we mark that with the unspecified family)
+    if (address) memcpy(&entry.first, address, addrsize);
+    else entry.first.ss_family = AF_UNSPEC;
+
+    // copy the message
+    entry.second.assign(data, data + size);
+
+    // if we were not yet monitoring for writability we should start now
+    if (_events != 3) _identifier = _core->loop()->update(_identifier, _fd, _events = 3, this);
+
+    // the message will go out later
+    return true;
+}
+
+/**
+ *  Flush the backlog of outgoing messages
+ */
+void Udp::flush()
+{
+    // keep sending batches until the backlog is empty or the socket is full
+    while (!_outgoing.empty())
+    {
+        // per-message structures for the sendmmsg() call
+        struct mmsghdr messages[_batchsize];
+        struct iovec iovecs[_batchsize];
+
+        // number of messages in this batch
+        size_t count = 0;
+
+        // fill the structures from the backlog
+        for (auto iter = _outgoing.begin(); iter != _outgoing.end() && count < _batchsize; ++iter, ++count)
+        {
+            // the message itself
+            iovecs[count].iov_base = iter->second.data();
+            iovecs[count].iov_len = iter->second.size();
+
+            // fill in the message header (the address-size follows from the
+            // family, connected sockets queue their messages without address)
+            messages[count].msg_hdr.msg_name = iter->first.ss_family == AF_UNSPEC ? nullptr : &iter->first;
+            messages[count].msg_hdr.msg_namelen = iter->first.ss_family == AF_UNSPEC ? 0 : (iter->first.ss_family == AF_INET6 ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in));
+            messages[count].msg_hdr.msg_iov = &iovecs[count];
+            messages[count].msg_hdr.msg_iovlen = 1;
+            messages[count].msg_hdr.msg_control = nullptr;
+            messages[count].msg_hdr.msg_controllen = 0;
+            messages[count].msg_hdr.msg_flags = 0;
+        }
+
+        // hand the whole batch to the kernel with a single system call
+        auto result = sendmmsg(_fd, messages, count, MSG_NOSIGNAL);
+
+        // if nothing was sent the socket is still full, we try again on the next notification
+        if (result <= 0) return;
+
+        // remove the messages that were sent
+        for (int i = 0; i < result; ++i) _outgoing.pop_front();
+
+        // a partial batch means that the socket is full again
+        if ((size_t)result < count) return;
+    }
+
+    // the backlog has been drained, writability notifications are no longer needed
+    _identifier = _core->loop()->update(_identifier, _fd, _events = 1, this);
 }
 
 /**
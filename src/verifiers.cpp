@@ -0,0 +1,174 @@
+/**
+ *  Verifiers.cpp
+ *
+ *  Implementation file for the Verifiers class
+ *
+ *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Dependencies
+ */
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdexcept>
+#include "../include/dnscpp/verifiers.h"
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Constructor
+ *  @param  loop        the event loop of the loop thread
+ *  @param  threads     number of worker threads
+ *  @throws std::runtime_error
+ */
+Verifiers::Verifiers(Loop *loop, size_t threads) : _loop(loop)
+{
+    // we need at least one worker
+    if (threads == 0) throw std::runtime_error("worker pool without workers");
+
+    // create the notification pipe
+    if (pipe(_fds) != 0) throw std::runtime_error("failed to create notification pipe");
+
+    // both ends should be non-blocking: the loop thread drains the read
+    // end without blocking, and a worker that cannot write because the
+    // pipe is full knows that a wakeup is already underway
+    fcntl(_fds[0], F_SETFL, fcntl(_fds[0], F_GETFL) | O_NONBLOCK);
+    fcntl(_fds[1], F_SETFL, fcntl(_fds[1], F_GETFL) | O_NONBLOCK);
+
+    // the pipe should not leak to child processes
+    fcntl(_fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(_fds[1], F_SETFD, FD_CLOEXEC);
+
+    // have the event loop watch the read end for readability
+    _identifier = _loop->add(_fds[0], 1, this);
+
+    // start the workers
+    for (size_t i = 0; i < threads; ++i) _threads.emplace_back(&Verifiers::run, this);
+}
+
+/**
+ *  Destructor
+ */
+Verifiers::~Verifiers()
+{
+    // tell the workers to stop, in a scope so the lock is released
+    // before the join
+    {
+        // the queues are shared
+        std::unique_lock<std::mutex> lock(_mutex);
+
+        // set the stop flag
+        _stop = true;
+
+        // wake up all idle workers
+        _condition.notify_all();
+    }
+
+    // wait for the workers to finish their current job
+    for (auto &thread : _threads) thread.join();
+
+    // the event loop no longer has to watch the pipe
+    _loop->remove(_identifier, _fds[0], this);
+
+    // close both ends
+    close(_fds[0]);
+    close(_fds[1]);
+}
+
+/**
+ *  The main function of each worker thread
+ */
+void Verifiers::run()
+{
+    // keep processing jobs
+    while (true)
+    {
+        // the job to run
+        Pending pending;
+
+        // in a scope so the lock is not held while the job runs
+        {
+            // the queues are shared
+            std::unique_lock<std::mutex> lock(_mutex);
+
+            // wait for a job or for shutdown
+            _condition.wait(lock, [this]() { return _stop || !_jobs.empty(); });
+
+            // leap out when the pool is being destructed
+            if (_stop) return;
+
+            // take the oldest job
+            pending = std::move(_jobs.front()); _jobs.pop_front();
+        }
+
+        // the verdict of the job, a job that throws is never valid
+        bool valid = false;
+
+        // run the job, but prevent exceptions
+        try { valid = pending.job(); } catch (...) {}
+
+        // in a scope so the lock is released before the write
+        {
+            // the queues are shared
+            std::unique_lock<std::mutex> lock(_mutex);
+
+            // store the verdict for the loop thread
+            _verdicts.push_back(Verdict{ std::move(pending.callback), valid });
+        }
+
+        // wake up the loop thread (a failed write means the pipe is
+        // full, so a wakeup is already on its way and nothing is lost)
+        auto result = write(_fds[1], "x", 1); (void)result;
+    }
+}
+
+/**
+ *  Method that is called by the event loop when the pipe becomes readable
+ */
+void Verifiers::notify()
+{
+    // drain the pipe, we deliver all verdicts in one batch anyway
+    char buffer[64]; while (read(_fds[0], buffer, sizeof(buffer)) > 0) {}
+
+    // the verdicts to deliver
+    std::deque<Verdict> verdicts;
+
+    // in a scope so the lock is not held while the callbacks run
+    {
+        // the queues are shared
+        std::unique_lock<std::mutex> lock(_mutex);
+
+        // take over all pending verdicts
+        verdicts.swap(_verdicts);
+    }
+
+    // deliver the verdicts on this (the loop) thread
+    for (auto &verdict : verdicts) verdict.callback(verdict.valid);
+}
+
+/**
+ *  Queue a job to the pool
+ *  @param  job         the check to run
+ *  @param  callback    the callback for the verdict
+ */
+void Verifiers::offload(const Job &job, const Callback &callback)
+{
+    // the queues are shared
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    // add the job
+    _jobs.push_back(Pending{ job, callback });
+
+    // wake up one idle worker
+    _condition.notify_one();
+}
+
+/**
+ *  End of namespace
+ */
+}
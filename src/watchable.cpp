@@ -20,12 +20,10 @@ namespace DNS {
  */
 Watchable::~Watchable()
 {
-    // loop through all monitors
-    for (auto iter = _monitors.begin(); iter != _monitors.end(); iter++)
-    {
-        // tell the monitor that it now is invalid
-        (*iter)->invalidate();
-    }
+    // tell all watchers that they now are invalid (the list is almost
+    // always empty or holds a single entry), no watcher unlinks itself
+    // afterwards because an invalidated watcher skips the removal
+    for (auto *watcher = _watchers; watcher != nullptr; watcher = watcher->_next) watcher->invalidate();
 }
 
 /**
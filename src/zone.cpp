@@ -0,0 +1,438 @@
+/**
+ *  Zone.cpp
+ *
+ *  Implementation file for the Zone and ZoneBuilder classes
+ *
+ *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Dependencies
+ */
+#include "../include/dnscpp/ip.h"
+#include "../include/dnscpp/zone.h"
+#include "../include/dnscpp/response.h"
+#include "../include/dnscpp/handler.h"
+#include "../include/dnscpp/question.h"
+#include "../include/dnscpp/type.h"
+#include "fakeresponse.h"
+#include "dname.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Helper function to hash a name without looking at case, because
+ *  domain names are case-insensitive (fnv-1a, same as the hosts index)
+ *  @param  name        the name to hash
+ *  @return uint64_t
+ */
+static uint64_t hash(const char *name)
+{
+    // the 64-bit fnv-1a offset-basis
+    uint64_t result = 14695981039346656037ull;
+
+    // mix in all characters of the name
+    for (const char *c = name; *c; ++c) result = (result ^ (uint8_t)tolower(*c)) * 1099511628211ull;
+
+    // done
+    return result;
+}
+
+/**
+ *  Destructor
+ */
+Zone::~Zone()
+{
+    // remove the mapping (if any)
+    if (_address != nullptr) munmap(_address, _size);
+}
+
+/**
+ *  Load a compiled zone file
+ *  @param  filename    the file to map
+ *  @return bool        was the file valid and mapped?
+ */
+bool Zone::load(const char *filename)
+{
+    // open the file for reading
+    int fd = open(filename, O_RDONLY | O_CLOEXEC);
+
+    // file should be open by now
+    if (fd < 0) return false;
+
+    // we need the size of the file
+    struct stat info;
+
+    // if the file cannot be inspected
+    if (fstat(fd, &info) != 0) { ::close(fd); return false; }
+
+    // the file must at least hold a header
+    if ((size_t)info.st_size < sizeof(Header)) { ::close(fd); return false; }
+
+    // map the file read-only and shared, so that the page cache backs the
+    // mapping and all worker processes that load the same file share it
+    void *address = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+    // the descriptor is no longer needed, the mapping stays valid without it
+    ::close(fd);
+
+    // check for failure
+    if (address == MAP_FAILED) return false;
+
+    // access to the header
+    auto *header = (const Header *)address;
+
+    // validate the magic bytes
+    if (memcmp(header->magic, "DNSCPPZ1", 8) != 0) { munmap(address, info.st_size); return false; }
+
+    // the slot count must be a power of two, and the table must fit in the file
+    if (header->slots == 0 || (header->slots & (header->slots - 1)) != 0) { munmap(address, info.st_size); return false; }
+    if (sizeof(Header) + header->slots * sizeof(Slot) > (size_t)info.st_size) { munmap(address, info.st_size); return false; }
+
+    // get rid of the zone that was loaded before (if any)
+    if (_address != nullptr) munmap(_address, _size);
+
+    // install the new mapping
+    _address = address;
+    _size = info.st_size;
+
+    // done
+    return true;
+}
+
+/**
+ *  Find the entry for an exact (already normalized) name
+ *  @param  name    the name to look for (lowercase, no trailing dot)
+ *  @return const unsigned char *   the entry (nullptr if there is no match)
+ */
+const unsigned char *Zone::find(const char *name) const
+{
+    // mask for the probe sequence (slot count is a power of two)
+    uint64_t mask = header()->slots - 1;
+
+    // hash of the name
+    uint64_t code = hash(name);
+
+    // probe until we run into an empty slot, a full revolution means that
+    // there is no match either (a well-formed file is never more than half
+    // full, but a corrupt file without empty slots must not loop forever)
+    uint64_t slot = code & mask;
+
+    // check all slots at most once
+    for (uint64_t attempt = 0; attempt < header()->slots; ++attempt, slot = (slot + 1) & mask)
+    {
+        // get a reference to the slot
+        const auto &current = slots()[slot];
+
+        // an empty slot means that there is no match at all
+        if (current.offset == 0) return nullptr;
+
+        // skip slots that hold a different hash
+        if (current.hash != code) continue;
+
+        // refuse entries that point outside the file (a corrupt or
+        // truncated file should not take the process down), written in
+        // subtraction form so huge offsets cannot wrap the comparison
+        if (current.offset >= _size || _size - current.offset < 4) return nullptr;
+
+        // access to the entry (flags byte, two counters, then the name)
+        auto *entry = (const unsigned char *)_address + current.offset;
+
+        // the stored name must be null-terminated inside the mapping,
+        // otherwise the comparison could read past the mapped region
+        auto *terminator = (const char *)memchr(entry + 3, '\0', _size - current.offset - 3);
+
+        // refuse entries with an unterminated name
+        if (terminator == nullptr) return nullptr;
+
+        // the addresses stored behind the name must fit in the mapping too,
+        // otherwise answering from this entry would read past it
+        if ((size_t)(terminator + 1 - (const char *)_address) + entry[1] * 4 + entry[2] * 16 > _size) return nullptr;
+
+        // the stored name must really match (hashes can collide)
+        if (Dname::equal((const char *)entry + 3, name)) return entry;
+    }
+
+    // all slots were visited without running into a match
+    return nullptr;
+}
+
+/**
+ *  Find the entry that applies to a query
+ *  @param  qname   the name that is being queried
+ *  @param  qtype   the record type that is being queried
+ *  @return const unsigned char *   the entry (nullptr if there is no match)
+ */
+const unsigned char *Zone::applicable(const char *qname, uint16_t qtype) const
+{
+    // without a loaded zone there can be no match
+    if (_address == nullptr) return nullptr;
+
+    // we need a local copy because a possible trailing dot must be
+    // stripped before the name can be compared with the stored entries
+    char buffer[NS_MAXDNAME];
+
+    // length of the name
+    size_t length = strlen(qname);
+
+    // refuse names that do not even fit in a valid dns name
+    if (length >= sizeof(buffer)) return nullptr;
+
+    // copy, and strip the trailing dot of absolute names
+    memcpy(buffer, qname, length + 1);
+    if (length > 0 && buffer[length-1] == '.') buffer[length-1] = '\0';
+
+    // walk from the full name to ever shorter enclosing suffixes
+    for (const char *current = buffer; *current != '\0'; )
+    {
+        // look for an entry for this suffix
+        auto *entry = find(current);
+
+        // is this entry usable for the query? the exact name always
+        // applies, an enclosing suffix only when it covers subdomains
+        if (entry && (current == buffer || (entry[0] & _subdomains)))
+        {
+            // blocked names match queries of any type
+            if (entry[0] & _blocked) return entry;
+
+            // rewrites only answer queries for a family they hold addresses for
+            if (qtype == TYPE_A && entry[1] > 0) return entry;
+            if (qtype == TYPE_AAAA && entry[2] > 0) return entry;
+        }
+
+        // move to the next (shorter) suffix
+        auto *dot = strchr(current, '.');
+
+        // stop when there are no more labels to strip
+        if (dot == nullptr) break;
+
+        // continue right behind the dot
+        current = dot + 1;
+    }
+
+    // nothing in the zone applies to this query
+    return nullptr;
+}
+
+/**
+ *  Does the zone hold an answer for a certain query?
+ *  @param  qname   the name that is being queried
+ *  @param  qtype   the record type that is being queried
+ *  @return bool
+ */
+bool Zone::match(const char *qname, uint16_t qtype) const
+{
+    // pass on to the finder
+    return applicable(qname, qtype) != nullptr;
+}
+
+/**
+ *  Notify a user-space handler about the answer for a certain query
+ *  @param  request         the original request
+ *  @param  handler         user-space object that should be notified
+ *  @param  operation       the operation-pointer that should be passed
+ *  @return bool            was the handler called?
+ */
+bool Zone::notify(const Request &request, Handler *handler, const Operation *operation) const
+{
+    // extract the question
+    Question question(request);
+
+    // construct the fake response message that we will pass to user-space
+    FakeResponse response(request, question);
+
+    // look up the entry once more (the lookup was scheduled because there
+    // was a match, but the zone could have been swapped in the meantime)
+    auto *entry = applicable(question.name(), question.type());
+
+    // blocked names are answered with nxdomain
+    if (entry != nullptr && (entry[0] & _blocked)) response.rcode(ns_r_nxdomain);
+
+    // rewrites are answered with the stored addresses of the right family
+    else if (entry != nullptr)
+    {
+        // the addresses live behind the flags, the counters and the name
+        // (find() already verified that they fit inside the mapping)
+        auto *data = entry + 3 + strlen((const char *)entry + 3) + 1;
+
+        // the ipv4 addresses come first
+        if (question.type() == TYPE_A)
+        {
+            // append all ipv4 addresses
+            for (size_t i = 0; i < entry[1]; ++i) response.append(question.name(), Ip((const struct in_addr *)(data + i * 4)));
+        }
+        else if (question.type() == TYPE_AAAA)
+        {
+            // the ipv6 addresses are stored behind the ipv4 addresses
+            data += entry[1] * 4;
+
+            // append all ipv6 addresses
+            for (size_t i = 0; i < entry[2]; ++i) response.append(question.name(), Ip((const struct in6_addr *)(data + i * 16)));
+        }
+    }
+
+    // send back the answer
+    handler->onReceived(operation, Response(response.data(), response.size()));
+
+    // done
+    return true;
+}
+
+/**
+ *  Normalize a name: fold to lowercase and strip the trailing dot
+ *  @param  name        the name to normalize
+ *  @return std::string
+ */
+std::string ZoneBuilder::normalize(const char *name)
+{
+    // make a copy
+    std::string result(name);
+
+    // strip the trailing dot of absolute names
+    if (!result.empty() && result.back() == '.') result.pop_back();
+
+    // fold to lowercase
+    for (auto &c : result) c = tolower(c);
+
+    // done
+    return result;
+}
+
+/**
+ *  Block a name
+ *  @param  name        the name to block
+ *  @param  subdomains  should subdomains be blocked too?
+ */
+void ZoneBuilder::block(const char *name, bool subdomains)
+{
+    // get (or create) the entry
+    auto &policy = _entries[normalize(name)];
+
+    // update the policy
+    policy.blocked = true;
+    if (subdomains) policy.subdomains = true;
+}
+
+/**
+ *  Add a rewrite
+ *  @param  name        the name to rewrite
+ *  @param  ip          the address to answer with
+ *  @param  subdomains  should subdomains get the same answer?
+ */
+void ZoneBuilder::add(const char *name, const Ip &ip, bool subdomains)
+{
+    // get (or create) the entry
+    auto &policy = _entries[normalize(name)];
+
+    // store the raw address in the right family (each entry holds at
+    // most 255 addresses per family, more makes no sense in an answer)
+    auto &list = ip.version() == 4 ? policy.ipv4 : policy.ipv6;
+
+    // check the capacity
+    if (list.size() >= 255) return;
+
+    // add the raw address bytes
+    list.emplace_back((const char *)ip.data(), ip.size());
+
+    // update the policy
+    if (subdomains) policy.subdomains = true;
+}
+
+/**
+ *  Write the compiled zone to a file
+ *  @param  filename    the file to (over)write
+ *  @return bool        was the file written?
+ */
+bool ZoneBuilder::save(const char *filename) const
+{
+    // the number of slots that we want: the first power of two that keeps
+    // the table at most half full, so that linear probing stays fast
+    uint64_t slots = 64;
+
+    // keep doubling
+    while (slots < _entries.size() * 2) slots *= 2;
+
+    // the (initially empty) slot table
+    std::vector<Zone::Slot> table(slots);
+
+    // the data region with the serialized entries
+    std::vector<unsigned char> data;
+
+    // offset of the data region in the file
+    uint64_t base = sizeof(Zone::Header) + slots * sizeof(Zone::Slot);
+
+    // mask for the probe sequence
+    uint64_t mask = slots - 1;
+
+    // serialize all entries
+    for (const auto &iter : _entries)
+    {
+        // hash of the name (the names are already normalized)
+        uint64_t code = hash(iter.first.data());
+
+        // probe until we find a free slot
+        for (uint64_t slot = code & mask; true; slot = (slot + 1) & mask)
+        {
+            // skip slots that are already occupied
+            if (table[slot].offset != 0) continue;
+
+            // claim the slot, the entry goes at the end of the data region
+            table[slot].hash = code;
+            table[slot].offset = base + data.size();
+
+            // done
+            break;
+        }
+
+        // the flags byte
+        unsigned char flags = 0;
+        if (iter.second.subdomains) flags |= 1;
+        if (iter.second.blocked) flags |= 2;
+
+        // serialize flags, the two address counters and the name
+        data.push_back(flags);
+        data.push_back((unsigned char)iter.second.ipv4.size());
+        data.push_back((unsigned char)iter.second.ipv6.size());
+        data.insert(data.end(), iter.first.data(), iter.first.data() + iter.first.size() + 1);
+
+        // serialize the raw addresses, ipv4 first
+        for (const auto &ip : iter.second.ipv4) data.insert(data.end(), ip.begin(), ip.end());
+        for (const auto &ip : iter.second.ipv6) data.insert(data.end(), ip.begin(), ip.end());
+    }
+
+    // construct the header
+    Zone::Header header;
+    memcpy(header.magic, "DNSCPPZ1", 8);
+    header.slots = slots;
+    header.entries = _entries.size();
+
+    // open the output file
+    int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+    // file should be open by now
+    if (fd < 0) return false;
+
+    // write header, slot table and data region
+    bool success = write(fd, &header, sizeof(header)) == (ssize_t)sizeof(header)
+                && write(fd, table.data(), table.size() * sizeof(Zone::Slot)) == (ssize_t)(table.size() * sizeof(Zone::Slot))
+                && write(fd, data.data(), data.size()) == (ssize_t)data.size();
+
+    // close the file
+    ::close(fd);
+
+    // done
+    return success;
+}
+
+/**
+ *  End of namespace
+ */
+}
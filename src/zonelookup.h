@@ -0,0 +1,134 @@
+/**
+ *  ZoneLookup.h
+ *
+ *  Class that implements a lookup that is answered from the memory-mapped
+ *  local policy zone, without any network traffic. This is the twin of
+ *  the LocalLookup class that answers from the /etc/hosts file
+ *
+ *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include "../include/dnscpp/request.h"
+#include "../include/dnscpp/zone.h"
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Class definition
+ */
+class ZoneLookup : public Lookup
+{
+private:
+    /**
+     *  Reference to the policy zone
+     *  @var Zone
+     */
+    const Zone &_zone;
+
+    /**
+     *  Is the operation ready?
+     *  @var bool
+     */
+    bool _ready = false;
+
+    /**
+     *  Method that is called when it is time to process this lookup
+     *  @param  now     current time
+     *  @return bool    should it be rescheduled?
+     */
+    virtual bool execute(double now) override
+    {
+        // do nothing if ready
+        if (_ready) return false;
+
+        // pass to the zone
+        _zone.notify(Request(this), _handler, this);
+
+        // remember that the operation is ready
+        _ready = true;
+
+        // no need to reschedule
+        return false;
+    }
+
+    /**
+     *  How long should we wait until the next runtime?
+     *  @param  now         current time
+     *  @return double      delay in seconds
+     */
+    virtual double delay(double now) const override
+    {
+        // should run right away
+        return 0.0;
+    }
+
+    /**
+     *  How many credits are left (meaning: how many datagrams do we still have to send?)
+     *  @return size_t      number of attempts
+     */
+    virtual size_t credits() const override
+    {
+        // zone lookups do not send anything at all
+        return 0;
+    }
+
+    /**
+     *  Cancel the lookup
+     */
+    virtual void cancel() override
+    {
+        // if already reported back to user-space
+        if (_handler == nullptr) return;
+
+        // remember the handler
+        auto *handler = _handler;
+
+        // get rid of the handler to avoid that the result is reported
+        _handler = nullptr;
+
+        // the last instruction is to report it back to user-space
+        handler->onCancelled(this);
+    }
+
+public:
+    /**
+     *  Constructor
+     *  To keep the behavior of lookups consistent with the behavior of remote lookups, the
+     *  result is reported in a later tick of the event loop (unless immediate mode is on)
+     *  @param  zone
+     *  @param  domain
+     *  @param  type
+     *  @param  handler
+     */
+    ZoneLookup(const Zone &zone, const char *domain, int type, Handler *handler) :
+        Lookup(handler, ns_o_query, domain, type, false), _zone(zone) {}
+
+    /**
+     *  Destructor
+     *  This is a self-destructing class
+     */
+    virtual ~ZoneLookup()
+    {
+        // if the operation is destructed while it was still running, it means that the
+        // operation was prematurely cancelled from user-space, let the handler
+        // know (unless an explicit cancel() already did)
+        if (!_ready && _handler != nullptr) _handler->onCancelled(this);
+    }
+};
+
+/**
+ *  End of namespace
+ */
+}
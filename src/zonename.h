@@ -13,6 +13,12 @@
  */
 #pragma once
 
+/**
+ *  Dependencies
+ */
+#include "dname.h"
+#include "name.h"
+
 /**
  *  Begin of namespace
  */
@@ -48,7 +54,24 @@ public:
         // we have the zone
         _name = dot + 1;
     }
-    
+
+    /**
+     *  Constructor that starts from an already-indexed name, so that
+     *  code that needs the zones of a whole ancestor chain does not
+     *  re-scan the string for every level (the string that was used to
+     *  construct the name must still be in scope)
+     *  @param  name        the indexed hostname
+     *  @throws std::runtime_error
+     */
+    ZoneName(const Name &name)
+    {
+        // a zone can only be extracted when there is a parent label
+        if (name.labels() < 2) throw std::runtime_error("no zone could be extracted");
+
+        // the zone starts at the second label, an O(1) hop in the index
+        _name = name.suffix(name.labels() - 1);
+    }
+
     /**
      *  Destructor
      */
@@ -63,7 +86,7 @@ public:
      */
     bool operator==(const char *name) const
     {
-        return strcasecmp(_name, name) == 0;
+        return Dname::equal(_name, name);
     }
 
     /**
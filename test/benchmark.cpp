@@ -0,0 +1,387 @@
+/**
+ *  Benchmark.cpp
+ *
+ *  Benchmark harness for the library. Unlike stress.cpp (which fires
+ *  one big burst and counts successes), this program generates load
+ *  with an open-loop arrival schedule at a configurable target rate,
+ *  so that queueing delay inside the library shows up in the measured
+ *  latencies instead of being hidden by back-pressure. Latencies are
+ *  collected in an hdr-style log-linear histogram and reported as
+ *  percentiles (p50/p95/p99/p999), with per-second throughput along
+ *  the way.
+ *
+ *  Usage: benchmark [qps] [concurrency] [seconds] [labelsize] [allocbudget]
+ *
+ *      qps         target queries per second       (default 1000)
+ *      concurrency max lookups inside the library  (default 1000)
+ *      seconds     duration of the run             (default 10)
+ *      labelsize   size of the generated labels    (default 4)
+ *      allocbudget max heap allocations per lookup (default 0 = no limit)
+ *
+ *  When the library is built with -DDNSCPP_ALLOCATIONS the per-lookup
+ *  allocation averages are reported too, and the program exits with
+ *  status 2 when the allocbudget is exceeded, so that a ci pipeline
+ *  can fail a build that reintroduces allocations on the hot path.
+ *
+ *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Dependencies
+ */
+#include <dnscpp.h>
+#include <iostream>
+#include <iomanip>
+#include <unordered_map>
+#include <ev.h>
+#include <dnscpp/libev.h>
+#include <math.h>
+#include "histogram.h"
+
+/**
+ *  The benchmark driver: issues queries on an open-loop schedule and
+ *  collects the per-lookup latencies
+ */
+class Benchmark : public DNS::Handler
+{
+private:
+    /**
+     *  The dns context under test
+     *  @var DNS::Context
+     */
+    DNS::Context &_context;
+
+    /**
+     *  The libev loop (needed to stop it at the end)
+     *  @var struct ev_loop
+     */
+    struct ev_loop *_loop;
+
+    /**
+     *  Target rate in queries per second
+     *  @var double
+     */
+    double _qps;
+
+    /**
+     *  End-time of the run
+     *  @var double
+     */
+    double _end;
+
+    /**
+     *  Size of the generated labels
+     *  @var size_t
+     */
+    size_t _labelsize;
+
+    /**
+     *  Number of queries that the schedule owes us (fractional, so that
+     *  non-integer rates and tick-sizes work out exactly)
+     *  @var double
+     */
+    double _due = 0.0;
+
+    /**
+     *  Sequence number of the next query (this becomes the domain)
+     *  @var uint64_t
+     */
+    uint64_t _sequence = 0;
+
+    /**
+     *  Start-times of the lookups that are in flight
+     *  @var std::unordered_map
+     */
+    std::unordered_map<const DNS::Operation*,double> _inflight;
+
+    /**
+     *  The latency histogram
+     *  @var Histogram
+     */
+    Histogram _histogram;
+
+    /**
+     *  The allocation counters at the start of the run (all zero in
+     *  builds without -DDNSCPP_ALLOCATIONS)
+     *  @var DNS::Allocations::Snapshot
+     */
+    DNS::Allocations::Snapshot _allocations = DNS::Allocations::snapshot();
+
+    /**
+     *  Counters for the final report
+     *  @var uint64_t
+     */
+    uint64_t _issued = 0, _success = 0, _failures = 0, _timeouts = 0;
+
+    /**
+     *  Counters at the time of the previous per-second report
+     *  @var uint64_t
+     */
+    uint64_t _previssued = 0, _prevdone = 0;
+
+    /**
+     *  The pacing timer (fires many times per second) and the timer
+     *  for the per-second progress report
+     *  @var ev_timer
+     */
+    ev_timer _pacer, _reporter;
+
+    /**
+     *  Generate the domain for a sequence number: base-26 labels so
+     *  that every query is unique and nothing is answered from cache
+     *  @param  buffer      output buffer
+     *  @param  sequence    the sequence number
+     */
+    void domain(char *buffer, uint64_t sequence) const
+    {
+        // fill the label
+        for (size_t i = 0; i < _labelsize; ++i, sequence /= 26) buffer[i] = 'a' + sequence % 26;
+
+        // and the fixed suffix
+        strcpy(buffer + _labelsize, ".com");
+    }
+
+    /**
+     *  One tick of the open-loop schedule: issue the queries that are
+     *  due by now, no matter how many are still in flight
+     *  @param  now     current time
+     */
+    void tick(double now)
+    {
+        // the schedule is over when the end-time has passed
+        if (now >= _end) { ev_timer_stop(_loop, &_pacer); return; }
+
+        // the queries that the schedule owes us by now
+        _due += _qps * _pacer.repeat;
+
+        // issue them all
+        while (_due >= 1.0)
+        {
+            // one less owed
+            _due -= 1.0;
+
+            // the domain of this query
+            char name[64]; domain(name, _sequence++);
+
+            // issue the lookup
+            auto *operation = _context.query(name, ns_t_a, this);
+
+            // administration for the latency measurement
+            if (operation) { _inflight[operation] = ev_time(); _issued += 1; }
+        }
+    }
+
+    /**
+     *  One lookup came back (with whatever outcome)
+     *  @param  operation   the operation that finished
+     */
+    void finish(const DNS::Operation *operation)
+    {
+        // find the start-time back
+        auto iter = _inflight.find(operation);
+
+        // unknown operations should not happen, but better be safe
+        if (iter == _inflight.end()) return;
+
+        // record the latency
+        _histogram.add(ev_time() - iter->second);
+
+        // administration
+        _inflight.erase(iter);
+
+        // when the schedule is done and the last lookup came back the
+        // benchmark is over
+        if (ev_time() >= _end && _inflight.empty()) ev_break(_loop, EVBREAK_ONE);
+    }
+
+    /**
+     *  Per-second progress report (this is the per-phase throughput)
+     */
+    void progress()
+    {
+        // lookups that completed so far
+        uint64_t done = _success + _failures + _timeouts;
+
+        // show the throughput of the past second
+        std::cout << "issued " << (_issued - _previssued) << "/s  completed " << (done - _prevdone) << "/s  inflight " << _inflight.size() << std::endl;
+
+        // remember for the next phase
+        _previssued = _issued; _prevdone = done;
+    }
+
+    /**
+     *  Handler method for successful lookups
+     *  @param  operation   the operation that finished
+     *  @param  response    the received response
+     */
+    virtual void onResolved(const DNS::Operation *operation, const DNS::Response &response) override
+    {
+        // count and finish
+        _success += 1; finish(operation);
+    }
+
+    /**
+     *  Handler method for failed lookups (nxdomain is expected here,
+     *  the generated domains normally do not exist)
+     *  @param  operation   the operation that finished
+     *  @param  rcode       the received rcode
+     */
+    virtual void onFailure(const DNS::Operation *operation, int rcode) override
+    {
+        // count and finish
+        _failures += 1; finish(operation);
+    }
+
+    /**
+     *  Handler method for lookups that timed out
+     *  @param  operation   the operation that timed out
+     */
+    virtual void onTimeout(const DNS::Operation *operation) override
+    {
+        // count and finish
+        _timeouts += 1; finish(operation);
+    }
+
+    /**
+     *  Trampolines from the libev c callbacks to the member functions
+     *  @param  loop        the reporting loop
+     *  @param  timer       the timer that fired
+     *  @param  revents     the events
+     */
+    static void onPace(struct ev_loop *loop, ev_timer *timer, int revents)
+    {
+        // pass on to the member function
+        ((Benchmark *)timer->data)->tick(ev_time());
+    }
+    static void onReport(struct ev_loop *loop, ev_timer *timer, int revents)
+    {
+        // pass on to the member function
+        ((Benchmark *)timer->data)->progress();
+    }
+
+public:
+    /**
+     *  Constructor
+     *  @param  context     the dns context under test
+     *  @param  loop        the libev loop
+     *  @param  qps         target rate in queries per second
+     *  @param  seconds     duration of the run
+     *  @param  labelsize   size of the generated labels
+     */
+    Benchmark(DNS::Context &context, struct ev_loop *loop, double qps, double seconds, size_t labelsize) :
+        _context(context), _loop(loop), _qps(qps), _end(ev_time() + seconds), _labelsize(labelsize)
+    {
+        // the pacing timer fires often, so that arrivals are spread out
+        // instead of batched per second
+        ev_timer_init(&_pacer, onPace, 0.0, 0.002); _pacer.data = this;
+        ev_timer_start(_loop, &_pacer);
+
+        // the progress report fires once per second
+        ev_timer_init(&_reporter, onReport, 1.0, 1.0); _reporter.data = this;
+        ev_timer_start(_loop, &_reporter);
+    }
+
+    /**
+     *  Destructor
+     */
+    virtual ~Benchmark()
+    {
+        // stop the timers
+        ev_timer_stop(_loop, &_pacer);
+        ev_timer_stop(_loop, &_reporter);
+    }
+
+    /**
+     *  Average number of heap allocations per issued lookup (zero in
+     *  builds without allocation accounting)
+     *  @return double
+     */
+    double allocrate() const
+    {
+        // nothing was measured without lookups or without accounting
+        if (_issued == 0 || !DNS::Allocations::enabled()) return 0.0;
+
+        // allocations since the start of the run, averaged per lookup
+        return double((DNS::Allocations::snapshot() - _allocations).count) / _issued;
+    }
+
+    /**
+     *  The final report with the percentiles
+     */
+    void report() const
+    {
+        // the totals
+        std::cout << std::endl << "issued " << _issued << "  success " << _success << "  failures " << _failures << "  timeouts " << _timeouts << std::endl;
+
+        // the per-lookup allocation averages, but only when the
+        // accounting build actually measured something
+        if (DNS::Allocations::enabled() && _issued > 0)
+        {
+            // the counters since the start of the run
+            auto delta = DNS::Allocations::snapshot() - _allocations;
+
+            // averaged per issued lookup
+            std::cout << std::fixed << std::setprecision(1)
+                << "allocations " << double(delta.count) / _issued << "/lookup"
+                << "  bytes " << double(delta.bytes) / _issued << "/lookup" << std::endl;
+        }
+
+        // without samples there are no percentiles
+        if (_histogram.count() == 0) return;
+
+        // the percentiles of the latency distribution
+        std::cout << std::fixed << std::setprecision(3)
+            << "latency p50 "  << _histogram.percentile(0.50)  * 1000 << "ms"
+            << "  p95 "        << _histogram.percentile(0.95)  * 1000 << "ms"
+            << "  p99 "        << _histogram.percentile(0.99)  * 1000 << "ms"
+            << "  p999 "       << _histogram.percentile(0.999) * 1000 << "ms" << std::endl;
+    }
+};
+
+/**
+ *  Main procedure
+ *  @param  argc    number of arguments
+ *  @param  argv    the arguments
+ *  @return int
+ */
+int main(int argc, char *argv[])
+{
+    // the parameters with their defaults
+    double qps = argc > 1 ? atof(argv[1]) : 1000.0;
+    size_t concurrency = argc > 2 ? atoi(argv[2]) : 1000;
+    double seconds = argc > 3 ? atof(argv[3]) : 10.0;
+    size_t labelsize = argc > 4 ? atoi(argv[4]) : 4;
+    double allocbudget = argc > 5 ? atof(argv[5]) : 0.0;
+
+    // the event loop
+    struct ev_loop *loop = EV_DEFAULT;
+
+    // wrap the loop to make it accessible by dns-cpp
+    DNS::LibEv myloop(loop);
+
+    // create a dns context
+    DNS::Context context(&myloop);
+
+    // the concurrency parameter bounds the lookups inside the library,
+    // the open-loop schedule keeps issuing regardless so that overload
+    // shows up as latency (that is the point of open-loop testing)
+    context.capacity(concurrency);
+    context.buffersize(4 * 1024 * 1024);
+
+    // the driver issues the queries and collects the latencies
+    Benchmark benchmark(context, loop, qps, seconds, labelsize);
+
+    // run the event loop until the last lookup came back
+    ev_run(loop);
+
+    // show the percentiles
+    benchmark.report();
+
+    // fail the run when the allocation budget was exceeded (this only
+    // triggers in accounting builds, where the counters actually move)
+    if (allocbudget > 0.0 && benchmark.allocrate() > allocbudget) return 2;
+
+    // done
+    return 0;
+}
@@ -0,0 +1,123 @@
+/**
+ *  Histogram.h
+ *
+ *  Log-linear latency histogram (hdr-style) that is shared by the
+ *  benchmark and replay programs: values are bucketed with a
+ *  power-of-two major bucket and sixteen linear sub-buckets, so the
+ *  relative error of a reconstructed percentile is at most ~6% over
+ *  the full range from microseconds to minutes, with a fixed footprint
+ *
+ *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include <stdint.h>
+#include <string.h>
+
+/**
+ *  Class definition
+ */
+class Histogram
+{
+private:
+    /**
+     *  The buckets (values are microseconds, 16 sub-buckets per power
+     *  of two, which fits comfortably in 1024 slots)
+     *  @var uint64_t[]
+     */
+    uint64_t _buckets[1024];
+
+    /**
+     *  Total number of recorded samples
+     *  @var uint64_t
+     */
+    uint64_t _count = 0;
+
+    /**
+     *  The bucket that a value belongs in
+     *  @param  us      the value in microseconds
+     *  @return size_t
+     */
+    static size_t index(uint64_t us)
+    {
+        // small values get their own bucket (exact)
+        if (us < 16) return us;
+
+        // position of the highest set bit
+        int high = 63 - __builtin_clzll(us);
+
+        // major bucket by power of two, minor by the next four bits
+        return (high - 3) * 16 + ((us >> (high - 4)) & 15);
+    }
+
+    /**
+     *  The lower bound of a bucket (used to reconstruct percentiles)
+     *  @param  idx     the bucket
+     *  @return uint64_t
+     */
+    static uint64_t value(size_t idx)
+    {
+        // the exact small buckets
+        if (idx < 16) return idx;
+
+        // invert the index calculation
+        int high = idx / 16 + 3; uint64_t sub = idx % 16;
+
+        // reconstruct the lower bound
+        return (uint64_t(1) << high) + (sub << (high - 4));
+    }
+
+public:
+    /**
+     *  Constructor, all buckets start empty
+     */
+    Histogram() { memset(_buckets, 0, sizeof(_buckets)); }
+
+    /**
+     *  Record one latency sample
+     *  @param  seconds     the measured latency
+     */
+    void add(double seconds)
+    {
+        // convert to microseconds and count it
+        _buckets[index(uint64_t(seconds * 1e6))] += 1; _count += 1;
+    }
+
+    /**
+     *  Number of recorded samples
+     *  @return uint64_t
+     */
+    uint64_t count() const { return _count; }
+
+    /**
+     *  Reconstruct a percentile
+     *  @param  fraction    the percentile as fraction (0.99 for p99)
+     *  @return double      the latency in seconds
+     */
+    double percentile(double fraction) const
+    {
+        // the rank of the sample we are looking for
+        uint64_t rank = uint64_t(_count * fraction), seen = 0;
+
+        // walk the cumulative distribution
+        for (size_t idx = 0; idx < 1024; ++idx)
+        {
+            // samples up to and including this bucket
+            seen += _buckets[idx];
+
+            // is the wanted rank inside?
+            if (seen > rank) return value(idx) / 1e6;
+        }
+
+        // empty histogram
+        return 0.0;
+    }
+};
@@ -0,0 +1,474 @@
+/**
+ *  Replay.cpp
+ *
+ *  Replay harness that drives the library with a recorded query log
+ *  instead of a synthetic workload. Uniform-random benchmarks miss the
+ *  skew and burstiness of real traffic, so features like caching and
+ *  query coalescing are validated by replaying production logs through
+ *  Context::query() at recorded (or scaled) speed, and reporting the
+ *  same percentile metrics as the benchmark program.
+ *
+ *  The log is read line by line, one json object per line, with at
+ *  least the following members (extra members are ignored):
+ *
+ *      {"time": 1621334450.123, "domain": "example.com", "type": "A"}
+ *
+ *  The "time" member holds the original timestamp (seconds, absolute
+ *  or relative, only the differences matter), "type" is a mnemonic
+ *  like "A", "AAAA" or "MX" (or the numeric type).
+ *
+ *  Usage: replay logfile [speed] [concurrency]
+ *
+ *      logfile     the query log to replay
+ *      speed       replay speedup factor          (default 1.0)
+ *      concurrency max lookups inside the library (default 1000)
+ *
+ *  @author Emiel Bruijntjes <emiel.bruijntjes@copernica.com>
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Dependencies
+ */
+#include <dnscpp.h>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <vector>
+#include <unordered_map>
+#include <ev.h>
+#include <dnscpp/libev.h>
+#include <string.h>
+#include "histogram.h"
+
+/**
+ *  One entry of the recorded log
+ */
+struct Entry
+{
+    /**
+     *  Offset of the query relative to the first query in the log
+     *  @var double
+     */
+    double offset;
+
+    /**
+     *  The domain that was queried
+     *  @var std::string
+     */
+    std::string domain;
+
+    /**
+     *  The record type that was queried
+     *  @var ns_type
+     */
+    ns_type type;
+};
+
+/**
+ *  Extract the raw value of a member from a json line, this is a
+ *  deliberately minimal parser: the log is machine-generated with a
+ *  known flat layout, so we do not pull in a json library for it
+ *  @param  line    the json line
+ *  @param  key     the member to look for
+ *  @param  value   output: the raw value (without quotes)
+ *  @return bool    was the member found?
+ */
+static bool extract(const std::string &line, const char *key, std::string &value)
+{
+    // the member name as it appears in the line
+    std::string needle = std::string("\"") + key + "\"";
+
+    // look for the member
+    auto pos = line.find(needle);
+
+    // not in this line
+    if (pos == std::string::npos) return false;
+
+    // skip to the value (past the colon and whitespace)
+    pos = line.find(':', pos + needle.size());
+    if (pos == std::string::npos) return false;
+    for (++pos; pos < line.size() && isspace(line[pos]); ++pos) {}
+    if (pos >= line.size()) return false;
+
+    // quoted string value
+    if (line[pos] == '"')
+    {
+        // find the closing quote (the logged domains never hold escapes)
+        auto end = line.find('"', pos + 1);
+        if (end == std::string::npos) return false;
+
+        // the value between the quotes
+        value = line.substr(pos + 1, end - pos - 1); return true;
+    }
+
+    // bare value (number), runs until a delimiter
+    auto end = line.find_first_of(",}", pos);
+    if (end == std::string::npos) return false;
+
+    // the bare value
+    value = line.substr(pos, end - pos); return true;
+}
+
+/**
+ *  Turn a record-type mnemonic (or number) into the numeric type
+ *  @param  text    the mnemonic from the log
+ *  @return ns_type the numeric type, or 0 when unrecognized
+ */
+static ns_type recordtype(const std::string &text)
+{
+    // numeric types are used as-is
+    if (!text.empty() && isdigit(text[0])) return (ns_type)atoi(text.c_str());
+
+    // the mnemonics that appear in our logs
+    if (strcasecmp(text.c_str(), "a") == 0)     return ns_t_a;
+    if (strcasecmp(text.c_str(), "aaaa") == 0)  return ns_t_aaaa;
+    if (strcasecmp(text.c_str(), "mx") == 0)    return ns_t_mx;
+    if (strcasecmp(text.c_str(), "txt") == 0)   return ns_t_txt;
+    if (strcasecmp(text.c_str(), "cname") == 0) return ns_t_cname;
+    if (strcasecmp(text.c_str(), "ns") == 0)    return ns_t_ns;
+    if (strcasecmp(text.c_str(), "ptr") == 0)   return ns_t_ptr;
+    if (strcasecmp(text.c_str(), "soa") == 0)   return ns_t_soa;
+    if (strcasecmp(text.c_str(), "caa") == 0)   return ns_t_caa;
+    if (strcasecmp(text.c_str(), "tlsa") == 0)  return ns_t_tlsa;
+
+    // unrecognized entries are skipped by the loader
+    return (ns_type)0;
+}
+
+/**
+ *  Load the query log into memory, so that disk io cannot disturb the
+ *  replay timing later on
+ *  @param  path        the log file
+ *  @param  entries     output: the loaded entries
+ *  @return bool        was the file readable?
+ */
+static bool load(const char *path, std::vector<Entry> &entries)
+{
+    // open the log
+    std::ifstream log(path);
+
+    // leap out on failure
+    if (!log) return false;
+
+    // the timestamp of the first entry (offsets are relative to this)
+    double first = 0.0; bool hasfirst = false;
+
+    // process the log line by line
+    std::string line;
+    while (std::getline(log, line))
+    {
+        // the raw member values
+        std::string time, domain, type;
+
+        // lines that miss a member are skipped (blank lines, comments)
+        if (!extract(line, "time", time)) continue;
+        if (!extract(line, "domain", domain)) continue;
+        if (!extract(line, "type", type)) continue;
+
+        // parse the type, unrecognized types are skipped too
+        ns_type parsedtype = recordtype(type);
+        if (parsedtype == 0) continue;
+
+        // the first timestamp anchors the schedule
+        double stamp = atof(time.c_str());
+        if (!hasfirst) { first = stamp; hasfirst = true; }
+
+        // store the entry
+        entries.push_back({ stamp - first, std::move(domain), parsedtype });
+    }
+
+    // the log was readable (possibly empty)
+    return true;
+}
+
+/**
+ *  The replay driver: issues the recorded queries on their recorded
+ *  (scaled) schedule and collects the per-lookup latencies
+ */
+class Replay : public DNS::Handler
+{
+private:
+    /**
+     *  The dns context under test
+     *  @var DNS::Context
+     */
+    DNS::Context &_context;
+
+    /**
+     *  The libev loop (needed to stop it at the end)
+     *  @var struct ev_loop
+     */
+    struct ev_loop *_loop;
+
+    /**
+     *  The recorded entries, in log order
+     *  @var std::vector
+     */
+    const std::vector<Entry> &_entries;
+
+    /**
+     *  Replay speedup factor (2.0 replays twice as fast)
+     *  @var double
+     */
+    double _speed;
+
+    /**
+     *  Start-time of the replay (the first entry is issued right away)
+     *  @var double
+     */
+    double _start;
+
+    /**
+     *  Index of the next entry to issue
+     *  @var size_t
+     */
+    size_t _position = 0;
+
+    /**
+     *  Start-times of the lookups that are in flight
+     *  @var std::unordered_map
+     */
+    std::unordered_map<const DNS::Operation*,double> _inflight;
+
+    /**
+     *  The latency histogram
+     *  @var Histogram
+     */
+    Histogram _histogram;
+
+    /**
+     *  Counters for the final report
+     *  @var uint64_t
+     */
+    uint64_t _issued = 0, _success = 0, _failures = 0, _timeouts = 0;
+
+    /**
+     *  Counters at the time of the previous per-second report
+     *  @var uint64_t
+     */
+    uint64_t _previssued = 0, _prevdone = 0;
+
+    /**
+     *  The pacing timer (fires many times per second) and the timer
+     *  for the per-second progress report
+     *  @var ev_timer
+     */
+    ev_timer _pacer, _reporter;
+
+    /**
+     *  One tick of the schedule: issue every entry whose recorded
+     *  offset has been reached by now (open-loop, just like the
+     *  benchmark, so that queueing inside the library shows up as
+     *  latency instead of shifting the schedule)
+     *  @param  now     current time
+     */
+    void tick(double now)
+    {
+        // how far into the recorded timeline we are
+        double elapsed = (now - _start) * _speed;
+
+        // issue all entries that are due
+        while (_position < _entries.size() && _entries[_position].offset <= elapsed)
+        {
+            // the next entry
+            const auto &entry = _entries[_position++];
+
+            // issue the lookup
+            auto *operation = _context.query(entry.domain.c_str(), entry.type, this);
+
+            // administration for the latency measurement
+            if (operation) { _inflight[operation] = ev_time(); _issued += 1; }
+        }
+
+        // the schedule is over when the last entry has been issued
+        if (_position >= _entries.size()) ev_timer_stop(_loop, &_pacer);
+    }
+
+    /**
+     *  One lookup came back (with whatever outcome)
+     *  @param  operation   the operation that finished
+     */
+    void finish(const DNS::Operation *operation)
+    {
+        // find the start-time back
+        auto iter = _inflight.find(operation);
+
+        // unknown operations should not happen, but better be safe
+        if (iter == _inflight.end()) return;
+
+        // record the latency
+        _histogram.add(ev_time() - iter->second);
+
+        // administration
+        _inflight.erase(iter);
+
+        // when the schedule is done and the last lookup came back the
+        // replay is over
+        if (_position >= _entries.size() && _inflight.empty()) ev_break(_loop, EVBREAK_ONE);
+    }
+
+    /**
+     *  Per-second progress report
+     */
+    void progress()
+    {
+        // lookups that completed so far
+        uint64_t done = _success + _failures + _timeouts;
+
+        // show the throughput of the past second
+        std::cout << "issued " << (_issued - _previssued) << "/s  completed " << (done - _prevdone) << "/s  inflight " << _inflight.size() << "  position " << _position << "/" << _entries.size() << std::endl;
+
+        // remember for the next phase
+        _previssued = _issued; _prevdone = done;
+    }
+
+    /**
+     *  Handler method for successful lookups
+     *  @param  operation   the operation that finished
+     *  @param  response    the received response
+     */
+    virtual void onResolved(const DNS::Operation *operation, const DNS::Response &response) override
+    {
+        // count and finish
+        _success += 1; finish(operation);
+    }
+
+    /**
+     *  Handler method for failed lookups
+     *  @param  operation   the operation that finished
+     *  @param  rcode       the received rcode
+     */
+    virtual void onFailure(const DNS::Operation *operation, int rcode) override
+    {
+        // count and finish
+        _failures += 1; finish(operation);
+    }
+
+    /**
+     *  Handler method for lookups that timed out
+     *  @param  operation   the operation that timed out
+     */
+    virtual void onTimeout(const DNS::Operation *operation) override
+    {
+        // count and finish
+        _timeouts += 1; finish(operation);
+    }
+
+    /**
+     *  Trampolines from the libev c callbacks to the member functions
+     *  @param  loop        the reporting loop
+     *  @param  timer       the timer that fired
+     *  @param  revents     the events
+     */
+    static void onPace(struct ev_loop *loop, ev_timer *timer, int revents)
+    {
+        // pass on to the member function
+        ((Replay *)timer->data)->tick(ev_time());
+    }
+    static void onReport(struct ev_loop *loop, ev_timer *timer, int revents)
+    {
+        // pass on to the member function
+        ((Replay *)timer->data)->progress();
+    }
+
+public:
+    /**
+     *  Constructor
+     *  @param  context     the dns context under test
+     *  @param  loop        the libev loop
+     *  @param  entries     the recorded entries
+     *  @param  speed       replay speedup factor
+     */
+    Replay(DNS::Context &context, struct ev_loop *loop, const std::vector<Entry> &entries, double speed) :
+        _context(context), _loop(loop), _entries(entries), _speed(speed), _start(ev_time())
+    {
+        // the pacing timer fires often, so that the recorded arrival
+        // times are honored with millisecond-level accuracy
+        ev_timer_init(&_pacer, onPace, 0.0, 0.002); _pacer.data = this;
+        ev_timer_start(_loop, &_pacer);
+
+        // the progress report fires once per second
+        ev_timer_init(&_reporter, onReport, 1.0, 1.0); _reporter.data = this;
+        ev_timer_start(_loop, &_reporter);
+    }
+
+    /**
+     *  Destructor
+     */
+    virtual ~Replay()
+    {
+        // stop the timers
+        ev_timer_stop(_loop, &_pacer);
+        ev_timer_stop(_loop, &_reporter);
+    }
+
+    /**
+     *  The final report with the percentiles
+     */
+    void report() const
+    {
+        // the totals
+        std::cout << std::endl << "issued " << _issued << "  success " << _success << "  failures " << _failures << "  timeouts " << _timeouts << std::endl;
+
+        // without samples there are no percentiles
+        if (_histogram.count() == 0) return;
+
+        // the percentiles of the latency distribution
+        std::cout << std::fixed << std::setprecision(3)
+            << "latency p50 "  << _histogram.percentile(0.50)  * 1000 << "ms"
+            << "  p95 "        << _histogram.percentile(0.95)  * 1000 << "ms"
+            << "  p99 "        << _histogram.percentile(0.99)  * 1000 << "ms"
+            << "  p999 "       << _histogram.percentile(0.999) * 1000 << "ms" << std::endl;
+    }
+};
+
+/**
+ *  Main procedure
+ *  @param  argc    number of arguments
+ *  @param  argv    the arguments
+ *  @return int
+ */
+int main(int argc, char *argv[])
+{
+    // a logfile is required
+    if (argc < 2) { std::cerr << "usage: " << argv[0] << " logfile [speed] [concurrency]" << std::endl; return 1; }
+
+    // the parameters with their defaults
+    double speed = argc > 2 ? atof(argv[2]) : 1.0;
+    size_t concurrency = argc > 3 ? atoi(argv[3]) : 1000;
+
+    // load the whole log up front, so that disk io does not disturb
+    // the replay timing
+    std::vector<Entry> entries;
+    if (!load(argv[1], entries)) { std::cerr << "cannot read " << argv[1] << std::endl; return 1; }
+
+    // an empty log means nothing to do
+    if (entries.empty()) { std::cerr << "no entries in " << argv[1] << std::endl; return 1; }
+
+    // the event loop
+    struct ev_loop *loop = EV_DEFAULT;
+
+    // wrap the loop to make it accessible by dns-cpp
+    DNS::LibEv myloop(loop);
+
+    // create a dns context
+    DNS::Context context(&myloop);
+
+    // the concurrency parameter bounds the lookups inside the library,
+    // the recorded schedule keeps issuing regardless (open-loop)
+    context.capacity(concurrency);
+    context.buffersize(4 * 1024 * 1024);
+
+    // the driver issues the queries and collects the latencies
+    Replay replay(context, loop, entries, speed);
+
+    // run the event loop until the last lookup came back
+    ev_run(loop);
+
+    // show the percentiles
+    replay.report();
+
+    // done
+    return 0;
+}